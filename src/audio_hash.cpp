@@ -0,0 +1,433 @@
+/******************************************************************************
+audio_hash.cpp - Hashes the audio data of MP3 and OGG files, ignoring their tags
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "audio_hash.h"
+#include "metadata.h"
+#include "prefetch.h"
+#include "util.h"
+#include <string.h>
+
+// XXH64 ==========================================================================================
+// Reference:  https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+
+#define XXH_PRIME64_1	0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3	0x165667B19E3779F9ULL
+#define XXH_PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5	0x27D4EB2F165667C5ULL
+
+
+static inline unsigned long long RotateLeft64(unsigned long long value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+
+// Input is little endian
+static inline unsigned long long Read64(const unsigned char* ptr)
+{
+	unsigned long long value;
+	memcpy(&value, ptr, 8);
+	return value;
+}
+
+
+static inline unsigned int Read32(const unsigned char* ptr)
+{
+	unsigned int value;
+	memcpy(&value, ptr, 4);
+	return value;
+}
+
+
+static inline unsigned long long XXH64Round(unsigned long long acc, unsigned long long input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = RotateLeft64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+
+static inline unsigned long long XXH64MergeRound(unsigned long long hash, unsigned long long acc)
+{
+	hash ^= XXH64Round(0, acc);
+	return hash * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+
+void XXH64Reset(XXH64State* state, unsigned long long seed)
+{
+	state->acc[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+	state->acc[1] = seed + XXH_PRIME64_2;
+	state->acc[2] = seed;
+	state->acc[3] = seed - XXH_PRIME64_1;
+	state->total_len = 0;
+	state->buffer_len = 0;
+	state->seed = seed;
+}
+
+
+void XXH64Update(XXH64State* state, const void* data, size_t len)
+{
+	const unsigned char* pos = (const unsigned char*)data;
+	const unsigned char* end = pos + len;
+	state->total_len += len;
+
+	// Finish the stripe left over from the last call
+	if (state->buffer_len > 0)
+	{
+		const size_t fill_len = (32 - state->buffer_len < len) ? 32 - state->buffer_len : len;
+		memcpy(state->buffer + state->buffer_len, pos, fill_len);
+		state->buffer_len += (unsigned int)fill_len;
+		pos += fill_len;
+		if (state->buffer_len < 32)
+			return;
+		for (int lane = 0; lane < 4; lane++)
+			state->acc[lane] = XXH64Round(state->acc[lane], Read64(state->buffer + lane * 8));
+		state->buffer_len = 0;
+	}
+
+	// Whole stripes, straight from the input
+	unsigned long long acc0 = state->acc[0];
+	unsigned long long acc1 = state->acc[1];
+	unsigned long long acc2 = state->acc[2];
+	unsigned long long acc3 = state->acc[3];
+	while (end - pos >= 32)
+	{
+		acc0 = XXH64Round(acc0, Read64(pos));
+		acc1 = XXH64Round(acc1, Read64(pos + 8));
+		acc2 = XXH64Round(acc2, Read64(pos + 16));
+		acc3 = XXH64Round(acc3, Read64(pos + 24));
+		pos += 32;
+	}
+	state->acc[0] = acc0;
+	state->acc[1] = acc1;
+	state->acc[2] = acc2;
+	state->acc[3] = acc3;
+
+	memcpy(state->buffer, pos, end - pos);
+	state->buffer_len = (unsigned int)(end - pos);
+}
+
+
+unsigned long long XXH64Digest(const XXH64State* state)
+{
+	unsigned long long hash;
+	if (state->total_len >= 32)
+	{
+		hash = RotateLeft64(state->acc[0], 1) + RotateLeft64(state->acc[1], 7) + 
+			RotateLeft64(state->acc[2], 12) + RotateLeft64(state->acc[3], 18);
+		for (int lane = 0; lane < 4; lane++)
+			hash = XXH64MergeRound(hash, state->acc[lane]);
+	}
+	else
+	{
+		hash = state->seed + XXH_PRIME64_5;
+	}
+	hash += state->total_len;
+
+	const unsigned char* pos = state->buffer;
+	const unsigned char* end = pos + state->buffer_len;
+	for (; end - pos >= 8; pos += 8)
+	{
+		hash ^= XXH64Round(0, Read64(pos));
+		hash = RotateLeft64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if (end - pos >= 4)
+	{
+		hash ^= (unsigned long long)Read32(pos) * XXH_PRIME64_1;
+		hash = RotateLeft64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		pos += 4;
+	}
+	for (; pos < end; pos++)
+	{
+		hash ^= *pos * XXH_PRIME64_5;
+		hash = RotateLeft64(hash, 11) * XXH_PRIME64_1;
+	}
+
+	// Avalanche
+	hash ^= hash >> 33;
+	hash *= XXH_PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= XXH_PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+// ================================================================================================
+
+
+// Reads exactly len bytes at offset.  Returns false if the file is shorter.
+static bool ReadAt(HANDLE file, ULONGLONG offset, unsigned char* buffer, DWORD len)
+{
+	LARGE_INTEGER pos;
+	pos.QuadPart = (LONGLONG)offset;
+	DWORD bytes_read = 0;
+	return SetFilePointerEx(file, pos, NULL, FILE_BEGIN) && ReadFile(file, buffer, len, &bytes_read, NULL) && 
+		bytes_read == len;
+}
+
+
+// Finds the MP3 frames between the ID3v2 tag(s) at the start and the APE/ID3v1 tags at the end
+static void GetMP3AudioRange(HANDLE file, ULONGLONG file_size, ULONGLONG* start, ULONGLONG* end)
+{
+	*start = 0;
+	*end = file_size;
+
+	// Some files have more than one ID3v2 tag in a row
+	unsigned char header[ID3V2_HEADER_LEN];
+	while (*start + ID3V2_HEADER_LEN <= file_size && ReadAt(file, *start, header, ID3V2_HEADER_LEN) && 
+		!memcmp(header, "ID3", 3))
+	{
+		const ID3v2Header id3v2_header = ID3v2_ParseHeader(header);
+		*start += ID3V2_HEADER_LEN + id3v2_header.tag_size;
+		if (id3v2_header.flags & 0x10)
+			*start += ID3V2_HEADER_LEN;		// Footer present
+	}
+
+	// ID3v1 is always the last 128 bytes
+	// Reference:  https://en.wikipedia.org/wiki/ID3#ID3v1
+	unsigned char trailer[128];
+	if (*end >= *start + 128 && ReadAt(file, *end - 128, trailer, 128) && !memcmp(trailer, "TAG", 3))
+		*end -= 128;
+
+	// APEv2 footer.  The tag size includes the footer but not the header.
+	// Reference:  https://wiki.hydrogenaud.io/index.php?title=APE_Tags_Header
+	if (*end >= *start + 32 && ReadAt(file, *end - 32, trailer, 32) && !memcmp(trailer, "APETAGEX", 8))
+	{
+		ULONGLONG tag_size = Read32(trailer + 12);
+		const unsigned int flags = Read32(trailer + 20);
+		if (flags & 0x80000000)
+			tag_size += 32;			// Header present
+		*end = (tag_size <= *end - *start) ? *end - tag_size : *start;
+	}
+	if (*start > *end)
+		*start = *end;
+}
+
+
+static bool HashMP3AudioData(HANDLE file, unsigned char* read_buffer, XXH64State* hash_state)
+{
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size))
+		return false;
+	ULONGLONG start, end;
+	GetMP3AudioRange(file, (ULONGLONG)file_size.QuadPart, &start, &end);
+
+	LARGE_INTEGER pos;
+	pos.QuadPart = (LONGLONG)start;
+	if (!SetFilePointerEx(file, pos, NULL, FILE_BEGIN))
+		return false;
+	ULONGLONG bytes_left = end - start;
+	while (bytes_left > 0)
+	{
+		const DWORD read_len = (bytes_left < AUDIO_HASH_READ_SIZE) ? (DWORD)bytes_left : AUDIO_HASH_READ_SIZE;
+		DWORD bytes_read = 0;
+		if (!ReadFile(file, read_buffer, read_len, &bytes_read, NULL) || bytes_read == 0)
+			return false;
+		XXH64Update(hash_state, read_buffer, bytes_read);
+		bytes_left -= bytes_read;
+	}
+	return true;
+}
+
+
+// Walks the Ogg pages and hashes the packet data of every page that isn't a header page
+// Reference:  https://xiph.org/ogg/doc/framing.html
+static bool HashOggAudioData(HANDLE file, unsigned char* read_buffer, XXH64State* hash_state)
+{
+	const size_t page_header_len = 27;
+	size_t data_len = 0;		// Bytes in read_buffer
+	size_t pos = 0;				// Start of the current page in read_buffer
+	bool is_eof = false;
+	while (true)
+	{
+		// Make sure the whole page is in the buffer.  The page length is only known after reading
+		// the header and then the segment table, so this may take up to three tries.
+		size_t page_len = page_header_len;
+		size_t needed_len = page_header_len;
+		while (true)
+		{
+			if (data_len - pos < needed_len && !is_eof)
+			{
+				memmove(read_buffer, read_buffer + pos, data_len - pos);
+				data_len -= pos;
+				pos = 0;
+				while (data_len < AUDIO_HASH_READ_SIZE && !is_eof)
+				{
+					DWORD bytes_read = 0;
+					if (!ReadFile(file, read_buffer + data_len, (DWORD)(AUDIO_HASH_READ_SIZE - data_len), &bytes_read, NULL))
+						return false;
+					is_eof = (bytes_read == 0);
+					data_len += bytes_read;
+				}
+			}
+			if (data_len - pos < needed_len)
+				return true;		// End of file.  A truncated last page is ignored.
+
+			const unsigned char* page = read_buffer + pos;
+			if (memcmp(page, "OggS", 4) != 0)
+			{
+				// Lost sync, e.g. garbage between pages.  Skip ahead to the next capture pattern.
+				pos++;
+				needed_len = page_header_len;
+				continue;
+			}
+			const size_t num_segments = page[26];
+			page_len = page_header_len + num_segments;
+			if (needed_len < page_len)
+			{
+				needed_len = page_len;
+				continue;
+			}
+			for (size_t i = 0; i < num_segments; i++)
+				page_len += page[page_header_len + i];
+			if (needed_len < page_len)
+			{
+				needed_len = page_len;
+				continue;
+			}
+			break;
+		}
+
+		// Header pages have a granule position of 0
+		const unsigned char* page = read_buffer + pos;
+		const size_t body_offset = page_header_len + page[26];
+		if (Read64(page + 6) != 0)
+			XXH64Update(hash_state, page + body_offset, page_len - body_offset);
+		pos += page_len;
+	}
+}
+
+
+// Hashes the audio data of the file.  read_buffer must be AUDIO_HASH_READ_SIZE bytes.
+bool HashAudioData(const char* path, FileFormat format, unsigned char* read_buffer, unsigned long long* hash)
+{
+	// FILE_FLAG_SEQUENTIAL_SCAN tells the cache manager to read ahead aggressively
+	HANDLE file = CreateFileUtf8(path, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	XXH64State hash_state;
+	XXH64Reset(&hash_state, 0);
+	bool result = false;
+	if (format == MP3)
+		result = HashMP3AudioData(file, read_buffer, &hash_state);
+	else if (format == OGG)
+		result = HashOggAudioData(file, read_buffer, &hash_state);
+	CloseHandle(file);
+
+	if (result)
+		*hash = XXH64Digest(&hash_state);
+	return result;
+}
+
+
+static DWORD WINAPI AudioHashThreadProc(LPVOID param)
+{
+	AudioHashJob* job = (AudioHashJob*)param;
+	unsigned char* read_buffer = (unsigned char*)VirtualAlloc(NULL, AUDIO_HASH_READ_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (read_buffer)
+		CountMemory(ALLOC_AUDIO, AUDIO_HASH_READ_SIZE);
+	unsigned int* order = (unsigned int*)AllocMemory(ALLOC_AUDIO, job->num_songs * sizeof(unsigned int));
+	if (read_buffer && order)
+	{
+		// Visit the files in disk order so the reads are as sequential as possible
+		SortPathsByLocality((const char**)job->paths, job->num_songs, order);
+		for (unsigned int i = 0; i < job->num_songs && !job->is_cancelled; i++)
+		{
+			const unsigned int song_idx = order[i];
+			job->is_hashed[song_idx] = HashAudioData(job->paths[song_idx], job->formats[song_idx], 
+				read_buffer, &job->hashes[song_idx]);
+		}
+	}
+	if (read_buffer)
+	{
+		VirtualFree(read_buffer, 0, MEM_RELEASE);
+		CountMemory(ALLOC_AUDIO, -AUDIO_HASH_READ_SIZE);
+	}
+	FreeMemory(order);
+
+	PostMessage(job->notify_hwnd, job->notify_msg, 0, (LPARAM)job);
+	return 0;
+}
+
+
+// Starts hashing the songs in the background
+AudioHashJob* AudioHashJobStart(Song** songs, unsigned int num_songs, HWND notify_hwnd, UINT notify_msg)
+{
+	AudioHashJob* job = (AudioHashJob*)AllocMemory(ALLOC_AUDIO, sizeof(AudioHashJob));
+	job->notify_hwnd = notify_hwnd;
+	job->notify_msg = notify_msg;
+	job->num_songs = num_songs;
+	job->paths = (char**)AllocMemory(ALLOC_AUDIO, num_songs * sizeof(char*) + 1);
+	job->formats = (FileFormat*)AllocMemory(ALLOC_AUDIO, num_songs * sizeof(FileFormat) + 1);
+	job->hashes = (unsigned long long*)AllocMemory(ALLOC_AUDIO, num_songs * sizeof(unsigned long long) + 1);
+	job->is_hashed = (bool*)AllocMemory(ALLOC_AUDIO, num_songs * sizeof(bool) + 1);
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		// Songs only keep their directory id and file name, and the thread mustn't touch the path
+		// table, so the full paths are put together here
+		char path[UTF8_MAX_PATH];
+		if (!SongGetPath(songs[i], path, UTF8_MAX_PATH))
+			path[0] = '\0';
+		job->paths[i] = DuplicateString(ALLOC_AUDIO, path);
+		job->formats[i] = songs[i]->format;
+	}
+
+	job->thread = CreateThread(NULL, 0, AudioHashThreadProc, job, 0, NULL);
+	if (job->thread == NULL)
+	{
+		AudioHashJobFree(job);
+		return NULL;
+	}
+	return job;
+}
+
+
+// Cancels the job if it is still running, waits for the thread to exit, and frees the job
+void AudioHashJobFree(AudioHashJob* job)
+{
+	if (!job)
+		return;
+
+	if (job->thread)
+	{
+		InterlockedExchange(&job->is_cancelled, 1);
+		WaitForSingleObject(job->thread, INFINITE);
+		CloseHandle(job->thread);
+	}
+	for (unsigned int i = 0; i < job->num_songs; i++)
+		FreeMemory(job->paths[i]);
+	FreeMemory(job->paths);
+	FreeMemory(job->formats);
+	FreeMemory(job->hashes);
+	FreeMemory(job->is_hashed);
+	FreeMemory(job);
+}
\ No newline at end of file
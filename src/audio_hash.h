@@ -0,0 +1,72 @@
+/******************************************************************************
+audio_hash.h - Hashes the audio data of MP3 and OGG files, ignoring their tags
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+#include <Windows.h>
+#include "song.h"
+
+// Two files with the same recording but different tags have the same audio hash.  The hash
+// skips everything that can change when a file is retagged:
+//		MP3:  ID3v2 tags at the start, and ID3v1 and APE tags at the end
+//		OGG:  the header pages (identification, comments, and setup), which all have a granule 
+//			  position of 0.  Only the packet data of the audio pages is hashed, because the page
+//			  headers hold sequence numbers and checksums that change when the comments grow.
+// The hash is XXH64, which is much faster than the disk, so hashing runs at the speed of the reads.
+
+#define AUDIO_HASH_READ_SIZE	(1024 * 1024)		// Large sequential reads.  Must hold a whole Ogg page.
+
+struct XXH64State {
+	unsigned long long acc[4];
+	unsigned long long total_len;
+	unsigned char buffer[32];		// Input that doesn't fill a 32-byte stripe yet
+	unsigned int buffer_len;
+	unsigned long long seed;
+};
+
+// Hashes the songs on a background thread.  When it finishes (or is cancelled), it posts 
+// notify_msg to notify_hwnd with the job as the lParam.
+struct AudioHashJob {
+	HANDLE thread;
+	volatile LONG is_cancelled;
+	HWND notify_hwnd;
+	UINT notify_msg;
+	unsigned int num_songs;
+	char** paths;						// Copies, so the songs can be deleted while the job runs
+	FileFormat* formats;
+	unsigned long long* hashes;
+	bool* is_hashed;					// False if the file couldn't be read
+};
+
+void XXH64Reset(XXH64State* state, unsigned long long seed);
+void XXH64Update(XXH64State* state, const void* data, size_t len);
+unsigned long long XXH64Digest(const XXH64State* state);
+bool HashAudioData(const char* path, FileFormat format, unsigned char* read_buffer, unsigned long long* hash);
+AudioHashJob* AudioHashJobStart(Song** songs, unsigned int num_songs, HWND notify_hwnd, UINT notify_msg);
+void AudioHashJobFree(AudioHashJob* job);
\ No newline at end of file
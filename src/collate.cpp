@@ -0,0 +1,214 @@
+/******************************************************************************
+collate.cpp - Byte-comparable sort keys for multi-key playlist sorting
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "collate.h"
+#include <string.h>
+#include <algorithm>
+
+
+// Usage:
+//		CollationKeysBegin(&keys, count);
+//		for each item:
+//			CollationKeysNext(&keys);
+//			AppendCollationText(&keys, ...);
+//			AppendCollationNumber(&keys, ...);
+//		CollationKeysEnd(&keys);
+void CollationKeysBegin(CollationKeys* keys, size_t num_keys)
+{
+	keys->buffer.clear();
+	keys->buffer.reserve(num_keys * 64);
+	keys->offsets.clear();
+	keys->offsets.reserve(num_keys + 1);
+}
+
+
+// Starts the key for the next item
+void CollationKeysNext(CollationKeys* keys)
+{
+	keys->offsets.push_back(keys->buffer.size());
+}
+
+
+void CollationKeysEnd(CollationKeys* keys)
+{
+	keys->offsets.push_back(keys->buffer.size());
+}
+
+
+void AppendCollationText(CollationKeys* keys, const char* str)
+{
+	// Make room for the longest field str can make, then write through a pointer, so there's no 
+	// capacity check for every byte.  A run of digits takes 2 bytes more than its length, and runs 
+	// are at least a byte apart.
+	std::string& key = keys->buffer;
+	const size_t str_len = str ? strlen(str) : 0;
+	const size_t key_start = key.size();
+	key.resize(key_start + str_len * 2 + 2);
+	unsigned char* out = (unsigned char*)&key[key_start];
+	const unsigned char* pos = (const unsigned char*)str;
+	while (pos && *pos)
+	{
+		if (*pos >= '0' && *pos <= '9')
+		{
+			// Skip leading zeros (but keep the last digit of "000"), then store the length of the
+			// digit run before the digits.  A longer run is a bigger number.
+			while (*pos == '0' && pos[1] >= '0' && pos[1] <= '9')
+				pos++;
+			const unsigned char* run_start = pos;
+			while (*pos >= '0' && *pos <= '9')
+				pos++;
+			size_t run_len = pos - run_start;
+			if (run_len > 255)
+				run_len = 255;
+			*out++ = COLLATE_NUMBER_MARKER;
+			*out++ = (unsigned char)run_len;
+			memcpy(out, run_start, run_len);
+			out += run_len;
+		}
+		else if (*pos < ' ')
+		{
+			// Control characters would clash with the field terminator and the number marker
+			pos++;
+		}
+		else
+		{
+			unsigned char c = *pos;
+			if (c >= 'A' && c <= 'Z')
+				c += 'a' - 'A';
+			*out++ = c;
+			pos++;
+		}
+	}
+	*out++ = '\0';		// End of field
+	key.resize(out - (unsigned char*)&key[0]);
+}
+
+
+void AppendCollationNumber(CollationKeys* keys, unsigned int value)
+{
+	keys->buffer.push_back((char)(value >> 24));
+	keys->buffer.push_back((char)(value >> 16));
+	keys->buffer.push_back((char)(value >> 8));
+	keys->buffer.push_back((char)value);
+}
+
+
+static bool KeysEqual(const CollationKeys* keys, unsigned int a, unsigned int b)
+{
+	const size_t a_len = keys->offsets[a + 1] - keys->offsets[a];
+	const size_t b_len = keys->offsets[b + 1] - keys->offsets[b];
+	return a_len == b_len && !memcmp(keys->buffer.data() + keys->offsets[a], keys->buffer.data() + keys->offsets[b], a_len);
+}
+
+
+struct CollationSortEntry {
+	unsigned long long chunk;		// 8 bytes of the key starting at the current depth, big endian
+	unsigned int len;				// Key length, capped to one past the end of the current chunk
+	unsigned int idx;
+};
+
+
+static bool CompareSortEntries(const CollationSortEntry& a, const CollationSortEntry& b)
+{
+	if (a.chunk != b.chunk)
+		return a.chunk < b.chunk;
+	return a.len < b.len;
+}
+
+
+// Sorts entries[begin, end) by the 8 key bytes starting at depth, then sorts each run of entries
+// that tie on those bytes by the next 8 bytes, and so on.  This way each comparison is a single
+// integer compare on data that sits next to the index, instead of a memcmp() into the key buffer.
+static void SortCollationRange(const CollationKeys* keys, std::vector<CollationSortEntry>& entries, 
+	size_t begin, size_t end, size_t depth)
+{
+	const char* buffer = keys->buffer.data();
+	const size_t* offsets = keys->offsets.data();
+	for (size_t i = begin; i < end; i++)
+	{
+		const unsigned int idx = entries[i].idx;
+		const size_t key_len = offsets[idx + 1] - offsets[idx];
+		unsigned long long chunk = 0;
+		for (size_t b = depth; b < depth + 8; b++)
+		{
+			const unsigned char c = (b < key_len) ? (unsigned char)buffer[offsets[idx] + b] : 0;
+			chunk = (chunk << 8) | c;
+		}
+		entries[i].chunk = chunk;
+		// Keys that end inside this chunk sort by length (a shorter key is a prefix of a longer 
+		// one once the chunks match).  Keys that continue past it all get the same value.
+		entries[i].len = (unsigned int)((key_len < depth + 9) ? key_len : depth + 9);
+	}
+	std::stable_sort(entries.begin() + begin, entries.begin() + end, CompareSortEntries);
+
+	// Break ties between keys that continue past this chunk
+	size_t run_start = begin;
+	for (size_t i = begin + 1; i <= end; i++)
+	{
+		if (i == end || CompareSortEntries(entries[run_start], entries[i]))
+		{
+			if (i - run_start > 1 && entries[run_start].len == depth + 9)
+				SortCollationRange(keys, entries, run_start, i, depth + 8);
+			run_start = i;
+		}
+	}
+}
+
+
+// Stable sort of order[] (indices of the keys) by key
+void SortByCollationKeys(const CollationKeys* keys, bool descending, std::vector<unsigned int>& order)
+{
+	const size_t count = order.size();
+	std::vector<CollationSortEntry> entries(count);
+	for (size_t i = 0; i < count; i++)
+		entries[i].idx = order[i];
+	if (count > 1)
+		SortCollationRange(keys, entries, 0, count, 0);
+
+	if (!descending)
+	{
+		for (size_t i = 0; i < count; i++)
+			order[i] = entries[i].idx;
+		return;
+	}
+
+	// Reverse the runs of equal keys, then the whole array, so equal keys keep their original order
+	size_t write_pos = 0;
+	size_t run_end = count;
+	while (run_end > 0)
+	{
+		size_t run_start = run_end - 1;
+		while (run_start > 0 && KeysEqual(keys, entries[run_start - 1].idx, entries[run_end - 1].idx))
+			run_start--;
+		for (size_t i = run_start; i < run_end; i++)
+			order[write_pos++] = entries[i].idx;
+		run_end = run_start;
+	}
+}
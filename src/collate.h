@@ -0,0 +1,57 @@
+/******************************************************************************
+collate.h - Header file for collate.cpp
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Collation keys are byte strings built so that comparing two keys with memcmp() gives the 
+// same order as comparing the original values field by field:
+//		- Text is case folded, and each run of digits is compared by its numeric value, so 
+//		  "track 2" sorts before "track 10".
+//		- Text fields end with a 0 byte, which is lower than any byte inside a field, so a 
+//		  shorter string sorts before a longer string with the same beginning.
+//		- Numbers are stored as 4 bytes, most significant byte first.
+// Build one key per item by appending its fields in order of importance.
+
+#define COLLATE_NUMBER_MARKER	0x01		// Starts a run of digits inside a text field
+
+struct CollationKeys {
+	std::string buffer;					// Every key, back to back
+	std::vector<size_t> offsets;		// Key i is buffer[offsets[i]] to buffer[offsets[i + 1]]
+};
+
+void CollationKeysBegin(CollationKeys* keys, size_t num_keys);
+void CollationKeysNext(CollationKeys* keys);
+void CollationKeysEnd(CollationKeys* keys);
+void AppendCollationText(CollationKeys* keys, const char* str);
+void AppendCollationNumber(CollationKeys* keys, unsigned int value);
+void SortByCollationKeys(const CollationKeys* keys, bool descending, std::vector<unsigned int>& order);
\ No newline at end of file
@@ -0,0 +1,449 @@
+/******************************************************************************
+fuzzy.cpp - Incremental fuzzy matching for the playlist search box
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "fuzzy.h"
+#include <string.h>
+#include <algorithm>
+
+// Scoring.  Matches at the start of a word and runs of consecutive matches score higher, 
+// and every unmatched character inside the match costs a little.  Matches that are entirely
+// inside the first field (the song name) get a bonus over matches in the album or path.
+#define SCORE_MATCH					16
+#define SCORE_WORD_START_BONUS		12
+#define SCORE_CONSECUTIVE_BONUS		8
+#define SCORE_FIRST_FIELD_BONUS		64
+#define SCORE_GAP_PENALTY			1
+
+#define FIRST_FIELD_OPEN			0xFFFFFFFF		// No field has been appended to the entry yet
+
+
+static inline char FoldChar(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+
+// Letters and digits get a bit each.  Everything else shares the remaining bits.
+static inline unsigned long long CharMask(unsigned char c)
+{
+	if (c >= 'a' && c <= 'z')
+		return 1ULL << (c - 'a');
+	if (c >= '0' && c <= '9')
+		return 1ULL << (26 + c - '0');
+	return 1ULL << (36 + c % 28);
+}
+
+
+static inline bool IsWordChar(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (unsigned char)c >= 0x80;
+}
+
+
+FuzzyMatcher* FuzzyMatcherCreate(void)
+{
+	FuzzyMatcher* matcher = new FuzzyMatcher();
+	FuzzyMatcherBegin(matcher, 0);
+	return matcher;
+}
+
+
+void FuzzyMatcherFree(FuzzyMatcher* matcher)
+{
+	delete matcher;
+}
+
+
+// Forgets every entry.  Usage:
+//		FuzzyMatcherBegin(matcher, count);
+//		for each entry:
+//			FuzzyMatcherNext(matcher);
+//			FuzzyMatcherAppendField(matcher, ...);
+// More entries can be appended the same way at any time after that.
+void FuzzyMatcherBegin(FuzzyMatcher* matcher, size_t num_entries)
+{
+	matcher->text.clear();
+	matcher->text.reserve(num_entries * 96);
+	matcher->offsets.clear();
+	matcher->offsets.reserve(num_entries + 1);
+	matcher->offsets.push_back(0);
+	matcher->masks.clear();
+	matcher->masks.reserve(num_entries);
+	matcher->first_field_lens.clear();
+	matcher->first_field_lens.reserve(num_entries);
+	matcher->order.clear();
+	matcher->order.reserve(num_entries);
+	matcher->positions.clear();
+	matcher->positions.reserve(num_entries);
+	matcher->is_positions_valid = true;
+	matcher->num_removed_chars = 0;
+	matcher->query.clear();
+	matcher->has_query = false;
+	matcher->is_reordered = false;
+	matcher->is_changed = false;
+	matcher->num_checked_slots = 0;
+	matcher->candidates.clear();
+	matcher->match_ends.clear();
+	matcher->scores.clear();
+	matcher->results.clear();
+}
+
+
+// Starts a new entry after the last one
+void FuzzyMatcherNext(FuzzyMatcher* matcher)
+{
+	const unsigned int slot = (unsigned int)matcher->masks.size();
+	matcher->offsets.push_back((unsigned int)matcher->text.size());
+	matcher->masks.push_back(0);
+	matcher->first_field_lens.push_back(FIRST_FIELD_OPEN);
+	matcher->positions.push_back((unsigned int)matcher->order.size());
+	matcher->order.push_back(slot);
+	matcher->is_changed = true;
+}
+
+
+void FuzzyMatcherAppendField(FuzzyMatcher* matcher, const char* str)
+{
+	std::vector<char>& text = matcher->text;
+	unsigned long long mask = matcher->masks.back();
+	const bool is_first_field = (matcher->first_field_lens.back() == FIRST_FIELD_OPEN);
+	const size_t entry_start = matcher->offsets[matcher->offsets.size() - 2];
+	if (!is_first_field)
+		text.push_back(FUZZY_FIELD_SEPARATOR);
+	for (const char* pos = str; pos && *pos; pos++)
+	{
+		const char c = FoldChar(*pos);
+		if (c == FUZZY_FIELD_SEPARATOR)
+			continue;
+		text.push_back(c);
+		mask |= CharMask((unsigned char)c);
+	}
+	matcher->masks.back() = mask;
+	matcher->offsets.back() = (unsigned int)text.size();
+	if (is_first_field)
+		matcher->first_field_lens.back() = (unsigned int)(text.size() - entry_start);
+}
+
+
+// Copies the text of the entries that are left into a new buffer, in position order, so slot
+// and position are the same again.  The candidates refer to the old slots, so they are dropped.
+static void CompactText(FuzzyMatcher* matcher)
+{
+	const size_t num_entries = matcher->order.size();
+	std::vector<char> text;
+	text.reserve(matcher->text.size() - matcher->num_removed_chars);
+	std::vector<unsigned int> offsets;
+	offsets.reserve(num_entries + 1);
+	std::vector<unsigned long long> masks(num_entries);
+	std::vector<unsigned int> first_field_lens(num_entries);
+	for (size_t i = 0; i < num_entries; i++)
+	{
+		const unsigned int slot = matcher->order[i];
+		offsets.push_back((unsigned int)text.size());
+		text.insert(text.end(), matcher->text.begin() + matcher->offsets[slot], 
+			matcher->text.begin() + matcher->offsets[slot + 1]);
+		masks[i] = matcher->masks[slot];
+		first_field_lens[i] = matcher->first_field_lens[slot];
+		matcher->order[i] = (unsigned int)i;
+	}
+	offsets.push_back((unsigned int)text.size());
+	matcher->text.swap(text);
+	matcher->offsets.swap(offsets);
+	matcher->masks.swap(masks);
+	matcher->first_field_lens.swap(first_field_lens);
+	matcher->positions.assign(matcher->order.begin(), matcher->order.end());
+	matcher->is_positions_valid = true;
+	matcher->num_removed_chars = 0;
+	matcher->has_query = false;
+	matcher->num_checked_slots = 0;
+}
+
+
+// Removes the entries at sorted_positions, which must be in ascending order.  The entries after
+// them move up, like the rows of the playlist.
+void FuzzyMatcherRemove(FuzzyMatcher* matcher, const unsigned int* sorted_positions, size_t count)
+{
+	if (count == 0)
+		return;
+	std::vector<unsigned int>& order = matcher->order;
+	size_t num_kept = sorted_positions[0];
+	size_t next_removed = 0;
+	for (size_t i = sorted_positions[0]; i < order.size(); i++)
+	{
+		const unsigned int slot = order[i];
+		if (next_removed < count && sorted_positions[next_removed] == i)
+		{
+			matcher->positions[slot] = FUZZY_NO_ENTRY;
+			matcher->num_removed_chars += matcher->offsets[slot + 1] - matcher->offsets[slot];
+			next_removed++;
+		}
+		else
+		{
+			order[num_kept++] = slot;
+		}
+	}
+	order.resize(num_kept);
+	matcher->is_positions_valid = false;
+	matcher->is_changed = true;
+
+	if (matcher->num_removed_chars > matcher->text.size() / 2)
+		CompactText(matcher);
+}
+
+
+// Moves count entries starting at first so that they start at dest.  dest is a position in the
+// entries that are left after the moved ones are taken out, the same as PlaylistMove().
+void FuzzyMatcherMove(FuzzyMatcher* matcher, unsigned int first, unsigned int count, unsigned int dest)
+{
+	std::vector<unsigned int>& order = matcher->order;
+	if (dest < first)
+		std::rotate(order.begin() + dest, order.begin() + first, order.begin() + first + count);
+	else if (dest > first)
+		std::rotate(order.begin() + first, order.begin() + first + count, order.begin() + dest + count);
+	matcher->is_positions_valid = false;
+	matcher->is_reordered = true;
+}
+
+
+// Puts the entries in a new order:  the entry at position i afterwards is the one that was at
+// old_positions[i].  count must be the number of entries.
+void FuzzyMatcherReorder(FuzzyMatcher* matcher, const unsigned int* old_positions, size_t count)
+{
+	std::vector<unsigned int> order(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = matcher->order[old_positions[i]];
+	matcher->order.swap(order);
+	matcher->is_positions_valid = false;
+	matcher->is_reordered = true;
+}
+
+
+// Finds the end of the leftmost match of query[0..query_len) in text[from..text_len).  Returns 
+// the offset one past the last matched character, or -1 if there is no match.  memchr() is 
+// vectorized by the CRT, so this skips over unmatched text much faster than comparing one 
+// character at a time.
+static int FindMatchEnd(const char* text, size_t from, size_t text_len, const char* query, size_t query_len)
+{
+	const char* text_end = text + text_len;
+	const char* pos = text + from;
+	for (size_t i = 0; i < query_len; i++)
+	{
+		pos = (const char*)memchr(pos, query[i], text_end - pos);
+		if (pos == NULL)
+			return -1;
+		pos++;
+	}
+	return (int)(pos - text);
+}
+
+
+// Scores the shortest match that ends at match_end.  Walking backwards from the end finds it,
+// e.g. for "ab" in "a...ab" this picks the last "a" instead of the first one.
+static int ScoreMatch(const char* text, size_t match_end, size_t first_field_len, const char* query, 
+	size_t query_len)
+{
+	if (query_len == 0)
+		return 1;
+
+	int score = 0;
+	const char* next_match = NULL;
+	const char* pos = text + match_end;
+	for (size_t i = query_len; i-- > 0;)
+	{
+		do
+			pos--;
+		while (*pos != query[i]);
+
+		score += SCORE_MATCH;
+		if (pos == text || !IsWordChar(pos[-1]))
+			score += SCORE_WORD_START_BONUS;
+		if (next_match == pos + 1)
+			score += SCORE_CONSECUTIVE_BONUS;
+		else if (next_match != NULL)
+			score -= (int)(next_match - pos - 1) * SCORE_GAP_PENALTY;
+		next_match = pos;
+	}
+	if (match_end <= first_field_len)
+		score += SCORE_FIRST_FIELD_BONUS;
+
+	// 0 means "no match", so a poor match still scores at least 1
+	if (score < 1)
+		score = 1;
+	else if (score > FUZZY_MAX_SCORE)
+		score = FUZZY_MAX_SCORE;
+	return score;
+}
+
+
+// Returns the score of the best match of query in text, or 0 if text doesn't contain every 
+// character of query in order.  Both must already be case folded.
+int FuzzyScore(const char* text, size_t text_len, const char* query, size_t query_len)
+{
+	const int match_end = FindMatchEnd(text, 0, text_len, query, query_len);
+	if (match_end < 0)
+		return 0;
+	const char* separator = (const char*)memchr(text, FUZZY_FIELD_SEPARATOR, text_len);
+	const size_t first_field_len = separator ? separator - text : text_len;
+	return ScoreMatch(text, match_end, first_field_len, query, query_len);
+}
+
+
+// Checks whether slot matches query and adds it to the candidates if it does
+static inline void CheckSlot(FuzzyMatcher* matcher, unsigned int slot, const char* query, size_t query_len,
+	unsigned long long query_mask)
+{
+	if ((matcher->masks[slot] & query_mask) != query_mask)
+		return;
+	const char* entry_text = matcher->text.data() + matcher->offsets[slot];
+	const int match_end = FindMatchEnd(entry_text, 0, matcher->offsets[slot + 1] - matcher->offsets[slot],
+		query, query_len);
+	if (match_end < 0)
+		return;
+	matcher->candidates.push_back(slot);
+	matcher->match_ends.push_back(match_end);
+	matcher->scores.push_back((unsigned short)ScoreMatch(entry_text, match_end, matcher->first_field_lens[slot], 
+		query, query_len));
+}
+
+
+// Returns the positions of the entries that match query, best match first.  Entries with the 
+// same score stay in position order.  Spaces in the query are ignored.
+const std::vector<unsigned int>& FuzzyMatcherSearch(FuzzyMatcher* matcher, const char* query)
+{
+	char folded_query[FUZZY_MAX_QUERY_LEN];
+	size_t query_len = 0;
+	unsigned long long query_mask = 0;
+	for (const char* pos = query; pos && *pos && query_len < FUZZY_MAX_QUERY_LEN; pos++)
+	{
+		const char c = FoldChar(*pos);
+		if (c == ' ' || c == FUZZY_FIELD_SEPARATOR)
+			continue;
+		folded_query[query_len++] = c;
+		query_mask |= CharMask((unsigned char)c);
+	}
+
+	// The candidates are kept in position order, so once entries have moved they can't be reused
+	const bool is_refinement = matcher->has_query && !matcher->is_reordered && query_len >= matcher->query.size() &&
+		memcmp(folded_query, matcher->query.data(), matcher->query.size()) == 0;
+	if (is_refinement && query_len == matcher->query.size() && !matcher->is_changed)
+		return matcher->results;		// Same query and same entries as last time
+
+	if (!matcher->is_positions_valid)
+	{
+		for (size_t i = 0; i < matcher->order.size(); i++)
+			matcher->positions[matcher->order[i]] = (unsigned int)i;
+		matcher->is_positions_valid = true;
+	}
+
+	const char* text = matcher->text.data();
+	const unsigned int* offsets = matcher->offsets.data();
+	const unsigned long long* masks = matcher->masks.data();
+	const unsigned int* first_field_lens = matcher->first_field_lens.data();
+	const unsigned int* positions = matcher->positions.data();
+	const unsigned int num_slots = (unsigned int)matcher->masks.size();
+	std::vector<unsigned int>& candidates = matcher->candidates;
+	std::vector<unsigned int>& match_ends = matcher->match_ends;
+	std::vector<unsigned short>& scores = matcher->scores;
+	if (is_refinement)
+	{
+		// Every entry that matches the new query is already a candidate, and its leftmost match
+		// of the new query can't end before the one of the old query.  So only the new characters
+		// need to be searched for, starting where the old match ended.
+		// If the query is the same, entries were only added or removed, so the scores still hold.
+		const size_t prev_query_len = matcher->query.size();
+		size_t num_kept = 0;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			const unsigned int slot = candidates[i];
+			if (positions[slot] == FUZZY_NO_ENTRY)
+				continue;
+			if (query_len == prev_query_len)
+			{
+				candidates[num_kept] = slot;
+				match_ends[num_kept] = match_ends[i];
+				scores[num_kept] = scores[i];
+				num_kept++;
+				continue;
+			}
+			if ((masks[slot] & query_mask) != query_mask)
+				continue;
+			const char* entry_text = text + offsets[slot];
+			const int match_end = FindMatchEnd(entry_text, match_ends[i], offsets[slot + 1] - offsets[slot],
+				folded_query + prev_query_len, query_len - prev_query_len);
+			if (match_end < 0)
+				continue;
+			candidates[num_kept] = slot;
+			match_ends[num_kept] = match_end;
+			scores[num_kept] = (unsigned short)ScoreMatch(entry_text, match_end, first_field_lens[slot], 
+				folded_query, query_len);
+			num_kept++;
+		}
+		candidates.resize(num_kept);
+		match_ends.resize(num_kept);
+		scores.resize(num_kept);
+
+		// Entries appended since the last search come after all the others, since nothing has moved
+		for (unsigned int slot = matcher->num_checked_slots; slot < num_slots; slot++)
+		{
+			if (positions[slot] != FUZZY_NO_ENTRY)
+				CheckSlot(matcher, slot, folded_query, query_len, query_mask);
+		}
+	}
+	else
+	{
+		const size_t num_entries = matcher->order.size();
+		candidates.clear();
+		candidates.reserve(num_entries);
+		match_ends.clear();
+		match_ends.reserve(num_entries);
+		scores.clear();
+		scores.reserve(num_entries);
+		for (size_t i = 0; i < num_entries; i++)
+			CheckSlot(matcher, matcher->order[i], folded_query, query_len, query_mask);
+	}
+	matcher->query.assign(folded_query, query_len);
+	matcher->has_query = true;
+	matcher->is_reordered = false;
+	matcher->is_changed = false;
+	matcher->num_checked_slots = num_slots;
+
+	// Counting sort by score, best first.  Scores are small integers, so this is linear, and
+	// it's stable, so ties stay in position order.
+	std::vector<unsigned int> bucket_start(FUZZY_MAX_SCORE + 2, 0);
+	for (size_t i = 0; i < scores.size(); i++)
+		bucket_start[FUZZY_MAX_SCORE - scores[i] + 1]++;
+	for (size_t i = 1; i < bucket_start.size(); i++)
+		bucket_start[i] += bucket_start[i - 1];
+	matcher->results.resize(candidates.size());
+	for (size_t i = 0; i < candidates.size(); i++)
+		matcher->results[bucket_start[FUZZY_MAX_SCORE - scores[i]]++] = positions[candidates[i]];
+
+	return matcher->results;
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+/******************************************************************************
+fuzzy.h - Incremental fuzzy matching for the playlist search box
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Fuzzy matching finds entries that contain the characters of the query in order, but not 
+// necessarily next to each other, so "bthlp" matches "The Beatles - Help!".  Each entry is 
+// made of one or more fields (e.g. song name, album, path), which are case folded and stored
+// back to back in one buffer.
+//
+// Searching is incremental:  when the new query starts with the previous query, only the 
+// entries that matched the previous query are checked again, because an entry that doesn't
+// match "bea" can't match "beat".  Each entry also has a bitmask of the characters it
+// contains, which rejects most entries with a single AND before any text is scanned.
+//
+// The entries can be edited in the same ways as the playlist:  appended, removed, moved, and 
+// put in a new order.  Each entry keeps the slot its text was stored in, and order says which
+// slot is at each position, so an edit only changes order instead of folding the text of every
+// entry again.  The text of removed entries is dropped once it is more than half of the buffer.
+
+#define FUZZY_FIELD_SEPARATOR	'\x1F'		// Between the fields of an entry
+#define FUZZY_MAX_QUERY_LEN		256
+#define FUZZY_MAX_SCORE			1023
+#define FUZZY_NO_ENTRY			0xFFFFFFFF
+
+struct FuzzyMatcher {
+	std::vector<char> text;						// Case-folded fields of every slot, back to back
+	std::vector<unsigned int> offsets;			// Slot i is text[offsets[i]] to text[offsets[i + 1]]
+	std::vector<unsigned long long> masks;		// Characters present in each slot
+	std::vector<unsigned int> first_field_lens;	// Length of the first field of each slot
+	std::vector<unsigned int> order;			// Slot of the entry at each position
+	std::vector<unsigned int> positions;		// Position of each slot, or FUZZY_NO_ENTRY if it was removed
+	bool is_positions_valid;					// Are positions up to date with order?
+	size_t num_removed_chars;					// Text of removed slots that hasn't been dropped yet
+	std::string query;							// Query that produced candidates
+	bool has_query;								// Are candidates valid for query?
+	bool is_reordered;							// Have entries moved since candidates were found?
+	bool is_changed;							// Have entries been added or removed since results were found?
+	unsigned int num_checked_slots;				// Slots before this one have been checked against query
+	std::vector<unsigned int> candidates;		// Slots that match query, in position order
+	std::vector<unsigned int> match_ends;		// End of the leftmost match in each candidate
+	std::vector<unsigned short> scores;			// Score of each candidate
+	std::vector<unsigned int> results;			// Positions of the candidates, best match first
+};
+
+FuzzyMatcher* FuzzyMatcherCreate(void);
+void FuzzyMatcherFree(FuzzyMatcher* matcher);
+void FuzzyMatcherBegin(FuzzyMatcher* matcher, size_t num_entries);
+void FuzzyMatcherNext(FuzzyMatcher* matcher);
+void FuzzyMatcherAppendField(FuzzyMatcher* matcher, const char* str);
+void FuzzyMatcherRemove(FuzzyMatcher* matcher, const unsigned int* sorted_positions, size_t count);
+void FuzzyMatcherMove(FuzzyMatcher* matcher, unsigned int first, unsigned int count, unsigned int dest);
+void FuzzyMatcherReorder(FuzzyMatcher* matcher, const unsigned int* old_positions, size_t count);
+const std::vector<unsigned int>& FuzzyMatcherSearch(FuzzyMatcher* matcher, const char* query);
+int FuzzyScore(const char* text, size_t text_len, const char* query, size_t query_len);
\ No newline at end of file
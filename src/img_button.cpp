@@ -254,7 +254,7 @@ HWND CreateImageButton(int img_res_id, COLORREF normal_color, COLORREF hover_col
 	HWND parent_hwnd, HMENU btn_id, HINSTANCE parent_inst, int x, int y, int width, int height)
 {
 	HWND btn_hwnd = 0;
-	ImageButtonState* btn_data = (ImageButtonState*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(ImageButtonState));
+	ImageButtonState* btn_data = (ImageButtonState*)AllocMemory(ALLOC_UI, sizeof(ImageButtonState));
 	if (btn_data)
 	{
 		btn_data->img_res_id = img_res_id;
@@ -285,7 +285,7 @@ HWND CreateImageLabel(int img_res_id, bool stretch, BYTE alpha, COLORREF backgro
 	HMENU lbl_id, HINSTANCE parent_inst, int x, int y, int width, int height)
 {
 	HWND lbl_hwnd = 0;
-	ImageLabelState* lbl_state = (ImageLabelState*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(ImageLabelState));
+	ImageLabelState* lbl_state = (ImageLabelState*)AllocMemory(ALLOC_UI, sizeof(ImageLabelState));
 	if (lbl_state)
 	{
 		if (img_res_id)
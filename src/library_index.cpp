@@ -0,0 +1,325 @@
+/******************************************************************************
+library_index.cpp - Columnar index of song metadata for sorting, grouping, and filtering
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "library_index.h"
+
+
+static const StringPool* GetStringPool(const LibraryIndex* index, LibraryColumn column)
+{
+	switch (column)
+	{
+		case LIB_COL_ARTIST:	return &index->artists;
+		case LIB_COL_ALBUM:		return &index->albums;
+		case LIB_COL_GENRE:		return &index->genres;
+		default:				return NULL;
+	}
+}
+
+
+// Lowercases ASCII letters so that "The Beatles" and "the beatles" get the same id
+static void FoldCase(const char* str, std::string& folded)
+{
+	folded.assign(str);
+	for (size_t i = 0; i < folded.size(); i++)
+	{
+		if (folded[i] >= 'A' && folded[i] <= 'Z')
+			folded[i] += 'a' - 'A';
+	}
+}
+
+
+// Returns the id of the string, and counts one more row with it
+static unsigned int InternString(StringPool* pool, const char* str)
+{
+	if (!str || !str[0])
+		return 0;
+
+	std::string folded;
+	FoldCase(str, folded);
+	auto found = pool->ids.find(folded);
+	if (found != pool->ids.end())
+	{
+		pool->ref_counts[found->second]++;
+		return found->second;
+	}
+
+	unsigned int id;
+	if (pool->free_ids.empty())
+	{
+		id = (unsigned int)pool->names.size();
+		pool->names.push_back(str);
+		pool->ref_counts.push_back(1);
+	}
+	else
+	{
+		id = pool->free_ids.back();
+		pool->free_ids.pop_back();
+		pool->names[id] = str;
+		pool->ref_counts[id] = 1;
+	}
+	pool->ids.emplace(folded, id);
+	return id;
+}
+
+
+// Counts one less row with the string, and frees its id if that was the last one
+static void ReleaseString(LibraryIndex* index, StringPool* pool, unsigned int id)
+{
+	if (id == 0 || --pool->ref_counts[id] > 0)
+		return;
+
+	std::string folded;
+	FoldCase(pool->names[id].c_str(), folded);
+	pool->ids.erase(folded);
+	std::string().swap(pool->names[id]);
+	pool->free_ids.push_back(id);
+	index->string_generation++;
+}
+
+
+// Does the string fold to the same text as the name?
+static bool IsSameFoldedString(const std::string& name, const char* str)
+{
+	size_t i = 0;
+	for (; i < name.size() && str[i]; i++)
+	{
+		char a = name[i];
+		char b = str[i];
+		a += (a >= 'A' && a <= 'Z') ? 'a' - 'A' : 0;
+		b += (b >= 'A' && b <= 'Z') ? 'a' - 'A' : 0;
+		if (a != b)
+			return false;
+	}
+	return i == name.size() && str[i] == '\0';
+}
+
+
+// Replaces the string in a text column of the row.  Songs are mostly updated when something other
+// than the text changed (e.g. the length), so the hash lookup is skipped if the text is the same.
+static void SetRowString(LibraryIndex* index, StringPool* pool, LibraryColumn column, unsigned int row, const char* str)
+{
+	const unsigned int old_id = index->columns[column][row];
+	if (old_id == 0 ? (!str || !str[0]) : (str && IsSameFoldedString(pool->names[old_id], str)))
+		return;
+	index->columns[column][row] = InternString(pool, str);
+	ReleaseString(index, pool, old_id);
+}
+
+
+static void InitStringPool(StringPool* pool)
+{
+	pool->ids.clear();
+	pool->names.clear();
+	pool->names.push_back("");		// Id 0 = missing tag
+	pool->ref_counts.assign(1, 0);
+	pool->free_ids.clear();
+}
+
+
+// Parses the leading number from a tag.  Ex:  "3/12" -> 3, " 07" -> 7.  Returns 0 if there is none.
+unsigned int ParseTagNumber(const char* str)
+{
+	if (!str)
+		return 0;
+
+	while (*str == ' ')
+		str++;
+	unsigned int result = 0;
+	while (*str >= '0' && *str <= '9' && result < 100000)
+	{
+		result = result * 10 + (*str - '0');
+		str++;
+	}
+	return result;
+}
+
+
+// Finds the first run of exactly 4 digits in a date tag.  Ex:  "2004-05-01" -> 2004, 
+// "05/01/2004" -> 2004.  Returns 0 if there is none.
+unsigned int ParseTagYear(const char* str)
+{
+	if (!str)
+		return 0;
+
+	while (*str)
+	{
+		if (*str >= '0' && *str <= '9')
+		{
+			const char* run_start = str;
+			while (*str >= '0' && *str <= '9')
+				str++;
+			if (str - run_start == 4)
+				return ParseTagNumber(run_start);
+		}
+		else
+		{
+			str++;
+		}
+	}
+	return 0;
+}
+
+
+LibraryIndex* LibraryIndexCreate(void)
+{
+	LibraryIndex* index = new LibraryIndex();
+	LibraryIndexClear(index);
+	return index;
+}
+
+
+void LibraryIndexFree(LibraryIndex* index)
+{
+	delete index;
+}
+
+
+// Removes every row.  The songs themselves are not freed.
+void LibraryIndexClear(LibraryIndex* index)
+{
+	for (size_t row = 0; row < index->songs.size(); row++)
+		index->songs[row]->is_indexed = false;
+	index->songs.clear();
+	for (int col = 0; col < LIB_NUM_COLUMNS; col++)
+		index->columns[col].clear();
+
+	InitStringPool(&index->artists);
+	InitStringPool(&index->albums);
+	InitStringPool(&index->genres);
+	index->string_generation++;
+
+	for (size_t i = 0; i < index->listeners.size(); i++)
+		index->listeners[i].on_clear(index->listeners[i].context);
+}
+
+
+void LibraryIndexAddListener(LibraryIndex* index, const LibraryListener* listener)
+{
+	index->listeners.push_back(*listener);
+}
+
+
+void LibraryIndexRemoveListener(LibraryIndex* index, void* context)
+{
+	for (size_t i = 0; i < index->listeners.size(); i++)
+	{
+		if (index->listeners[i].context == context)
+		{
+			index->listeners.erase(index->listeners.begin() + i);
+			return;
+		}
+	}
+}
+
+
+// Adds a row for the song, or refreshes its existing row after the song's info has changed
+void LibraryIndexUpdate(LibraryIndex* index, Song* song)
+{
+	if (!index || !song)
+		return;
+
+	if (!song->is_indexed)
+	{
+		song->index_row = (unsigned int)index->songs.size();
+		song->is_indexed = true;
+		index->songs.push_back(song);
+		for (int col = 0; col < LIB_NUM_COLUMNS; col++)
+			index->columns[col].push_back(0);
+	}
+
+	const unsigned int row = song->index_row;
+	const SongDetails* details = SongGetDetails(song);
+	SetRowString(index, &index->artists, LIB_COL_ARTIST, row, details->metadata.artist);
+	SetRowString(index, &index->albums, LIB_COL_ALBUM, row, details->metadata.album);
+	SetRowString(index, &index->genres, LIB_COL_GENRE, row, details->metadata.genre);
+	index->columns[LIB_COL_TRACK][row] = ParseTagNumber(details->metadata.track_num);
+	index->columns[LIB_COL_DISC][row] = ParseTagNumber(details->metadata.disc_num);
+	index->columns[LIB_COL_YEAR][row] = ParseTagYear(details->metadata.date);
+	index->columns[LIB_COL_DURATION][row] = song->song_length_secs;
+	index->columns[LIB_COL_BITRATE][row] = details->bitrate;
+
+	for (size_t i = 0; i < index->listeners.size(); i++)
+		index->listeners[i].on_update(index->listeners[i].context, index, row);
+}
+
+
+// Removes the song's row in O(1) by moving the last row into its place
+void LibraryIndexRemove(LibraryIndex* index, Song* song)
+{
+	if (!index || !song || !song->is_indexed)
+		return;
+
+	const unsigned int row = song->index_row;
+	const unsigned int last_row = (unsigned int)index->songs.size() - 1;
+	for (size_t i = 0; i < index->listeners.size(); i++)
+		index->listeners[i].on_remove(index->listeners[i].context, row, last_row);
+
+	ReleaseString(index, &index->artists, index->columns[LIB_COL_ARTIST][row]);
+	ReleaseString(index, &index->albums, index->columns[LIB_COL_ALBUM][row]);
+	ReleaseString(index, &index->genres, index->columns[LIB_COL_GENRE][row]);
+	if (row != last_row)
+	{
+		Song* moved_song = index->songs[last_row];
+		index->songs[row] = moved_song;
+		moved_song->index_row = row;
+		for (int col = 0; col < LIB_NUM_COLUMNS; col++)
+			index->columns[col][row] = index->columns[col][last_row];
+	}
+
+	index->songs.pop_back();
+	for (int col = 0; col < LIB_NUM_COLUMNS; col++)
+		index->columns[col].pop_back();
+	song->is_indexed = false;
+}
+
+
+// Returns the id of the string in a text column, or LIB_STRING_NOT_FOUND if no song has it
+unsigned int LibraryIndexFindString(const LibraryIndex* index, LibraryColumn column, const char* str)
+{
+	const StringPool* pool = GetStringPool(index, column);
+	if (!pool)
+		return LIB_STRING_NOT_FOUND;
+	if (!str || !str[0])
+		return 0;
+
+	std::string folded;
+	FoldCase(str, folded);
+	auto found = pool->ids.find(folded);
+	return (found != pool->ids.end()) ? found->second : LIB_STRING_NOT_FOUND;
+}
+
+
+const char* LibraryIndexGetString(const LibraryIndex* index, LibraryColumn column, unsigned int id)
+{
+	const StringPool* pool = GetStringPool(index, column);
+	if (!pool || id >= pool->names.size())
+		return NULL;
+	return pool->names[id].c_str();
+}
@@ -0,0 +1,109 @@
+/******************************************************************************
+library_index.h - Header file for library_index.cpp
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "song.h"
+
+// Columnar index of the songs in the playlist.  Each song has one row, and each column is a
+// contiguous array of 32-bit values, so smart playlist queries (query.h) only touch the
+// columns they need instead of chasing Song pointers all over the heap.
+//
+// Text columns (artist, album, genre) hold ids from a string pool.  Id 0 is always the
+// empty string, which is used when the tag is missing.  Numeric columns hold 0 when the
+// tag is missing or can't be parsed.  Once no row has a string, its id is freed and handed
+// out again for the next new string, so the pools only hold the strings the rows have.
+// string_generation changes whenever that happens, so ids looked up before it changed must be
+// looked up again.
+
+enum LibraryColumn {
+	LIB_COL_ARTIST,
+	LIB_COL_ALBUM,
+	LIB_COL_GENRE,
+	LIB_COL_TRACK,			// Parsed from track_num, e.g. "3/12" -> 3
+	LIB_COL_DISC,			// Parsed from disc_num, e.g. "1/2" -> 1
+	LIB_COL_YEAR,			// Parsed from date, e.g. "2004-05-01" -> 2004
+	LIB_COL_DURATION,		// Seconds
+	LIB_COL_BITRATE,		// kbps
+	LIB_NUM_COLUMNS
+};
+
+#define LIB_STRING_NOT_FOUND	0xFFFFFFFF
+
+enum LibraryFilterOp { LIB_OP_EQ, LIB_OP_NE, LIB_OP_LT, LIB_OP_LE, LIB_OP_GT, LIB_OP_GE };
+
+// Interned strings.  Lookups are case insensitive, but the first spelling seen is kept for display.
+struct StringPool {
+	std::unordered_map<std::string, unsigned int> ids;		// Case-folded string -> id
+	std::vector<std::string> names;							// Id -> string.  Empty if the id is free.
+	std::vector<unsigned int> ref_counts;					// Id -> number of rows with the string
+	std::vector<unsigned int> free_ids;
+};
+
+struct LibraryIndex;
+
+// Listeners keep derived data (e.g. smart playlist membership) up to date as rows change.
+// on_update is called after a row is added or changed.  on_remove is called before last_row 
+// is moved into the removed row.  on_clear is called after every row has been removed.
+typedef void (*LibraryRowUpdatedFn)(void* context, const LibraryIndex* index, unsigned int row);
+typedef void (*LibraryRowRemovedFn)(void* context, unsigned int row, unsigned int last_row);
+typedef void (*LibraryClearedFn)(void* context);
+
+struct LibraryListener {
+	void* context;
+	LibraryRowUpdatedFn on_update;
+	LibraryRowRemovedFn on_remove;
+	LibraryClearedFn on_clear;
+};
+
+struct LibraryIndex {
+	StringPool artists;
+	StringPool albums;
+	StringPool genres;
+	std::vector<Song*> songs;								// Row -> song
+	std::vector<unsigned int> columns[LIB_NUM_COLUMNS];		// Column -> row -> value
+	std::vector<LibraryListener> listeners;
+	unsigned int string_generation;							// Changes when a string id is freed
+};
+
+LibraryIndex* LibraryIndexCreate(void);
+void LibraryIndexFree(LibraryIndex* index);
+void LibraryIndexClear(LibraryIndex* index);
+void LibraryIndexAddListener(LibraryIndex* index, const LibraryListener* listener);
+void LibraryIndexRemoveListener(LibraryIndex* index, void* context);
+void LibraryIndexUpdate(LibraryIndex* index, Song* song);
+void LibraryIndexRemove(LibraryIndex* index, Song* song);
+unsigned int LibraryIndexFindString(const LibraryIndex* index, LibraryColumn column, const char* str);
+const char* LibraryIndexGetString(const LibraryIndex* index, LibraryColumn column, unsigned int id);
+unsigned int ParseTagNumber(const char* str);
+unsigned int ParseTagYear(const char* str);
\ No newline at end of file
@@ -0,0 +1,107 @@
+/******************************************************************************
+locality.cpp - Order for scanning many files with as little disk seeking as possible
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "locality.h"
+#include <string.h>
+#include <algorithm>
+
+
+// Gets the directory length (including the trailing separator) of a full path
+size_t GetDirectoryLength(const char* path)
+{
+	size_t dir_len = 0;
+	for (size_t i = 0; path[i]; i++)
+	{
+		if (path[i] == '\\' || path[i] == '/')
+			dir_len = i + 1;
+	}
+	return dir_len;
+}
+
+
+static inline unsigned char FoldAscii(unsigned char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+
+// Compares the first len bytes of a and b, or up to the end of the shorter one.  Paths are case
+// insensitive on Windows.
+static int CompareNoCase(const char* a, const char* b, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		const unsigned char fold_a = FoldAscii(a[i]);
+		const unsigned char fold_b = FoldAscii(b[i]);
+		if (fold_a != fold_b)
+			return (fold_a < fold_b) ? -1 : 1;
+		if (!fold_a)
+			break;
+	}
+	return 0;
+}
+
+
+static bool CompareLocalityKeys(const LocalityKey& a, const LocalityKey& b)
+{
+	// Group by directory first
+	const size_t min_dir_len = (a.dir_len < b.dir_len) ? a.dir_len : b.dir_len;
+	const int dir_cmp = CompareNoCase(a.path, b.path, min_dir_len);
+	if (dir_cmp != 0)
+		return dir_cmp < 0;
+	if (a.dir_len != b.dir_len)
+		return a.dir_len < b.dir_len;
+
+	// Same directory.  Visit the files in the order they are laid out on disk, if that is known.
+	if (a.volume != b.volume)
+		return a.volume < b.volume;
+	if (a.has_disk_pos != b.has_disk_pos)
+		return a.has_disk_pos;
+	if (a.has_disk_pos)
+	{
+		if (a.has_extent != b.has_extent)
+			return a.has_extent;
+		if (a.disk_pos != b.disk_pos)
+			return a.disk_pos < b.disk_pos;
+	}
+	else
+	{
+		const int name_cmp = CompareNoCase(a.path + a.dir_len, b.path + b.dir_len, (size_t)-1);
+		if (name_cmp != 0)
+			return name_cmp < 0;
+	}
+	return a.idx < b.idx;
+}
+
+
+void SortLocalityKeys(LocalityKey* keys, unsigned int count)
+{
+	std::sort(keys, keys + count, CompareLocalityKeys);
+}
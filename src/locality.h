@@ -0,0 +1,51 @@
+/******************************************************************************
+locality.h - Order for scanning many files with as little disk seeking as possible
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+
+// Files are visited directory by directory.  Within a directory, files on a local disk are visited
+// in the order they are laid out on it.  Asking a network share where a file is costs as much as
+// reading its header, so files there (and any whose position isn't known) are visited by name,
+// which is how most shares hand out their directory listings.  The platform code fills in the
+// keys:  prefetch.cpp on Windows, and the scan benchmark on Linux.
+
+struct LocalityKey {
+	const char* path;
+	size_t dir_len;				// Length of the directory portion of path, including the last separator
+	unsigned long long volume;	// Volume serial number, to keep volumes mounted in one tree apart
+	unsigned long long disk_pos;// First cluster of the file, or the file index as a fallback
+	bool has_disk_pos;			// Is disk_pos known?  It is only looked up on local fixed disks.
+	bool has_extent;			// Is disk_pos a cluster number (true) or only the file index (false)?
+	unsigned int idx;			// Position in the caller's array
+};
+
+size_t GetDirectoryLength(const char* path);
+void SortLocalityKeys(LocalityKey* keys, unsigned int count);
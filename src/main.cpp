@@ -33,7 +33,8 @@ SOFTWARE.
 
 #define WIN32_LEAN_AND_MEAN
 
-static void GetINIFilePath(char* ini_path, size_t len)
+// Gets the full path of a file in the program's directory, e.g. the INI file
+static void GetProgramFilePath(char* path, size_t len, const char* file_name)
 {
 	char current_dir[MAX_PATH];
 
@@ -41,9 +42,111 @@ static void GetINIFilePath(char* ini_path, size_t len)
 	GetModuleFileName(NULL, current_dir, MAX_PATH);
 	RemoveFilenameFromPath(current_dir, MAX_PATH);
 
-	// Append the INI file name to end
-	StringCbCopyA(ini_path, len, current_dir);
-	StringCbCatA(ini_path, len, "settings.ini");
+	// Append the file name to end
+	StringCbCopyA(path, len, current_dir);
+	StringCbCatA(path, len, file_name);
+}
+
+
+// Gets the full path of the snapshot file of the playlist at index.  The first playlist keeps the
+// file name from before there were several playlists.
+static void GetPlaylistSnapshotPath(unsigned int index, char* path, size_t len)
+{
+	if (index == 0)
+	{
+		GetProgramFilePath(path, len, SNAPSHOT_FILE_NAME);
+	}
+	else
+	{
+		char file_name[32];
+		StringCbPrintfA(file_name, sizeof(file_name), SNAPSHOT_TAB_FILE_NAME, index + 1);
+		GetProgramFilePath(path, len, file_name);
+	}
+}
+
+
+// Saves every playlist to its own snapshot file, and their names to the [Playlists] section.  Once
+// they are written, the list saved by older versions is removed from the INI file.
+static void WritePlaylistTabs(AppState* state, char* ini_path)
+{
+	bool is_saved = true;
+	std::string section;		// Null terminated lines, ending with an empty line
+	for (unsigned int i = 0; i < state->tabs.size(); i++)
+	{
+		const PlaylistTab* tab = state->tabs[i];
+		const bool is_active = (i == state->active_tab);
+		char snapshot_path[MAX_PATH];
+		GetPlaylistSnapshotPath(i, snapshot_path, MAX_PATH);
+		if (!WritePlaylistSnapshot(snapshot_path, is_active ? &state->playlist_view : &tab->playlist_view,
+			is_active ? &state->playlist : &tab->playlist))
+			is_saved = false;
+
+		char line[16 + PLAYLIST_NAME_MAX];
+		StringCbPrintfA(line, sizeof(line), "Playlist%u=%s", i + 1, tab->name);
+		section.append(line);
+		section.push_back('\0');
+	}
+	section.push_back('\0');
+	WritePrivateProfileSection(PLAYLISTS_SECTION, section.c_str(), ini_path);
+
+	// Remove the files of deleted playlists.  The files are numbered without gaps, so stop at the first
+	// one that isn't there.
+	for (unsigned int i = state->tabs.size(); ; i++)
+	{
+		char snapshot_path[MAX_PATH];
+		GetPlaylistSnapshotPath(i, snapshot_path, MAX_PATH);
+		if (!DeleteFile(snapshot_path))
+			break;
+	}
+
+	char active_tab[12];
+	StringCbPrintfA(active_tab, ARRAYSIZE(active_tab), "%u", state->active_tab);
+	WritePrivateProfileString(SETTINGS_SECTION, "ActivePlaylist", active_tab, ini_path);
+	if (is_saved)
+		WritePrivateProfileString(SETTINGS_SECTION, "PlaylistFiles", NULL, ini_path);
+}
+
+
+// Reads the names of the playlists from the [Playlists] section of the INI file, and loads every
+// playlist except the active one, which ReadPlaylistFromSettings() loads.  The other playlists aren't
+// indexed until a smart playlist is selected while they are shown.
+static void ReadPlaylistTabs(AppState* state, char* ini_path)
+{
+	for (unsigned int i = 0; ; i++)
+	{
+		char key[16];
+		char name[PLAYLIST_NAME_MAX];
+		StringCbPrintfA(key, sizeof(key), "Playlist%u", i + 1);
+		GetPrivateProfileString(PLAYLISTS_SECTION, key, "", name, sizeof(name), ini_path);
+		if (name[0] == '\0')
+		{
+			// Settings from older versions don't have any playlist names
+			if (i > 0)
+				break;
+			StringCbCopyA(name, sizeof(name), "Playlist 1");
+		}
+		PlaylistTab* tab = new PlaylistTab();
+		LegacyTextToUtf8(name, tab->name, sizeof(tab->name));
+		state->tabs.push_back(tab);
+	}
+
+	state->active_tab = GetPrivateProfileInt(SETTINGS_SECTION, "ActivePlaylist", 0, ini_path);
+	if (state->active_tab >= state->tabs.size())
+		state->active_tab = 0;
+
+	for (unsigned int i = 0; i < state->tabs.size(); i++)
+	{
+		if (i == state->active_tab)
+			continue;
+		PlaylistTab* tab = state->tabs[i];
+		tab->history = UndoHistoryCreate(UNDO_MEMORY_BUDGET);
+		char snapshot_path[MAX_PATH];
+		GetPlaylistSnapshotPath(i, snapshot_path, MAX_PATH);
+		std::vector<Song*> songs;
+		std::vector<unsigned int> play_order;
+		if (ReadPlaylistSnapshot(snapshot_path, songs, play_order))
+			LoadPlaylistLists(songs, play_order, state->options.shuffle, &tab->playlist_view, &tab->playlist, tab->history, NULL);
+	}
 }
 
 
@@ -88,11 +191,30 @@ static void WriteSettings(AppState* state, char* ini_path)
 	StringCbPrintfA(playlist_visible, ARRAYSIZE(playlist_visible), "%i", (state->is_playlist_visible) ? 1 : 0);
 	WritePrivateProfileString(SETTINGS_SECTION, "PlaylistVisible", playlist_visible, ini_path);
 
+	char memory_budget[12];
+	StringCbPrintfA(memory_budget, ARRAYSIZE(memory_budget), "%u", state->options.memory_budget_mb);
+	WritePrivateProfileString(SETTINGS_SECTION, "MemoryBudgetMB", memory_budget, ini_path);
+
+	char crossfade_secs[12];
+	StringCbPrintfA(crossfade_secs, ARRAYSIZE(crossfade_secs), "%u", state->options.crossfade_secs);
+	WritePrivateProfileString(SETTINGS_SECTION, "CrossfadeSecs", crossfade_secs, ini_path);
+	char crossfade_curve[2];
+	StringCbPrintfA(crossfade_curve, ARRAYSIZE(crossfade_curve), "%i", (int)state->options.crossfade_curve);
+	WritePrivateProfileString(SETTINGS_SECTION, "CrossfadeCurve", crossfade_curve, ini_path);
+
 	char curr_song_idx[10];
-	StringCbPrintfA(curr_song_idx, ARRAYSIZE(curr_song_idx), "%i", GetPlaylistCurrentIndex(state->playlist_view));
+	StringCbPrintfA(curr_song_idx, ARRAYSIZE(curr_song_idx), "%i", GetPlaylistViewCurrentIndex(state));
 	WritePrivateProfileString(SETTINGS_SECTION, "CurrentSongIndex", curr_song_idx, ini_path);
 
-	WritePlaylistToSettings(state, ini_path);
+	// The shuffle order is generated from the seed, so saving the seed saves the order
+	char shuffle_seed[20];
+	StringCbPrintfA(shuffle_seed, ARRAYSIZE(shuffle_seed), "%016llx", state->shuffle.seed);
+	WritePrivateProfileString(SETTINGS_SECTION, "ShuffleSeed", shuffle_seed, ini_path);
+	char shuffle_start[12];
+	StringCbPrintfA(shuffle_start, ARRAYSIZE(shuffle_start), "%u", state->shuffle.run.start);
+	WritePrivateProfileString(SETTINGS_SECTION, "ShuffleStart", shuffle_start, ini_path);
+
+	WritePlaylistTabs(state, ini_path);
 }
 
 static void ReadSettings(AppState* state, char* ini_path)
@@ -124,94 +246,197 @@ static void ReadSettings(AppState* state, char* ini_path)
 	state->is_playlist_visible = (GetPrivateProfileInt(SETTINGS_SECTION, "PlaylistVisible",
 		0, state->ini_path)) ? true : false;
 
+	state->options.memory_budget_mb = GetPrivateProfileInt(SETTINGS_SECTION, "MemoryBudgetMB",
+		MEMORY_BUDGET_DEFAULT_MB, state->ini_path);
+	if (!state->options.memory_budget_mb)
+		state->options.memory_budget_mb = 1;
+	MemoryBudgetSetLimit((size_t)state->options.memory_budget_mb * 1024 * 1024);
+
+	state->options.crossfade_secs = GetPrivateProfileInt(SETTINGS_SECTION, "CrossfadeSecs", 0, state->ini_path);
+	if (state->options.crossfade_secs > CROSSFADE_MAX_SECS)
+		state->options.crossfade_secs = CROSSFADE_MAX_SECS;
+	state->options.crossfade_curve = (GetPrivateProfileInt(SETTINGS_SECTION, "CrossfadeCurve", 
+		CROSSFADE_EQUAL_POWER, state->ini_path) == CROSSFADE_LINEAR) ? CROSSFADE_LINEAR : CROSSFADE_EQUAL_POWER;
 }
 
 
-static void WritePlaylistToSettings(AppState* state, char* ini_path)
+// Reads the saved queries from the [Smart Playlists] section of the INI file.  Each line is 
+// Name=Query, e.g. Recent Jazz=genre = "Jazz" AND year >= 2010.  Must be called before any 
+// songs are added to the library index, so membership is built up as the songs are added.
+static void ReadSmartPlaylists(AppState* state, char* ini_path)
 {
-	if (!state || !state->playlist_view.size() || !ini_path)
-		return;
+	// Start with small buffer and increase as needed
+	DWORD buffer_size = 1024;
+	char* section_buffer = (char*)AllocMemory(ALLOC_UI, buffer_size);
+	while (GetPrivateProfileSection(SMART_PLAYLISTS_SECTION, section_buffer, buffer_size, ini_path) == buffer_size - 2)
+	{
+		buffer_size *= 2;
+		section_buffer = (char*)ReAllocMemory(section_buffer, buffer_size);
+	}
 
-	// Start by copying the first file path to the buffer
-	size_t file_list_buffer_len = lstrlen(state->playlist_view[0]->path) + 1;
-	char* file_list_buffer = DuplicateString(state->playlist_view[0]->path);
-	HANDLE heap = GetProcessHeap();
-	for (unsigned int i = 1; i < state->playlist_view.size(); i++)
+	// The section is a list of null terminated lines, ending with an empty line
+	for (char* line = section_buffer; *line; line += lstrlen(line) + 1)
 	{
-		// Increase the file list buffer size to hold this file path
-		file_list_buffer_len += lstrlen(state->playlist_view[i]->path) + 2;
-		file_list_buffer = (char*)HeapReAlloc(heap, HEAP_ZERO_MEMORY, file_list_buffer, file_list_buffer_len);
-		StringCbCatA(file_list_buffer, file_list_buffer_len, "|");	// Add the separator
-		StringCbCatA(file_list_buffer, file_list_buffer_len, state->playlist_view[i]->path);	// Add the file path
+		char* separator = strchr(line, '=');
+		if (separator == NULL || separator == line)
+			continue;
+		*separator = '\0';
+		char name[UI_TEXT_MAX];
+		char query[UI_TEXT_MAX];
+		LegacyTextToUtf8(line, name, sizeof(name));
+		LegacyTextToUtf8(separator + 1, query, sizeof(query));
+		state->smart_playlists.push_back(SmartPlaylistCreate(name, query, state->library));
 	}
-	WritePrivateProfileString(SETTINGS_SECTION, "PlaylistFiles", file_list_buffer, ini_path);
-	HeapFree(heap, 0, file_list_buffer);
+
+	FreeMemory(section_buffer);
 }
 
 
-static void ReadPlaylistFromSettings(AppState* state, char* ini_path)
+// Continues the shuffle order from the last run, or starts a new one if there isn't one saved.
+// The playlist and the current song must already be loaded.
+static void ReadShuffleFromSettings(AppState* state, char* ini_path)
+{
+	const unsigned int num_songs = PlaylistCount(&state->playlist);
+	const int curr_pl_idx = GetPlaylistCurrentIndex(state);
+	char shuffle_seed[20];
+	GetPrivateProfileString(SETTINGS_SECTION, "ShuffleSeed", "", shuffle_seed, ARRAYSIZE(shuffle_seed), ini_path);
+	const unsigned long long seed = strtoull(shuffle_seed, NULL, 16);
+	NumberShuffleSongs(state);
+	if (seed != 0)
+	{
+		const unsigned int start = GetPrivateProfileInt(SETTINGS_SECTION, "ShuffleStart", 0, ini_path);
+		ShuffleRestore(&state->shuffle, seed, start, num_songs, (curr_pl_idx >= 0) ? curr_pl_idx : 0);
+	}
+	else
+	{
+		ShuffleReset(&state->shuffle, NewShuffleSeed(), num_songs, (curr_pl_idx >= 0) ? curr_pl_idx : 0);
+	}
+}
+
+
+// Reads the playlist from the PlaylistFiles list in the INI file, which is where versions before the
+// playlist snapshot saved it
+static void ReadPlaylistFilesFromSettings(std::vector<Song*>& songs, char* ini_path)
 {
 	// Get the list of files that were in playlist last run.  Start with small buffer and increase as needed.
 	size_t buffer_size = 256;
-	char* file_list_buffer = (char*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, buffer_size);
+	char* file_list_buffer = (char*)AllocMemory(ALLOC_PLAYLIST, buffer_size);
 	DWORD bytes_read = 0;
 	while (true)
 	{
 		bytes_read = GetPrivateProfileString(SETTINGS_SECTION, "PlaylistFiles", 0, file_list_buffer,
-			buffer_size, state->ini_path);
+			buffer_size, ini_path);
 		if (bytes_read < buffer_size - 1 || bytes_read == 0)
 			break;
 
 		// Buffer is too small, so double the size and try again
 		buffer_size *= 2;
-		file_list_buffer = (char*)HeapReAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, file_list_buffer, buffer_size);
+		file_list_buffer = (char*)ReAllocMemory(file_list_buffer, buffer_size);
 	}
 
 	if (bytes_read)
+		GetPlaylistFromFileList(songs, file_list_buffer, bytes_read);
+	FreeMemory(file_list_buffer);
+}
+
+
+// Fills a playlist's lists with the songs read from its snapshot (or the INI file), and starts its undo
+// history with them.  play_order is the saved play order, if there is one.  Songs from the snapshot
+// already have their info, so only new or invalid files are opened here.  library is NULL if the
+// playlist isn't shown yet.
+static void LoadPlaylistLists(std::vector<Song*>& songs, const std::vector<unsigned int>& play_order, bool shuffle,
+	Playlist* playlist_view, Playlist* playlist, UndoHistory* history, LibraryIndex* library)
+{
+	ShareStoredSongs(songs);
+	GetPlaylistSongInfo(songs, library);
+	AppendSongs(playlist_view, playlist, songs);
+	const bool has_play_order = shuffle && play_order.size() == songs.size();
+	if (has_play_order)
 	{
-		// If successfully read some bytes, then try to make a playlist
-		GetPlaylistFromFileList(state->playlist_view, file_list_buffer, bytes_read);
+		// The view was sorted while shuffle was on, so the play order is different
+		std::vector<PlaylistNode*> view_nodes(songs.size());
+		std::vector<PlaylistNode*> nodes(songs.size());
+		PlaylistGetNodes(playlist_view, view_nodes.data());
+		for (unsigned int i = 0; i < play_order.size(); i++)
+			nodes[i] = view_nodes[play_order[i]]->link;
+		PlaylistRebuild(playlist, nodes.data(), nodes.size());
+	}
 
-		for (unsigned int i = 0; i < state->playlist_view.size(); i++)
-		{
-			GetSongInfo(state->playlist_view[i]);
-		}
-		UpdatePlaylistWindow(state->controls.playlist_hwnd, state->playlist_view, state->controls.lbl_pl_info);
+	// The loaded playlist is the oldest version that can be undone to
+	UndoHistoryReset(history, songs.data(), songs.size());
+	if (has_play_order)
+	{
+		std::vector<Song*> play_songs(songs.size());
+		for (unsigned int i = 0; i < play_order.size(); i++)
+			play_songs[i] = songs[play_order[i]];
+		UndoHistoryAssign(history, UNDO_PLAY, play_songs.data(), play_songs.size());
+	}
+}
 
-		// Copy vector
-		state->playlist = state->playlist_view;
 
-		if (state->options.shuffle)
-		{
-			std::random_shuffle(state->playlist.begin(), state->playlist.end());
-			int curr_pl_idx = GetPlaylistCurrentIndex(state->playlist);
-			if (curr_pl_idx > 0)
-			{
-				// Swap so that the current song is first in the playlist
-				std::swap(state->playlist[curr_pl_idx], state->playlist[0]);
-			}
-		}
+// Loads the playlist from last run
+static void ReadPlaylistFromSettings(AppState* state, char* ini_path)
+{
+	std::vector<Song*> songs;
+	std::vector<unsigned int> play_order;
+	char snapshot_path[MAX_PATH];
+	GetPlaylistSnapshotPath(state->active_tab, snapshot_path, MAX_PATH);
+	if (!ReadPlaylistSnapshot(snapshot_path, songs, play_order) && state->active_tab == 0)
+		ReadPlaylistFilesFromSettings(songs, ini_path);
+	if (songs.size())
+	{
+		// If successfully read some songs, then make a playlist
+		LoadPlaylistLists(songs, play_order, state->options.shuffle, &state->playlist_view, &state->playlist,
+			state->history, state->library);
+		for (PlaylistNode* node = PlaylistFirst(&state->playlist); node; node = PlaylistNext(node))
+			node->song->play_node = node;
+		state->is_search_indexed = false;
+		UpdatePlaylistWindow(state);
 
 		UINT curr_song_idx = GetPrivateProfileInt(SETTINGS_SECTION, "CurrentSongIndex", 0, state->ini_path);
-		if (curr_song_idx >= state->playlist.size() || curr_song_idx < 0)
+		if (curr_song_idx >= PlaylistCount(&state->playlist_view) || curr_song_idx < 0)
 			curr_song_idx = 0;
-		state->curr_song = state->playlist_view[curr_song_idx];
-		state->curr_song->is_current = true;
-		RedrawPlaylistWindow(state->controls.playlist_hwnd, state->playlist_view.size());
+		SetCurrentSong(state, PlaylistNodeAt(&state->playlist_view, curr_song_idx)->link);
+		if (state->options.shuffle)
+			ReadShuffleFromSettings(state, ini_path);
+
+		RedrawPlaylistWindow(state->controls.playlist_hwnd, PlaylistCount(&state->playlist_view));
 		ResetPositionTrackbar(state->controls.tb_pos, 0, 0, 0);
 		UpdateInfoLabels(state, false);
 		//LoadCurrentSong(state);
 	}
-
-	HeapFree(GetProcessHeap(), 0, file_list_buffer);
-
 }
 
 static void KeyDownHandler(AppState* state, int key_code)
 {
 	switch (key_code)
 	{
-		case 0x5A:		// Z = previous
+		case 0x5A:		// Z = previous, Ctrl+Z = undo
+		{
+			if (GetKeyState(VK_CONTROL) < 0)
+				UndoPlaylistEdit(state, false);
+			else
+				PrevBtnHandler(state);
+		} break;
+
+		case 0x59:		// Ctrl+Y = redo
+		{
+			if (GetKeyState(VK_CONTROL) < 0)
+				UndoPlaylistEdit(state, true);
+		} break;
+
+		case VK_TAB:	// Ctrl+Tab = next playlist, Ctrl+Shift+Tab = previous playlist
+		{
+			if (GetKeyState(VK_CONTROL) < 0)
+			{
+				const unsigned int num_tabs = state->tabs.size();
+				if (GetKeyState(VK_SHIFT) < 0)
+					SwitchPlaylist(state, (state->active_tab + num_tabs - 1) % num_tabs);
+				else
+					SwitchPlaylist(state, (state->active_tab + 1) % num_tabs);
+			}
+		} break;
+
 		case VK_LEFT:	// Left Arrow = previous
 		{
 			PrevBtnHandler(state);
@@ -280,17 +505,29 @@ static void KeyDownHandler(AppState* state, int key_code)
 			ShuffleBtnHandler(state, true);
 		} break;
 
-		case VK_DELETE:		// Delete = delete file from playlist
+		case VK_DELETE:		// Delete = delete selected files from playlist
+		{
+			DeleteSelectedSongs(state);
+		} break;
+
+		case 0x46:		// F = search playlist
 		{
-			const int sel_idx = SendMessage(state->controls.playlist_hwnd, LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED);
-			if (sel_idx >= 0)
-				DeleteSongFromPlaylist(state, sel_idx);
+			if (!state->is_playlist_visible)
+				TogglePlaylistVisible(state->main_hwnd, &state->is_playlist_visible,
+					true, state->options.playlist_size, state->controls.btn_playlist,
+					state->options.always_on_top);
+			SetFocus(state->controls.txt_search);
 		} break;
 
 		case VK_RETURN:		// Enter/Return = play currently selected song
 		{
 			PlaylistDoubleClickHandler(state);
 		} break;
+
+		case 0x51:		// Q = play selected songs next.  Shift+Q = remove them from the queue.
+		{
+			QueueSelectedSongs(state, GetKeyState(VK_SHIFT) < 0);
+		} break;
 	}
 }
 
@@ -335,17 +572,35 @@ static int PaintPlaylist(AppState* state, LPNMLVCUSTOMDRAW lv_custom_draw)
 
 		case CDDS_ITEMPREPAINT:
 		{
-			const unsigned int item_idx = (unsigned int)lv_custom_draw->nmcd.dwItemSpec;
+			const int pl_view_idx = GetPlaylistRowViewIndex(state, (int)lv_custom_draw->nmcd.dwItemSpec);
+			if (pl_view_idx < 0)
+				return CDRF_DODEFAULT;
 			
-			if (state->playlist_view[item_idx]->is_valid)
+			const PlaylistNode* view_node = PlaylistNodeAt(&state->playlist_view, pl_view_idx);
+			const Song* song = view_node->song;
+			if (song->is_valid)
 			{
-				if (state->playlist_view[item_idx]->is_current)
+				if (song == state->curr_song)
 				{
 					// Currently playing song
 					lv_custom_draw->clrText = PLAYLIST_CURRENT_COLOR;
 					lv_custom_draw->clrTextBk = PLAYLIST_COLOR;
 					SelectObject(lv_custom_draw->nmcd.hdc, state->gdi.playlist_font_current);
 				}
+				else if (view_node->link->queue_entries)
+				{
+					// Queued to play next
+					lv_custom_draw->clrText = PLAYLIST_QUEUED_COLOR;
+					lv_custom_draw->clrTextBk = PLAYLIST_COLOR;
+					SelectObject(lv_custom_draw->nmcd.hdc, state->gdi.playlist_font_normal);
+				}
+				else if (song->is_duplicate)
+				{
+					// Same audio as another song in the playlist
+					lv_custom_draw->clrText = PLAYLIST_DUPLICATE_COLOR;
+					lv_custom_draw->clrTextBk = PLAYLIST_COLOR;
+					SelectObject(lv_custom_draw->nmcd.hdc, state->gdi.playlist_font_normal);
+				}
 				else
 				{
 					// Normal playlist entry
@@ -374,51 +629,29 @@ static void TimerHandler(AppState* state, int timer_id)
 {
 	if (timer_id == TIMER_UPDATE_SONG_POS)
 	{
-		if (!state->bass_stream)
+		if (!state->player.stream)
 			return;
 
-		if (BASS_ChannelIsActive(state->bass_stream) == BASS_ACTIVE_STOPPED &&
-			state->player_state != STOPPED)
+		// The player went on to the next song by itself
+		if (PlayerUpdate(&state->player))
+			NextSongStarted(state);
+
+		if (state->player.stream && BASS_ChannelIsActive(state->player.stream) == BASS_ACTIVE_STOPPED &&
+			state->player_state == PLAYING)
 		{
-			// Song finished playing, so play the next song in playlist
-			int curr_song_idx = GetPlaylistCurrentIndex(state->playlist);
-			if (curr_song_idx == (int)state->playlist.size() - 1 && !state->options.repeat)
-			{
-				// Last song in playlist and repeat is turned off
-				ResetPositionTrackbar(state->controls.tb_pos, 0, 0, 0);
-				SendMessage(state->controls.lbl_time_pos, WM_SETTEXT, 0, 0);
-				SendMessage(state->controls.lbl_time_length, WM_SETTEXT, 0, 0);
-				state->player_state = STOPPED;
-				return;
-			}
-			
-			int count = 0;		// Only try each song in playlist once before giving up
-			while (!SelectNextSong(state))
-			{
-				// Keep trying until we find a playable song
-				count++;
-				if (count >= (int) state->playlist.size())
-				{
-					// Could not find a valid song in the playlist.  Clean up.
-					ClearInfoLabels(&state->controls, state->main_hwnd);
-					ResetPositionTrackbar(state->controls.tb_pos, 0, 0, 0);
-					state->player_state = STOPPED;
-					return;
-				}
-			}
-			UpdateInfoLabels(state, true);
-			BASS_ChannelPlay(state->bass_stream, false);
-			state->player_state = PLAYING;
+			// Song finished playing, and the next one couldn't be joined on, so play it the slow way
+			SongFinished(state);
 		}
 		else if (state->player_state == PLAYING)
 		{
 			// Song isn't finished, so update the time label and the menu_pos trackbar
-			const QWORD position = BASS_ChannelGetPosition(state->bass_stream, BASS_POS_BYTE);
-			const int position_seconds = (int)BASS_ChannelBytes2Seconds(state->bass_stream, position);
+			const QWORD position = PlayerGetPosition(&state->player);
+			const int position_seconds = (int)BASS_ChannelBytes2Seconds(state->player.stream, position);
 			char time[8];
 			StringCbPrintfA(time, 8, "%u:%02u", position_seconds / 60, position_seconds % 60);
 			SendMessage(state->controls.lbl_time_pos, WM_SETTEXT, 0, (LPARAM)time);
 			SendMessage(state->controls.tb_pos, WP_TBM_SETPOS, 0, position_seconds);
+			PrepareNextSong(state, position_seconds);
 		}
 	}
 	else if (timer_id == TIMER_REVERT_TITLE)
@@ -426,10 +659,8 @@ static void TimerHandler(AppState* state, int timer_id)
 		// Revert to the previous song title, then delete this timer
 		if (state->curr_song != NULL)
 		{
-			if (state->curr_song->metadata.title)
-				SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)state->curr_song->metadata.title);
-			else
-				SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)state->curr_song->file_name);
+			const char* title = SongGetDetails(state->curr_song)->metadata.title;
+			SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)(title ? title : state->curr_song->file_name));
 		}
 		else
 		{
@@ -464,8 +695,7 @@ static void MouseWheelHandler(AppState* state, short wheel_dir)
 	}
 	state->volume = vol;
 	SendMessage(state->controls.tb_vol, WP_TBM_SETPOS, 0, state->volume);
-	if (state->bass_stream)
-		BASS_ChannelSetAttribute(state->bass_stream, BASS_ATTRIB_VOL, state->volume / 100.0f);
+	PlayerSetVolume(&state->player, state->volume / 100.0f);
 
 	char vol_text[16];
 	StringCbPrintfA(vol_text, 16, "Volume:  %u%%", state->volume);
@@ -478,24 +708,24 @@ static void MouseWheelHandler(AppState* state, short wheel_dir)
 static void PlaylistDoubleClickHandler(AppState* state)
 {
 	// User double-clicked item in playlist_view
-	const int sel_idx = SendMessage(state->controls.playlist_hwnd, LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED);
-	if (sel_idx >= 0)
+	const int sel_pl_view_idx = GetSelectedViewIndex(state);
+	if (sel_pl_view_idx >= 0)
 	{
-		if (state->curr_song != NULL)
-			state->curr_song->is_current = false;
-
-		state->curr_song = state->playlist_view[sel_idx];
-		state->curr_song->is_current = true;
+		PlaylistNode* prev_node = state->curr_node;
+		SetCurrentSong(state, PlaylistNodeAt(&state->playlist_view, sel_pl_view_idx)->link);
+		state->play_queue.resume_node = NULL;		// Playlist continues from here, after any queued songs
+		if (state->options.shuffle)
+			ShuffleJumpTo(&state->shuffle, state->curr_node->shuffle_ordinal);
 		if (LoadCurrentSong(state))
 		{
-			RedrawPlaylistWindow(state->controls.playlist_hwnd, state->playlist_view.size());
+			RedrawPlaylistSong(state, prev_node);
+			RedrawPlaylistSong(state, state->curr_node);
 			UpdateInfoLabels(state, true);
 			// Set volume to current value from the volume trackbar
 			//state->volume = SendMessage(state->controls.tb_vol, WP_TBM_GETPOS, 0, 0);
-			if (state->bass_stream)
-				BASS_ChannelSetAttribute(state->bass_stream, BASS_ATTRIB_VOL, state->volume / 100.0f);
+			PlayerSetVolume(&state->player, state->volume / 100.0f);
 
-			BASS_ChannelPlay(state->bass_stream, false);
+			BASS_ChannelPlay(state->player.stream, false);
 			state->player_state = PLAYING;
 		}
 		else
@@ -509,12 +739,12 @@ static void PlaylistDoubleClickHandler(AppState* state)
 
 static void PlayBtnHandler(AppState* state)
 {
-	if (state->bass_stream)
+	if (state->player.stream)
 	{
 		if (state->player_state == PLAYING)
 		{
 			// Restart track from beginning
-			BASS_ChannelPlay(state->bass_stream, true);
+			PlayerSetPosition(&state->player, 0);
 			SendMessage(state->controls.tb_pos, WP_TBM_SETPOS, 0, 0);
 			state->player_state = PLAYING;
 		}
@@ -522,19 +752,21 @@ static void PlayBtnHandler(AppState* state)
 		{
 			if (state->curr_song != NULL)
 			{
-				BASS_ChannelPlay(state->bass_stream, true);
+				PlayerSetPosition(&state->player, 0);
+				BASS_ChannelPlay(state->player.stream, false);
 				ResetPositionTrackbar(state->controls.tb_pos, 0, state->curr_song->song_length_secs, 0);
-				SendMessage(state->controls.lbl_time_length, WM_SETTEXT, 0, (LPARAM)&state->curr_song->song_length_str);
+				char song_length[16];
+				SongFormatLength(state->curr_song, song_length, sizeof(song_length));
+				SendMessage(state->controls.lbl_time_length, WM_SETTEXT, 0, (LPARAM)song_length);
 				state->player_state = PLAYING;
 			}
 			else
 			{
 				// User has deleted the current song from playlist.  Clean up.
 				ClearInfoLabels(&state->controls, state->main_hwnd);
-				BASS_StreamFree(state->bass_stream);
-				state->bass_stream = 0;
+				UnloadCurrentSong(state);
 
-				if (state->playlist.size() > 0)
+				if (PlaylistCount(&state->playlist) > 0)
 				{
 
 					int count = 0;
@@ -542,7 +774,7 @@ static void PlayBtnHandler(AppState* state)
 					{
 						// Keep trying until we find a playable song
 						count++;
-						if (count >= (int) state->playlist.size())
+						if (count >= (int)PlaylistCount(&state->playlist))
 						{
 							// Could not find a valid song in the playlist.  Clean up.
 							ClearInfoLabels(&state->controls, state->main_hwnd);
@@ -552,7 +784,7 @@ static void PlayBtnHandler(AppState* state)
 						}
 					}
 					UpdateInfoLabels(state, true);
-					BASS_ChannelPlay(state->bass_stream, false);
+					BASS_ChannelPlay(state->player.stream, false);
 					state->player_state = PLAYING;
 				}
 				else
@@ -565,27 +797,28 @@ static void PlayBtnHandler(AppState* state)
 		}
 		else if (state->player_state == PAUSED)
 		{
-			BASS_ChannelPlay(state->bass_stream, false);
+			BASS_ChannelPlay(state->player.stream, false);
 			state->player_state = PLAYING;
 		}
 	}
 	else
 	{
 		// There is no BASS stream
-		if (state->playlist.size() > 0)
+		if (PlaylistCount(&state->playlist) > 0)
 		{
 			if (state->curr_song == NULL)
 			{
 				// If there are songs in the playlist, and none of them are the current song,
 				// select the first song in playlist, and play it.
-				state->curr_song = state->playlist[0];
-				state->curr_song->is_current = true;
+				SetCurrentSong(state, PlaylistFirst(&state->playlist));
+				if (state->options.shuffle)
+					ShuffleJumpTo(&state->shuffle, state->curr_node->shuffle_ordinal);
 			}
 			if (LoadCurrentSong(state))
 			{
-				RedrawPlaylistWindow(state->controls.playlist_hwnd, state->playlist_view.size());
+				RedrawPlaylistWindow(state->controls.playlist_hwnd, PlaylistCount(&state->playlist_view));
 				UpdateInfoLabels(state, true);
-				BASS_ChannelPlay(state->bass_stream, false);
+				BASS_ChannelPlay(state->player.stream, false);
 				state->player_state = PLAYING;
 			}
 		}
@@ -599,18 +832,18 @@ static void PlayBtnHandler(AppState* state)
 
 static void PauseBtnHandler(AppState* state)
 {
-	if (state->bass_stream)
+	if (state->player.stream)
 	{
 		if (state->player_state == PAUSED)
 		{
 			// Stream is already paused, so pause button resumes it
-			BASS_ChannelPlay(state->bass_stream, false);
+			BASS_ChannelPlay(state->player.stream, false);
 			state->player_state = PLAYING;
 		}
 		else if (state->player_state == PLAYING)
 		{
 			// Stream is playing, so pause button pauses it
-			BASS_ChannelPause(state->bass_stream);
+			BASS_ChannelPause(state->player.stream);
 			state->player_state = PAUSED;
 		}
 	}
@@ -618,9 +851,9 @@ static void PauseBtnHandler(AppState* state)
 
 static void StopBtnHandler(AppState* state)
 {
-	if (state->bass_stream)
+	if (state->player.stream)
 	{
-		BASS_ChannelStop(state->bass_stream);
+		BASS_ChannelStop(state->player.stream);
 
 		if (state->player_state == PLAYING || state->player_state == PAUSED)
 		{
@@ -633,9 +866,8 @@ static void StopBtnHandler(AppState* state)
 			// User has deleted the current song.  Clean up everything.
 			// Clear all the labels.
 			ClearInfoLabels(&state->controls, state->main_hwnd);
-			BASS_StreamFree(state->bass_stream);
-			state->bass_stream = 0;
-			state->curr_song = NULL;
+			UnloadCurrentSong(state);
+			SetCurrentSong(state, NULL);
 		}
 
 		state->player_state = STOPPED;
@@ -644,16 +876,15 @@ static void StopBtnHandler(AppState* state)
 
 static void PrevBtnHandler(AppState* state)
 {
-	if (state->playlist_view.size() > 0)
+	if (PlaylistCount(&state->playlist_view) > 0)
 	{
-		const int curr_pl_idx = GetPlaylistCurrentIndex(state->playlist);
-		if (state->options.repeat || curr_pl_idx > 0)
+		ShufflePosition shuffle_pos;
+		if (FindPrevSong(state, &shuffle_pos) >= 0)
 		{
-			if (state->bass_stream)
+			// When crossfading, the song keeps playing until the next one is loaded
+			if (state->player.stream && !ShouldCrossfade(state))
 			{
-				BASS_ChannelStop(state->bass_stream);
-				BASS_StreamFree(state->bass_stream);
-				state->bass_stream = 0;
+				UnloadCurrentSong(state);
 			}
 			
 			int count = 0;
@@ -661,9 +892,10 @@ static void PrevBtnHandler(AppState* state)
 			{
 				// Keep trying until we find a playable song
 				count++;
-				if (count >= (int) state->playlist.size())
+				if (count >= (int)PlaylistCount(&state->playlist))
 				{
 					// Could not find a valid song in the playlist.  Clean up.
+					UnloadCurrentSong(state);
 					ClearInfoLabels(&state->controls, state->main_hwnd);
 					ResetPositionTrackbar(state->controls.tb_pos, 0, 0, 0);
 					state->player_state = STOPPED;
@@ -674,7 +906,7 @@ static void PrevBtnHandler(AppState* state)
 			{
 				UpdateInfoLabels(state, true);
 				ResetPositionTrackbar(state->controls.tb_pos, 0, state->curr_song->song_length_secs, 0);
-				BASS_ChannelPlay(state->bass_stream, false);
+				BASS_ChannelPlay(state->player.stream, false);
 				state->player_state = PLAYING;
 			}
 			else
@@ -689,25 +921,25 @@ static void PrevBtnHandler(AppState* state)
 
 static void NextBtnHandler(AppState* state)
 {
-	if (state->playlist.size() > 0)
+	if (PlaylistCount(&state->playlist) > 0)
 	{
-		const int curr_pl_idx = GetPlaylistCurrentIndex(state->playlist);
-		if (state->options.repeat || curr_pl_idx < (int)state->playlist.size() - 1)
+		ShufflePosition shuffle_pos;
+		if (FindNextSong(state, &shuffle_pos) >= 0)
 		{
-			if (state->bass_stream)
+			// When crossfading, the song keeps playing until the next one is loaded
+			if (state->player.stream && !ShouldCrossfade(state))
 			{
-				BASS_ChannelStop(state->bass_stream);
-				BASS_StreamFree(state->bass_stream);
-				state->bass_stream = 0;
+				UnloadCurrentSong(state);
 			}
 			int count = 0;
 			while (!SelectNextSong(state))
 			{
 				// Keep trying until we find a playable song
 				count++;
-				if (count >= (int) state->playlist.size())
+				if (count >= (int)PlaylistCount(&state->playlist))
 				{
 					// Could not find a valid song in the playlist.  Clean up.
+					UnloadCurrentSong(state);
 					ClearInfoLabels(&state->controls, state->main_hwnd);
 					ResetPositionTrackbar(state->controls.tb_pos, 0, 0, 0);
 					state->player_state = STOPPED;
@@ -718,7 +950,7 @@ static void NextBtnHandler(AppState* state)
 			{
 				UpdateInfoLabels(state, true);
 				ResetPositionTrackbar(state->controls.tb_pos, 0, state->curr_song->song_length_secs, 0);
-				BASS_ChannelPlay(state->bass_stream, false);
+				BASS_ChannelPlay(state->player.stream, false);
 				state->player_state = PLAYING;
 			}
 			else
@@ -740,20 +972,27 @@ static void ShuffleBtnHandler(AppState* state, bool toggle)
 	if (state->options.shuffle)
 	{
 		SendMessage(state->controls.btn_shuffle, WP_BM_SETIMAGE, IDB_SHUFFLE_ON, 0);
-		if (state->playlist.size() > 0)
-		{
-			std::random_shuffle(state->playlist.begin(), state->playlist.end());
-			const int curr_pl_idx = GetPlaylistCurrentIndex(state->playlist);
-			if (curr_pl_idx > 0)
-				// Swap so that the current song is first in the playlist
-				std::swap(state->playlist[curr_pl_idx], state->playlist[0]);
+		if (toggle)
+		{
+			// New shuffle order, starting from the current song.  Nothing is copied or moved;
+			// the order is generated as the songs are played.
+			const int curr_pl_idx = GetPlaylistCurrentIndex(state);
+			NumberShuffleSongs(state);
+			ShuffleReset(&state->shuffle, NewShuffleSeed(), PlaylistCount(&state->playlist), 
+				(curr_pl_idx >= 0) ? curr_pl_idx : 0);
 		}
 	}
 	else
 	{
 		SendMessage(state->controls.btn_shuffle, WP_BM_SETIMAGE, IDB_SHUFFLE_OFF, 0);
-		if (state->playlist.size() > 0)
-			state->playlist = state->playlist_view;
+		// The ordinals aren't kept up to date while shuffle is off, so the next shuffle starts over
+		state->shuffle.seed = 0;
+		if (toggle && PlaylistCount(&state->playlist) > 0)
+		{
+			ResetPlayOrder(state);
+			// Not an edit that can be undone, but the current version must be in the new play order too
+			UndoHistoryPlayFollowsView(state->history);
+		}
 	}
 }
 
@@ -772,34 +1011,53 @@ static void RepeatBtnHandler(AppState* state, bool toggle)
 
 static void MoveUpBtnHandler(AppState* state)
 {
+	// The rows of a filtered playlist aren't next to each other in playlist_view
+	if (state->is_filtered)
+		return;
+
 	const int sel_idx = SendMessage(state->controls.playlist_hwnd, LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED);
 	if (sel_idx >= 1)
 	{
-		std::swap(state->playlist_view[sel_idx], state->playlist_view[sel_idx - 1]);
-		UpdatePlaylistWindow(state->controls.playlist_hwnd, state->playlist_view, state->controls.lbl_pl_info);
+		UndoHistoryBeginEdit(state->history);
+		UndoHistoryMove(state->history, UNDO_VIEW, sel_idx, 1, sel_idx - 1);
+		PlaylistMove(&state->playlist_view, sel_idx, 1, sel_idx - 1);
+		if (state->is_search_indexed)
+			FuzzyMatcherMove(state->search, sel_idx, 1, sel_idx - 1);
+		if (!state->options.shuffle)
+		{
+			// If shuffle is turned on, moving an item up/down doesn't really do anything.  If it
+			// is off, playlist is in the same order as playlist_view.
+			PlaylistMove(&state->playlist, sel_idx, 1, sel_idx - 1);
+		}
+		EndPlaylistEdit(state);
+		UpdatePlaylistWindow(state);
 		ListView_SetItemState(state->controls.playlist_hwnd, sel_idx - 1, LVIS_FOCUSED | LVIS_SELECTED, 0x000F);
 	}
-	if (!state->options.shuffle)
-	{
-		// If shuffle is turned on, moving an item up/down doesn't really do anything
-		state->playlist = state->playlist_view;
-	}
 }
 
 static void MoveDownBtnHandler(AppState* state)
 {
+	// The rows of a filtered playlist aren't next to each other in playlist_view
+	if (state->is_filtered)
+		return;
+
 	const int sel_idx = SendMessage(state->controls.playlist_hwnd, LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED);
-	if (sel_idx >= 0 && sel_idx < (int)state->playlist_view.size() - 1)
+	if (sel_idx >= 0 && sel_idx < (int)PlaylistCount(&state->playlist_view) - 1)
 	{
-		std::swap(state->playlist_view[sel_idx], state->playlist_view[sel_idx + 1]);
-		UpdatePlaylistWindow(state->controls.playlist_hwnd, state->playlist_view, state->controls.lbl_pl_info);
+		UndoHistoryBeginEdit(state->history);
+		UndoHistoryMove(state->history, UNDO_VIEW, sel_idx, 1, sel_idx + 1);
+		PlaylistMove(&state->playlist_view, sel_idx, 1, sel_idx + 1);
+		if (state->is_search_indexed)
+			FuzzyMatcherMove(state->search, sel_idx, 1, sel_idx + 1);
+		if (!state->options.shuffle)
+		{
+			// If shuffle is turned on, moving an item up/down doesn't really do anything.  If it
+			// is off, playlist is in the same order as playlist_view.
+			PlaylistMove(&state->playlist, sel_idx, 1, sel_idx + 1);
+		}
+		EndPlaylistEdit(state);
+		UpdatePlaylistWindow(state);
 		ListView_SetItemState(state->controls.playlist_hwnd, sel_idx + 1, LVIS_FOCUSED | LVIS_SELECTED, 0x000F);
-
-	}
-	if (!state->options.shuffle)
-	{
-		// If shuffle is turned on, moving an item up/down doesn't really do anything
-		state->playlist = state->playlist_view;
 	}
 }
 
@@ -829,7 +1087,88 @@ static void SettingsBtnHandler(AppState* state)
 	else if (state->options.playlist_size == LARGE)
 		CheckMenuRadioItem(pl_size_submenu, IDM_PLAYLIST_SMALL, IDM_PLAYLIST_LARGE, IDM_PLAYLIST_LARGE, MF_BYCOMMAND);
 
+	// Crossfade length and curve
+	HMENU crossfade_submenu = CreatePopupMenu();
+	AppendMenu(menu, MF_STRING | MF_POPUP, (UINT_PTR)crossfade_submenu, "Crossfade");
+	AppendMenu(crossfade_submenu, MF_STRING, IDM_CROSSFADE_SECS_FIRST, "Off");
+	for (unsigned int secs = CROSSFADE_SECS_STEP; secs <= CROSSFADE_MAX_SECS; secs += CROSSFADE_SECS_STEP)
+	{
+		char item_text[32];
+		StringCbPrintfA(item_text, sizeof(item_text), "%u Seconds", secs);
+		AppendMenu(crossfade_submenu, MF_STRING, IDM_CROSSFADE_SECS_FIRST + secs, item_text);
+	}
+	CheckMenuRadioItem(crossfade_submenu, IDM_CROSSFADE_SECS_FIRST, IDM_CROSSFADE_SECS_FIRST + CROSSFADE_MAX_SECS,
+		IDM_CROSSFADE_SECS_FIRST + state->options.crossfade_secs, MF_BYCOMMAND);
+	AppendMenu(crossfade_submenu, MF_SEPARATOR, 0, 0);
+	AppendMenu(crossfade_submenu, MF_STRING, IDM_CROSSFADE_EQUAL_POWER, "Equal Power");
+	AppendMenu(crossfade_submenu, MF_STRING, IDM_CROSSFADE_LINEAR, "Linear");
+	CheckMenuRadioItem(crossfade_submenu, IDM_CROSSFADE_EQUAL_POWER, IDM_CROSSFADE_LINEAR, 
+		(state->options.crossfade_curve == CROSSFADE_LINEAR) ? IDM_CROSSFADE_LINEAR : IDM_CROSSFADE_EQUAL_POWER, MF_BYCOMMAND);
+
+	// Playlists.  The one that is shown is checked.
+	HMENU playlists_submenu = CreatePopupMenu();
+	AppendMenu(menu, MF_STRING | MF_POPUP, (UINT_PTR)playlists_submenu, "Playlists");
+	for (unsigned int i = 0; i < state->tabs.size(); i++)
+		AppendMenuUtf8(playlists_submenu, MF_STRING, IDM_PLAYLIST_TAB_FIRST + i, state->tabs[i]->name);
+	CheckMenuRadioItem(playlists_submenu, IDM_PLAYLIST_TAB_FIRST, IDM_PLAYLIST_TAB_FIRST + state->tabs.size() - 1,
+		IDM_PLAYLIST_TAB_FIRST + state->active_tab, MF_BYCOMMAND);
+	AppendMenu(playlists_submenu, MF_SEPARATOR, 0, 0);
+	AppendMenu(playlists_submenu, MF_STRING, IDM_NEW_PLAYLIST, "New Playlist");
+	if (state->tabs.size() > 1)
+		AppendMenu(playlists_submenu, MF_STRING, IDM_DELETE_PLAYLIST, "Delete Playlist");
+	else
+		AppendMenu(playlists_submenu, MF_STRING | MF_GRAYED, IDM_DELETE_PLAYLIST, "Delete Playlist");
+
+	// Smart playlists.  Queries that don't compile are grayed out.
+	HMENU smart_pl_submenu = CreatePopupMenu();
+	AppendMenu(menu, MF_STRING | MF_POPUP, (UINT_PTR)smart_pl_submenu, "Smart Playlists");
+	AppendMenu(smart_pl_submenu, MF_STRING, IDM_SMART_PLAYLIST_NONE, "All Songs");
+	if (state->active_smart_playlist == NULL)
+		CheckMenuItem(smart_pl_submenu, IDM_SMART_PLAYLIST_NONE, MF_CHECKED);
+	if (state->smart_playlists.size())
+		AppendMenu(smart_pl_submenu, MF_SEPARATOR, 0, 0);
+	else
+		AppendMenu(smart_pl_submenu, MF_STRING | MF_GRAYED, 0, "Add queries to settings.ini");
+	for (unsigned int i = 0; i < state->smart_playlists.size(); i++)
+	{
+		const SmartPlaylist* smart_playlist = state->smart_playlists[i];
+		char item_text[256];
+		if (smart_playlist->is_valid)
+		{
+			// The number of songs is only known once the library index is built, which the playlist
+			// only does when a smart playlist is selected
+			if (state->is_library_indexed)
+				StringCbPrintfA(item_text, sizeof(item_text), "%s (%u)", smart_playlist->name.c_str(), smart_playlist->num_members);
+			else
+				StringCbCopyA(item_text, sizeof(item_text), smart_playlist->name.c_str());
+			AppendMenuUtf8(smart_pl_submenu, MF_STRING, IDM_SMART_PLAYLIST_FIRST + i, item_text);
+		}
+		else
+		{
+			StringCbPrintfA(item_text, sizeof(item_text), "%s (%s)", smart_playlist->name.c_str(), smart_playlist->error);
+			AppendMenuUtf8(smart_pl_submenu, MF_STRING | MF_GRAYED, IDM_SMART_PLAYLIST_FIRST + i, item_text);
+		}
+		if (smart_playlist == state->active_smart_playlist)
+			CheckMenuItem(smart_pl_submenu, IDM_SMART_PLAYLIST_FIRST + i, MF_CHECKED);
+	}
+
+	// Grayed out while the songs are being hashed
+	if (state->audio_hash_job)
+		AppendMenu(menu, MF_STRING | MF_GRAYED, IDM_FIND_DUPLICATES, "Find Duplicate Songs");
+	else
+		AppendMenu(menu, MF_STRING, IDM_FIND_DUPLICATES, "Find Duplicate Songs");
+
+	if (PlaylistCount(&state->playlist_view))
+		AppendMenu(menu, MF_STRING, IDM_SAVE_PLAYLIST, "Save Playlist As...");
+	else
+		AppendMenu(menu, MF_STRING | MF_GRAYED, IDM_SAVE_PLAYLIST, "Save Playlist As...");
+
+	AppendMenu(menu, MF_SEPARATOR, 0, 0);
+	AppendMenu(menu, MF_STRING | (UndoHistoryCanUndo(state->history) ? 0 : MF_GRAYED), IDM_UNDO, "Undo\tCtrl+Z");
+	AppendMenu(menu, MF_STRING | (UndoHistoryCanRedo(state->history) ? 0 : MF_GRAYED), IDM_REDO, "Redo\tCtrl+Y");
+
 	AppendMenu(menu, MF_SEPARATOR, 0, 0);
+	AppendMenu(menu, MF_STRING, IDM_MEMORY_STATS, "Memory Statistics...");
 	AppendMenu(menu, MF_STRING, IDM_ABOUT, "About...");
 	AppendMenu(menu, MF_SEPARATOR, 0, 0);
 	AppendMenu(menu, MF_STRING, IDM_EXIT, "Exit");
@@ -837,6 +1176,289 @@ static void SettingsBtnHandler(AppState* state)
 	DestroyMenu(menu);
 }
 
+// Shows only the songs in the smart playlist, or all songs if smart_playlist is NULL
+static void SelectSmartPlaylist(AppState* state, SmartPlaylist* smart_playlist)
+{
+	state->active_smart_playlist = smart_playlist;
+	FilterPlaylist(state);
+	if (!state->is_playlist_visible)
+		TogglePlaylistVisible(state->main_hwnd, &state->is_playlist_visible, true, 
+			state->options.playlist_size, state->controls.btn_playlist, state->options.always_on_top);
+}
+
+// Swaps the lists of the active playlist with the ones kept in tab
+static void SwapPlaylistTab(AppState* state, PlaylistTab* tab)
+{
+	std::swap(state->playlist_view, tab->playlist_view);
+	std::swap(state->playlist, tab->playlist);
+	std::swap(state->shuffle, tab->shuffle);
+	std::swap(state->shuffle_nodes, tab->shuffle_nodes);
+	std::swap(state->history, tab->history);
+}
+
+
+// Shows the playlist at index instead of the active one.  Its songs are already loaded, so nothing is
+// read from disk, and the library index and the search index are only built again once they are used.
+// The song that is playing stays current if the new playlist has it too.
+static void SwitchPlaylist(AppState* state, unsigned int index)
+{
+	if (index == state->active_tab || index >= state->tabs.size())
+		return;
+
+	// The play next queue, the library index, and the songs' play nodes are only for the active playlist
+	PlayQueueClear(&state->play_queue);
+	if (state->is_library_indexed)
+		LibraryIndexClear(state->library);
+	for (PlaylistNode* node = PlaylistFirst(&state->playlist); node; node = PlaylistNext(node))
+		node->song->play_node = NULL;
+	Song* playing_song = state->curr_song;
+	SetCurrentSong(state, NULL);
+	SwapPlaylistTab(state, state->tabs[state->active_tab]);
+	SwapPlaylistTab(state, state->tabs[index]);
+	state->active_tab = index;
+	state->is_search_indexed = false;
+	state->is_library_indexed = false;
+
+	// Songs shared with other playlists may be flagged as duplicates of songs that aren't in this one,
+	// so the flags are set again in the same pass
+	const unsigned int num_songs = PlaylistCount(&state->playlist_view);
+	std::vector<Song*> hashed_songs;
+	for (PlaylistNode* node = PlaylistFirst(&state->playlist_view); node; node = PlaylistNext(node))
+	{
+		node->song->play_node = node->link;
+		if (node->song == playing_song)
+			SetCurrentSong(state, node->link);
+		if (node->song->has_audio_hash)
+			hashed_songs.push_back(node->song);
+		else
+			node->song->is_duplicate = false;
+	}
+	MarkDuplicateHashes(hashed_songs);
+
+	if (!state->options.shuffle)
+	{
+		// The playlist may have been sorted while it was shuffled
+		ResetPlayOrder(state);
+		UndoHistoryPlayFollowsView(state->history);
+		state->shuffle.seed = 0;
+	}
+	else if (state->shuffle.seed == 0)
+	{
+		// Never shuffled yet.  A playlist that was shuffled keeps its order and history, since it
+		// can't be edited while it isn't shown.
+		const int curr_pl_idx = GetPlaylistCurrentIndex(state);
+		NumberShuffleSongs(state);
+		ShuffleReset(&state->shuffle, NewShuffleSeed(), num_songs, (curr_pl_idx >= 0) ? curr_pl_idx : 0);
+	}
+	UpdatePlaylistWindow(state);
+
+	// Show the name of the playlist for 1 second
+	SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)state->tabs[index]->name);
+	SetTimer(state->main_hwnd, TIMER_REVERT_TITLE, 1000, NULL);
+}
+
+
+// Adds an empty playlist, named after the first number that isn't taken, and switches to it
+static void NewPlaylist(AppState* state)
+{
+	PlaylistTab* tab = new PlaylistTab();
+	tab->history = UndoHistoryCreate(UNDO_MEMORY_BUDGET);
+	unsigned int number = state->tabs.size() + 1;
+	bool is_taken = true;
+	while (is_taken)
+	{
+		StringCbPrintfA(tab->name, sizeof(tab->name), "Playlist %u", number++);
+		is_taken = false;
+		for (unsigned int i = 0; i < state->tabs.size(); i++)
+			is_taken |= (lstrcmp(state->tabs[i]->name, tab->name) == 0);
+	}
+	state->tabs.push_back(tab);
+	SwitchPlaylist(state, state->tabs.size() - 1);
+
+	if (!state->is_playlist_visible)
+		TogglePlaylistVisible(state->main_hwnd, &state->is_playlist_visible, true,
+			state->options.playlist_size, state->controls.btn_playlist, state->options.always_on_top);
+}
+
+
+// Deletes the active playlist and switches to the one before it.  Its songs are only freed if no other
+// playlist has them.  The last playlist can't be deleted.
+static void DeletePlaylist(AppState* state)
+{
+	if (state->tabs.size() < 2)
+		return;
+
+	char prompt[32 + PLAYLIST_NAME_MAX];
+	StringCbPrintfA(prompt, sizeof(prompt), "Delete the playlist \"%s\"?", state->tabs[state->active_tab]->name);
+	if (MessageBoxUtf8(state->main_hwnd, prompt, "Delete Playlist", MB_YESNO | MB_ICONQUESTION) != IDYES)
+		return;
+
+	const unsigned int deleted_tab = state->active_tab;
+	std::vector<PlaylistNode*> view_nodes(PlaylistCount(&state->playlist_view));
+	PlaylistGetNodes(&state->playlist_view, view_nodes.data());
+	RemoveSongs(state, view_nodes);
+	SwitchPlaylist(state, (deleted_tab > 0) ? deleted_tab - 1 : 1);
+
+	// The emptied lists and the undo history were put in the deleted playlist's tab by the switch
+	PlaylistTab* tab = state->tabs[deleted_tab];
+	UndoHistoryFree(tab->history);
+	delete tab;
+	state->tabs.erase(state->tabs.begin() + deleted_tab);
+	if (state->active_tab > deleted_tab)
+		state->active_tab--;
+}
+
+
+// Sorts playlist_view by a field.  Sorting by the same field again reverses the order.  Each field is
+// followed by the others that tell songs apart, in the order a person would use to break the tie:
+//		Artist:		artist, album, disc, track, title
+//		Album:		album, disc, track, artist, title
+//		Track:		disc, track, artist, album, title
+//		Title:		title, artist, album
+//		Length:		length, artist, title
+// The file name breaks any tie left.
+static void SortPlaylist(AppState* state, PlaylistSortType sort_type)
+{
+	if (state->sort_type == sort_type)
+	{
+		state->sort_descending = !state->sort_descending;
+	}
+	else
+	{
+		state->sort_type = sort_type;
+		state->sort_descending = false;
+	}
+
+	// Build all the sort keys up front, so each comparison is a single memcmp()
+	const unsigned int num_songs = PlaylistCount(&state->playlist_view);
+	std::vector<PlaylistNode*> nodes(num_songs);
+	PlaylistGetNodes(&state->playlist_view, nodes.data());
+	CollationKeys keys;
+	CollationKeysBegin(&keys, num_songs);
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		const Song* song = nodes[i]->song;
+		const AudioFileMetadata* metadata = &SongGetDetails(song)->metadata;
+		// Songs without tags are usually named "Artist - Title.mp3", so the file name is the 
+		// best substitute for the artist and the title
+		const char* artist = metadata->artist ? metadata->artist : song->file_name;
+		const char* title = metadata->title ? metadata->title : song->file_name;
+		const unsigned int disc = ParseTagNumber(metadata->disc_num);
+		const unsigned int track = ParseTagNumber(metadata->track_num);
+		CollationKeysNext(&keys);
+		switch (sort_type)
+		{
+			case SORT_BY_ALBUM:
+				AppendCollationText(&keys, metadata->album);
+				AppendCollationNumber(&keys, disc);
+				AppendCollationNumber(&keys, track);
+				AppendCollationText(&keys, artist);
+				AppendCollationText(&keys, title);
+				break;
+			case SORT_BY_TRACK:
+				AppendCollationNumber(&keys, disc);
+				AppendCollationNumber(&keys, track);
+				AppendCollationText(&keys, artist);
+				AppendCollationText(&keys, metadata->album);
+				AppendCollationText(&keys, title);
+				break;
+			case SORT_BY_TITLE:
+				AppendCollationText(&keys, title);
+				AppendCollationText(&keys, artist);
+				AppendCollationText(&keys, metadata->album);
+				break;
+			case SORT_BY_LENGTH:
+				AppendCollationNumber(&keys, song->song_length_secs);
+				AppendCollationText(&keys, artist);
+				AppendCollationText(&keys, title);
+				break;
+			default:
+				AppendCollationText(&keys, artist);
+				AppendCollationText(&keys, metadata->album);
+				AppendCollationNumber(&keys, disc);
+				AppendCollationNumber(&keys, track);
+				AppendCollationText(&keys, title);
+				break;
+		}
+		AppendCollationText(&keys, song->file_name);
+	}
+	CollationKeysEnd(&keys);
+
+	std::vector<unsigned int> order(num_songs);
+	for (unsigned int i = 0; i < num_songs; i++)
+		order[i] = i;
+	SortByCollationKeys(&keys, state->sort_descending, order);
+
+	std::vector<PlaylistNode*> sorted_nodes(num_songs);
+	std::vector<Song*> sorted_songs(num_songs);
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		sorted_nodes[i] = nodes[order[i]];
+		sorted_songs[i] = sorted_nodes[i]->song;
+	}
+	PlaylistRebuild(&state->playlist_view, sorted_nodes.data(), num_songs);
+	if (state->is_search_indexed)
+		FuzzyMatcherReorder(state->search, order.data(), num_songs);
+
+	// If shuffle is on, the play order stays shuffled
+	if (!state->options.shuffle)
+		ResetPlayOrder(state);
+
+	// Every position may have changed, so this version doesn't share anything with the last one
+	UndoHistoryBeginEdit(state->history);
+	UndoHistoryAssign(state->history, UNDO_VIEW, sorted_songs.data(), num_songs);
+	EndPlaylistEdit(state);
+
+	UpdatePlaylistWindow(state);
+	SetPlaylistSortArrow(state->controls.playlist_hwnd, (sort_type == SORT_BY_LENGTH) ? PL_COL_LENGTH : PL_COL_SONG, 
+		state->sort_descending);
+	const int curr_row = GetPlaylistViewIndexRow(state, GetPlaylistViewCurrentIndex(state));
+	if (curr_row >= 0)
+		ListView_EnsureVisible(state->controls.playlist_hwnd, curr_row, FALSE);
+}
+
+
+// The "Song" column shows several fields, so clicking its header asks which one to sort by.  The menu
+// is shown under the header, and the choice comes back as WM_COMMAND.
+static void ShowSongSortMenu(AppState* state)
+{
+	HWND header_hwnd = ListView_GetHeader(state->controls.playlist_hwnd);
+	RECT header_rect;
+	Header_GetItemRect(header_hwnd, PL_COL_SONG, &header_rect);
+	MapWindowPoints(header_hwnd, HWND_DESKTOP, (POINT*)&header_rect, 2);
+
+	HMENU menu = CreatePopupMenu();
+	AppendMenu(menu, MF_STRING, IDM_SORT_BY_ARTIST, "Sort by Artist");
+	AppendMenu(menu, MF_STRING, IDM_SORT_BY_ALBUM, "Sort by Album");
+	AppendMenu(menu, MF_STRING, IDM_SORT_BY_TRACK, "Sort by Track Number");
+	AppendMenu(menu, MF_STRING, IDM_SORT_BY_TITLE, "Sort by Title");
+	if (state->sort_type >= SORT_BY_ARTIST && state->sort_type <= SORT_BY_TITLE)
+	{
+		CheckMenuRadioItem(menu, IDM_SORT_BY_ARTIST, IDM_SORT_BY_TITLE, 
+			IDM_SORT_BY_ARTIST + state->sort_type - SORT_BY_ARTIST, MF_BYCOMMAND);
+	}
+	TrackPopupMenu(menu, TPM_LEFTBUTTON, header_rect.left, header_rect.bottom, 0, state->main_hwnd, 0);
+	DestroyMenu(menu);
+}
+
+
+// Shows the sort direction arrow in the header of the sorted column, and removes it from the others
+static void SetPlaylistSortArrow(HWND playlist_hwnd, int column, bool descending)
+{
+	HWND header_hwnd = ListView_GetHeader(playlist_hwnd);
+	for (int col = PL_COL_SONG; col <= PL_COL_LENGTH; col++)
+	{
+		HDITEM header_item = {};
+		header_item.mask = HDI_FORMAT;
+		Header_GetItem(header_hwnd, col, &header_item);
+		header_item.fmt &= ~(HDF_SORTUP | HDF_SORTDOWN);
+		if (col == column)
+			header_item.fmt |= descending ? HDF_SORTDOWN : HDF_SORTUP;
+		Header_SetItem(header_hwnd, col, &header_item);
+	}
+}
+
+
 static void ResetPositionTrackbar(HWND tb_pos, int min, int max, int pos)
 {
 	SendMessage(tb_pos, WP_TBM_SETMIN, 0, min);
@@ -870,117 +1492,428 @@ static void ResizePlaylist(int playlist_size, HWND main_hwnd, ControlHandles* co
 	SetWindowPos(controls->btn_delete, 0, 25, win_height_pl - 25, 0, 0, SWP_NOSIZE);
 	SetWindowPos(controls->btn_move_up, 0, 65, win_height_pl - 25, 0, 0, SWP_NOSIZE);
 	SetWindowPos(controls->btn_move_down, 0, 85, win_height_pl - 25, 0, 0, SWP_NOSIZE);
+	SetWindowPos(controls->txt_search, 0, 115, win_height_pl - 23, 0, 0, SWP_NOSIZE);
 	SetWindowPos(controls->lbl_pl_info, 0, 265, win_height_pl - 25, 0, 0, SWP_NOSIZE);
 }
 
 
-// Free heap memory associated with the Song object
-static void FreeSong(Song* song)
+// Shows how much heap memory each subsystem is using, followed by the song memory the budget keeps track of
+static void ShowMemoryStats(AppState* state)
 {
-	if (song == NULL)
-		return;
-	
-	FreeMemory(song->metadata.title);
-	FreeMemory(song->metadata.artist);
-	FreeMemory(song->metadata.album);
-	FreeMemory(song->metadata.genre);
-	FreeMemory(song->metadata.track_num);
-	FreeMemory(song->metadata.date);
-	FreeMemory(song->metadata.comment_description);
-	if (song->metadata.album_art)
+	char text[ALLOC_STATS_TEXT_SIZE * 2];
+	FormatAllocStats(text, sizeof(text));
+
+	MemoryCategoryStats budget_stats[MEM_NUM_CATEGORIES];
+	MemoryBudgetGetStats(budget_stats);
+	StringCbCatA(text, sizeof(text), "\r\nSong memory     KB   Peak KB   Entries   Evicted\r\n");
+	for (int i = 0; i < MEM_NUM_CATEGORIES; i++)
 	{
-		FreeMemory(song->metadata.album_art->data);
-		FreeMemory(song->metadata.album_art);
+		char line[128];
+		StringCbPrintfA(line, sizeof(line), "%-12s %8llu  %8llu  %8u  %8u\r\n", MemoryCategoryName((MemoryCategory)i),
+			budget_stats[i].bytes / 1024, budget_stats[i].peak_bytes / 1024, budget_stats[i].entries,
+			budget_stats[i].evictions);
+		StringCbCatA(text, sizeof(text), line);
 	}
-	if (song->playlist_song_name != NULL && song->playlist_song_name != song->file_name)
-	{
-		// If playlist_song_name == file_name when there is no metadata for the file
-		// Must check to avoid a double free bug
-		FreeMemory(song->playlist_song_name);
-	}	
-	FreeMemory(song->file_name);
-	FreeMemory(song->path);
-	FreeMemory(song);
+	MessageBox(state->main_hwnd, text, "Memory Statistics", MB_OK | MB_ICONINFORMATION);
 }
 
-// Delete a song from the playlist vectors and from the playlist window
-static void DeleteSongFromPlaylist(AppState* state, int pl_view_idx_to_del)
+
+// Hashes the audio of every song that hasn't been hashed yet on a background thread.  When the
+// job finishes, AudioHashDoneHandler() flags the duplicates.
+static void FindDuplicateSongs(AppState* state)
 {
-	const int curr_pl_view_idx = GetPlaylistCurrentIndex(state->playlist_view);
+	if (state->audio_hash_job)
+		return;
+
+	std::vector<Song*> songs_to_hash;
+	for (PlaylistNode* node = PlaylistFirst(&state->playlist_view); node; node = PlaylistNext(node))
+	{
+		Song* song = node->song;
+		if (song->is_valid && !song->has_audio_hash)
+			songs_to_hash.push_back(song);
+	}
 
-	// If sel_idx == curr_pl_view_idx, then user just deleted the current song
-	if (pl_view_idx_to_del == curr_pl_view_idx)
+	if (songs_to_hash.size())
+		state->audio_hash_job = AudioHashJobStart(songs_to_hash.data(), (unsigned int)songs_to_hash.size(), 
+			state->main_hwnd, WM_AUDIO_HASH_DONE);
+	if (state->audio_hash_job)
 	{
-		state->curr_song = NULL;
+		SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)"Finding duplicate songs...");
+		KillTimer(state->main_hwnd, TIMER_REVERT_TITLE);
 	}
-	Song* song_to_del = state->playlist_view[pl_view_idx_to_del];
-	FreeSong(song_to_del);		// Clean up the song before deleting
-	state->playlist_view.erase(state->playlist_view.begin() + pl_view_idx_to_del);
-	int pl_idx_to_del = -1;
-	for (pl_idx_to_del = 0; pl_idx_to_del < (int) state->playlist.size(); pl_idx_to_del++)
+	else
 	{
-		if (state->playlist[pl_idx_to_del] == song_to_del)
-			state->playlist.erase(state->playlist.begin() + pl_idx_to_del);
+		// Everything was already hashed
+		AudioHashDoneHandler(state, NULL);
 	}
-	UpdatePlaylistWindow(state->controls.playlist_hwnd, state->playlist_view, state->controls.lbl_pl_info);
 }
 
 
-// Update the text labels on main window with song title, artist, album, and album art
-static void UpdateInfoLabels(AppState* state, bool display_song_len)
+// Copies the hashes from the finished job to the songs, then flags the duplicates
+static void AudioHashDoneHandler(AppState* state, AudioHashJob* job)
 {
-	// Title
-	if (state->curr_song->metadata.title)
-		SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)state->curr_song->metadata.title);
-	else
-		// No title found in ID3v2 tag.  Use the file name as the title.
-		SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)state->curr_song->file_name);
+	if (job)
+	{
+		// Songs may have been deleted while the job was running, so match the results by path
+		std::unordered_map<std::string, unsigned long long> hashes;
+		for (unsigned int i = 0; i < job->num_songs; i++)
+		{
+			if (job->is_hashed[i])
+				hashes[job->paths[i]] = job->hashes[i];
+		}
+		for (PlaylistNode* node = PlaylistFirst(&state->playlist_view); node; node = PlaylistNext(node))
+		{
+			Song* song = node->song;
+			char path[UTF8_MAX_PATH];
+			if (!SongGetPath(song, path, UTF8_MAX_PATH))
+				continue;
+			auto it = hashes.find(path);
+			if (it != hashes.end())
+			{
+				song->audio_hash = it->second;
+				song->has_audio_hash = true;
+			}
+		}
+		if (job == state->audio_hash_job)
+			state->audio_hash_job = NULL;
+		AudioHashJobFree(job);
+	}
+
+	const unsigned int num_duplicates = MarkDuplicateSongs(&state->playlist_view);
+	char title_text[64];
+	if (num_duplicates == 1)
+		StringCbPrintfA(title_text, sizeof(title_text), "1 duplicate song found");
+	else
+		StringCbPrintfA(title_text, sizeof(title_text), "%u duplicate songs found", num_duplicates);
+	SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)title_text);
+	// Use timer to revert to the previous title after 1 second (1000 ms)
+	SetTimer(state->main_hwnd, TIMER_REVERT_TITLE, 1000, NULL);
+	InvalidateRect(state->controls.playlist_hwnd, NULL, TRUE);
+}
+
+
+// Flags every hashed song whose audio_hash is shared with another song.  Returns the number flagged.
+static unsigned int MarkDuplicateSongs(const Playlist* playlist_view)
+{
+	std::vector<Song*> hashed_songs;
+	for (PlaylistNode* node = PlaylistFirst(playlist_view); node; node = PlaylistNext(node))
+	{
+		if (node->song->has_audio_hash)
+			hashed_songs.push_back(node->song);
+		else
+			node->song->is_duplicate = false;
+	}
+	return MarkDuplicateHashes(hashed_songs);
+}
+
+
+// Flags each of hashed_songs whose audio_hash is shared with another of them.  Returns the number flagged.
+// Only the songs that were hashed are looked at again, so the playlist is walked once.
+static unsigned int MarkDuplicateHashes(const std::vector<Song*>& hashed_songs)
+{
+	std::unordered_map<unsigned long long, unsigned int> hash_counts;
+	hash_counts.reserve(hashed_songs.size());
+	for (const Song* song : hashed_songs)
+		hash_counts[song->audio_hash]++;
+
+	unsigned int num_duplicates = 0;
+	for (Song* song : hashed_songs)
+	{
+		song->is_duplicate = hash_counts[song->audio_hash] > 1;
+		if (song->is_duplicate)
+			num_duplicates++;
+	}
+	return num_duplicates;
+}
+
+
+// Adds the selected songs to the end of the play next queue, in the order they are shown.  If 
+// remove is true, takes them out of the queue instead.
+static void QueueSelectedSongs(AppState* state, bool remove)
+{
+	HWND playlist_hwnd = state->controls.playlist_hwnd;
+	for (int row = SendMessage(playlist_hwnd, LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED); row >= 0;
+		row = SendMessage(playlist_hwnd, LVM_GETNEXTITEM, (WPARAM)row, LVNI_SELECTED))
+	{
+		const int pl_view_idx = GetPlaylistRowViewIndex(state, row);
+		if (pl_view_idx < 0)
+			continue;
+		PlaylistNode* view_node = PlaylistNodeAt(&state->playlist_view, pl_view_idx);
+		if (remove)
+		{
+			while (view_node->link->queue_entries)
+				PlayQueueRemove(&state->play_queue, view_node->link->queue_entries);
+		}
+		else
+		{
+			PlayQueuePush(&state->play_queue, view_node->link);
+		}
+	}
+	// Queued songs are drawn in a different color
+	RedrawPlaylistWindow(playlist_hwnd, GetPlaylistRowCount(state));
+}
+
+
+// Takes the songs of view_nodes out of both playlists, the library index and the play next queue.
+// The songs are released rather than freed, since versions in the undo history may still have them.
+// The caller resizes the shuffle order and updates the playlist window.
+static void RemoveSongs(AppState* state, std::vector<PlaylistNode*>& view_nodes)
+{
+	std::vector<PlaylistNode*> nodes_to_del(view_nodes.size());
+	std::vector<Song*> songs_to_del(view_nodes.size());
+	bool was_duplicate = false;
+	for (unsigned int i = 0; i < view_nodes.size(); i++)
+	{
+		nodes_to_del[i] = view_nodes[i]->link;
+		songs_to_del[i] = view_nodes[i]->song;
+		// User just deleted the current song
+		if (nodes_to_del[i] == state->curr_node)
+			SetCurrentSong(state, NULL);
+		was_duplicate |= songs_to_del[i]->is_duplicate;
+		LibraryIndexRemove(GetBuiltLibraryIndex(state), songs_to_del[i]);
+		PlayQueueSongDeleted(&state->play_queue, nodes_to_del[i]);
+		songs_to_del[i]->play_node = NULL;
+		if (state->shuffle.seed != 0)
+		{
+			ShuffleDelete(&state->shuffle, nodes_to_del[i]->shuffle_ordinal);
+			state->shuffle_nodes[nodes_to_del[i]->shuffle_ordinal] = NULL;
+		}
+	}
+	if (state->is_search_indexed)
+	{
+		std::vector<unsigned int> indexes(view_nodes.size());
+		for (unsigned int i = 0; i < view_nodes.size(); i++)
+			indexes[i] = PlaylistIndexOf(view_nodes[i]);
+		std::sort(indexes.begin(), indexes.end());
+		FuzzyMatcherRemove(state->search, indexes.data(), indexes.size());
+	}
+	PlaylistDeleteNodes(&state->playlist_view, view_nodes.data(), view_nodes.size());
+	PlaylistDeleteNodes(&state->playlist, nodes_to_del.data(), nodes_to_del.size());
+	// Clean up the songs after the nodes are gone
+	for (Song* song : songs_to_del)
+		SongRelease(song);
+
+	// The other copies may not be duplicates anymore
+	if (was_duplicate)
+		MarkDuplicateSongs(&state->playlist_view);
+}
+
+
+// Finishes the version of the playlist started with UndoHistoryBeginEdit().  Call it after both
+// playlists are edited.
+static void EndPlaylistEdit(AppState* state)
+{
+	// With shuffle off, playlist is always in the same order as playlist_view
+	if (!state->options.shuffle)
+		UndoHistoryPlayFollowsView(state->history);
+	UndoHistoryEndEdit(state->history);
+}
+
+
+// Makes both playlists match a version from the undo history.  Songs that are still in the playlist
+// keep their nodes, so the current song and the play next queue aren't disturbed.  Songs that aren't
+// in the version are removed, and songs that were deleted since are put back.
+static void RestorePlaylistVersion(AppState* state, const PlaylistVersion* version)
+{
+	const unsigned int num_songs = SeqCount(version->view);
+	std::vector<Song*> view_songs(num_songs);
+	SeqGetSongs(version->view, view_songs.data());
+
+	// Each song is in the playlist once, so its node can be found by the Song pointer
+	std::unordered_map<Song*, PlaylistNode*> view_nodes;
+	view_nodes.reserve(PlaylistCount(&state->playlist_view));
+	for (PlaylistNode* node = PlaylistFirst(&state->playlist_view); node; node = PlaylistNext(node))
+		view_nodes[node->song] = node;
+
+	std::vector<PlaylistNode*> new_view_order(num_songs);
+	std::vector<Song*> returning_songs;
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		auto it = view_nodes.find(view_songs[i]);
+		if (it != view_nodes.end())
+		{
+			new_view_order[i] = it->second;
+			view_nodes.erase(it);
+		}
+		else
+		{
+			new_view_order[i] = NULL;
+			returning_songs.push_back(view_songs[i]);
+		}
+	}
+
+	// The nodes that are left are songs the version doesn't have
+	if (view_nodes.size())
+	{
+		std::vector<PlaylistNode*> removed_nodes;
+		removed_nodes.reserve(view_nodes.size());
+		for (auto& entry : view_nodes)
+			removed_nodes.push_back(entry.second);
+		RemoveSongs(state, removed_nodes);
+	}
+
+	if (returning_songs.size())
+	{
+		// The songs are added to the end, in the same order as the empty places they fill
+		AddSongsToPlaylist(state, returning_songs);
+		PlaylistNode* node = PlaylistNodeAt(&state->playlist_view, PlaylistCount(&state->playlist_view) - returning_songs.size());
+		for (unsigned int i = 0; i < num_songs; i++)
+		{
+			if (new_view_order[i] == NULL)
+			{
+				LibraryIndexUpdate(GetBuiltLibraryIndex(state), node->song);
+				new_view_order[i] = node;
+				node = PlaylistNext(node);
+			}
+		}
+	}
+	if (state->is_search_indexed)
+	{
+		std::vector<unsigned int> old_indexes(num_songs);
+		for (unsigned int i = 0; i < num_songs; i++)
+			old_indexes[i] = PlaylistIndexOf(new_view_order[i]);
+		FuzzyMatcherReorder(state->search, old_indexes.data(), num_songs);
+	}
+	PlaylistRebuild(&state->playlist_view, new_view_order.data(), num_songs);
+
+	if (state->options.shuffle && version->play != version->view)
+	{
+		// The view was sorted or moved while shuffle was on
+		std::unordered_map<Song*, PlaylistNode*> nodes;
+		nodes.reserve(num_songs);
+		for (unsigned int i = 0; i < num_songs; i++)
+			nodes[new_view_order[i]->song] = new_view_order[i]->link;
+		std::vector<Song*> play_songs(num_songs);
+		SeqGetSongs(version->play, play_songs.data());
+		std::vector<PlaylistNode*> play_order(num_songs);
+		for (unsigned int i = 0; i < num_songs; i++)
+			play_order[i] = nodes[play_songs[i]];
+		PlaylistRebuild(&state->playlist, play_order.data(), num_songs);
+	}
+	else
+	{
+		ResetPlayOrder(state);
+		if (!state->options.shuffle)
+			UndoHistoryPlayFollowsView(state->history);
+	}
+
+	// Shuffle stays on or off.  The songs that were removed or put back have already left or
+	// joined the shuffle order, and the others keep their places in it.
+	MarkDuplicateSongs(&state->playlist_view);
+	UpdatePlaylistWindow(state);
+}
+
+
+// Goes back to the version of the playlist before the last edit, or forward again if redo is true
+static void UndoPlaylistEdit(AppState* state, bool redo)
+{
+	const PlaylistVersion* version = redo ? UndoHistoryRedo(state->history) : UndoHistoryUndo(state->history);
+	if (version)
+		RestorePlaylistVersion(state, version);
+}
+
+
+// Delete all of the selected songs from the playlists and from the playlist window.  Both trees are
+// compacted in one pass and the ListView item count is only changed once, so deleting thousands of
+// songs isn't any slower than deleting one.
+static void DeleteSelectedSongs(AppState* state)
+{
+	HWND playlist_hwnd = state->controls.playlist_hwnd;
+	std::vector<PlaylistNode*> view_nodes_to_del;
+	view_nodes_to_del.reserve(SendMessage(playlist_hwnd, LVM_GETSELECTEDCOUNT, 0, 0));
+	for (int row = SendMessage(playlist_hwnd, LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED); row >= 0;
+		row = SendMessage(playlist_hwnd, LVM_GETNEXTITEM, (WPARAM)row, LVNI_SELECTED))
+	{
+		const int pl_view_idx = GetPlaylistRowViewIndex(state, row);
+		if (pl_view_idx >= 0)
+			view_nodes_to_del.push_back(PlaylistNodeAt(&state->playlist_view, pl_view_idx));
+	}
+	if (view_nodes_to_del.empty())
+		return;
+
+	// Record the edit while the nodes still have their indexes
+	UndoHistoryBeginEdit(state->history);
+	std::vector<unsigned int> indexes(view_nodes_to_del.size());
+	for (unsigned int i = 0; i < view_nodes_to_del.size(); i++)
+		indexes[i] = PlaylistIndexOf(view_nodes_to_del[i]);
+	std::sort(indexes.begin(), indexes.end());
+	UndoHistoryDelete(state->history, UNDO_VIEW, indexes.data(), indexes.size());
+	if (state->options.shuffle)
+	{
+		for (unsigned int i = 0; i < view_nodes_to_del.size(); i++)
+			indexes[i] = PlaylistIndexOf(view_nodes_to_del[i]->link);
+		std::sort(indexes.begin(), indexes.end());
+		UndoHistoryDelete(state->history, UNDO_PLAY, indexes.data(), indexes.size());
+	}
+
+	RemoveSongs(state, view_nodes_to_del);
+	EndPlaylistEdit(state);
+	UpdatePlaylistWindow(state);
+}
+
+
+// Update the text labels on main window with song title, artist, album, and album art
+static void UpdateInfoLabels(AppState* state, bool display_song_len)
+{
+	const SongDetails* details = SongGetDetails(state->curr_song);
+
+	// Title
+	if (details->metadata.title)
+		SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)details->metadata.title);
+	else
+		// No title found in ID3v2 tag.  Use the file name as the title.
+		SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)state->curr_song->file_name);
 	
 	// Artist
-	if (state->curr_song->metadata.artist)
-		SendMessage(state->controls.lbl_artist, WM_SETTEXT, 0, (LPARAM)state->curr_song->metadata.artist);
+	if (details->metadata.artist)
+		SendMessage(state->controls.lbl_artist, WM_SETTEXT, 0, (LPARAM)details->metadata.artist);
 	else
 		SendMessage(state->controls.lbl_artist, WM_SETTEXT, 0, 0);		// Blank
 
 	// Album
-	if (state->curr_song->metadata.album)
-		SendMessage(state->controls.lbl_album, WM_SETTEXT, 0, (LPARAM)state->curr_song->metadata.album);
+	if (details->metadata.album)
+		SendMessage(state->controls.lbl_album, WM_SETTEXT, 0, (LPARAM)details->metadata.album);
 	else
 		SendMessage(state->controls.lbl_album, WM_SETTEXT, 0, 0);		// Blank
 		
 	// Album art
-	if (state->curr_song->metadata.album_art)
-		SendMessage(state->controls.lbl_album_art, WP_LM_SETIMAGE_FROM_BUFFER, (WPARAM)state->curr_song->metadata.album_art->data, (LPARAM)state->curr_song->metadata.album_art->size);
+	MemoryBudgetTouch(state->curr_song, MEM_ALBUM_ART);
+	if (details->metadata.album_art)
+		SendMessage(state->controls.lbl_album_art, WP_LM_SETIMAGE_FROM_BUFFER, (WPARAM)details->metadata.album_art->data, (LPARAM)details->metadata.album_art->size);
 	else
 		SendMessage(state->controls.lbl_album_art, WP_LM_CLEARIMAGE, 0, 0);
 
 	// Create the file info text
 	char file_info[48] = {};
-	if (state->curr_song->is_stereo)
+	if (details->is_stereo)
 	{
 		if (state->curr_song->format == MP3)
-			StringCbPrintfA(file_info, 48, "MP3, %u kbps, %u kHz, Stereo", state->curr_song->bitrate, 
-				state->curr_song->frequency);
+			StringCbPrintfA(file_info, 48, "MP3, %u kbps, %u kHz, Stereo", details->bitrate, 
+				details->frequency);
 		else if (state->curr_song->format == OGG)
-			StringCbPrintfA(file_info, 48, "OGG, %u kbps, %u kHz, Stereo", state->curr_song->bitrate, 
-				state->curr_song->frequency);
+			StringCbPrintfA(file_info, 48, "OGG, %u kbps, %u kHz, Stereo", details->bitrate, 
+				details->frequency);
 	}
 	else
 	{
 		if (state->curr_song->format == MP3)
-			StringCbPrintfA(file_info, 48, "MP3, %u kbps, %u kHz, Mono", state->curr_song->bitrate, 
-				state->curr_song->frequency);
+			StringCbPrintfA(file_info, 48, "MP3, %u kbps, %u kHz, Mono", details->bitrate, 
+				details->frequency);
 		else if (state->curr_song->format == OGG)
-			StringCbPrintfA(file_info, 48, "OGG, %u kbps, %u kHz, Mono", state->curr_song->bitrate, 
-				state->curr_song->frequency);
+			StringCbPrintfA(file_info, 48, "OGG, %u kbps, %u kHz, Mono", details->bitrate, 
+				details->frequency);
 	}
 	SendMessage(state->controls.lbl_file_info, WM_SETTEXT, 0, (LPARAM)&file_info);
 
 	if (display_song_len)
-		SendMessage(state->controls.lbl_time_length, WM_SETTEXT, 0, (LPARAM)state->curr_song->song_length_str);
+	{
+		char song_length[16];
+		SongFormatLength(state->curr_song, song_length, sizeof(song_length));
+		SendMessage(state->controls.lbl_time_length, WM_SETTEXT, 0, (LPARAM)song_length);
+	}
 
 	// Set the window caption to the current song (shown in Windows task bar)
-	SetWindowText(state->main_hwnd, state->curr_song->playlist_song_name);
+	SetWindowTextUtf8(state->main_hwnd, state->curr_song->playlist_song_name);
 }
 
 // Shows/hides the playlist portion of the main window
@@ -1012,26 +1945,38 @@ static void TogglePlaylistVisible(HWND hwnd, bool* is_playlist_visible, bool tog
 	}
 }
 
+// Opens a BASS stream for the song's file.  BASS is given the UTF-16 path, so any file name can be opened.
+static HSTREAM CreateSongStream(const Song* song, DWORD flags)
+{
+	char path[UTF8_MAX_PATH];
+	WCHAR wide_path[MAX_PATH];
+	if (!SongGetPath(song, path, UTF8_MAX_PATH))
+		return 0;
+	Utf8ToUtf16(path, lstrlen(path), wide_path, MAX_PATH);
+	return BASS_StreamCreateFile(false, wide_path, 0, 0, flags | BASS_UNICODE);
+}
+
+
 // Gets the song metadata, song length, bitrate, frequency, and stereo and stores them in the Song struct
-static void GetSongInfo(Song* song)
+static void GetSongInfo(Song* song, MetadataArena* arena)
 {
 	if (song->has_info)
 		// This song already has ID3v2 and format info.  This happens when we add additional songs
 		// to the playlist_view using the "Add" button.  No need to do any work.
 		return;
 
-	const HSTREAM temp_stream = BASS_StreamCreateFile(false, song->path, 0, 0, 0);	// Create temporary BASS stream
+	const HSTREAM temp_stream = CreateSongStream(song, 0);	// Create temporary BASS stream
 	if (temp_stream)
 	{
 		// Get song length
-		song->song_length_bytes = BASS_ChannelGetLength(temp_stream, BASS_POS_BYTE);
-		song->song_length_secs = (int)BASS_ChannelBytes2Seconds(temp_stream, song->song_length_bytes);
-		StringCbPrintfA(song->song_length_str, 8, "%u:%02u", song->song_length_secs / 60, song->song_length_secs % 60);
+		SongDetails details = {};
+		details.song_length_bytes = BASS_ChannelGetLength(temp_stream, BASS_POS_BYTE);
+		song->song_length_secs = (int)BASS_ChannelBytes2Seconds(temp_stream, details.song_length_bytes);
 					
 		const char* ext = GetFilenameExt(song->file_name);	// Get the file extension to determine if it is MP3 or OGG
 
 		// Get metadata (ID3v2 for MP3, comments for OGG)
-		song->metadata = {};
+		AudioFileMetadata* metadata = &details.metadata;
 		if (!lstrcmpi(ext, "mp3"))
 		{
 			song->format = MP3;
@@ -1039,8 +1984,9 @@ static void GetSongInfo(Song* song)
 			const char* id3v2_buffer = BASS_ChannelGetTags(temp_stream, BASS_TAG_ID3V2);
 			if (id3v2_buffer)
 			{
-				ParseID3v2(id3v2_buffer, &song->metadata);
+				ParseID3v2(id3v2_buffer, metadata, arena);
 			}
+			GetMp3GaplessInfo(song, temp_stream, id3v2_buffer, &details.gapless);
 		}
 		else if (!lstrcmpi(ext, "ogg"))
 		{
@@ -1048,58 +1994,44 @@ static void GetSongInfo(Song* song)
 			const char* ogg_comments_buffer = BASS_ChannelGetTags(temp_stream, BASS_TAG_OGG);
 			if (ogg_comments_buffer)
 			{
-				ParseOggComments(ogg_comments_buffer, &song->metadata);
+				ParseOggComments(ogg_comments_buffer, metadata, arena);
 			}
 		}
 
 		// Construct the playlist text in this format:  Artist - SongTitle
-		// Sometimes artist metadata is ridiciculously long, so truncate artist after 30 chars.
-		if (song->metadata.artist && song->metadata.title)
-		{
-			const int max_artist_len = 30;
-			const int artist_len = lstrlen(song->metadata.artist);
-			if (artist_len < max_artist_len)
-			{
-				const size_t buf_len = artist_len + lstrlen(song->metadata.title) + 4;
-				song->playlist_song_name = (char*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, buf_len);
-				StringCbPrintfA(song->playlist_song_name, buf_len, "%s - %s", song->metadata.artist, song->metadata.title);
-			}
-			else
-			{
-				// Truncate the artist
-				// Ex:
-				//		Before: Miles Kane, Zach Dawes, Loren Shane Humphrey, Tyler Parkford - Cry On My Guitar
-				//		After:  Miles Kane, Zach Dawes, Loren ... - Cry On My Guitar
-				const size_t buf_len = max_artist_len + lstrlen(song->metadata.title) + 7;
-				song->playlist_song_name = (char*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, buf_len);
-				StringCbPrintfA(song->playlist_song_name, buf_len, "%.30s... - %s", song->metadata.artist, song->metadata.title);
-			}
-		}
-		else
-		{
-			// No metadata.  Use the file name as the playlist text
-			song->playlist_song_name = song->file_name;
-		}
+		// With no metadata, the file name is used as the playlist text.
+		const char* playlist_song_name = SongMakePlaylistName(metadata, arena);
 
 		// Get bitrate.
 		// Valid bitrates for MP3 = 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320.
 		float bitrate = 0;
 		BASS_ChannelGetAttribute(temp_stream, BASS_ATTRIB_BITRATE, &bitrate);
-		song->bitrate = (int) round(bitrate);
+		details.bitrate = (int) round(bitrate);
 		
 		// Get frequency (e.g. 44.1 kHz)
 		float freq = 0;
 		BASS_ChannelGetAttribute(temp_stream, BASS_ATTRIB_FREQ, &freq);
-		song->frequency = (int) freq / 1000;	// Divide by 1000 to convert Hz to kHz (e.g. 44100 -> 44.1)
+		details.frequency = (int) freq / 1000;	// Divide by 1000 to convert Hz to kHz (e.g. 44100 -> 44.1)
 
 		// Get mono/stereo information
 		BASS_CHANNELINFO channel_info;
 		BASS_ChannelGetInfo(temp_stream, &channel_info);
-		song->is_stereo = (channel_info.chans > 1) ? true : false;
+		details.is_stereo = (channel_info.chans > 1) ? true : false;
 		
 		BASS_StreamFree(temp_stream);
-		song->has_info = true;
 		song->is_valid = true;
+		song->has_info = SongSetDetails(song, &details, playlist_song_name, false);
+		if (!song->has_info)
+		{
+			// Out of memory.  The song can still be played.
+			song->playlist_song_name = song->file_name;
+			if (metadata->album_art)
+			{
+				FreeMemory(metadata->album_art->data);
+				FreeMemory(metadata->album_art);
+			}
+		}
+		MetadataArenaReset(arena);
 	}
 	else
 	{
@@ -1111,6 +2043,136 @@ static void GetSongInfo(Song* song)
 }
 
 
+// Finds how much of the start and end of an MP3 is encoder delay and padding, so the player can trim it.
+// The LAME tag at the start of the audio is exact, so it comes first.  iTunes' comment is the fallback.
+static void GetMp3GaplessInfo(const Song* song, HSTREAM stream, const char* id3v2_buffer, GaplessInfo* gapless)
+{
+	char path[UTF8_MAX_PATH];
+	const QWORD audio_start = BASS_StreamGetFilePosition(stream, BASS_FILEPOS_START);
+	if (audio_start != (QWORD)-1 && SongGetPath(song, path, UTF8_MAX_PATH))
+	{
+		HANDLE file = CreateFileUtf8(path, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL);
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			unsigned char header[MP3_GAPLESS_HEADER_LEN];
+			LARGE_INTEGER offset;
+			offset.QuadPart = (LONGLONG)audio_start;
+			DWORD bytes_read = 0;
+			const bool is_read = SetFilePointerEx(file, offset, NULL, FILE_BEGIN) &&
+				ReadFile(file, header, sizeof(header), &bytes_read, NULL);
+			CloseHandle(file);
+			if (is_read && ParseLameHeader(header, bytes_read, gapless))
+				return;
+		}
+	}
+	if (id3v2_buffer)
+		ID3v2_GetITunesGapless(id3v2_buffer, gapless);
+}
+
+
+// Opens a decoder for the player.  If the song's encoder delay and padding are known, BASS is told not
+// to remove them itself, since the player trims exactly that much.
+static HSTREAM CreateSongDecoder(const Song* song, const GaplessInfo** gapless)
+{
+	const GaplessInfo* info = &SongGetDetails(song)->gapless;
+	*gapless = (song->format == MP3 && info->num_samples != 0) ? info : NULL;
+	return CreateSongStream(song, PLAYER_DECODER_FLAGS | (*gapless ? BASS_MP3_IGNOREDELAY : 0));
+}
+
+
+// Reads the album art of a song whose info came from the playlist snapshot, which doesn't save it
+static void LoadAlbumArt(Song* song, HSTREAM stream)
+{
+	song->is_art_pending = false;
+	const char* id3v2_buffer = BASS_ChannelGetTags(stream, BASS_TAG_ID3V2);
+	if (!id3v2_buffer || !song->details || song->details->metadata.album_art)
+		return;
+
+	AudioFileMetadata metadata = {};
+	MetadataArena arena = {};
+	ParseID3v2(id3v2_buffer, &metadata, &arena);
+	SongSetAlbumArt(song, metadata.album_art);
+	MetadataArenaFree(&arena);
+}
+
+
+// Calls GetSongInfo() for every song in the playlist that doesn't have its info yet, and adds it to
+// the library index (unless library is NULL).  Instead of opening the files in playlist order, they are opened in disk order 
+// (see prefetch.cpp), and the headers of the next few files are read in the background while BASS 
+// probes the current one.
+static void GetPlaylistSongInfo(std::vector<Song*>& songs, LibraryIndex* library)
+{
+	std::vector<Song*> pending;
+	std::vector<std::string> full_paths;		// Songs only keep their directory id and file name
+	for (unsigned int i = 0; i < songs.size(); i++)
+	{
+		if (!songs[i]->has_info)
+		{
+			char path[UTF8_MAX_PATH];
+			if (!SongGetPath(songs[i], path, UTF8_MAX_PATH))
+				path[0] = '\0';
+			pending.push_back(songs[i]);
+			full_paths.push_back(path);
+		}
+		else if (!songs[i]->is_indexed)
+		{
+			// Info was loaded from the playlist snapshot
+			LibraryIndexUpdate(library, songs[i]);
+		}
+	}
+	if (pending.empty())
+		return;
+
+	const unsigned int num_pending = pending.size();
+	std::vector<const char*> paths(num_pending);
+	for (unsigned int i = 0; i < num_pending; i++)
+		paths[i] = full_paths[i].c_str();
+	std::vector<unsigned int> order(num_pending);
+	SortPathsByLocality(paths.data(), num_pending, order.data());
+
+	// Ring of outstanding reads.  File i uses requests[i % PREFETCH_MAX_IN_FLIGHT].
+	PrefetchRequest requests[PREFETCH_MAX_IN_FLIGHT] = {};
+	MetadataArena arena = {};		// Text of the tags of one file at a time, until it is copied into the song
+	unsigned int next_prefetch = 0;
+	for (unsigned int i = 0; i < num_pending; i++)
+	{
+		// Keep the read-ahead window full
+		while (next_prefetch < num_pending && next_prefetch < i + PREFETCH_MAX_IN_FLIGHT)
+		{
+			PrefetchBegin(&requests[next_prefetch % PREFETCH_MAX_IN_FLIGHT], paths[order[next_prefetch]]);
+			next_prefetch++;
+		}
+
+		PrefetchEnd(&requests[i % PREFETCH_MAX_IN_FLIGHT]);
+		GetSongInfo(pending[order[i]], &arena);
+		LibraryIndexUpdate(library, pending[order[i]]);
+	}
+
+	for (unsigned int i = 0; i < PREFETCH_MAX_IN_FLIGHT; i++)
+		PrefetchFree(&requests[i]);
+	MetadataArenaFree(&arena);
+}
+
+
+// Returns the library index, or NULL if it hasn't been built for playlist_view, so edits don't update it
+static LibraryIndex* GetBuiltLibraryIndex(AppState* state)
+{
+	return state->is_library_indexed ? state->library : NULL;
+}
+
+
+// Builds the library index from every song in playlist_view, if it wasn't built since the playlist was
+// switched to.  The smart playlists get their members as the rows are added.
+static void BuildLibraryIndex(AppState* state)
+{
+	if (state->is_library_indexed)
+		return;
+	for (PlaylistNode* node = PlaylistFirst(&state->playlist_view); node; node = PlaylistNext(node))
+		LibraryIndexUpdate(state->library, node->song);
+	state->is_library_indexed = true;
+}
+
+
 // Force playlist listview to repaint so that the current song is painted in a different color
 static void RedrawPlaylistWindow(HWND playlist_hwnd, unsigned int num_items)
 {
@@ -1119,57 +2181,195 @@ static void RedrawPlaylistWindow(HWND playlist_hwnd, unsigned int num_items)
 }
 
 
-// Adds all the items in the playlist_view vector to playlist_hwnd
-static void UpdatePlaylistWindow(HWND playlist_hwnd, std::vector<Song*>& playlist_view, HWND lbl_pl_info)
+// Redraws only the row of the song, e.g. when it stops or starts being the current song.  node
+// is the song's node in playlist (play order).
+static void RedrawPlaylistSong(AppState* state, const PlaylistNode* node)
 {
-	ListView_DeleteAllItems(playlist_hwnd);
-	SendMessage(playlist_hwnd, LVM_SETITEMCOUNT, playlist_view.size(), 0);
-	unsigned int total_pl_length = 0;
-	for (unsigned int i = 0; i < playlist_view.size(); i++)
+	if (node == NULL)
+		return;
+	const int row = GetPlaylistViewIndexRow(state, PlaylistIndexOf(node->link));
+	if (row >= 0)
 	{
-		LVITEM item = {};
-		item.mask = LVIF_TEXT;
-		item.cchTextMax = MAX_PATH;
+		ListView_RedrawItems(state->controls.playlist_hwnd, row, row);
+		UpdateWindow(state->controls.playlist_hwnd);
+	}
+}
+
+
+// Refreshes the playlist ListView after playlist_view has changed.  The ListView is virtual
+// (LVS_OWNERDATA), so it only needs to know the number of rows.  The text of each row is
+// supplied when the ListView asks for it in LVN_GETDISPINFO.  The search index is kept up to 
+// date by the edits themselves (see AddSongsToPlaylist, RemoveSongs, and the moves and sorts), 
+// so filtering again only searches, it doesn't index every song again.
+static void UpdatePlaylistWindow(AppState* state)
+{
+	FilterPlaylist(state);
+}
+
 
-		// Row
-		item.iItem = i;			
-		ListView_InsertItem(playlist_hwnd, &item);
+// Adds the song name, album, and folder of song to the end of the fuzzy search index
+static void AddSearchEntry(FuzzyMatcher* search, const Song* song)
+{
+	FuzzyMatcherNext(search);
+	FuzzyMatcherAppendField(search, song->playlist_song_name);
+	FuzzyMatcherAppendField(search, SongGetDetails(song)->metadata.album);
+
+	// The file name is usually the same as the song name, so only the folder is searched
+	char folder[UTF8_MAX_PATH];
+	if (!PathTableGetDirectory(song->dir_id, folder, UTF8_MAX_PATH))
+		folder[0] = '\0';
+	FuzzyMatcherAppendField(search, folder);
+}
 
-		// Song name
-		item.iSubItem = 0;
-		item.pszText = playlist_view[i]->playlist_song_name;
-		ListView_SetItem(playlist_hwnd, &item);
 
-		// Length
-		item.iSubItem = 1;
-		item.pszText = playlist_view[i]->song_length_str;
-		ListView_SetItem(playlist_hwnd, &item);
-		total_pl_length += playlist_view[i]->song_length_secs;
+// Builds the fuzzy search index from every song in playlist_view.  Entry i is playlist_view[i].
+static void BuildSearchIndex(AppState* state)
+{
+	FuzzyMatcher* search = state->search;
+	FuzzyMatcherBegin(search, PlaylistCount(&state->playlist_view));
+	for (PlaylistNode* node = PlaylistFirst(&state->playlist_view); node; node = PlaylistNext(node))
+		AddSearchEntry(search, node->song);
+}
+
+
+// Shows only the songs that match the text in the search box, best match first, and that are
+// in the selected smart playlist.  If neither is set, shows the whole playlist.  Called every time 
+// the search box text changes.  When the user types another character, only the songs that
+// matched the previous text are searched.
+static void FilterPlaylist(AppState* state)
+{
+	char query[FUZZY_MAX_QUERY_LEN];
+	GetWindowTextUtf8(state->controls.txt_search, query, FUZZY_MAX_QUERY_LEN);
+	const SmartPlaylist* smart_playlist = state->active_smart_playlist;
+	state->is_filtered = (query[0] != '\0' || smart_playlist != NULL);
+	if (smart_playlist)
+		BuildLibraryIndex(state);
+
+	// Only the rows that were shown are reset, so filtering a few rows out of a big playlist
+	// doesn't touch every song
+	std::vector<int>& view_index_rows = state->view_index_rows;
+	for (unsigned int i = 0; i < state->filter_rows.size(); i++)
+	{
+		if (state->filter_rows[i] < view_index_rows.size())
+			view_index_rows[state->filter_rows[i]] = -1;
+	}
+	view_index_rows.resize(PlaylistCount(&state->playlist_view), -1);
+	state->filter_rows.clear();
+	if (query[0] != '\0')
+	{
+		if (!state->is_search_indexed)
+		{
+			BuildSearchIndex(state);
+			state->is_search_indexed = true;
+		}
+		const std::vector<unsigned int>& results = FuzzyMatcherSearch(state->search, query);
+		for (unsigned int i = 0; i < results.size(); i++)
+		{
+			if (!smart_playlist || SmartPlaylistContains(smart_playlist, PlaylistSongAt(&state->playlist_view, results[i])))
+				state->filter_rows.push_back(results[i]);
+		}
+	}
+	else if (smart_playlist)
+	{
+		unsigned int i = 0;
+		for (PlaylistNode* node = PlaylistFirst(&state->playlist_view); node; node = PlaylistNext(node), i++)
+		{
+			if (SmartPlaylistContains(smart_playlist, node->song))
+				state->filter_rows.push_back(i);
+		}
 	}
+	for (unsigned int row = 0; row < state->filter_rows.size(); row++)
+		view_index_rows[state->filter_rows[row]] = row;
+
+	// Rows have moved, so the old selection no longer points to the same songs
+	const unsigned int num_rows = GetPlaylistRowCount(state);
+	ListView_SetItemState(state->controls.playlist_hwnd, -1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+	SendMessage(state->controls.playlist_hwnd, LVM_SETITEMCOUNT, num_rows, 0);
+	InvalidateRect(state->controls.playlist_hwnd, NULL, TRUE);
 
 	// General playlist info.  Displayed bottom right of playlist window.
 	char pl_info[48];
-	StringCbPrintfA(pl_info, 48, "%u Songs, Time: %u:%02u", playlist_view.size(), total_pl_length / 60, total_pl_length % 60);
-	SendMessage(lbl_pl_info, WM_SETTEXT, 0, (LPARAM)pl_info);
+	if (state->is_filtered)
+	{
+		StringCbPrintfA(pl_info, 48, "%u of %u Songs", num_rows, PlaylistCount(&state->playlist_view));
+	}
+	else
+	{
+		const unsigned int total_pl_length = (unsigned int)PlaylistTotalLength(&state->playlist_view);
+		StringCbPrintfA(pl_info, 48, "%u Songs, Time: %u:%02u", PlaylistCount(&state->playlist_view), total_pl_length / 60, total_pl_length % 60);
+	}
+	SendMessage(state->controls.lbl_pl_info, WM_SETTEXT, 0, (LPARAM)pl_info);
+}
+
+
+// Number of rows in the playlist ListView
+static unsigned int GetPlaylistRowCount(AppState* state)
+{
+	return state->is_filtered ? state->filter_rows.size() : PlaylistCount(&state->playlist_view);
+}
+
+
+// Converts a row in the playlist ListView to an index in playlist_view.  Returns -1 if there is no such row.
+static int GetPlaylistRowViewIndex(AppState* state, int row)
+{
+	if (row < 0 || row >= (int)GetPlaylistRowCount(state))
+		return -1;
+	return state->is_filtered ? (int)state->filter_rows[row] : row;
+}
+
+
+// Converts an index in playlist_view to a row in the playlist ListView.  Returns -1 if the song
+// is filtered out.
+static int GetPlaylistViewIndexRow(AppState* state, int pl_view_idx)
+{
+	if (pl_view_idx < 0 || !state->is_filtered)
+		return pl_view_idx;
+	return (pl_view_idx < (int)state->view_index_rows.size()) ? state->view_index_rows[pl_view_idx] : -1;
+}
+
+
+// Returns the playlist_view index of the song selected in the playlist ListView, or -1 if nothing is selected
+static int GetSelectedViewIndex(AppState* state)
+{
+	const int sel_row = SendMessage(state->controls.playlist_hwnd, LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED);
+	return GetPlaylistRowViewIndex(state, sel_row);
+}
+
+
+// Supplies the text for a row of the playlist ListView (LVN_GETDISPINFOW)
+// Only visible rows are asked for, so the UTF-8 text is converted straight into the ListView's buffer
+static void GetPlaylistItemText(AppState* state, LVITEMW* item)
+{
+	if (!(item->mask & LVIF_TEXT))
+		return;
+	
+	const int pl_view_idx = GetPlaylistRowViewIndex(state, item->iItem);
+	if (pl_view_idx < 0)
+		return;
+	const Song* song = PlaylistSongAt(&state->playlist_view, pl_view_idx);
+	if (item->iSubItem == PL_COL_LENGTH)
+	{
+		char length[32];
+		SongFormatLength(song, length, sizeof(length));
+		Utf8ToUtf16(length, strlen(length), item->pszText, item->cchTextMax);
+	}
+	else if (song->playlist_song_name)
+	{
+		Utf8ToUtf16(song->playlist_song_name, strlen(song->playlist_song_name), item->pszText, item->cchTextMax);
+	}
 }
 
 
-static void GetPlaylistFromFileList(std::vector<Song*>& playlist_view, char* file_list, size_t file_list_len)
+static void GetPlaylistFromFileList(std::vector<Song*>& songs, char* file_list, size_t file_list_len)
 {
 	if (!lstrlen(file_list))
 		return;
 		
 	int last_sep_pos = -1;
-	int last_backslash_pos = 0;
-	HANDLE heap = GetProcessHeap();
 	// Read through each byte until we find a separator or reach the end
 	for (unsigned int curr_pos = 0; curr_pos < file_list_len; curr_pos++)
 	{
-		if (file_list[curr_pos] == '\\')
-		{
-			last_backslash_pos = curr_pos;
-		}
-		else if (file_list[curr_pos] == '|')
+		if (file_list[curr_pos] == '|')
 		{
 			if (curr_pos - last_sep_pos <= 8 || curr_pos - last_sep_pos > MAX_PATH)
 			{
@@ -1178,14 +2378,13 @@ static void GetPlaylistFromFileList(std::vector<Song*>& playlist_view, char* fil
 				continue;
 			}
 			
-			Song* song = (Song*)HeapAlloc(heap, HEAP_ZERO_MEMORY, sizeof(Song));
-			size_t path_len = curr_pos - last_sep_pos - 1;
-			song->path = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, path_len + 1);
-			size_t file_name_len = curr_pos - last_backslash_pos - 1;
-			song->file_name = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, file_name_len + 1);
-			memcpy(song->path, file_list + last_sep_pos + 1, path_len);
-			memcpy(song->file_name, file_list + last_backslash_pos + 1, file_name_len);
-			playlist_view.push_back(song);
+			Song* song = SongCreate();
+			char path[MAX_PATH + 1] = {};
+			memcpy(path, file_list + last_sep_pos + 1, curr_pos - last_sep_pos - 1);
+			char utf8_path[UTF8_MAX_PATH];
+			LegacyTextToUtf8(path, utf8_path, UTF8_MAX_PATH);
+			SongSetPath(song, utf8_path);
+			songs.push_back(song);
 			last_sep_pos = curr_pos;
 		}
 		else if (curr_pos == file_list_len - 1)
@@ -1196,33 +2395,30 @@ static void GetPlaylistFromFileList(std::vector<Song*>& playlist_view, char* fil
 				last_sep_pos = curr_pos;
 				break;
 			}
-			Song* song = (Song*)HeapAlloc(heap, HEAP_ZERO_MEMORY, sizeof(Song));
-			size_t path_len = curr_pos - last_sep_pos;
-			song->path = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, path_len + 1);
-			size_t file_name_len = curr_pos - last_backslash_pos;
-			song->file_name = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, file_name_len + 1);
-			memcpy(song->path, file_list + last_sep_pos + 1, path_len);
-			memcpy(song->file_name, file_list + last_backslash_pos + 1, file_name_len);
-			playlist_view.push_back(song);
+			Song* song = SongCreate();
+			char path[MAX_PATH + 1] = {};
+			memcpy(path, file_list + last_sep_pos + 1, curr_pos - last_sep_pos);
+			char utf8_path[UTF8_MAX_PATH];
+			LegacyTextToUtf8(path, utf8_path, UTF8_MAX_PATH);
+			SongSetPath(song, utf8_path);
+			songs.push_back(song);
 		}
 	}
 }
 
 // Parses a buffer of file names from the Windows "Open File" dialog.  file_offset specifies where the 
 // name of the directory ends and the filenames begin.  Returns a std::vector containing the songs.
-static void GetPlaylistFromFileBuffer(std::vector<Song*>& playlist_view, char* file_buffer, const int file_buffer_size,
+static void GetPlaylistFromFileBuffer(std::vector<Song*>& songs, char* file_buffer, const int file_buffer_size,
 	const int file_offset, char* file_title)
 {
 	if (!file_buffer || !file_title)
 		return;
 
-	HANDLE heap = GetProcessHeap();
-	char* dir = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, file_offset);
+	char* dir = (char*)AllocMemory(ALLOC_PLAYLIST, file_offset);
 	if (!dir)
 		return;
 
 	memcpy(dir, file_buffer, file_offset - 1);
-	size_t dir_len = lstrlen(dir);
 
 	// For multiple selection, the file buffer will contain null characters as separators
 	// See:  https://stackoverflow.com/a/41371253
@@ -1230,7 +2426,12 @@ static void GetPlaylistFromFileBuffer(std::vector<Song*>& playlist_view, char* f
 	{
 		// Multiple files were selected.  Format if 3 files were selected:
 		// <Directory>\0<File1>\0<File2>\0<File3>\0\0
-		// Directory is only listed once, since all songs must be in same directory.
+		// Directory is only listed once, since all songs must be in same directory, so it only has to be
+		// added to the path table once.  A root directory like C:\ already ends in a backslash.
+		size_t dir_len = lstrlen(dir);
+		if (dir_len > 0 && dir[dir_len - 1] == '\\')
+			dir_len--;
+		const unsigned int dir_id = PathTableAddDirectory(dir, dir_len);
 		int last_null_pos = file_offset - 1;
 		for (int curr_byte_pos = file_offset; curr_byte_pos < file_buffer_size; curr_byte_pos++)
 		{
@@ -1243,29 +2444,14 @@ static void GetPlaylistFromFileBuffer(std::vector<Song*>& playlist_view, char* f
 				}
 
 				// Allocate memory for new Song struct
-				Song* song = (Song*)HeapAlloc(heap, HEAP_ZERO_MEMORY, sizeof(Song));
+				Song* song = SongCreate();
 				size_t file_name_len = curr_byte_pos - last_null_pos;
-				size_t path_len = dir_len + file_name_len + 1;		// 1 extra byte for added backslash
-				song->path = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, path_len + 1);
-				song->file_name = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, file_name_len + 1);
+				song->dir_id = dir_id;
+				song->file_name = (char*)AllocMemory(ALLOC_PLAYLIST, file_name_len + 1);
 
 				// Copy file_name to struct
 				memcpy(song->file_name, file_buffer + last_null_pos + 1, file_name_len);
-
-				// Copy path to struct by concatenating the directory and file_name
-				memcpy(song->path, dir, dir_len);		// Copy directory portion of path
-				if (dir[dir_len] != '\\')
-				{
-					// Directory does NOT already end in a backslash
-					song->path[dir_len] = '\\';
-					memcpy(song->path + dir_len + 1, song->file_name, file_name_len);
-				}
-				else
-				{
-					// Directory already ends in backslash
-					memcpy(song->path + dir_len, song->file_name, file_name_len);
-				}
-				playlist_view.push_back(song);		// Add to end of playlist
+				songs.push_back(song);		// Add to end of playlist
 				last_null_pos = curr_byte_pos;
 			}
 
@@ -1274,101 +2460,317 @@ static void GetPlaylistFromFileBuffer(std::vector<Song*>& playlist_view, char* f
 	else
 	{
 		// Single file selected.  File buffer format:  C:\Music\Led Zeppelin - Stairway to Heaven.mp3\0
-		Song* song = (Song*)HeapAlloc(heap, HEAP_ZERO_MEMORY, sizeof(Song));
-		song->path = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, file_buffer_size + 1);	// Already null terminated?
-		if (song->path)
-			memcpy(song->path, file_buffer, file_buffer_size);
-		const size_t file_name_len = lstrlen(file_title);
-		song->file_name = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, file_name_len + 1);
-		if (song->file_name)
-			memcpy(song->file_name, file_title, file_name_len);
-		playlist_view.push_back(song);
+		Song* song = SongCreate();
+		SongSetPath(song, file_buffer);
+		songs.push_back(song);
 	}
+	FreeMemory(dir);
 }
 
 
 // Displays the Windows "Open File" dialog, gets the user input, and processes it
 static void OpenFile(AppState* state, bool is_add_btn)
 {
-	char file_name[MAX_PATH] = {};
+	WCHAR file_name[MAX_PATH] = {};
 	const int file_buffer_size = 4096;
-	char file_buffer[file_buffer_size] = {};	// Must use huge buffer, in case user selects many files
+	WCHAR file_buffer[file_buffer_size] = {};	// Must use huge buffer, in case user selects many files
 	
-	OPENFILENAME ofn = {};
+	OPENFILENAMEW ofn = {};
 	ofn.lStructSize = sizeof(ofn);
 	ofn.hwndOwner = state->main_hwnd;
 	ofn.lpstrFile = file_buffer;
 	ofn.nMaxFile = file_buffer_size;
-	ofn.lpstrFilter = "Audio Files\0*.mp3;*.ogg\0MP3\0*.mp3\0OGG\0*.ogg\0";
+	ofn.lpstrFilter = L"Audio Files and Playlists\0*.mp3;*.ogg;*.m3u;*.m3u8;*.pls;*.xspf\0MP3\0*.mp3\0OGG\0*.ogg\0"
+		L"Playlists\0*.m3u;*.m3u8;*.pls;*.xspf\0";
 	ofn.lpstrFileTitle = file_name;
 	ofn.nMaxFileTitle = MAX_PATH;
 	if (is_add_btn)
-		ofn.lpstrTitle = "Add File(s) to Playlist";
+		ofn.lpstrTitle = L"Add File(s) to Playlist";
 	else
-		ofn.lpstrTitle = "Open File(s)";
+		ofn.lpstrTitle = L"Open File(s)";
 	ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST | OFN_ALLOWMULTISELECT | OFN_EXPLORER | OFN_HIDEREADONLY;
-	if (!GetOpenFileName(&ofn))
+	if (!GetOpenFileNameW(&ofn))
 	{
 		// User clicked "Cancel" or there was an error
 		return;
 	}
 
-	if (!is_add_btn && !state->playlist_view.empty())
+	// Convert the whole buffer, null separators included, so the multiple selection format is kept.
+	// The file offset has to be moved to where the file names start in the UTF-8 buffer.
+	const int utf8_buffer_size = (int)UTF8_SIZE_OF_UTF16(file_buffer_size) + 1;
+	char* utf8_buffer = (char*)AllocMemory(ALLOC_PLAYLIST, utf8_buffer_size);
+	if (!utf8_buffer)
+		return;
+	Utf16ToUtf8(file_buffer, file_buffer_size, utf8_buffer, utf8_buffer_size);
+	const int utf8_file_offset = (int)Utf16ToUtf8(file_buffer, ofn.nFileOffset, NULL, 0);
+	char utf8_file_name[UTF8_MAX_PATH];
+	Utf16ToUtf8(file_name, lstrlenW(file_name), utf8_file_name, UTF8_MAX_PATH);
+
+	std::vector<Song*> songs;
+	GetPlaylistFromFileBuffer(songs, utf8_buffer, utf8_buffer_size, utf8_file_offset, utf8_file_name);
+	FreeMemory(utf8_buffer);
+	OpenSongs(state, songs, is_add_btn);
+}
+
+
+// Adds the files dropped on the window to the end of the playlist
+static void DropFiles(AppState* state, HDROP drop)
+{
+	const UINT num_files = DragQueryFileW(drop, 0xFFFFFFFF, NULL, 0);
+	std::vector<Song*> songs;
+	songs.reserve(num_files);
+	for (UINT i = 0; i < num_files; i++)
+	{
+		WCHAR wide_path[MAX_PATH];
+		const UINT wide_len = DragQueryFileW(drop, i, wide_path, MAX_PATH);
+		if (!wide_len)
+			continue;
+		char path[UTF8_MAX_PATH];
+		Utf16ToUtf8(wide_path, wide_len, path, UTF8_MAX_PATH);
+		Song* song = SongCreate();
+		if (!song)
+			break;
+		SongSetPath(song, path);
+		songs.push_back(song);
+	}
+	DragFinish(drop);
+	OpenSongs(state, songs, true);
+}
+
+
+// Puts the songs in the playlist, after the songs already there if is_add is true, or instead of them
+// if it's false.  Files that are already in the playlist are skipped.
+static void OpenSongs(AppState* state, std::vector<Song*>& songs, bool is_add)
+{
+	UndoHistoryBeginEdit(state->history);
+	if (!is_add && PlaylistCount(&state->playlist_view) > 0)
 	{
 		// User clicked the "open" button, NOT the "add" button.  Must clear all previous items in playlist.
-		for (unsigned int i = 0; i < state->playlist_view.size(); i++)
+		LibraryIndexClear(state->library);
+		PlayQueueClear(&state->play_queue);
+		SetCurrentSong(state, NULL);
+		for (PlaylistNode* node = PlaylistFirst(&state->playlist_view); node; node = PlaylistNext(node))
 		{
-			Song* song = state->playlist_view[i];
-			FreeSong(song);
+			node->song->play_node = NULL;
+			SongRelease(node->song);
 		}
 		// Erase all elements
-		state->playlist_view.erase(state->playlist_view.begin(), state->playlist_view.end());
-		state->playlist.erase(state->playlist.begin(), state->playlist.end());
+		PlaylistClear(&state->playlist_view);
+		PlaylistClear(&state->playlist);
+		state->is_search_indexed = false;
+		state->shuffle.seed = 0;
 	}
 	
-	GetPlaylistFromFileBuffer(state->playlist_view, file_buffer, file_buffer_size, ofn.nFileOffset, ofn.lpstrFileTitle);
-	for (unsigned int i = 0; i < state->playlist_view.size(); i++)
+	ExpandPlaylistFiles(songs);
+	SkipAddedSongs(songs);
+	ShareStoredSongs(songs);
+	GetPlaylistSongInfo(songs, GetBuiltLibraryIndex(state));
+	AddSongsToPlaylist(state, songs);
+	UpdatePlaylistWindow(state);
+
+	// Added songs go on the end of both orders.  An opened playlist replaces the old one.
+	if (is_add)
+	{
+		UndoHistoryAppend(state->history, UNDO_VIEW, songs.data(), songs.size());
+		if (state->options.shuffle)
+			UndoHistoryAppend(state->history, UNDO_PLAY, songs.data(), songs.size());
+	}
+	else
 	{
-		GetSongInfo(state->playlist_view[i]);
+		UndoHistoryAssign(state->history, UNDO_VIEW, songs.data(), songs.size());
+		UndoHistoryPlayFollowsView(state->history);
 	}
-	UpdatePlaylistWindow(state->controls.playlist_hwnd, state->playlist_view, state->controls.lbl_pl_info);
+	EndPlaylistEdit(state);
 
-	// Copy vector
-	state->playlist = state->playlist_view;
+	if (!is_add && PlaylistCount(&state->playlist) > 0)
+	{
+		if (state->options.shuffle)
+		{
+			// Start the new playlist with a random song
+			const unsigned long long seed = NewShuffleSeed();
+			const unsigned int first_song = (unsigned int)(seed % PlaylistCount(&state->playlist));
+			NumberShuffleSongs(state);
+			ShuffleReset(&state->shuffle, seed, PlaylistCount(&state->playlist), first_song);
+			SetCurrentSong(state, PlaylistNodeAt(&state->playlist, first_song));
+		}
+		else
+		{
+			SetCurrentSong(state, PlaylistFirst(&state->playlist));
+		}
 
-	if (state->options.shuffle)
+		RedrawPlaylistWindow(state->controls.playlist_hwnd, PlaylistCount(&state->playlist_view));
+		ResetPositionTrackbar(state->controls.tb_pos, 0, state->curr_song->song_length_secs, 0);
+		UpdateInfoLabels(state, true);
+
+		// If user added multiple files, automatically show the playlist
+		if (PlaylistCount(&state->playlist_view) > 1 && !state->is_playlist_visible)
+			TogglePlaylistVisible(state->main_hwnd, &state->is_playlist_visible, true, state->options.playlist_size, state->controls.btn_playlist, state->options.always_on_top);
+
+		if (LoadCurrentSong(state))
+		{
+			// Play the song
+			if (BASS_ChannelPlay(state->player.stream, false))
+			{
+				state->player_state = PLAYING;
+			}
+		}
+	}
+}
+
+
+// Converts text from one code page to another, e.g. CP_UTF8 to CP_ACP.  Returns false if it doesn't fit
+// in result_len bytes, or has characters that can't be converted.
+static bool ConvertCodePage(const char* text, UINT from_code_page, UINT to_code_page, char* result, int result_len)
+{
+	WCHAR wide_text[MAX_PATH * 4];
+	if (!MultiByteToWideChar(from_code_page, MB_ERR_INVALID_CHARS, text, -1, wide_text, ARRAYSIZE(wide_text)))
+		return false;
+
+	// Can't ask about default characters when converting to UTF-8
+	BOOL is_default_char_used = FALSE;
+	if (!WideCharToMultiByte(to_code_page, 0, wide_text, -1, result, result_len, NULL,
+		(to_code_page == CP_UTF8) ? NULL : &is_default_char_used))
+		return false;
+	return !is_default_char_used;
+}
+
+
+// Called by the playlist file reader for each song in the playlist file
+static void ImportPlaylistEntry(void* context, const PlaylistFileEntry* entry)
+{
+	std::vector<Song*>* songs = (std::vector<Song*>*)context;
+	char path[UTF8_MAX_PATH];
+	if (entry->is_utf8)
+	{
+		if (FAILED(StringCbCopyA(path, UTF8_MAX_PATH, entry->path)))
+			return;
+	}
+	else
+	{
+		LegacyTextToUtf8(entry->path, path, UTF8_MAX_PATH);
+	}
+
+	Song* song = SongCreate();
+	if (!song)
+		return;
+	SongSetPath(song, path);
+	songs->push_back(song);
+}
+
+
+// Adds the songs in a M3U, M3U8, PLS, or XSPF file to songs.  The file is read in chunks, so it doesn't
+// matter how big it is.
+static void ImportPlaylistFile(std::vector<Song*>& songs, const char* path, PlaylistFileFormat format)
+{
+	HANDLE file = CreateFileUtf8(path, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	char* buffer = (char*)AllocMemory(ALLOC_PLAYLIST, PLAYLIST_IMPORT_CHUNK_SIZE);
+	if (buffer)
+	{
+		PlaylistFileReader reader;
+		PlaylistFileReaderBegin(&reader, format, path, ImportPlaylistEntry, &songs);
+		DWORD bytes_read = 0;
+		while (ReadFile(file, buffer, PLAYLIST_IMPORT_CHUNK_SIZE, &bytes_read, NULL) && bytes_read > 0)
+			PlaylistFileReaderFeed(&reader, buffer, bytes_read);
+		PlaylistFileReaderEnd(&reader);
+		FreeMemory(buffer);
+	}
+	CloseHandle(file);
+}
+
+
+// Replaces any playlist files the user opened with the songs in them, so they go through the same
+// steps as songs that were opened directly
+static void ExpandPlaylistFiles(std::vector<Song*>& songs)
+{
+	std::vector<Song*> expanded;
+	expanded.reserve(songs.size());
+	for (unsigned int i = 0; i < songs.size(); i++)
 	{
-		std::random_shuffle(state->playlist.begin(), state->playlist.end());
-		int curr_pl_idx = GetPlaylistCurrentIndex(state->playlist);
-		if (curr_pl_idx > 0)
+		const PlaylistFileFormat format = GetPlaylistFileFormat(songs[i]->file_name);
+		char path[UTF8_MAX_PATH];
+		if (format == PLAYLIST_FORMAT_NONE || !SongGetPath(songs[i], path, UTF8_MAX_PATH))
 		{
-			// Swap so that the current song is first in the playlist
-			std::swap(state->playlist[curr_pl_idx], state->playlist[0]);
+			expanded.push_back(songs[i]);
+		}
+		else
+		{
+			ImportPlaylistFile(expanded, path, format);
+			FreeSong(songs[i]);
 		}
 	}
+	songs.swap(expanded);
+}
 
-	if (!is_add_btn)
-	{
-		state->curr_song = state->playlist[0];
-		state->curr_song->is_current = true;
 
-		RedrawPlaylistWindow(state->controls.playlist_hwnd, state->playlist_view.size());
-		ResetPositionTrackbar(state->controls.tb_pos, 0, state->curr_song->song_length_secs, 0);
-		UpdateInfoLabels(state, true);
+static bool WritePlaylistFileData(void* context, const char* data, size_t len)
+{
+	DWORD bytes_written = 0;
+	return WriteFile((HANDLE)context, data, (DWORD)len, &bytes_written, NULL) && bytes_written == len;
+}
 
-		// If user added multiple files, automatically show the playlist
-		if (state->playlist_view.size() > 1 && !state->is_playlist_visible)
-			TogglePlaylistVisible(state->main_hwnd, &state->is_playlist_visible, true, state->options.playlist_size, state->controls.btn_playlist, state->options.always_on_top);
 
-		if (LoadCurrentSong(state))
-		{
-			// Play the song
-			if (BASS_ChannelPlay(state->bass_stream, false))
+// Saves the playlist, in the order it is shown, as a M3U, M3U8, PLS, or XSPF file
+static void SavePlaylistFile(AppState* state)
+{
+	WCHAR wide_path[MAX_PATH] = {};
+	OPENFILENAMEW ofn = {};
+	ofn.lStructSize = sizeof(ofn);
+	ofn.hwndOwner = state->main_hwnd;
+	ofn.lpstrFile = wide_path;
+	ofn.nMaxFile = MAX_PATH;
+	ofn.lpstrFilter = L"M3U8 Playlist (UTF-8)\0*.m3u8\0M3U Playlist\0*.m3u\0PLS Playlist\0*.pls\0XSPF Playlist\0*.xspf\0";
+	ofn.lpstrDefExt = L"m3u8";
+	ofn.lpstrTitle = L"Save Playlist";
+	ofn.Flags = OFN_PATHMUSTEXIST | OFN_OVERWRITEPROMPT | OFN_HIDEREADONLY;
+	if (!GetSaveFileNameW(&ofn))
+		return;
+	char path[UTF8_MAX_PATH];
+	Utf16ToUtf8(wide_path, lstrlenW(wide_path), path, UTF8_MAX_PATH);
+
+	// Use the file type that was picked if the extension isn't a playlist extension
+	const PlaylistFileFormat filter_formats[] = { PLAYLIST_FORMAT_M3U8, PLAYLIST_FORMAT_M3U, 
+		PLAYLIST_FORMAT_PLS, PLAYLIST_FORMAT_XSPF };
+	PlaylistFileFormat format = GetPlaylistFileFormat(path);
+	if (format == PLAYLIST_FORMAT_NONE)
+		format = filter_formats[(ofn.nFilterIndex >= 1 && ofn.nFilterIndex <= 4) ? ofn.nFilterIndex - 1 : 0];
+	const bool is_utf8 = (format == PLAYLIST_FORMAT_M3U8 || format == PLAYLIST_FORMAT_XSPF);
+
+	HANDLE file = CreateFileW(wide_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	bool is_saved = false;
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		PlaylistFileWriter writer;
+		PlaylistFileWriterBegin(&writer, format, WritePlaylistFileData, file);
+		char ansi_path[MAX_PATH];
+		char ansi_title[UI_TEXT_MAX];
+		for (PlaylistNode* node = PlaylistFirst(&state->playlist_view); node; node = PlaylistNext(node))
+		{
+			const Song* song = node->song;
+			const char* title = (song->has_info && song->playlist_song_name != song->file_name) ? song->playlist_song_name : NULL;
+			const int length_secs = song->has_info ? (int)song->song_length_secs : -1;
+			char song_path[UTF8_MAX_PATH];
+			if (!SongGetPath(song, song_path, UTF8_MAX_PATH))
+				continue;
+			if (is_utf8)
 			{
-				state->player_state = PLAYING;
+				PlaylistFileWriteEntry(&writer, song_path, title, length_secs);
+			}
+			else if (ConvertCodePage(song_path, CP_UTF8, CP_ACP, ansi_path, sizeof(ansi_path)))
+			{
+				// Songs whose path can't be written in the ANSI code page are left out
+				if (title && !ConvertCodePage(title, CP_UTF8, CP_ACP, ansi_title, sizeof(ansi_title)))
+					title = NULL;
+				PlaylistFileWriteEntry(&writer, ansi_path, title ? ansi_title : NULL, length_secs);
 			}
 		}
+		is_saved = PlaylistFileWriterEnd(&writer);
+		CloseHandle(file);
 	}
+	if (!is_saved)
+		MessageBox(state->main_hwnd, "Error:  Could not save the playlist.", 0, MB_ICONERROR);
 }
 
 
@@ -1461,33 +2863,49 @@ static HWND CreatePlaylistWindow(HWND main_hwnd, HINSTANCE instance, HFONT pl_fo
 	InitCommonControlsEx(&icex);
 
 	HWND playlist_hwnd = CreateWindow(WC_LISTVIEW, NULL, WS_CHILD | WS_VISIBLE | WS_VSCROLL |  
-		LVS_REPORT | LVS_NOCOLUMNHEADER, 0, WIN_HEIGHT + 5, WIN_WIDTH, playlist_size - 30,
+		LVS_REPORT | LVS_OWNERDATA, 0, WIN_HEIGHT + 5, WIN_WIDTH, playlist_size - 30,
 		main_hwnd, (HMENU)1, instance, 0);
 
+	// Ask for the row text as UTF-16 (LVN_GETDISPINFOW), so song names aren't limited to the ANSI code page
+	ListView_SetUnicodeFormat(playlist_hwnd, TRUE);
+
 	// Set listview styles and font
 	SendMessage(playlist_hwnd, LVM_SETEXTENDEDLISTVIEWSTYLE, LVS_EX_FULLROWSELECT | LVS_EX_FLATSB,
 		LVS_EX_FULLROWSELECT | LVS_EX_FLATSB);
 	ListView_SetBkColor(playlist_hwnd, PLAYLIST_COLOR);
 	SendMessage(playlist_hwnd, WM_SETFONT, (WPARAM)pl_font, 0);
 	
-	// Song name
+	// Song name.  Clicking the column headers sorts the playlist.
 	LVCOLUMN song_name_col = {};
-	song_name_col.mask = LVCF_WIDTH | LVCF_SUBITEM;
-	song_name_col.iSubItem = 0;
+	song_name_col.mask = LVCF_WIDTH | LVCF_SUBITEM | LVCF_TEXT;
+	song_name_col.iSubItem = PL_COL_SONG;
 	song_name_col.cx = 330;
-	ListView_InsertColumn(playlist_hwnd, 0, &song_name_col);
+	song_name_col.pszText = (LPSTR)"Song";
+	ListView_InsertColumn(playlist_hwnd, PL_COL_SONG, &song_name_col);
 
 	// Song length
 	LVCOLUMN song_length_col = {};
-	song_length_col.mask = LVCF_WIDTH | LVCF_SUBITEM | LVCF_FMT;
-	song_length_col.iSubItem = 1;
+	song_length_col.mask = LVCF_WIDTH | LVCF_SUBITEM | LVCF_FMT | LVCF_TEXT;
+	song_length_col.iSubItem = PL_COL_LENGTH;
 	song_length_col.cx = 50;
 	song_length_col.fmt = LVCFMT_RIGHT;
-	ListView_InsertColumn(playlist_hwnd, 1, &song_length_col);
+	song_length_col.pszText = (LPSTR)"Length";
+	ListView_InsertColumn(playlist_hwnd, PL_COL_LENGTH, &song_length_col);
 
 	return playlist_hwnd;
 }
 
+
+// Search box at the bottom of the playlist, between the move down button and the playlist info
+static HWND CreateSearchBox(HWND main_hwnd, HINSTANCE instance, HFONT font, int playlist_size)
+{
+	HWND search_hwnd = CreateWindow("EDIT", NULL, WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+		115, WIN_HEIGHT + playlist_size - 23, 145, 21, main_hwnd, (HMENU)TXT_SEARCH, instance, 0);
+	SendMessage(search_hwnd, WM_SETFONT, (WPARAM)font, 0);
+	SendMessage(search_hwnd, EM_SETCUEBANNER, TRUE, (LPARAM)L"Search");
+	return search_hwnd;
+}
+
 static void CreateGDIObjects(AppState* state)
 {
 	state->gdi.main_bg_brush = CreateSolidBrush(BACKGROUND_COLOR);
@@ -1503,45 +2921,425 @@ static void CreateGDIObjects(AppState* state)
 
 static bool LoadCurrentSong(AppState* state)
 {
-	if (state->bass_stream) {
-		BASS_StreamFree(state->bass_stream);	// Free the previous stream, if necessary
-		state->bass_stream = 0;
-	}
-
+	// While a song is playing with crossfade on, it fades out under the new one instead of stopping
+	const bool is_crossfade = ShouldCrossfade(state);
+	if (is_crossfade)
+		CancelNextSong(state);
+	else
+		UnloadCurrentSong(state);		// Free the previous stream, if necessary
 	if (state->curr_song == NULL)
 	{
+		UnloadCurrentSong(state);
 		return false;
 	}
-	state->bass_stream = BASS_StreamCreateFile(false, state->curr_song->path, 0, 0, 0);
 
-	if (state->bass_stream)
+	const GaplessInfo* gapless;
+	HSTREAM decoder = CreateSongDecoder(state->curr_song, &gapless);
+	bool is_loaded = false;
+	if (decoder && is_crossfade)
 	{
-		state->curr_song->song_length_bytes = BASS_ChannelGetLength(state->bass_stream, BASS_POS_BYTE);
-		state->curr_song->song_length_secs = (int)BASS_ChannelBytes2Seconds(state->bass_stream, state->curr_song->song_length_bytes);
-		ResetPositionTrackbar(state->controls.tb_pos, 0, state->curr_song->song_length_secs, 0);
-		BASS_ChannelSetAttribute(state->bass_stream, BASS_ATTRIB_VOL, state->volume / 100.0f);
-		state->curr_song->is_valid = true;
+		is_loaded = PlayerCrossfadeTo(&state->player, decoder, gapless);
+		if (!is_loaded)
+		{
+			// The songs can't be mixed (different sample rates...), so the new one starts the usual way
+			UnloadCurrentSong(state);
+			decoder = CreateSongDecoder(state->curr_song, &gapless);
+		}
+	}
+	if (decoder && !is_loaded)
+		is_loaded = PlayerLoad(&state->player, decoder, gapless);
+	if (is_loaded)
+	{
+		PlayerSetVolume(&state->player, state->volume / 100.0f);
+		CurrentSongStreamOpened(state);
 		return true;
 	}
 	else
 	{
+		UnloadCurrentSong(state);
 		state->curr_song->is_valid = false;
-		RedrawPlaylistWindow(state->controls.playlist_hwnd, state->playlist_view.size());
+		RedrawPlaylistSong(state, state->curr_node);
 	}
 
 	return false;
 }
 
-static int GetPlaylistCurrentIndex(std::vector<Song*> &playlist)
+
+// Updates the current song from the player's stream of it, which is either newly loaded or was joined on
+// to the end of the last song
+static void CurrentSongStreamOpened(AppState* state)
+{
+	// The decoder is in floating-point, so only the length in seconds is comparable with GetSongInfo()
+	const HSTREAM decoder = PlayerGetDecoder(&state->player);
+	state->curr_song->song_length_secs = (int)BASS_ChannelBytes2Seconds(decoder, PlayerGetLength(&state->player));
+	ResetPositionTrackbar(state->controls.tb_pos, 0, state->curr_song->song_length_secs, 0);
+	state->curr_song->is_valid = true;
+	if (state->curr_song->is_art_pending)
+		LoadAlbumArt(state->curr_song, decoder);
+	LibraryIndexUpdate(GetBuiltLibraryIndex(state), state->curr_song);		// Length may have changed
+	PlaylistSongLengthChanged(state->curr_node);
+	PlaylistSongLengthChanged(state->curr_node->link);
+}
+
+
+// Stops the player and frees the streams of the current song and of the one after it
+static void UnloadCurrentSong(AppState* state)
+{
+	CancelNextSong(state);
+	PlayerUnload(&state->player);
+}
+
+
+// Opens the song that plays after the current one when the current one is about to end, so the player
+// can join it on without a gap.  Called on every timer tick, so if the next song changes (the user queued
+// a song, turned on shuffle, deleted it...), the new one replaces it.
+static void PrepareNextSong(AppState* state, int position_secs)
+{
+	const int prepare_secs = PREPARE_NEXT_SONG_SECS + (int)state->options.crossfade_secs;
+	if (state->curr_song == NULL || state->curr_song->song_length_secs - position_secs > prepare_secs ||
+		PlayerIsChanging(&state->player))
+		return;
+
+	ShufflePosition shuffle_pos;
+	const int next_idx = FindNextSong(state, &shuffle_pos);
+	Song* song = (next_idx >= 0) ? PlaylistNodeAt(&state->playlist, next_idx)->song : NULL;
+	if (song == state->next_song)
+		return;
+	CancelNextSong(state);
+	if (song == NULL)
+		return;
+
+	// Kept even if the player can't join it on, so it isn't opened again on every tick
+	SongAddRef(song);
+	state->next_song = song;
+	const GaplessInfo* gapless;
+	const HSTREAM decoder = CreateSongDecoder(song, &gapless);
+	if (decoder)
+		PlayerSetNext(&state->player, decoder, gapless);
+}
+
+
+// Should a new song fade in over the one that is playing, instead of stopping it?
+static bool ShouldCrossfade(AppState* state)
+{
+	return state->options.crossfade_secs && state->player_state == PLAYING && state->player.stream &&
+		BASS_ChannelIsActive(state->player.stream) == BASS_ACTIVE_PLAYING;
+}
+
+
+// Gives the crossfade settings to the player
+static void UpdatePlayerCrossfade(AppState* state)
+{
+	PlayerSetCrossfade(&state->player, state->options.crossfade_secs * 1000, state->options.crossfade_curve);
+}
+
+
+// Forgets the song given to the player by PrepareNextSong()
+static void CancelNextSong(AppState* state)
+{
+	if (state->next_song == NULL)
+		return;
+	PlayerClearNext(&state->player);
+	SongRelease(state->next_song);
+	state->next_song = NULL;
+}
+
+
+// Called when the song prepared by PrepareNextSong() can be heard.  Makes it the current song the same 
+// way SelectNextSong() does, except that it is already playing.
+static void NextSongStarted(AppState* state)
+{
+	Song* song = state->next_song;
+	state->next_song = NULL;
+
+	// The next song is normally still the same, but the playlist can change in the moment it takes to
+	// start hearing it.  RemoveSongs() clears the song's play node if it was deleted.
+	PlaylistNode* node = song ? song->play_node : NULL;
+	ShufflePosition shuffle_pos;
+	const int next_idx = FindNextSong(state, &shuffle_pos);
+	if (node != NULL && next_idx >= 0 && PlaylistIndexOf(node) == (unsigned int)next_idx)
+	{
+		TakeNextSong(state);
+	}
+	else
+	{
+		state->play_queue.resume_node = NULL;
+		if (node != NULL && state->options.shuffle)
+			ShuffleJumpTo(&state->shuffle, node->shuffle_ordinal);
+	}
+	if (song)
+		SongRelease(song);
+
+	if (node == NULL)
+	{
+		// It was deleted, so don't keep playing it
+		UnloadCurrentSong(state);
+		SongFinished(state);
+		return;
+	}
+
+	PlaylistNode* prev_node = state->curr_node;
+	SetCurrentSong(state, node);
+	const int curr_row = GetPlaylistViewIndexRow(state, GetPlaylistViewCurrentIndex(state));
+	if (curr_row >= 0)
+		ListView_EnsureVisible(state->controls.playlist_hwnd, curr_row, FALSE);
+	CurrentSongStreamOpened(state);
+	RedrawPlaylistSong(state, prev_node);
+	RedrawPlaylistSong(state, state->curr_node);
+	UpdateInfoLabels(state, true);
+}
+
+
+// Called when the current song has finished playing and the player didn't go on to the next one by
+// itself.  Loads and plays the next song in the playlist, or stops if there isn't one.
+static void SongFinished(AppState* state)
+{
+	ShufflePosition shuffle_pos;
+	if (FindNextSong(state, &shuffle_pos) < 0)
+	{
+		// Last song in playlist and repeat is turned off
+		ResetPositionTrackbar(state->controls.tb_pos, 0, 0, 0);
+		SendMessage(state->controls.lbl_time_pos, WM_SETTEXT, 0, 0);
+		SendMessage(state->controls.lbl_time_length, WM_SETTEXT, 0, 0);
+		state->player_state = STOPPED;
+		return;
+	}
+	
+	int count = 0;		// Only try each song in playlist once before giving up
+	while (!SelectNextSong(state))
+	{
+		// Keep trying until we find a playable song
+		count++;
+		if (count >= (int)PlaylistCount(&state->playlist))
+		{
+			// Could not find a valid song in the playlist.  Clean up.
+			ClearInfoLabels(&state->controls, state->main_hwnd);
+			ResetPositionTrackbar(state->controls.tb_pos, 0, 0, 0);
+			state->player_state = STOPPED;
+			return;
+		}
+	}
+	UpdateInfoLabels(state, true);
+	BASS_ChannelPlay(state->player.stream, false);
+	state->player_state = PLAYING;
+}
+
+// Index of the current song in playlist, or -1 if there is no current song
+static int GetPlaylistCurrentIndex(AppState* state)
+{
+	return state->curr_node ? (int)PlaylistIndexOf(state->curr_node) : -1;
+}
+
+
+// Index of the current song in playlist_view, or -1 if there is no current song
+static int GetPlaylistViewCurrentIndex(AppState* state)
+{
+	return state->curr_node ? (int)PlaylistIndexOf(state->curr_node->link) : -1;
+}
+
+
+// Tells the memory budget how far each song is ahead of the current song in play order, so the album art
+// of the songs about to play is kept longest.  With shuffle on, that's the number of shuffle steps to the
+// song.  Queued songs are next.  Songs that only other playlists or undo versions have are the farthest,
+// and the current song is 0, since its album art is on screen.  Each song is looked up through its node,
+// so this is O(log n) per song and doesn't walk the playlist.
+static void GetPlayDistances(void* context, Song* const* songs, unsigned int num_songs, unsigned int* distances)
+{
+	AppState* state = (AppState*)context;
+	const int curr_idx = GetPlaylistCurrentIndex(state);
+	const unsigned int count = PlaylistCount(&state->playlist);
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		const PlaylistNode* node = songs[i]->play_node;
+		if (node == NULL)
+			distances[i] = 0xFFFFFFFF;
+		else if (node == state->curr_node)
+			distances[i] = 0;
+		else if (node->queue_entries)
+			distances[i] = 1;		// Plays next
+		else if (curr_idx < 0)
+			distances[i] = PlaylistIndexOf(node) + 2;
+		else if (state->options.shuffle)
+			distances[i] = ShuffleStepsAhead(&state->shuffle, node->shuffle_ordinal) + 1;
+		else
+			// Songs before the current one are only played again after the playlist starts over
+			distances[i] = (PlaylistIndexOf(node) + count - curr_idx) % count + 1;
+	}
+}
+
+
+// Makes the song of node (in playlist, NOT playlist_view) the current song.  node can be NULL.
+static void SetCurrentSong(AppState* state, PlaylistNode* node)
+{
+	state->curr_node = node;
+	state->curr_song = node ? node->song : NULL;
+}
+
+
+// Adds the songs to the end of a playlist's two lists, and links their nodes together.  The playlist
+// holds a reference to each song until it is removed, and the songs go in the song store so other
+// playlists can share them.
+static void AppendSongs(Playlist* playlist_view, Playlist* playlist, std::vector<Song*>& songs)
+{
+	for (unsigned int i = 0; i < songs.size(); i++)
+	{
+		SongAddRef(songs[i]);
+		SongStoreAdd(songs[i]);
+		PlaylistNode* view_node = PlaylistPushBack(playlist_view, songs[i]);
+		PlaylistNode* node = PlaylistPushBack(playlist, songs[i]);
+		view_node->link = node;
+		node->link = view_node;
+	}
+}
+
+
+// Adds the songs to the end of playlist_view and playlist
+static void AddSongsToPlaylist(AppState* state, std::vector<Song*>& songs)
+{
+	AppendSongs(&state->playlist_view, &state->playlist, songs);
+
+	// Added songs get their own places in the shuffle order
+	PlaylistNode* node = songs.size() ? PlaylistNodeAt(&state->playlist, PlaylistCount(&state->playlist) - songs.size()) : NULL;
+	for (; node; node = PlaylistNext(node))
+	{
+		node->song->play_node = node;
+		if (state->shuffle.seed != 0)
+		{
+			node->shuffle_ordinal = ShuffleAdd(&state->shuffle);
+			if (node->shuffle_ordinal >= state->shuffle_nodes.size())
+				state->shuffle_nodes.resize(node->shuffle_ordinal + 1);
+			state->shuffle_nodes[node->shuffle_ordinal] = node;
+		}
+	}
+	if (state->is_search_indexed)
+	{
+		for (unsigned int i = 0; i < songs.size(); i++)
+			AddSearchEntry(state->search, songs[i]);
+	}
+}
+
+
+// Frees the new songs whose files are already in the shown playlist, or earlier in songs, before any of
+// them are opened.  The song store is a hash set of every song's path, and the songs of the shown
+// playlist are the ones with a play node, so each song is checked in O(1).  The new songs are put
+// in the store here, so a file that is in songs twice is caught too.
+static void SkipAddedSongs(std::vector<Song*>& songs)
+{
+	std::unordered_set<Song*> added;
+	added.reserve(songs.size());
+	unsigned int num_kept = 0;
+	for (unsigned int i = 0; i < songs.size(); i++)
+	{
+		Song* stored = SongStoreFind(songs[i]);
+		if (stored && (stored->play_node || added.count(stored)))
+		{
+			FreeSong(songs[i]);
+			continue;
+		}
+		if (stored == NULL)
+		{
+			SongStoreAdd(songs[i]);
+			stored = songs[i];
+		}
+		added.insert(stored);
+		songs[num_kept++] = songs[i];
+	}
+	songs.resize(num_kept);
+}
+
+
+// Replaces each new song with the stored song that has the same path, so a file that is already in
+// another playlist isn't opened again and isn't stored twice.  A stored song that has a play node
+// is already in the shown playlist, so a saved playlist that has a file twice still gets a
+// separate song for each.
+static void ShareStoredSongs(std::vector<Song*>& songs)
+{
+	std::unordered_set<Song*> shared;
+	for (unsigned int i = 0; i < songs.size(); i++)
+	{
+		Song* stored = SongStoreFind(songs[i]);
+		if (stored == NULL || stored == songs[i] || stored->play_node || !shared.insert(stored).second)
+			continue;
+		FreeSong(songs[i]);
+		songs[i] = stored;
+	}
+}
+
+
+// Puts playlist back in the same order as playlist_view, e.g. when shuffle is turned off
+static void ResetPlayOrder(AppState* state)
+{
+	const unsigned int num_songs = PlaylistCount(&state->playlist_view);
+	std::vector<PlaylistNode*> nodes(num_songs);
+	PlaylistGetNodes(&state->playlist_view, nodes.data());
+	for (unsigned int i = 0; i < num_songs; i++)
+		nodes[i] = nodes[i]->link;
+	PlaylistRebuild(&state->playlist, nodes.data(), num_songs);
+}
+
+
+// Gives the songs in playlist the shuffle ordinals 0 to n - 1, in play order, so an ordinal is
+// also the song's index until the playlist is edited.  Call before ShuffleReset() or ShuffleRestore().
+static void NumberShuffleSongs(AppState* state)
+{
+	state->shuffle_nodes.resize(PlaylistCount(&state->playlist));
+	unsigned int ordinal = 0;
+	for (PlaylistNode* node = PlaylistFirst(&state->playlist); node; node = PlaylistNext(node))
+	{
+		node->shuffle_ordinal = ordinal;
+		state->shuffle_nodes[ordinal++] = node;
+	}
+}
+
+
+// Index in playlist of the song with a shuffle ordinal, or -1 if ordinal is -1
+static int GetShuffleSongIndex(AppState* state, int ordinal)
+{
+	return (ordinal >= 0) ? (int)PlaylistIndexOf(state->shuffle_nodes[ordinal]) : -1;
+}
+
+
+// Index in playlist of the song to play after the current one, or -1 if there isn't one.  Songs in
+// the play next queue come first.  Otherwise, if shuffle is on, shuffle_pos is where the shuffle
+// order moves to when that song is selected.
+static int FindNextSong(AppState* state, ShufflePosition* shuffle_pos)
+{
+	PlaylistNode* queued_node = PlayQueuePeek(&state->play_queue);
+	if (queued_node)
+		return (int)PlaylistIndexOf(queued_node);
+
+	// Queued songs don't move the shuffle order, so it continues from where it was
+	if (state->options.shuffle)
+		return GetShuffleSongIndex(state, ShuffleFindNext(&state->shuffle, state->options.repeat, shuffle_pos));
+
+	// After the queued songs, the playlist continues from the song that was playing before them
+	const int curr_pl_idx = state->play_queue.resume_node ? (int)PlaylistIndexOf(state->play_queue.resume_node)
+		: GetPlaylistCurrentIndex(state);
+	if (curr_pl_idx == -1)
+	{
+		// User deleted the current song.  Go back to beginning of playlist.
+		return PlaylistCount(&state->playlist) ? 0 : -1;
+	}
+	return GetNextSongIndex(curr_pl_idx, PlaylistCount(&state->playlist), state->options.repeat);
+}
+
+
+// Same as FindNextSong(), for the song before the current one
+static int FindPrevSong(AppState* state, ShufflePosition* shuffle_pos)
 {
-	for (unsigned int i = 0; i < playlist.size(); i++)
+	if (state->options.shuffle)
+		return GetShuffleSongIndex(state, ShuffleFindPrev(&state->shuffle, state->options.repeat, shuffle_pos));
+
+	const int curr_pl_idx = GetPlaylistCurrentIndex(state);
+	if (curr_pl_idx == -1)
 	{
-		if (playlist[i]->is_current)
-			return (int) i;
+		// User deleted the current song.  Go back to beginning of playlist.
+		return PlaylistCount(&state->playlist) ? 0 : -1;
 	}
-	return -1;
+	return GetPrevSongIndex(curr_pl_idx, PlaylistCount(&state->playlist), state->options.repeat);
 }
 
+
 static int GetPrevSongIndex(unsigned int curr_idx, unsigned int pl_size, bool repeat)
 {
 	int result;
@@ -1557,34 +3355,26 @@ static int GetPrevSongIndex(unsigned int curr_idx, unsigned int pl_size, bool re
 
 static bool SelectPrevSong(AppState* state)
 {
-	int curr_pl_idx = GetPlaylistCurrentIndex(state->playlist);
-	//int curr_pl_view_idx = GetPlaylistCurrentIndex(state->playlist_view);
-
-	int prev_idx = -1;
-	if (state->curr_song == NULL || curr_pl_idx == -1)
-	{
-		// User deleted the current song.  Go back to beginning of playlist.
-		prev_idx = 0;
-	}
-	else
+	ShufflePosition shuffle_pos;
+	const int prev_idx = FindPrevSong(state, &shuffle_pos);
+	PlaylistNode* node = (prev_idx >= 0) ? PlaylistNodeAt(&state->playlist, prev_idx) : NULL;
+	if (node != NULL)
 	{
-		prev_idx = GetPrevSongIndex(curr_pl_idx, state->playlist.size(), state->options.repeat);
-	}
-
-	if (prev_idx >= 0)
-	{
-		if (state->curr_song != NULL)
-			state->curr_song->is_current = false;
-		state->curr_song = state->playlist[prev_idx];
-		state->curr_song->is_current = true;
+		if (state->options.shuffle)
+			ShuffleMoveTo(&state->shuffle, &shuffle_pos);
+		PlaylistNode* prev_node = state->curr_node;
+		SetCurrentSong(state, node);
+		state->play_queue.resume_node = NULL;
 
 		// Find this item in the view playlist and scroll to ensure it is visible
-		int curr_pl_view_idx = GetPlaylistCurrentIndex(state->playlist_view);
-		ListView_EnsureVisible(state->controls.playlist_hwnd, curr_pl_view_idx, FALSE);
+		int curr_row = GetPlaylistViewIndexRow(state, GetPlaylistViewCurrentIndex(state));
+		if (curr_row >= 0)
+			ListView_EnsureVisible(state->controls.playlist_hwnd, curr_row, FALSE);
 		
 		if (LoadCurrentSong(state))
 		{
-			RedrawPlaylistWindow(state->controls.playlist_hwnd, state->playlist.size());
+			RedrawPlaylistSong(state, prev_node);
+			RedrawPlaylistSong(state, state->curr_node);
 			return true;
 		}
 	}
@@ -1608,36 +3398,49 @@ static int GetNextSongIndex(unsigned int curr_idx, unsigned int pl_size, bool re
 	return result;
 }
 
-static bool SelectNextSong(AppState* state)
+// Takes the song to play after the current one out of the play next queue, or moves the shuffle order
+// to it.  Returns its node in playlist, or NULL if there isn't one.
+static PlaylistNode* TakeNextSong(AppState* state)
 {
-	int curr_pl_idx = GetPlaylistCurrentIndex(state->playlist);
-
-	int next_idx = -1;
-	if (state->curr_song == NULL || curr_pl_idx == -1)
+	ShufflePosition shuffle_pos;
+	PlaylistNode* node = PlayQueuePop(&state->play_queue);
+	if (node != NULL)
 	{
-		// User deleted the current song.  Go back to beginning of playlist.
-		next_idx = 0;
+		// Remember where the playlist was, unless the current song is also from the queue
+		if (state->play_queue.resume_node == NULL)
+			state->play_queue.resume_node = state->curr_node;
 	}
 	else
 	{
-		next_idx = GetNextSongIndex(curr_pl_idx, state->playlist.size(), state->options.repeat);
+		const int next_idx = FindNextSong(state, &shuffle_pos);
+		node = (next_idx >= 0) ? PlaylistNodeAt(&state->playlist, next_idx) : NULL;
+		if (node != NULL)
+		{
+			if (state->options.shuffle)
+				ShuffleMoveTo(&state->shuffle, &shuffle_pos);
+			state->play_queue.resume_node = NULL;
+		}
 	}
+	return node;
+}
 
-	if (next_idx >= 0)
+static bool SelectNextSong(AppState* state)
+{
+	PlaylistNode* node = TakeNextSong(state);
+	if (node != NULL)
 	{
-		if (state->curr_song != NULL)
-			state->curr_song->is_current = false;
-		
-		state->curr_song = state->playlist[next_idx];
-		state->curr_song->is_current = true;
+		PlaylistNode* prev_node = state->curr_node;
+		SetCurrentSong(state, node);
 
 		// Find this item in the view playlist and scroll to ensure it is visible
-		int curr_pl_view_idx = GetPlaylistCurrentIndex(state->playlist_view);
-		ListView_EnsureVisible(state->controls.playlist_hwnd, curr_pl_view_idx, FALSE);
+		int curr_row = GetPlaylistViewIndexRow(state, GetPlaylistViewCurrentIndex(state));
+		if (curr_row >= 0)
+			ListView_EnsureVisible(state->controls.playlist_hwnd, curr_row, FALSE);
 
 		if (LoadCurrentSong(state))
 		{
-			RedrawPlaylistWindow(state->controls.playlist_hwnd, state->playlist.size());
+			RedrawPlaylistSong(state, prev_node);
+			RedrawPlaylistSong(state, state->curr_node);
 			return true;
 		}
 	}
@@ -1656,6 +3459,8 @@ static void Initialize(AppState* state)
 	state->controls.playlist_hwnd = CreatePlaylistWindow(state->main_hwnd,
 		state->instance, state->gdi.playlist_font_normal, state->options.playlist_size);
 	CreateGDIObjects(state);
+	state->controls.txt_search = CreateSearchBox(state->main_hwnd, state->instance, 
+		state->gdi.playlist_font_normal, state->options.playlist_size);
 
 	// Use SetTimer() to cause WM_TIMER message to fire every interval for updating 
 	// song menu_pos and time elapsed
@@ -1723,6 +3528,16 @@ LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 				SetWindowPos(hwnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE);
 		} break;
 
+		case WM_AUDIO_HASH_DONE:
+		{
+			AudioHashDoneHandler(state, (AudioHashJob*)lParam);
+		} break;
+
+		case WM_DROPFILES:
+		{
+			DropFiles(state, (HDROP)wParam);
+		} break;
+
 		case WM_CLOSE:
 		{
 			state->is_running = false;
@@ -1802,11 +3617,7 @@ LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 				case BTN_DELETE:
 				{
-					const int sel_idx = SendMessage(state->controls.playlist_hwnd, LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED);
-					if (sel_idx >= 0)
-					{
-						DeleteSongFromPlaylist(state, sel_idx);
-					}
+					DeleteSelectedSongs(state);
 				} break;
 
 				case BTN_MOVE_UP:
@@ -1825,6 +3636,12 @@ LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 					SettingsBtnHandler(state);
 				} break;
 
+				case TXT_SEARCH:
+				{
+					if (HIWORD(wParam) == EN_CHANGE)
+						FilterPlaylist(state);
+				} break;
+
 				case IDM_ALWAYS_ON_TOP:
 				{
 					state->options.always_on_top = !state->options.always_on_top;
@@ -1862,7 +3679,7 @@ LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 				case IDM_ABOUT:
 				{
-					AboutDlgState* about_dlg_state = (AboutDlgState*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(AboutDlgState));
+					AboutDlgState* about_dlg_state = (AboutDlgState*)AllocMemory(ALLOC_UI, sizeof(AboutDlgState));
 					about_dlg_state->bg_brush = state->gdi.main_bg_brush;
 					about_dlg_state->bg_color = BACKGROUND_COLOR;
 					about_dlg_state->text_color = TEXT_COLOR;
@@ -1877,6 +3694,79 @@ LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 				{
 					state->is_running = false;
 				} break;
+
+				case IDM_SMART_PLAYLIST_NONE:
+				{
+					SelectSmartPlaylist(state, NULL);
+				} break;
+
+				case IDM_FIND_DUPLICATES:
+				{
+					FindDuplicateSongs(state);
+				} break;
+
+				case IDM_MEMORY_STATS:
+				{
+					ShowMemoryStats(state);
+				} break;
+
+				case IDM_SAVE_PLAYLIST:
+				{
+					SavePlaylistFile(state);
+				} break;
+
+				case IDM_UNDO:
+				{
+					UndoPlaylistEdit(state, false);
+				} break;
+
+				case IDM_REDO:
+				{
+					UndoPlaylistEdit(state, true);
+				} break;
+
+				case IDM_NEW_PLAYLIST:
+				{
+					NewPlaylist(state);
+				} break;
+
+				case IDM_DELETE_PLAYLIST:
+				{
+					DeletePlaylist(state);
+				} break;
+
+				case IDM_SORT_BY_ARTIST:
+				case IDM_SORT_BY_ALBUM:
+				case IDM_SORT_BY_TRACK:
+				case IDM_SORT_BY_TITLE:
+				{
+					SortPlaylist(state, (PlaylistSortType)(SORT_BY_ARTIST + ctrl_id - IDM_SORT_BY_ARTIST));
+				} break;
+
+				case IDM_CROSSFADE_EQUAL_POWER:
+				{
+					state->options.crossfade_curve = CROSSFADE_EQUAL_POWER;
+					UpdatePlayerCrossfade(state);
+				} break;
+
+				case IDM_CROSSFADE_LINEAR:
+				{
+					state->options.crossfade_curve = CROSSFADE_LINEAR;
+					UpdatePlayerCrossfade(state);
+				} break;
+
+				default:
+				{
+					if (ctrl_id >= IDM_SMART_PLAYLIST_FIRST && ctrl_id < IDM_SMART_PLAYLIST_FIRST + state->smart_playlists.size())
+						SelectSmartPlaylist(state, state->smart_playlists[ctrl_id - IDM_SMART_PLAYLIST_FIRST]);
+					else if (ctrl_id >= IDM_PLAYLIST_TAB_FIRST && ctrl_id < IDM_PLAYLIST_TAB_FIRST + state->tabs.size())
+						SwitchPlaylist(state, ctrl_id - IDM_PLAYLIST_TAB_FIRST);
+					else if (ctrl_id >= IDM_CROSSFADE_SECS_FIRST && ctrl_id <= IDM_CROSSFADE_SECS_FIRST + CROSSFADE_MAX_SECS)
+					{
+						state->options.crossfade_secs = ctrl_id - IDM_CROSSFADE_SECS_FIRST;
+						UpdatePlayerCrossfade(state);
+					}
+				} break;
 			}
 
 		} break;
@@ -1896,22 +3786,20 @@ LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 			HWND sender = (HWND)wParam;
 			if (sender == state->controls.tb_pos)
 			{
-				if (state->bass_stream)
+				if (state->player.stream)
 				{
 					// User changed the song menu_pos trackbar.  Seek to the specified location.
 					int new_pos = (int)lParam;
 					// Must cast to double to force floating point division
 					double pos = (new_pos / (double)state->curr_song->song_length_secs) * 
-						state->curr_song->song_length_bytes;
-					if (!BASS_ChannelSetPosition(state->bass_stream, (QWORD)pos, BASS_POS_BYTE))
+						PlayerGetLength(&state->player);
+					if (!PlayerSetPosition(&state->player, (QWORD)pos))
 					{
 						OutputDebugString("BASS Error while Seeking\n");
 						break;
 					}
-					if (state->curr_song->metadata.title)
-						SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)state->curr_song->metadata.title);
-					else
-						SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)state->curr_song->file_name);
+					const char* title = SongGetDetails(state->curr_song)->metadata.title;
+					SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)(title ? title : state->curr_song->file_name));
 					
 				}
 			}
@@ -1920,10 +3808,8 @@ LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 				// User is done changing the volume, so put old text back
 				if (state->curr_song != NULL)
 				{
-					if (state->curr_song->metadata.title)
-						SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)state->curr_song->metadata.title);
-					else
-						SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)state->curr_song->file_name);
+					const char* title = SongGetDetails(state->curr_song)->metadata.title;
+					SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)(title ? title : state->curr_song->file_name));
 				}
 				else
 				{
@@ -1938,7 +3824,7 @@ LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 			HWND sender = (HWND)wParam;
 			if (sender == state->controls.tb_pos)
 			{
-				if (state->bass_stream)
+				if (state->player.stream)
 				{
 					// User is currently dragging the menu_pos trackbar.  Don't seek until user is
 					// finished.  But, we can display the potential location where title normally is.
@@ -1955,8 +3841,7 @@ LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 				char vol_text[16];
 				StringCbPrintfA(vol_text, 16, "Volume:  %u%%", state->volume);
 				SendMessage(state->controls.lbl_title, WM_SETTEXT, 0, (LPARAM)vol_text);
-				if (state->bass_stream)
-					BASS_ChannelSetAttribute(state->bass_stream, BASS_ATTRIB_VOL, state->volume / 100.0f);
+				PlayerSetVolume(&state->player, state->volume / 100.0f);
 			}
 		} break;
 
@@ -2037,6 +3922,19 @@ LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 					LPNMLVKEYDOWN key_info = (LPNMLVKEYDOWN)lParam;
 					SendMessage(state->main_hwnd, WM_KEYDOWN, (WPARAM)key_info->wVKey, 0);
 				}
+				else if (msg_info->code == LVN_GETDISPINFOW)
+				{
+					NMLVDISPINFOW* disp_info = (NMLVDISPINFOW*)lParam;
+					GetPlaylistItemText(state, &disp_info->item);
+				}
+				else if (msg_info->code == LVN_COLUMNCLICK)
+				{
+					LPNMLISTVIEW column_info = (LPNMLISTVIEW)lParam;
+					if (column_info->iSubItem == PL_COL_LENGTH)
+						SortPlaylist(state, SORT_BY_LENGTH);
+					else
+						ShowSongSortMenu(state);
+				}
 			}
 
 		} break;
@@ -2078,11 +3976,17 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line,
 
 	if (RegisterClass(&main_class))
 	{
-		AppState* state = (AppState*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(AppState));
+		AppState* state = (AppState*)AllocMemory(ALLOC_UI, sizeof(AppState));
+		state->library = LibraryIndexCreate();
+		state->is_library_indexed = true;		// Empty, like the playlist
+		state->search = FuzzyMatcherCreate();
+		state->history = UndoHistoryCreate(UNDO_MEMORY_BUDGET);
 
 		// Read the settings from the INI file
-		GetINIFilePath(state->ini_path, MAX_PATH);
+		GetProgramFilePath(state->ini_path, MAX_PATH, SETTINGS_INI_FILE_NAME);
 		ReadSettings(state, state->ini_path);
+		ReadSmartPlaylists(state, state->ini_path);
+		MemoryBudgetSetDistanceFunc(GetPlayDistances, state);
 		
 		// Create the main window
 		HWND main_hwnd = CreateWindow(main_class.lpszClassName, "Winphonic", WS_VISIBLE | WS_POPUP, 
@@ -2096,12 +4000,16 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line,
 				return 0;
 			}
 		}
+		PlayerInit(&state->player);
+		UpdatePlayerCrossfade(state);
 
+		ReadPlaylistTabs(state, state->ini_path);
 		ReadPlaylistFromSettings(state, state->ini_path);
 		
 		// Message processing loop
 		if (main_hwnd)
 		{
+			DragAcceptFiles(main_hwnd, TRUE);
 			state->is_running = true;
 			while (state->is_running)
 			{
@@ -2124,9 +4032,16 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line,
 			}
 
 			// Clean up before shutting down.
+			AudioHashJobFree(state->audio_hash_job);
+			UnloadCurrentSong(state);
+			PlayerFree(&state->player);
 			BASS_Free();
 			KillTimer(main_hwnd, TIMER_UPDATE_SONG_POS);
 			WriteSettings(state, state->ini_path);
+
+			char stats_path[MAX_PATH];
+			GetProgramFilePath(stats_path, MAX_PATH, MEMORY_STATS_FILE_NAME);
+			WriteAllocStatsFile(stats_path);
 		}
 	}
 
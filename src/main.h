@@ -60,8 +60,12 @@ SOFTWARE.
 #include <Windows.h>
 #include <stdio.h>
 #include <CommCtrl.h>
+#include <shellapi.h>
 #include <vector>
 #include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <strsafe.h>
 
 #include "resource.h"
@@ -73,6 +77,22 @@ SOFTWARE.
 #include "text_label.h"
 #include "img_label.h"
 #include "metadata.h"
+#include "song.h"
+#include "path_table.h"
+#include "memory_budget.h"
+#include "playlist.h"
+#include "shuffle.h"
+#include "library_index.h"
+#include "collate.h"
+#include "fuzzy.h"
+#include "query.h"
+#include "prefetch.h"
+#include "player.h"
+#include "audio_hash.h"
+#include "snapshot.h"
+#include "playlist_file.h"
+#include "play_queue.h"
+#include "undo_history.h"
 #include "about_dialog.h"
 
 static HWND g_about_dlg_hwnd;		// Handle for the "About" dialog box
@@ -92,6 +112,8 @@ static HWND g_about_dlg_hwnd;		// Handle for the "About" dialog box
 #define PLAYLIST_TEXT_COLOR			RGB(0, 0, 0)		// Font color for normal song in playlist
 #define PLAYLIST_CURRENT_COLOR		RGB(0, 175, 0)		// Font color for current song in playlist
 #define PLAYLIST_INVALID_COLOR		RGB(150, 150, 150)	// Font color for invalid song in playlist
+#define PLAYLIST_DUPLICATE_COLOR	RGB(200, 100, 0)	// Font color for song with the same audio as another song
+#define PLAYLIST_QUEUED_COLOR		RGB(0, 90, 200)		// Font color for song in the play next queue
 #define PLAYLIST_AREA_COLOR			RGB(90, 90, 90)		// Background color for area around playlist
 
 // Control IDs for WM_COMMAND messages
@@ -120,11 +142,30 @@ static HWND g_about_dlg_hwnd;		// Handle for the "About" dialog box
 #define LBL_TIME_LEN		205		// Length of song (or time remaining)
 #define LBL_PL_INFO			206		// Playlist info
 #define LBL_ALBUM_ART		300		// Image label for showing album art
+#define TXT_SEARCH			400		// Search box for filtering the playlist
+
+// Playlist ListView columns
+#define PL_COL_SONG			0
+#define PL_COL_LENGTH		1
 
 // Timer IDs
 #define TIMER_UPDATE_SONG_POS		1
 #define TIMER_REVERT_TITLE			2
 
+// The song after the current one is opened when the current one has this many seconds left, plus the
+// length of the crossfade
+#define PREPARE_NEXT_SONG_SECS		10
+
+// Crossfade lengths offered in the settings menu go up to this in steps of CROSSFADE_SECS_STEP
+#define CROSSFADE_MAX_SECS			(PLAYER_MAX_CROSSFADE_MS / 1000)
+#define CROSSFADE_SECS_STEP			2
+
+// Window messages
+#define WM_AUDIO_HASH_DONE			(WM_APP + 1)	// lParam is the finished AudioHashJob
+
+// Bytes of a M3U, PLS, or XSPF file read at a time
+#define PLAYLIST_IMPORT_CHUNK_SIZE	(256 * 1024)
+
 // IDs for popup menu items
 #define IDM_ALWAYS_ON_TOP	1
 #define IDM_SNAP_TO_EDGES	2
@@ -133,15 +174,39 @@ static HWND g_about_dlg_hwnd;		// Handle for the "About" dialog box
 #define IDM_PLAYLIST_LARGE	5
 #define IDM_ABOUT			6
 #define IDM_EXIT			7
+#define IDM_SMART_PLAYLIST_NONE		8
+#define IDM_FIND_DUPLICATES			9
+#define IDM_SAVE_PLAYLIST			10
+#define IDM_UNDO					11
+#define IDM_REDO					12
+#define IDM_NEW_PLAYLIST			13
+#define IDM_DELETE_PLAYLIST			14
+#define IDM_MEMORY_STATS			15
+#define IDM_CROSSFADE_EQUAL_POWER	16
+#define IDM_CROSSFADE_LINEAR		17
+#define IDM_SORT_BY_ARTIST			18		// IDM_SORT_BY_ARTIST to IDM_SORT_BY_TITLE are in PlaylistSortType order
+#define IDM_SORT_BY_ALBUM			19
+#define IDM_SORT_BY_TRACK			20
+#define IDM_SORT_BY_TITLE			21
+#define IDM_SMART_PLAYLIST_FIRST	1000	// IDs from here up are the entries of AppState::smart_playlists
+#define IDM_PLAYLIST_TAB_FIRST		2000	// IDs from here up are the entries of AppState::tabs
+#define IDM_CROSSFADE_SECS_FIRST	3000	// IDM_CROSSFADE_SECS_FIRST + n is a crossfade of n seconds
 
 // Settings INI file
 #define SETTINGS_SECTION		"Winphonic Settings"
 #define SETTINGS_INI_FILE_NAME	"settings.ini"
+#define SNAPSHOT_FILE_NAME		"playlist.dat"			// The first playlist
+#define SNAPSHOT_TAB_FILE_NAME	"playlist%u.dat"		// The other playlists, numbered from 2
+#define SMART_PLAYLISTS_SECTION	"Smart Playlists"		// Each line is Name=Query
+#define PLAYLISTS_SECTION		"Playlists"				// Each line is PlaylistN=Name
+#define MEMORY_STATS_FILE_NAME	"memory_stats.txt"		// Heap use per subsystem, written at exit
+
+#define PLAYLIST_NAME_MAX		64
 
 
 enum PlayerStateType { STOPPED, PLAYING, PAUSED };
-enum FileFormat { MP3, OGG, AAC, FLAC };
 enum PlaylistSize { SMALL = 250, MEDIUM = 500, LARGE = 750};
+enum PlaylistSortType { SORT_NONE, SORT_BY_ARTIST, SORT_BY_ALBUM, SORT_BY_TRACK, SORT_BY_TITLE, SORT_BY_LENGTH };
 
 struct ControlHandles {
 	HWND tb_pos;
@@ -172,29 +237,11 @@ struct ControlHandles {
 	HWND btn_move_down;
 	HWND btn_more;
 	HWND playlist_hwnd;
+	HWND txt_search;
 	HWND dlg_about;
 
 };
 
-// Entries in the playlist
-struct Song {
-	bool is_current;
-	bool is_valid;		// Invalid (e.g. deleted) songs will be drawn in playlist grayed out
-	AudioFileMetadata metadata;
-	char* playlist_song_name;
-	char song_length_str[8] = {};	// Song length displayed in playlist (e.g. "4:13")
-	unsigned int song_length_secs = 0;
-	QWORD song_length_bytes;	// Song length in bytes.  QWORD = unsigned int64
-	char* path;					// Full file path including file name, e.g. C:\Music\Directory\Artist - Song.mp3
-	char* file_name;			// e.g. Artist - Song.mp3
-	unsigned int bitrate;		// e.g. 256 kbps
-	unsigned int frequency;		// e.g. 44100 hertz
-	bool is_stereo;
-	FileFormat format;
-	bool has_info;				// Was song info already looked up?
-};
-
-
 struct GDIObjects {
 	HBRUSH main_bg_brush;
 	HBRUSH titlebar_brush;
@@ -213,18 +260,54 @@ struct Options {
 	PlaylistSize playlist_size;
 	int x;
 	int y;
+	unsigned int memory_budget_mb;	// Most memory the album art of the songs can use
+	unsigned int crossfade_secs;	// 0 to play songs back to back without a fade
+	CrossfadeCurve crossfade_curve;
 };
 
 // Main application state
+// A named playlist.  The lists of the active playlist are kept in AppState, and the others are kept
+// here until they are switched to.  Songs are shared between the playlists through the song store, so
+// a file in several playlists is loaded and stored once, and each playlist only adds its own nodes.
+struct PlaylistTab {
+	char name[PLAYLIST_NAME_MAX];
+	Playlist playlist_view;
+	Playlist playlist;
+	ShuffleOrder shuffle;
+	std::vector<PlaylistNode*> shuffle_nodes;
+	UndoHistory* history;
+};
+
 struct AppState {
 	HINSTANCE instance;
 	HWND main_hwnd;
 	ControlHandles controls;
 	GDIObjects gdi;
-	std::vector<Song*> playlist_view;	// Playlist as shown in the playlist ListView window
-	std::vector<Song*> playlist;		// Actual playlist. If shuffle is on, it will be different order from playlist_view
+	Playlist playlist_view;				// Playlist as shown in the playlist ListView window
+	Playlist playlist;					// Actual playlist.  Same order as playlist_view, unless songs were sorted or moved
+										// while shuffle was on.  If shuffle is on, the songs are played in the order of shuffle.
+										// The link of each node is the same song's node in the other playlist.
 	Song* curr_song;					// Pointer to the current song
-	HSTREAM bass_stream;
+	PlaylistNode* curr_node;			// Node of the current song in playlist (NOT playlist_view)
+	ShuffleOrder shuffle;				// Play order of the songs in playlist when shuffle is on
+	std::vector<PlaylistNode*> shuffle_nodes;	// Node in playlist of each shuffle ordinal, or NULL if it was deleted
+	PlayQueue play_queue;				// Songs to play next, before continuing in playlist or shuffle order
+	UndoHistory* history;				// Earlier and later versions of the playlist, for undo and redo
+	LibraryIndex* library;				// Columnar index of the metadata of every song in playlist_view
+	bool is_library_indexed;			// Has library been built?  Once it has, every edit of playlist_view updates it.
+	PlaylistSortType sort_type;			// How playlist_view was last sorted by clicking a column header
+	bool sort_descending;
+	FuzzyMatcher* search;				// Fuzzy matcher for the search box.  Entry i is playlist_view[i].
+	bool is_search_indexed;				// Has search been built?  Once it has, every edit of playlist_view updates it.
+	std::vector<SmartPlaylist*> smart_playlists;	// Saved queries from the INI file
+	SmartPlaylist* active_smart_playlist;			// Smart playlist shown in the ListView, or NULL for all songs
+	bool is_filtered;					// Is the ListView only showing some of playlist_view?
+	std::vector<unsigned int> filter_rows;		// If is_filtered, the playlist_view index of each ListView row
+	std::vector<int> view_index_rows;			// If is_filtered, the ListView row of each playlist_view index, or -1
+	AudioHashJob* audio_hash_job;		// Background job hashing the songs to find duplicates, or NULL
+	Player player;						// Plays the current song, and joins the next one on without a gap
+	Song* next_song;					// Song given to player to play next, or NULL.  Holds a reference.  Its
+										// play_node is where it is in the playlist, or NULL if it was deleted.
 	PlayerStateType player_state = STOPPED;
 	unsigned int volume;
 	Options options;
@@ -232,6 +315,8 @@ struct AppState {
 	bool is_running = false;			// Is the program running?
 	int width;							// Current window width
 	int height;							// Current window height
+	std::vector<PlaylistTab*> tabs;		// Every playlist, in menu order
+	unsigned int active_tab;			// Index in tabs of the playlist in playlist_view and playlist
 	char ini_path[MAX_PATH];			// Full path to INI settings file
 };
 
@@ -254,38 +339,107 @@ static void RepeatBtnHandler(AppState* state, bool toggle);
 static void MoveUpBtnHandler(AppState* state);
 static void MoveDownBtnHandler(AppState* state);
 static void SettingsBtnHandler(AppState* state);
+static void SortPlaylist(AppState* state, PlaylistSortType sort_type);
+static void ShowSongSortMenu(AppState* state);
+static void SetPlaylistSortArrow(HWND playlist_hwnd, int column, bool descending);
 static void ResetPositionTrackbar(HWND tb_pos, int min, int max, int pos);
 static void ClearInfoLabels(ControlHandles* controls, HWND main_hwnd);
 static void ResizePlaylist(int playlist_size, HWND main_hwnd, ControlHandles* controls,
 	bool* is_playlist_visible, bool always_on_top);
-static void FreeSong(Song* song);
-static void DeleteSongFromPlaylist(AppState* state, int pl_view_idx_to_del);
+static void QueueSelectedSongs(AppState* state, bool remove);
+static void RemoveSongs(AppState* state, std::vector<PlaylistNode*>& view_nodes);
+static void EndPlaylistEdit(AppState* state);
+static void RestorePlaylistVersion(AppState* state, const PlaylistVersion* version);
+static void UndoPlaylistEdit(AppState* state, bool redo);
+static void GetPlaylistSnapshotPath(unsigned int index, char* path, size_t len);
+static void SkipAddedSongs(std::vector<Song*>& songs);
+static void ShareStoredSongs(std::vector<Song*>& songs);
+static void AppendSongs(Playlist* playlist_view, Playlist* playlist, std::vector<Song*>& songs);
+static void LoadPlaylistLists(std::vector<Song*>& songs, const std::vector<unsigned int>& play_order, bool shuffle,
+	Playlist* playlist_view, Playlist* playlist, UndoHistory* history, LibraryIndex* library);
+static void ReadPlaylistTabs(AppState* state, char* ini_path);
+static void WritePlaylistTabs(AppState* state, char* ini_path);
+static void SwitchPlaylist(AppState* state, unsigned int index);
+static void NewPlaylist(AppState* state);
+static void DeletePlaylist(AppState* state);
+static void DeleteSelectedSongs(AppState* state);
 static void UpdateInfoLabels(AppState* state, bool display_song_len);
 static void TogglePlaylistVisible(HWND hwnd, bool* is_playlist_visible, bool toggle, 
 	int playlist_size, HWND btn_playlist, bool always_on_top);
-static void GetSongInfo(Song* song);
+static HSTREAM CreateSongStream(const Song* song, DWORD flags);
+static void GetSongInfo(Song* song, MetadataArena* arena);
+static void GetMp3GaplessInfo(const Song* song, HSTREAM stream, const char* id3v2_buffer, GaplessInfo* gapless);
+static HSTREAM CreateSongDecoder(const Song* song, const GaplessInfo** gapless);
+static void LoadAlbumArt(Song* song, HSTREAM stream);
+static void GetPlaylistSongInfo(std::vector<Song*>& songs, LibraryIndex* library);
+static LibraryIndex* GetBuiltLibraryIndex(AppState* state);
+static void BuildLibraryIndex(AppState* state);
 static void RedrawPlaylistWindow(HWND playlist_hwnd, unsigned int num_items);
-static void UpdatePlaylistWindow(HWND playlist_hwnd, std::vector<Song*>& playlist_view, HWND lbl_pl_info);
-static void GetPlaylistFromFileList(std::vector<Song*>& playlist_view, char* file_list, size_t file_list_len);
-static void GetPlaylistFromFileBuffer(std::vector<Song*>& playlist_view, char* file_buffer, const int file_buffer_size,
+static void RedrawPlaylistSong(AppState* state, const PlaylistNode* node);
+static void UpdatePlaylistWindow(AppState* state);
+static void AddSearchEntry(FuzzyMatcher* search, const Song* song);
+static void BuildSearchIndex(AppState* state);
+static void FilterPlaylist(AppState* state);
+static unsigned int GetPlaylistRowCount(AppState* state);
+static int GetPlaylistRowViewIndex(AppState* state, int row);
+static int GetPlaylistViewIndexRow(AppState* state, int pl_view_idx);
+static int GetSelectedViewIndex(AppState* state);
+static void GetPlaylistItemText(AppState* state, LVITEMW* item);
+static void GetPlaylistFromFileList(std::vector<Song*>& songs, char* file_list, size_t file_list_len);
+static void GetPlaylistFromFileBuffer(std::vector<Song*>& songs, char* file_buffer, const int file_buffer_size,
 	const int file_offset, char* file_title);
 static void OpenFile(AppState* state, bool is_add_btn);
+static void DropFiles(AppState* state, HDROP drop);
+static void OpenSongs(AppState* state, std::vector<Song*>& songs, bool is_add);
+static bool ConvertCodePage(const char* text, UINT from_code_page, UINT to_code_page, char* result, int result_len);
+static void ImportPlaylistEntry(void* context, const PlaylistFileEntry* entry);
+static void ImportPlaylistFile(std::vector<Song*>& songs, const char* path, PlaylistFileFormat format);
+static void ExpandPlaylistFiles(std::vector<Song*>& songs);
+static bool WritePlaylistFileData(void* context, const char* data, size_t len);
+static void SavePlaylistFile(AppState* state);
 static void CreateButtons(ControlHandles* controls, HWND main_hwnd, HINSTANCE instance, int playlist_size);
 static void CreateTrackbars(ControlHandles* controls, HWND main_hwnd, HINSTANCE instance);
 static void CreateTextLabels(ControlHandles* controls, HWND main_hwnd, HINSTANCE instance, int playlist_size);
 static void CreateImgLabels(ControlHandles* controls, HWND main_hwnd, HINSTANCE instance);
 static HWND CreatePlaylistWindow(HWND main_hwnd, HINSTANCE instance, HFONT pl_font, int playlist_size);
+static HWND CreateSearchBox(HWND main_hwnd, HINSTANCE instance, HFONT font, int playlist_size);
 static void CreateGDIObjects(AppState* state);
 static bool LoadCurrentSong(AppState* state);
-static int GetPlaylistCurrentIndex(std::vector<Song*> &playlist);
+static void CurrentSongStreamOpened(AppState* state);
+static void UnloadCurrentSong(AppState* state);
+static void PrepareNextSong(AppState* state, int position_secs);
+static void CancelNextSong(AppState* state);
+static bool ShouldCrossfade(AppState* state);
+static void UpdatePlayerCrossfade(AppState* state);
+static void NextSongStarted(AppState* state);
+static void SongFinished(AppState* state);
+static int GetPlaylistCurrentIndex(AppState* state);
+static int GetPlaylistViewCurrentIndex(AppState* state);
+static void SetCurrentSong(AppState* state, PlaylistNode* node);
+static void GetPlayDistances(void* context, Song* const* songs, unsigned int num_songs, unsigned int* distances);
+static void AddSongsToPlaylist(AppState* state, std::vector<Song*>& songs);
+static void ResetPlayOrder(AppState* state);
+static void NumberShuffleSongs(AppState* state);
+static int GetShuffleSongIndex(AppState* state, int ordinal);
+static int FindNextSong(AppState* state, ShufflePosition* shuffle_pos);
+static int FindPrevSong(AppState* state, ShufflePosition* shuffle_pos);
 static int GetPrevSongIndex(unsigned int curr_idx, unsigned int pl_size, bool repeat);
 static bool SelectPrevSong(AppState* state);
 static int GetNextSongIndex(unsigned int curr_idx, unsigned int pl_size, bool repeat);
+static PlaylistNode* TakeNextSong(AppState* state);
 static bool SelectNextSong(AppState* state);
 static void Initialize(AppState* state);
 static void ReadSettings(AppState* state, char* ini_path);
+static void ReadSmartPlaylists(AppState* state, char* ini_path);
+static void SelectSmartPlaylist(AppState* state, SmartPlaylist* smart_playlist);
+static void FindDuplicateSongs(AppState* state);
+static void ShowMemoryStats(AppState* state);
+static void AudioHashDoneHandler(AppState* state, AudioHashJob* job);
+static unsigned int MarkDuplicateSongs(const Playlist* playlist_view);
+static unsigned int MarkDuplicateHashes(const std::vector<Song*>& hashed_songs);
 static void ReadPlaylistFromSettings(AppState* state, char* ini_path);
+static void ReadShuffleFromSettings(AppState* state, char* ini_path);
 static void WriteSettings(AppState* state, char* ini_path);
-static void WritePlaylistToSettings(AppState* state, char* ini_path);
+static void ReadPlaylistFilesFromSettings(std::vector<Song*>& songs, char* ini_path);
 LRESULT CALLBACK MainProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line, int show_code);
\ No newline at end of file
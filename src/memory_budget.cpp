@@ -0,0 +1,192 @@
+/******************************************************************************
+memory_budget.cpp - Memory budget for song data that can be read again from the files
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "memory_budget.h"
+#include "song.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+struct CachedItem {
+	size_t bytes;
+	unsigned long long last_used;		// Value of g_clock when the item was added or last used
+};
+
+struct EvictionCandidate {
+	Song* song;
+	unsigned int distance;
+	unsigned long long last_used;
+};
+
+static const char* g_category_names[MEM_NUM_CATEGORIES] = { "Song records", "Song details", "Album art" };
+static const bool g_is_evictable[MEM_NUM_CATEGORIES] = { false, false, true };
+
+static MemoryCategoryStats g_stats[MEM_NUM_CATEGORIES];
+static std::unordered_map<Song*, CachedItem> g_cached[MEM_NUM_CATEGORIES];
+static unsigned long long g_cached_bytes;		// Total of the evictable categories
+static unsigned long long g_clock;
+static size_t g_limit = (size_t)MEMORY_BUDGET_DEFAULT_MB * 1024 * 1024;
+static SongDistanceFunc g_distance_func;
+static void* g_distance_context;
+
+
+// Sets the most memory the cached items can use, and evicts items if they are over it
+void MemoryBudgetSetLimit(size_t limit)
+{
+	g_limit = limit;
+	MemoryBudgetTrim();
+}
+
+
+// Sets the function that tells how far songs are from the current song.  Without one, only the least
+// recently used order is used.
+void MemoryBudgetSetDistanceFunc(SongDistanceFunc distance_func, void* context)
+{
+	g_distance_func = distance_func;
+	g_distance_context = context;
+}
+
+
+// Counts memory that can't be evicted.  bytes and entries are negative when it is freed.
+void MemoryBudgetCount(MemoryCategory category, long long bytes, int entries)
+{
+	MemoryCategoryStats* stats = &g_stats[category];
+	stats->bytes += bytes;
+	stats->entries += entries;
+	if (stats->bytes > stats->peak_bytes)
+		stats->peak_bytes = stats->bytes;
+}
+
+
+// Registers an item that the song can read again, e.g. its album art.  Items over the budget are evicted
+// right away, which can include this one.
+void MemoryBudgetAddCached(Song* song, MemoryCategory category, size_t bytes)
+{
+	MemoryBudgetRemoveCached(song, category);
+	g_cached[category][song] = { bytes, ++g_clock };
+	g_cached_bytes += bytes;
+	MemoryBudgetCount(category, (long long)bytes, 1);
+	MemoryBudgetTrim();
+}
+
+
+// Unregisters the item, because the song freed it.  Does nothing if the song has no such item.
+void MemoryBudgetRemoveCached(Song* song, MemoryCategory category)
+{
+	auto it = g_cached[category].find(song);
+	if (it == g_cached[category].end())
+		return;
+	g_cached_bytes -= it->second.bytes;
+	MemoryBudgetCount(category, -(long long)it->second.bytes, -1);
+	g_cached[category].erase(it);
+}
+
+
+// Marks the item as just used, so it is evicted after items that were used longer ago
+void MemoryBudgetTouch(Song* song, MemoryCategory category)
+{
+	auto it = g_cached[category].find(song);
+	if (it != g_cached[category].end())
+		it->second.last_used = ++g_clock;
+}
+
+
+// Evicts cached items until they use at most 7/8 of the budget, so adding one item after another
+// doesn't trim every time.  Farthest from the current song first, then least recently used.
+void MemoryBudgetTrim()
+{
+	if (g_cached_bytes <= g_limit)
+		return;
+
+	std::vector<EvictionCandidate> candidates;
+	std::vector<MemoryCategory> categories;
+	for (int category = 0; category < MEM_NUM_CATEGORIES; category++)
+	{
+		if (!g_is_evictable[category])
+			continue;
+		for (auto it = g_cached[category].begin(); it != g_cached[category].end(); ++it)
+		{
+			candidates.push_back({ it->first, 0xFFFFFFFF, it->second.last_used });
+			categories.push_back((MemoryCategory)category);
+		}
+	}
+
+	if (g_distance_func && candidates.size())
+	{
+		std::vector<Song*> songs(candidates.size());
+		std::vector<unsigned int> distances(candidates.size());
+		for (size_t i = 0; i < candidates.size(); i++)
+			songs[i] = candidates[i].song;
+		g_distance_func(g_distance_context, songs.data(), (unsigned int)songs.size(), distances.data());
+		for (size_t i = 0; i < candidates.size(); i++)
+			candidates[i].distance = distances[i];
+	}
+
+	// A heap with the item to evict first on top.  Usually only a few items are evicted, so this is
+	// O(n) to build and O(log n) per eviction, instead of sorting every item.
+	std::vector<unsigned int> heap(candidates.size());
+	for (unsigned int i = 0; i < heap.size(); i++)
+		heap[i] = i;
+	auto is_evicted_later = [&candidates](unsigned int a, unsigned int b) {
+		if (candidates[a].distance != candidates[b].distance)
+			return candidates[a].distance < candidates[b].distance;
+		return candidates[a].last_used > candidates[b].last_used;
+	};
+	std::make_heap(heap.begin(), heap.end(), is_evicted_later);
+
+	const unsigned long long low_water = g_limit - g_limit / 8;
+	while (heap.size() && g_cached_bytes > low_water)
+	{
+		std::pop_heap(heap.begin(), heap.end(), is_evicted_later);
+		const unsigned int i = heap.back();
+		heap.pop_back();
+		const EvictionCandidate* candidate = &candidates[i];
+		if (candidate->distance == 0)
+			break;		// Everything left is in use
+		const MemoryCategory category = categories[i];
+		MemoryBudgetRemoveCached(candidate->song, category);
+		g_stats[category].evictions++;
+		SongEvictCachedData(candidate->song, category);
+	}
+}
+
+
+// Copies the current usage of each category into stats
+void MemoryBudgetGetStats(MemoryCategoryStats stats[MEM_NUM_CATEGORIES])
+{
+	for (int category = 0; category < MEM_NUM_CATEGORIES; category++)
+		stats[category] = g_stats[category];
+}
+
+
+const char* MemoryCategoryName(MemoryCategory category)
+{
+	return g_category_names[category];
+}
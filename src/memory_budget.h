@@ -0,0 +1,67 @@
+/******************************************************************************
+memory_budget.h - Memory budget for song data that can be read again from the files
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+
+struct Song;
+
+// Keeps the song data that can be read again from the files (album art for now) under a budget.  Each
+// cached item is registered with the song that has it.  When the cached items are over the budget, the
+// ones of the songs farthest from the current song in play order are evicted first, and among songs
+// at the same distance the least recently used.  The song reads the item again when it is needed.
+//
+// Data that can't be rebuilt (the song records and their details) isn't evicted, but it is counted so
+// MemoryBudgetGetStats() shows where the memory goes.
+
+#define MEMORY_BUDGET_DEFAULT_MB	64
+
+enum MemoryCategory { MEM_SONG_RECORDS, MEM_SONG_DETAILS, MEM_ALBUM_ART, MEM_NUM_CATEGORIES };
+
+struct MemoryCategoryStats {
+	unsigned long long bytes;
+	unsigned long long peak_bytes;
+	unsigned int entries;
+	unsigned int evictions;
+};
+
+// Fills distances[i] with how far songs[i] is from the current song.  0 means the item must not be evicted.
+typedef void (*SongDistanceFunc)(void* context, Song* const* songs, unsigned int num_songs, unsigned int* distances);
+
+void MemoryBudgetSetLimit(size_t limit);
+void MemoryBudgetSetDistanceFunc(SongDistanceFunc distance_func, void* context);
+void MemoryBudgetCount(MemoryCategory category, long long bytes, int entries);
+void MemoryBudgetAddCached(Song* song, MemoryCategory category, size_t bytes);
+void MemoryBudgetRemoveCached(Song* song, MemoryCategory category);
+void MemoryBudgetTouch(Song* song, MemoryCategory category);
+void MemoryBudgetTrim();
+void MemoryBudgetGetStats(MemoryCategoryStats stats[MEM_NUM_CATEGORIES]);
+const char* MemoryCategoryName(MemoryCategory category);
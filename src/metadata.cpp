@@ -30,6 +30,8 @@ SOFTWARE.
 
 
 #include <Windows.h>
+#include <string.h>
+#include <stdlib.h>
 #include "metadata.h"
 
 
@@ -114,8 +116,9 @@ int ID3v2_ParseFrame(const char* buffer, ID3v2Frame* frame)
 }
 
 
-// Given the frame data with text encoding byte, convert it to a valid ANSI string.
-char* ID3v2_FrameDataToString(ID3v2Frame* frame)
+// Given the frame data with text encoding byte, convert it to a UTF-8 string.  The string is converted
+// straight into space from arena, sized for the worst case of its encoding.
+char* ID3v2_FrameDataToString(ID3v2Frame* frame, MetadataArena* arena)
 {
 	// First byte of frame data indicates the text encoding
 	// 00 = ISO-8859-1 (ASCII)
@@ -130,36 +133,58 @@ char* ID3v2_FrameDataToString(ID3v2Frame* frame)
 	if (frame->frame_size <= 1)
 		return NULL;
 		
+	const unsigned char* text = frame->data + 1;
+	size_t text_len = frame->frame_size - 1;
 	char* result = NULL;
-	HANDLE heap = GetProcessHeap();
 
 	switch (frame->data[0]) {
 		case ID3V2_FRAME_TEXT_ENC_ASCII:
 		{
-			result = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, frame->frame_size);
-			memcpy(result, frame->data + 1, frame->frame_size - 1);
-
+			const size_t result_size = UTF8_SIZE_OF_LATIN1(text_len) + 1;
+			result = MetadataArenaAlloc(arena, result_size);
+			if (result)
+				Latin1ToUtf8(text, text_len, result, result_size);
 		} break;
 
 		case ID3V2_FRAME_TEXT_ENC_UTF16_BOM:
-		{
-			// Convert from UTF-16 to ANSI
-			wchar_t* wide_str = (wchar_t*)HeapAlloc(heap, HEAP_ZERO_MEMORY, frame->frame_size + 1);
-			memcpy(wide_str, frame->data + 1, frame->frame_size - 1);
-			result = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, frame->frame_size);
-			
-			// Add 1 to wide string pointer so that the BOM is skipped
-			WideCharToMultiByte(CP_ACP, 0, wide_str + 1, -1, result, frame->frame_size, 0, 0);		
-		} break;
-
 		case ID3V2_FRAME_TEXT_ENC_UTF16_BE:
 		{
-			// TODO:  UTF-16 big endian.  Need samples of MP3s that use this encoding.
+			// Big endian unless there is a little endian BOM
+			bool is_big_endian = true;
+			if (frame->data[0] == ID3V2_FRAME_TEXT_ENC_UTF16_BOM && text_len >= 2)
+			{
+				is_big_endian = !(text[0] == 0xFF && text[1] == 0xFE);
+				if ((text[0] == 0xFF && text[1] == 0xFE) || (text[0] == 0xFE && text[1] == 0xFF))
+				{
+					text += 2;
+					text_len -= 2;
+				}
+			}
+			const size_t result_size = UTF8_SIZE_OF_UTF16(text_len / 2) + 1;
+			result = MetadataArenaAlloc(arena, result_size);
+			if (result)
+				Utf16BytesToUtf8(text, text_len, is_big_endian, result, result_size);
 		} break;
 
 		case ID3V2_FRAME_TEXT_ENC_UTF8:
 		{
-			// TODO:  UTF-8.  Need samples of MP3s that use this encoding.
+			// Already UTF-8, but broken taggers sometimes write ISO-8859-1 here instead
+			const size_t len = strnlen((const char*)text, text_len);
+			if (IsValidUtf8((const char*)text, len))
+			{
+				result = MetadataArenaAlloc(arena, len + 1);
+				if (result)
+				{
+					memcpy(result, text, len);
+					result[len] = '\0';
+				}
+			}
+			else
+			{
+				result = MetadataArenaAlloc(arena, UTF8_SIZE_OF_LATIN1(len) + 1);
+				if (result)
+					Latin1ToUtf8(text, len, result, UTF8_SIZE_OF_LATIN1(len) + 1);
+			}
 		} break;
 	}
 
@@ -183,7 +208,7 @@ ID3v2Image* ID3v2_GetAttachedPicture(unsigned char* frame_data, unsigned int fra
 	// JPEG = \xFF\xD8\xFF
 	// PNG = \x89\x50\x4E\x47\x0D\x0A\x1A\x0A
 
-	ID3v2Image* img = (ID3v2Image*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(ID3v2Image));
+	ID3v2Image* img = (ID3v2Image*)AllocMemory(ALLOC_ART, sizeof(ID3v2Image));
 	
 	// Iterate through each byte until we find where the image data starts
 	// Since description is limited to 64 bytes, just scan the first 100 bytes
@@ -194,7 +219,7 @@ ID3v2Image* ID3v2_GetAttachedPicture(unsigned char* frame_data, unsigned int fra
 		{
 			// Found JPEG data
 			img->size = frame_size - (pos - frame_data);
-			img->data = (unsigned char*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, img->size);
+			img->data = (unsigned char*)AllocMemory(ALLOC_ART, img->size);
 			memcpy(img->data, pos, img->size);
 			img->format = IMG_FORMAT_JPG;
 			break;
@@ -204,7 +229,7 @@ ID3v2Image* ID3v2_GetAttachedPicture(unsigned char* frame_data, unsigned int fra
 			// TODO: Need samples of MP3s that use PNG encoding for the attached image
 			// Found PNG data
 			img->size = frame_size - (pos - frame_data);
-			img->data = (unsigned char*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, img->size);
+			img->data = (unsigned char*)AllocMemory(ALLOC_ART, img->size);
 			memcpy(img->data, pos, img->size);
 			img->format = IMG_FORMAT_PNG;
 			break;
@@ -217,7 +242,7 @@ ID3v2Image* ID3v2_GetAttachedPicture(unsigned char* frame_data, unsigned int fra
 
 // This function fills the specified AudioFileMetadata struct with info from the buffer.
 // Returns 0 if success.  Returns non-zero otherwise.
-void ParseID3v2(const char* buffer, AudioFileMetadata* metadata)
+void ParseID3v2(const char* buffer, AudioFileMetadata* metadata, MetadataArena* arena)
 {
 	// ID3v2 header is always first 10 bytes
 	unsigned char raw_header[10];
@@ -245,19 +270,21 @@ void ParseID3v2(const char* buffer, AudioFileMetadata* metadata)
 		
 		// If memcmp() returns 0, that means the memory matches
 		if (!memcmp(frame.id, ID3V2_TITLE_FRAME_ID, 4))
-			metadata->title = ID3v2_FrameDataToString(&frame);
+			metadata->title = ID3v2_FrameDataToString(&frame, arena);
 		else if (!memcmp(frame.id, ID3V2_ARTIST_FRAME_ID, 4))
-			metadata->artist = ID3v2_FrameDataToString(&frame);
+			metadata->artist = ID3v2_FrameDataToString(&frame, arena);
 		else if (!memcmp(frame.id, ID3V2_ALBUM_FRAME_ID, 4))
-			metadata->album = ID3v2_FrameDataToString(&frame);
+			metadata->album = ID3v2_FrameDataToString(&frame, arena);
 		else if (!memcmp(frame.id, ID3V2_GENRE_FRAME_ID, 4))
-			metadata->genre = ID3v2_FrameDataToString(&frame);
+			metadata->genre = ID3v2_FrameDataToString(&frame, arena);
 		else if (!memcmp(frame.id, ID3V2_YEAR_FRAME_ID, 4))
-			metadata->date = ID3v2_FrameDataToString(&frame);
+			metadata->date = ID3v2_FrameDataToString(&frame, arena);
 		else if (!memcmp(frame.id, ID3V2_TRACK_NUM_FRAME_ID, 4))
-			metadata->track_num = ID3v2_FrameDataToString(&frame);
+			metadata->track_num = ID3v2_FrameDataToString(&frame, arena);
+		else if (!memcmp(frame.id, ID3V2_DISC_NUM_FRAME_ID, 4))
+			metadata->disc_num = ID3v2_FrameDataToString(&frame, arena);
 		else if (!memcmp(frame.id, ID3V2_COMMENT_FRAME_ID, 4))
-			metadata->comment_description = ID3v2_FrameDataToString(&frame);
+			metadata->comment_description = ID3v2_FrameDataToString(&frame, arena);
 		else if (!memcmp(frame.id, ID3V2_ALBUM_ART_FRAME_ID, 4))
 			metadata->album_art = ID3v2_GetAttachedPicture(frame.data, frame.frame_size);
 
@@ -266,7 +293,158 @@ void ParseID3v2(const char* buffer, AudioFileMetadata* metadata)
 }
 
 
-void ParseOggComments(const char* buffer, AudioFileMetadata* metadata)
+// Copies the description and text of a COMM frame, if both are ASCII and fit in the buffers.  The frame
+// data is:  text encoding byte, 3 byte language, null-terminated description, text.
+static bool ID3v2_GetCommentAscii(const ID3v2Frame* frame, char* desc, size_t desc_size, char* text, size_t text_size)
+{
+	if (frame->frame_size < 4)
+		return false;
+	const bool is_utf16 = (frame->data[0] == ID3V2_FRAME_TEXT_ENC_UTF16_BOM || frame->data[0] == ID3V2_FRAME_TEXT_ENC_UTF16_BE);
+	const size_t unit_len = is_utf16 ? 2 : 1;
+	const unsigned char* pos = frame->data + 4;
+	const unsigned char* end = frame->data + frame->frame_size;
+	char* out = desc;
+	size_t out_size = desc_size;
+	size_t out_len = 0;
+	bool is_desc = true;
+	desc[0] = text[0] = '\0';
+	for (; pos + unit_len <= end; pos += unit_len)
+	{
+		unsigned int c = pos[0];
+		if (is_utf16)
+		{
+			// An ASCII character has one zero byte, whichever the byte order is
+			if ((pos[0] == 0xFF && pos[1] == 0xFE) || (pos[0] == 0xFE && pos[1] == 0xFF))
+				continue;
+			if (pos[0] && pos[1])
+				return false;
+			c = pos[0] | pos[1];
+		}
+		if (c > 0x7F || out_len + 1 >= out_size)
+			return false;
+		if (c == '\0')
+		{
+			out[out_len] = '\0';
+			if (!is_desc)
+				return true;
+			is_desc = false;
+			out = text;
+			out_size = text_size;
+			out_len = 0;
+			continue;
+		}
+		out[out_len++] = (char)c;
+	}
+	out[out_len] = '\0';
+	return !is_desc;
+}
+
+
+// Reads the gapless info that iTunes writes in a COMM frame described as "iTunSMPB".  The text is hex numbers:
+//		" 00000000 PPPPPPPP EEEEEEEE SSSSSSSSSSSSSSSS ..."
+// where P is the priming (start trim, including the decoder delay), E is the padding, and S is the number
+// of samples.  Returns false if the tag doesn't have it.
+bool ID3v2_GetITunesGapless(const char* buffer, GaplessInfo* info)
+{
+	if (memcmp(buffer, "ID3", 3))
+		return false;
+	unsigned char raw_header[10];
+	memcpy(raw_header, buffer, 10);
+	ID3v2Header header = ID3v2_ParseHeader(raw_header);
+
+	unsigned int frame_offset = ID3V2_HEADER_LEN;
+	while (frame_offset < header.tag_size)
+	{
+		ID3v2Frame frame = {};
+		if (ID3v2_ParseFrame(buffer + frame_offset, &frame) == -1 || 
+			frame.frame_size > header.tag_size + ID3V2_HEADER_LEN - frame_offset - ID3V2_FRAME_HEADER_LEN)
+			break;
+
+		char desc[16];
+		char text[128];
+		if (!memcmp(frame.id, ID3V2_COMMENT_FRAME_ID, 4) && ID3v2_GetCommentAscii(&frame, desc, sizeof(desc), text, sizeof(text))
+			&& !lstrcmp(desc, ID3V2_ITUNES_GAPLESS_DESC))
+		{
+			unsigned long long fields[4];
+			const char* pos = text;
+			for (int i = 0; i < 4; i++)
+			{
+				char* field_end;
+				fields[i] = strtoull(pos, &field_end, 16);
+				if (field_end == pos)
+					return false;
+				pos = field_end;
+			}
+			if (fields[1] > MP3_MAX_START_TRIM || fields[3] == 0)
+				return false;
+			info->start_trim = (unsigned int)fields[1];
+			info->num_samples = fields[3];
+			return true;
+		}
+		frame_offset += frame.frame_size + ID3V2_FRAME_HEADER_LEN;
+	}
+	return false;
+}
+
+
+static unsigned int ReadUInt32BE(const unsigned char* bytes)
+{
+	return (bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+}
+
+
+// Reads the encoder delay and padding from the LAME Info tag, which is a Xing tag with a LAME extension in
+// place of the audio of the first frame.  data is the start of the audio, after the ID3v2 tag.
+// Returns false if there is no LAME tag.
+bool ParseLameHeader(const unsigned char* data, size_t len, GaplessInfo* info)
+{
+	// Frame header:  11 sync bits, version (2 bits), layer (2 bits), no CRC bit, ..., channel mode (2 bits), ...
+	size_t frame_pos = 0;
+	while (frame_pos + 4 <= len && !(data[frame_pos] == 0xFF && (data[frame_pos + 1] & 0xE0) == 0xE0))
+		frame_pos++;
+	if (frame_pos + 4 > len)
+		return false;
+	const unsigned char* frame = data + frame_pos;
+	const unsigned char* end = data + len;
+	const int version = (frame[1] >> 3) & 3;		// 3 = MPEG-1, 2 = MPEG-2, 0 = MPEG-2.5
+	const int layer = (frame[1] >> 1) & 3;			// 1 = Layer III
+	const bool has_crc = !(frame[1] & 1);
+	const bool is_mono = ((frame[3] >> 6) & 3) == 3;
+	if (version == 1 || layer != 1)
+		return false;
+
+	// The Xing tag is after the side information, whose size depends on the version and channels
+	size_t side_info_len;
+	if (version == 3)
+		side_info_len = is_mono ? 17 : 32;
+	else
+		side_info_len = is_mono ? 9 : 17;
+	const unsigned char* xing = frame + 4 + (has_crc ? 2 : 0) + side_info_len;
+	if (xing + 12 > end || (memcmp(xing, "Xing", 4) && memcmp(xing, "Info", 4)))
+		return false;
+	// Flags say which of frames (4 bytes), file size (4), TOC (100) and quality (4) follow
+	const unsigned int flags = ReadUInt32BE(xing + 4);
+	if (!(flags & 0x01))
+		return false;
+	const unsigned int num_frames = ReadUInt32BE(xing + 8);
+	const unsigned char* lame = xing + 12 + ((flags & 0x02) ? 4 : 0) + ((flags & 0x04) ? 100 : 0) + ((flags & 0x08) ? 4 : 0);
+
+	// LAME extension:  9 byte encoder version, and the delay and padding as two 12 bit numbers at byte 21.
+	// FFmpeg writes the same extension.
+	if (lame + 24 > end || (memcmp(lame, "LAME", 4) && memcmp(lame, "Lavf", 4) && memcmp(lame, "Lavc", 4)))
+		return false;
+	const unsigned int delay = (lame[21] << 4) | (lame[22] >> 4);
+	const unsigned int padding = ((lame[22] & 0x0F) << 8) | lame[23];
+	const unsigned long long total_samples = (unsigned long long)num_frames * (version == 3 ? 1152 : 576);
+	if (delay + padding >= total_samples)
+		return false;
+	info->start_trim = delay + MP3_DECODER_DELAY;
+	info->num_samples = total_samples - delay - padding;
+	return true;
+}
+
+
+void ParseOggComments(const char* buffer, AudioFileMetadata* metadata, MetadataArena* arena)
 {
 	// From BASS documentation:
 	// "A pointer to a series of null-terminated UTF-8 strings is returned,
@@ -275,7 +453,6 @@ void ParseOggComments(const char* buffer, AudioFileMetadata* metadata)
 	unsigned int curr_pos = 0;
 	int last_null_pos = -1;
 	int last_equals_pos = -1;
-	HANDLE heap = GetProcessHeap();
 	while (true)
 	{
 		if (buffer[curr_pos] == '=')
@@ -290,36 +467,97 @@ void ParseOggComments(const char* buffer, AudioFileMetadata* metadata)
 				break;
 			}
 
+			// Every known field name fits in field_name.  Longer names are left empty, so they match none.
 			const char* field_name_ptr = buffer + last_null_pos + 1;
 			unsigned int field_name_len = last_equals_pos - last_null_pos - 1;
-			char* field_name = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, field_name_len + 1);
-			memcpy(field_name, field_name_ptr, field_name_len);
-			
-			const char* field_value_ptr = buffer + last_equals_pos + 1;
-			unsigned int field_value_len = curr_pos - last_equals_pos - 1;
-			char* field_value = (char*)HeapAlloc(heap, HEAP_ZERO_MEMORY, field_value_len + 1);
-			memcpy(field_value, field_value_ptr, field_value_len);
+			char field_name[16] = {};
+			if (field_name_len < sizeof(field_name))
+				memcpy(field_name, field_name_ptr, field_name_len);
 						
 			// OGG field names are NOT case sensitive, so must use case insensitive string compare
 			// Ex: "ARTIST", "Artist", and "artist" are all valid field identifiers
+			char** field = NULL;
 			if (!lstrcmpi(field_name, OGG_TITLE_FIELD))
-				metadata->title = field_value;
-			if (!lstrcmpi(field_name, OGG_ARTIST_FIELD))
-				metadata->artist = field_value;
-			if (!lstrcmpi(field_name, OGG_ALBUM_FIELD))
-				metadata->album = field_value;
-			if (!lstrcmpi(field_name, OGG_GENRE_FIELD))
-				metadata->genre = field_value;
-			if (!lstrcmpi(field_name, OGG_TRACK_NUM_FIELD))
-				metadata->track_num = field_value;
-			if (!lstrcmpi(field_name, OGG_DATE_FIELD))
-				metadata->date = field_value;
-			if (!lstrcmpi(field_name, OGG_DESCRIPTION_FIELD))
-				metadata->comment_description = field_value;
+				field = &metadata->title;
+			else if (!lstrcmpi(field_name, OGG_ARTIST_FIELD))
+				field = &metadata->artist;
+			else if (!lstrcmpi(field_name, OGG_ALBUM_FIELD))
+				field = &metadata->album;
+			else if (!lstrcmpi(field_name, OGG_GENRE_FIELD))
+				field = &metadata->genre;
+			else if (!lstrcmpi(field_name, OGG_TRACK_NUM_FIELD))
+				field = &metadata->track_num;
+			else if (!lstrcmpi(field_name, OGG_DISC_NUM_FIELD))
+				field = &metadata->disc_num;
+			else if (!lstrcmpi(field_name, OGG_DATE_FIELD))
+				field = &metadata->date;
+			else if (!lstrcmpi(field_name, OGG_DESCRIPTION_FIELD))
+				field = &metadata->comment_description;
+
+			// Unknown fields are dropped, and a repeated field keeps the last value
+			if (field)
+			{
+				const char* field_value_ptr = buffer + last_equals_pos + 1;
+				unsigned int field_value_len = curr_pos - last_equals_pos - 1;
+				char* field_value = MetadataArenaAlloc(arena, field_value_len + 1);
+				if (field_value)
+				{
+					memcpy(field_value, field_value_ptr, field_value_len);
+					field_value[field_value_len] = '\0';
+				}
+				*field = field_value;
+			}
 
 			last_null_pos = curr_pos;
 		}
 
 		curr_pos++;
 	}
-}
\ No newline at end of file
+}
+
+
+// Returns size bytes of scratch memory that stay valid until the arena is reset, or NULL if out of memory.
+// Blocks kept from earlier files are used again before a new one is allocated.
+char* MetadataArenaAlloc(MetadataArena* arena, size_t size)
+{
+	while (arena->current == NULL || arena->used + size > arena->current->size)
+	{
+		MetadataArenaBlock** next = arena->current ? &arena->current->next : &arena->first;
+		if (*next == NULL)
+		{
+			const size_t block_size = (size > METADATA_ARENA_BLOCK_SIZE) ? size : METADATA_ARENA_BLOCK_SIZE;
+			*next = (MetadataArenaBlock*)AllocMemory(ALLOC_METADATA, sizeof(MetadataArenaBlock) + block_size);
+			if (*next == NULL)
+				return NULL;
+			(*next)->next = NULL;
+			(*next)->size = block_size;
+		}
+		arena->current = *next;
+		arena->used = 0;
+	}
+	char* memory = (char*)(arena->current + 1) + arena->used;
+	arena->used += size;
+	return memory;
+}
+
+
+// Makes all of the arena's memory free again, without giving the blocks back
+void MetadataArenaReset(MetadataArena* arena)
+{
+	arena->current = NULL;
+	arena->used = 0;
+}
+
+
+void MetadataArenaFree(MetadataArena* arena)
+{
+	MetadataArenaBlock* block = arena->first;
+	while (block)
+	{
+		MetadataArenaBlock* next = block->next;
+		FreeMemory(block);
+		block = next;
+	}
+	arena->first = NULL;
+	MetadataArenaReset(arena);
+}
@@ -45,6 +45,7 @@ SOFTWARE.
 #define ID3V2_ALBUM_FRAME_ID			"TALB"
 #define ID3V2_GENRE_FRAME_ID			"TCON"
 #define ID3V2_TRACK_NUM_FRAME_ID		"TRCK"
+#define ID3V2_DISC_NUM_FRAME_ID			"TPOS"
 #define ID3V2_YEAR_FRAME_ID				"TYER"
 #define ID3V2_COMMENT_FRAME_ID			"COMM"
 #define ID3V2_COMPOSER_FRAME_ID			"TCOM"
@@ -94,10 +95,47 @@ struct AudioFileMetadata {
 	char* album;
 	char* genre;
 	char* track_num;
+	char* disc_num;				// e.g. "1/2"
 	char* date;
 	char* comment_description;	// Comment (ID3v2) or description (OGG)
 	ID3v2Image* album_art;
 };
+
+// Scratch memory for the text read from the tags of a file.  ParseID3v2() and ParseOggComments() take the
+// text from it instead of allocating each field, since SongSetDetails() copies the text into the song's
+// details block anyway.  Reset it once the text is copied; the blocks are kept for the next file.
+#define METADATA_ARENA_BLOCK_SIZE		4096
+
+struct MetadataArenaBlock {
+	MetadataArenaBlock* next;
+	size_t size;					// Bytes of text after this header
+};
+
+struct MetadataArena {
+	MetadataArenaBlock* first;
+	MetadataArenaBlock* current;	// Block text is taken from, or NULL if none has been yet
+	size_t used;					// Bytes taken from current
+};
+// ================================================================================================
+
+// MP3 Gapless ====================================================================================
+// Encoders add silence before (encoder delay) and after (padding) the audio, and the decoder adds
+// MP3_DECODER_DELAY more samples at the start.  LAME writes both amounts in the Info tag of the first frame,
+// and iTunes writes them in an "iTunSMPB" comment.  Other formats (e.g. OGG) know their exact length.
+// References:
+//		http://gabriel.mp3-tech.org/mp3infotag.html
+//		https://www.hydrogenaud.io/forums/index.php?showtopic=85690
+
+#define MP3_DECODER_DELAY				529		// Samples added by the decoder
+#define MP3_GAPLESS_HEADER_LEN			4096	// Bytes to read from the start of the audio to find the Info tag
+#define MP3_MAX_START_TRIM				0xFFFF	// Real start trims are a few thousand samples
+#define ID3V2_ITUNES_GAPLESS_DESC		"iTunSMPB"
+
+// Counted in samples per channel
+struct GaplessInfo {
+	unsigned int start_trim;		// Samples to skip at the start, including the decoder delay
+	unsigned long long num_samples;	// Samples of actual audio after start_trim, or 0 if unknown
+};
 // ================================================================================================
 
 // OGG Comments ===================================================================================
@@ -110,11 +148,18 @@ struct AudioFileMetadata {
 #define OGG_ALBUM_FIELD					"ALBUM"
 #define OGG_GENRE_FIELD					"GENRE"
 #define OGG_TRACK_NUM_FIELD				"TRACKNUMBER"
+#define OGG_DISC_NUM_FIELD				"DISCNUMBER"
 #define OGG_DATE_FIELD					"DATE"
 #define OGG_DESCRIPTION_FIELD			"DESCRIPTION"
 
 // ================================================================================================
 
 // Functions
-void ParseID3v2(const char* buffer, AudioFileMetadata* metadata);
-void ParseOggComments(const char* buffer, AudioFileMetadata* metadata);
\ No newline at end of file
+ID3v2Header ID3v2_ParseHeader(unsigned char raw_header[10]);
+void ParseID3v2(const char* buffer, AudioFileMetadata* metadata, MetadataArena* arena);
+bool ID3v2_GetITunesGapless(const char* buffer, GaplessInfo* info);
+bool ParseLameHeader(const unsigned char* data, size_t len, GaplessInfo* info);
+void ParseOggComments(const char* buffer, AudioFileMetadata* metadata, MetadataArena* arena);
+char* MetadataArenaAlloc(MetadataArena* arena, size_t size);
+void MetadataArenaReset(MetadataArena* arena);
+void MetadataArenaFree(MetadataArena* arena);
\ No newline at end of file
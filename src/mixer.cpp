@@ -0,0 +1,169 @@
+/******************************************************************************
+mixer.cpp - Mixes the outgoing and incoming songs of a crossfade
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "mixer.h"
+
+// MIXER_NO_SSE2 leaves only the plain loop, for testing the SSE2 one against it
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)) && !defined(MIXER_NO_SSE2)
+#include <emmintrin.h>
+#define MIXER_USE_SSE2
+#endif
+
+#define MIXER_HALF_PI	1.57079632679489661923f
+
+
+#ifdef MIXER_USE_SSE2
+// sin(x) for x in [0, pi/2], from its Taylor series up to x^9.  The error is under 4e-6.
+static inline __m128 SinQuarterTurn(__m128 x)
+{
+	const __m128 x2 = _mm_mul_ps(x, x);
+	__m128 sum = _mm_set1_ps(1.0f / 362880.0f);
+	sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(-1.0f / 5040.0f));
+	sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(1.0f / 120.0f));
+	sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(-1.0f / 6.0f));
+	sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(1.0f));
+	return _mm_mul_ps(sum, x);
+}
+
+
+// Gains of four frames, whose positions in the fade (0 to 1) are t
+static inline void GetGains(__m128 t, CrossfadeCurve curve, __m128* gain_from, __m128* gain_to)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), one);
+	if (curve == CROSSFADE_LINEAR)
+	{
+		*gain_to = t;
+		*gain_from = _mm_sub_ps(one, t);
+	}
+	else
+	{
+		const __m128 half_pi = _mm_set1_ps(MIXER_HALF_PI);
+		const __m128 angle = _mm_mul_ps(t, half_pi);
+		*gain_to = SinQuarterTurn(angle);
+		*gain_from = SinQuarterTurn(_mm_sub_ps(half_pi, angle));
+	}
+}
+#else
+// sin(x) for x in [0, pi/2], from its Taylor series up to x^9.  The error is under 4e-6.
+static inline float SinQuarterTurn(float x)
+{
+	const float x2 = x * x;
+	return x * (1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f + x2 * (1.0f / 362880.0f)))));
+}
+#endif
+
+
+// Fills gain_from and gain_to with the gains of 4 frames, starting at frame pos of the fade
+static void GetGainsOf4(unsigned long long pos, float inv_len, CrossfadeCurve curve, float gain_from[4], float gain_to[4])
+{
+#ifdef MIXER_USE_SSE2
+	const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)pos), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)), _mm_set1_ps(inv_len));
+	__m128 from, to;
+	GetGains(t, curve, &from, &to);
+	_mm_storeu_ps(gain_from, from);
+	_mm_storeu_ps(gain_to, to);
+#else
+	for (int i = 0; i < 4; i++)
+	{
+		float t = (float)(pos + i) * inv_len;
+		t = (t < 0.0f) ? 0.0f : (t > 1.0f) ? 1.0f : t;
+		if (curve == CROSSFADE_LINEAR)
+		{
+			gain_to[i] = t;
+			gain_from[i] = 1.0f - t;
+		}
+		else
+		{
+			gain_to[i] = SinQuarterTurn(t * MIXER_HALF_PI);
+			gain_from[i] = SinQuarterTurn(MIXER_HALF_PI - t * MIXER_HALF_PI);
+		}
+	}
+#endif
+}
+
+
+// Mixes num_frames frames of from and to into out, which can be the same buffer as from or to.  fade_pos is
+// the frame of the fade that the first frame is at.
+void MixCrossfade(float* out, const float* from, const float* to, unsigned int num_frames, unsigned int chans,
+	unsigned long long fade_pos, unsigned long long fade_len, CrossfadeCurve curve)
+{
+	if (fade_len == 0 || chans == 0)
+		return;
+	const float inv_len = 1.0f / (float)fade_len;
+	unsigned int frame = 0;
+
+#ifdef MIXER_USE_SSE2
+	// Mono and stereo, which is nearly every song, get the gains and mix the samples in registers
+	if (chans <= 2)
+	{
+		const __m128 frame_offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		const __m128 inv_len_4 = _mm_set1_ps(inv_len);
+		for (; frame + 4 <= num_frames; frame += 4)
+		{
+			const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)(fade_pos + frame)), frame_offsets), inv_len_4);
+			__m128 gain_from, gain_to;
+			GetGains(t, curve, &gain_from, &gain_to);
+			if (chans == 1)
+			{
+				const __m128 mixed = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(from + frame), gain_from),
+					_mm_mul_ps(_mm_loadu_ps(to + frame), gain_to));
+				_mm_storeu_ps(out + frame, mixed);
+			}
+			else
+			{
+				// Each gain is repeated for the left and right samples of its frame
+				const size_t i = (size_t)frame * 2;
+				const __m128 mixed_lo = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(from + i), _mm_unpacklo_ps(gain_from, gain_from)),
+					_mm_mul_ps(_mm_loadu_ps(to + i), _mm_unpacklo_ps(gain_to, gain_to)));
+				const __m128 mixed_hi = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(from + i + 4), _mm_unpackhi_ps(gain_from, gain_from)),
+					_mm_mul_ps(_mm_loadu_ps(to + i + 4), _mm_unpackhi_ps(gain_to, gain_to)));
+				_mm_storeu_ps(out + i, mixed_lo);
+				_mm_storeu_ps(out + i + 4, mixed_hi);
+			}
+		}
+	}
+#endif
+
+	// Other channel counts, and the last few frames
+	for (; frame < num_frames; frame += 4)
+	{
+		float gain_from[4];
+		float gain_to[4];
+		GetGainsOf4(fade_pos + frame, inv_len, curve, gain_from, gain_to);
+		const unsigned int count = (num_frames - frame < 4) ? num_frames - frame : 4;
+		for (unsigned int k = 0; k < count; k++)
+		{
+			const size_t i = (size_t)(frame + k) * chans;
+			for (unsigned int ch = 0; ch < chans; ch++)
+				out[i + ch] = from[i + ch] * gain_from[k] + to[i + ch] * gain_to[k];
+		}
+	}
+}
@@ -0,0 +1,52 @@
+/******************************************************************************
+mixer.h - Mixes the outgoing and incoming songs of a crossfade
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+
+// A crossfade mixes the end of one song (from) with the start of the next (to).  The gains follow the
+// curve from 0 to 1 over fade_len frames, and each call mixes the part of the fade that starts at frame
+// fade_pos, so the fade can be mixed one output block at a time.  Samples are interleaved floats.
+//
+// With the equal power curve the gains are sin and cos of the fade position, so two songs that aren't
+// correlated stay at the same loudness through the fade.  The linear curve keeps the sum of the gains at 1,
+// which is better for songs that were mixed to run into each other.
+//
+// This file doesn't use any Windows or BASS functions, so it can be built and tested on other platforms.
+// Four frames are mixed at a time with SSE2.
+
+enum CrossfadeCurve {
+	CROSSFADE_EQUAL_POWER,
+	CROSSFADE_LINEAR
+};
+
+void MixCrossfade(float* out, const float* from, const float* to, unsigned int num_frames, unsigned int chans,
+	unsigned long long fade_pos, unsigned long long fade_len, CrossfadeCurve curve);
@@ -0,0 +1,206 @@
+/******************************************************************************
+path_table.cpp - Shared table of the directories in song paths
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "path_table.h"
+#include <string.h>
+#include <vector>
+#include <unordered_set>
+
+struct PathDirectory {
+	unsigned int parent;		// PATH_NO_DIRECTORY for the first component, e.g. C:
+	unsigned int name_offset;	// Start of the component's name in g_names
+	unsigned int name_len;
+	unsigned int path_len;		// Length of the whole directory, e.g. 14 for C:\Music\Jazz
+};
+
+// The lookup set holds directory ids, but hashes and compares the directories they point to.  To
+// look up a directory that may not be there yet, it is added to the end of g_dirs and looked up by
+// its id; if it was already there, it's taken off again.
+struct DirectoryHash {
+	size_t operator()(unsigned int dir_id) const;
+};
+
+struct DirectoryEqual {
+	bool operator()(unsigned int a, unsigned int b) const;
+};
+
+static std::vector<PathDirectory> g_dirs;
+static std::vector<char> g_names;		// Names of the components, without separators or terminators
+static std::unordered_set<unsigned int, DirectoryHash, DirectoryEqual> g_lookup;
+
+
+static inline unsigned char FoldCase(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : (unsigned char)c;
+}
+
+
+// Continues an FNV-1a hash with the name, ignoring case
+size_t PathHashName(size_t hash, const char* name, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ FoldCase(name[i])) * (size_t)1099511628211ULL;
+	return hash;
+}
+
+
+// Returns true if the names are the same, ignoring case
+bool PathNamesEqual(const char* a, const char* b, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		if (FoldCase(a[i]) != FoldCase(b[i]))
+			return false;
+	}
+	return true;
+}
+
+
+size_t DirectoryHash::operator()(unsigned int dir_id) const
+{
+	// FNV-1a of the parent id and the name
+	const PathDirectory& dir = g_dirs[dir_id];
+	size_t hash = (size_t)14695981039346656037ULL;
+	hash = (hash ^ dir.parent) * (size_t)1099511628211ULL;
+	return PathHashName(hash, g_names.data() + dir.name_offset, dir.name_len);
+}
+
+
+bool DirectoryEqual::operator()(unsigned int a, unsigned int b) const
+{
+	const PathDirectory& dir_a = g_dirs[a];
+	const PathDirectory& dir_b = g_dirs[b];
+	return dir_a.parent == dir_b.parent && dir_a.name_len == dir_b.name_len &&
+		PathNamesEqual(g_names.data() + dir_a.name_offset, g_names.data() + dir_b.name_offset, dir_a.name_len);
+}
+
+
+// Returns the id of the component under parent, adding it if it isn't there yet
+static unsigned int AddComponent(unsigned int parent, const char* name, unsigned int name_len)
+{
+	PathDirectory dir;
+	dir.parent = parent;
+	dir.name_offset = (unsigned int)g_names.size();
+	dir.name_len = name_len;
+	dir.path_len = (parent == PATH_NO_DIRECTORY) ? name_len : g_dirs[parent].path_len + 1 + name_len;
+	g_names.insert(g_names.end(), name, name + name_len);
+	g_dirs.push_back(dir);
+
+	const unsigned int new_id = (unsigned int)g_dirs.size() - 1;
+	auto result = g_lookup.insert(new_id);
+	if (!result.second)
+	{
+		g_dirs.pop_back();
+		g_names.resize(dir.name_offset);
+	}
+	return *result.first;
+}
+
+
+// Returns the id of a directory, given without a trailing backslash, adding it if it isn't there yet
+unsigned int PathTableAddDirectory(const char* dir, size_t len)
+{
+	unsigned int dir_id = PATH_NO_DIRECTORY;
+	size_t start = 0;
+	for (size_t i = 0; i <= len; i++)
+	{
+		if (i == len || dir[i] == '\\')
+		{
+			dir_id = AddComponent(dir_id, dir + start, (unsigned int)(i - start));
+			start = i + 1;
+		}
+	}
+	return dir_id;
+}
+
+
+// Adds the directory of a full path, and returns its id.  file_name is set to the part of path after
+// the directory.
+unsigned int PathTableAddPath(const char* path, const char** file_name)
+{
+	const char* last_backslash = strrchr(path, '\\');
+	if (last_backslash == NULL)
+	{
+		*file_name = path;
+		return PATH_NO_DIRECTORY;
+	}
+	*file_name = last_backslash + 1;
+	return PathTableAddDirectory(path, last_backslash - path);
+}
+
+
+// Writes the directory, without a trailing backslash, to buffer.  Returns false if it doesn't fit.
+bool PathTableGetDirectory(unsigned int dir_id, char* buffer, size_t buffer_size)
+{
+	if (dir_id == PATH_NO_DIRECTORY)
+	{
+		if (buffer_size == 0)
+			return false;
+		buffer[0] = '\0';
+		return true;
+	}
+
+	// Fill the buffer from the end, walking up to the first component
+	const size_t len = g_dirs[dir_id].path_len;
+	if (len + 1 > buffer_size)
+		return false;
+	buffer[len] = '\0';
+	size_t end = len;
+	for (unsigned int id = dir_id; id != PATH_NO_DIRECTORY; id = g_dirs[id].parent)
+	{
+		const PathDirectory& dir = g_dirs[id];
+		end -= dir.name_len;
+		memcpy(buffer + end, g_names.data() + dir.name_offset, dir.name_len);
+		if (dir.parent != PATH_NO_DIRECTORY)
+			buffer[--end] = '\\';
+	}
+	return true;
+}
+
+
+// Writes the full path of a file in the directory to buffer.  Returns false if it doesn't fit.
+bool PathTableGetPath(unsigned int dir_id, const char* file_name, char* buffer, size_t buffer_size)
+{
+	if (!PathTableGetDirectory(dir_id, buffer, buffer_size))
+		return false;
+	size_t len = (dir_id == PATH_NO_DIRECTORY) ? 0 : g_dirs[dir_id].path_len;
+	const size_t file_name_len = strlen(file_name);
+	if (dir_id != PATH_NO_DIRECTORY)
+	{
+		if (len + 1 >= buffer_size)
+			return false;
+		buffer[len++] = '\\';
+	}
+	if (len + file_name_len + 1 > buffer_size)
+		return false;
+	memcpy(buffer + len, file_name, file_name_len + 1);
+	return true;
+}
+
@@ -0,0 +1,53 @@
+/******************************************************************************
+path_table.h - Shared table of the directories in song paths
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+
+// Most of every song path is a directory that many other songs are in too, so songs don't store
+// their full paths.  Each directory is a node in a trie of path components, e.g. C:\Music\Artist\Album
+// is Album under Artist under Music under C:, and a song only stores the id of its directory and its
+// own file name.  Each component is stored once no matter how many songs or subdirectories it has.
+//
+// Directories are never removed, since a library has few of them compared to songs.  Full paths are
+// put back together in a buffer when a file needs to be opened.
+//
+// Windows paths aren't case sensitive, so names are hashed and compared with the case of A-Z folded.
+// A directory keeps the case it was first added with.
+
+#define PATH_NO_DIRECTORY	0xFFFFFFFF		// Directory id of a path without a backslash
+
+unsigned int PathTableAddDirectory(const char* dir, size_t len);
+unsigned int PathTableAddPath(const char* path, const char** file_name);
+bool PathTableGetDirectory(unsigned int dir_id, char* buffer, size_t buffer_size);
+bool PathTableGetPath(unsigned int dir_id, const char* file_name, char* buffer, size_t buffer_size);
+size_t PathHashName(size_t hash, const char* name, size_t len);
+bool PathNamesEqual(const char* a, const char* b, size_t len);
@@ -0,0 +1,136 @@
+/******************************************************************************
+play_queue.cpp - Queue of songs to play next, ahead of the playlist order
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "play_queue.h"
+#include "util.h"
+#include <Windows.h>
+
+
+// Takes the entry out of its song's list of entries
+static void UnlinkFromSong(PlayQueueEntry* entry)
+{
+	if (entry->prev_of_song)
+		entry->prev_of_song->next_of_song = entry->next_of_song;
+	else
+		entry->node->queue_entries = entry->next_of_song;
+	if (entry->next_of_song)
+		entry->next_of_song->prev_of_song = entry->prev_of_song;
+	entry->prev_of_song = NULL;
+	entry->next_of_song = NULL;
+}
+
+
+// Adds the song of node to the end of the queue.  A song can be queued more than once.  Returns 
+// the entry, which stays valid until it is removed or reaches the front of the queue.
+PlayQueueEntry* PlayQueuePush(PlayQueue* queue, PlaylistNode* node)
+{
+	PlayQueueEntry* entry = (PlayQueueEntry*)AllocMemory(ALLOC_PLAYLIST, sizeof(PlayQueueEntry));
+	if (!entry)
+		return NULL;
+	entry->node = node;
+	entry->prev = queue->tail;
+	if (queue->tail)
+		queue->tail->next = entry;
+	else
+		queue->head = entry;
+	queue->tail = entry;
+
+	entry->next_of_song = node->queue_entries;
+	if (entry->next_of_song)
+		entry->next_of_song->prev_of_song = entry;
+	node->queue_entries = entry;
+	return entry;
+}
+
+
+// Node of the next song in the queue, or NULL if the queue is empty.  Entries of deleted songs at
+// the front of the queue are thrown away.
+PlaylistNode* PlayQueuePeek(PlayQueue* queue)
+{
+	while (queue->head && queue->head->node == NULL)
+		PlayQueueRemove(queue, queue->head);
+	return queue->head ? queue->head->node : NULL;
+}
+
+
+// Removes the next song from the queue and returns its node, or NULL if the queue is empty
+PlaylistNode* PlayQueuePop(PlayQueue* queue)
+{
+	PlaylistNode* node = PlayQueuePeek(queue);
+	if (node)
+		PlayQueueRemove(queue, queue->head);
+	return node;
+}
+
+
+void PlayQueueRemove(PlayQueue* queue, PlayQueueEntry* entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		queue->head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		queue->tail = entry->prev;
+
+	if (entry->node)
+		UnlinkFromSong(entry);
+	FreeMemory(entry);
+}
+
+
+// Must be called before the node of a song in the queue is deleted from the playlist.  O(number of 
+// times the song is queued).
+void PlayQueueSongDeleted(PlayQueue* queue, PlaylistNode* node)
+{
+	if (queue->resume_node == node)
+		queue->resume_node = NULL;
+
+	PlayQueueEntry* entry = node->queue_entries;
+	while (entry)
+	{
+		PlayQueueEntry* next = entry->next_of_song;
+		entry->node = NULL;
+		entry->prev_of_song = NULL;
+		entry->next_of_song = NULL;
+		entry = next;
+	}
+	node->queue_entries = NULL;
+}
+
+
+// Removes every entry, e.g. when the playlist is cleared
+void PlayQueueClear(PlayQueue* queue)
+{
+	while (queue->head)
+		PlayQueueRemove(queue, queue->head);
+	queue->resume_node = NULL;
+}
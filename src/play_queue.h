@@ -0,0 +1,64 @@
+/******************************************************************************
+play_queue.h - Queue of songs to play next, ahead of the playlist order
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include "playlist.h"
+
+// Songs the user wants to play next, in the order they were queued, ahead of the playlist (or
+// shuffle) order.  The queue only points at nodes of the playlist, so queueing a song doesn't
+// change the playlist or the shuffle order.
+//
+// Entries are a doubly linked list, so adding, taking the next song, and removing any entry are
+// O(1).  Each node also links together its own entries, so when a song is deleted its entries
+// are just marked invalid, and are thrown away when they reach the front of the queue.
+
+struct PlayQueueEntry {
+	PlaylistNode* node;				// Node of the song in AppState::playlist, or NULL if the song was deleted
+	PlayQueueEntry* prev;
+	PlayQueueEntry* next;
+	PlayQueueEntry* prev_of_song;	// Other entries of the same song
+	PlayQueueEntry* next_of_song;
+};
+
+// A zero-initialized PlayQueue is a valid, empty queue
+struct PlayQueue {
+	PlayQueueEntry* head;
+	PlayQueueEntry* tail;
+	PlaylistNode* resume_node;		// Where the playlist continues when the queue is empty, or NULL to
+									// continue after the current song
+};
+
+PlayQueueEntry* PlayQueuePush(PlayQueue* queue, PlaylistNode* node);
+PlaylistNode* PlayQueuePeek(PlayQueue* queue);
+PlaylistNode* PlayQueuePop(PlayQueue* queue);
+void PlayQueueRemove(PlayQueue* queue, PlayQueueEntry* entry);
+void PlayQueueSongDeleted(PlayQueue* queue, PlaylistNode* node);
+void PlayQueueClear(PlayQueue* queue);
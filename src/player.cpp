@@ -0,0 +1,539 @@
+/******************************************************************************
+player.cpp - Plays songs back to back through one output stream, without gaps
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "player.h"
+#include "util.h"
+#include <string.h>
+
+
+// Frees the decoder and preroll of a track, and empties it
+static void FreeTrack(PlayerTrack* track)
+{
+	if (track->decoder)
+		BASS_StreamFree(track->decoder);
+	if (track->preroll)
+		FreeMemory(track->preroll);
+	*track = {};
+}
+
+
+// Sets the part of the decoder to play, and moves the decoder to the start of it.  gapless is NULL if
+// the whole decoder is played.
+static void SetTrackTrim(PlayerTrack* track, const GaplessInfo* gapless, DWORD chans)
+{
+	if (gapless == NULL || gapless->num_samples == 0)
+		return;
+	const QWORD frame_size = chans * sizeof(float);
+	track->start = gapless->start_trim * frame_size;
+	track->end = track->start + gapless->num_samples * frame_size;
+	// Decoding from the start is exact, where seeking in an MP3 may not be
+	if (track->start)
+		BASS_ChannelSetPosition(track->decoder, track->start, BASS_POS_BYTE | BASS_POS_DECODETO);
+}
+
+
+// Copies up to length bytes of the track into buffer, preroll first.  Returns the number of bytes copied.
+// Sets is_ended if the decoder has nothing more to give or the end of the trimmed song is reached.
+static DWORD ReadTrack(PlayerTrack* track, unsigned char* buffer, DWORD length)
+{
+	bool is_at_end = false;
+	if (track->end)
+	{
+		const QWORD left = (track->end > track->start + track->bytes_read) ? track->end - track->start - track->bytes_read : 0;
+		if (left <= length)
+		{
+			length = (DWORD)left;
+			is_at_end = true;
+		}
+	}
+	DWORD copied = 0;
+	if (track->preroll_pos < track->preroll_len)
+	{
+		copied = min(length, track->preroll_len - track->preroll_pos);
+		memcpy(buffer, track->preroll + track->preroll_pos, copied);
+		track->preroll_pos += copied;
+	}
+	if (copied < length)
+	{
+		const DWORD decoded = BASS_ChannelGetData(track->decoder, buffer + copied, length - copied);
+		if (decoded != (DWORD)-1)
+			copied += decoded;
+		if (copied < length && BASS_ChannelIsActive(track->decoder) != BASS_ACTIVE_PLAYING)
+			track->is_ended = true;
+	}
+	if (is_at_end && copied == length)
+		track->is_ended = true;
+	track->bytes_read += copied;
+	return copied;
+}
+
+
+// Length in bytes of the part of the track that is played, or (QWORD)-1 if BASS doesn't know it
+static QWORD GetTrackLength(const PlayerTrack* track)
+{
+	if (track->end)
+		return track->end - track->start;
+	const QWORD decoder_length = BASS_ChannelGetLength(track->decoder, BASS_POS_BYTE);
+	if (decoder_length == (QWORD)-1)
+		return (QWORD)-1;
+	return (decoder_length > track->start) ? decoder_length - track->start : 0;
+}
+
+
+// Moves the decoder of a track to pos, in bytes from the start of the trimmed song
+static bool SeekTrack(PlayerTrack* track, QWORD pos)
+{
+	if (!BASS_ChannelSetPosition(track->decoder, track->start + pos, BASS_POS_BYTE))
+		return false;
+	// The preroll is only the start of the song, and the decoder is past it now
+	track->preroll_pos = track->preroll_len;
+	track->bytes_read = pos;
+	track->is_ended = false;
+	return true;
+}
+
+
+// The song being heard:  prev until the start of curr is heard
+static const PlayerTrack* GetHeardTrack(const Player* player)
+{
+	return (player->prev.decoder && !player->is_changed) ? &player->prev : &player->curr;
+}
+
+
+// Makes next the song the output stream reads.  curr is kept in prev until the change is heard.
+static void ChangeToNext(Player* player)
+{
+	player->prev = player->curr;
+	player->curr = player->next;
+	player->next = {};
+	player->change_pos = player->prev.bytes_read;
+	player->is_changed = false;
+}
+
+
+// Starts fading prev out under curr, from where prev was read to.  The fade is crossfade_ms long, or as
+// long as what is left of prev.
+static void StartFade(Player* player)
+{
+	const QWORD frame_size = player->chans * sizeof(float);
+	QWORD fade_len = (QWORD)player->freq * player->crossfade_ms / 1000 * frame_size;
+	const QWORD length = GetTrackLength(&player->prev);
+	if (length != (QWORD)-1)
+		fade_len = min(fade_len, (length > player->prev.bytes_read) ? length - player->prev.bytes_read : 0);
+	player->fade_len = fade_len;
+	player->fade_pos = 0;
+}
+
+
+// Reads curr with the end of prev mixed in, for as much of the block as the fade lasts.  The fade ends 
+// when it is over or prev runs out.
+static DWORD ReadFade(Player* player, unsigned char* buffer, DWORD length)
+{
+	const DWORD frame_size = player->chans * sizeof(float);
+	const DWORD mix_size = (PLAYER_MIX_BUFFER_LEN / player->chans) * frame_size;
+	float from[PLAYER_MIX_BUFFER_LEN];
+	DWORD filled = 0;
+	while (filled < length && player->fade_len)
+	{
+		const DWORD size = (DWORD)min((QWORD)min(length - filled, mix_size), player->fade_len - player->fade_pos);
+		const DWORD read = ReadTrack(&player->curr, buffer + filled, size);
+		const DWORD from_read = ReadTrack(&player->prev, (unsigned char*)from, read);
+		// If prev ran out early, the rest of it is silence
+		memset((unsigned char*)from + from_read, 0, read - from_read);
+		float* to = (float*)(buffer + filled);
+		MixCrossfade(to, from, to, read / frame_size, player->chans, player->fade_pos / frame_size, 
+			player->fade_len / frame_size, player->crossfade_curve);
+		filled += read;
+		player->fade_pos += read;
+		if (player->fade_pos >= player->fade_len || from_read < read)
+			player->fade_len = player->fade_pos = 0;
+		if (read < size)
+			break;		// curr is behind or ended
+	}
+	return filled;
+}
+
+
+// Called by BASS when the output stream needs more audio.  When curr ends in the middle of the block,
+// the block is finished with the start of the next song.  With a crossfade, the next song starts when
+// curr is down to the length of the fade, and the two are mixed until curr ends.
+static DWORD CALLBACK PlayerStreamProc(HSTREAM handle, void* buffer, DWORD length, void* user)
+{
+	Player* player = (Player*)user;
+	unsigned char* bytes = (unsigned char*)buffer;
+	EnterCriticalSection(&player->lock);
+	if (player->crossfade_ms && player->next.decoder && !player->prev.decoder && !player->is_ended)
+	{
+		const QWORD song_length = GetTrackLength(&player->curr);
+		const QWORD fade_size = (QWORD)player->freq * player->crossfade_ms / 1000 * player->chans * sizeof(float);
+		if (song_length != (QWORD)-1 && song_length <= player->curr.bytes_read + fade_size)
+		{
+			ChangeToNext(player);
+			StartFade(player);
+		}
+	}
+	DWORD filled = 0;
+	if (player->fade_len)
+		filled = ReadFade(player, bytes, length);
+	if (!player->fade_len && player->curr.decoder && filled < length)
+		filled += ReadTrack(&player->curr, bytes + filled, length - filled);
+	while (filled < length && !player->is_ended)
+	{
+		if (!player->curr.is_ended)
+			break;		// Decoder is behind, but not finished
+		if (!player->next.decoder || player->prev.decoder)
+		{
+			// Nothing to join, or the last change or crossfade isn't over yet
+			player->is_ended = true;
+			break;
+		}
+		ChangeToNext(player);
+		filled += ReadTrack(&player->curr, bytes + filled, length - filled);
+	}
+	const bool is_ended = player->is_ended;
+	LeaveCriticalSection(&player->lock);
+	return is_ended ? (filled | BASS_STREAMPROC_END) : filled;
+}
+
+
+// Creates the output stream in the format of the player
+static bool CreateOutputStream(Player* player)
+{
+	player->stream = BASS_StreamCreate(player->freq, player->chans, BASS_SAMPLE_FLOAT, PlayerStreamProc, player);
+	if (!player->stream)
+		return false;
+	BASS_ChannelSetAttribute(player->stream, BASS_ATTRIB_VOL, player->volume);
+	return true;
+}
+
+
+void PlayerInit(Player* player)
+{
+	*player = {};
+	InitializeCriticalSection(&player->lock);
+	player->volume = 1.0f;
+}
+
+
+void PlayerFree(Player* player)
+{
+	PlayerUnload(player);
+	DeleteCriticalSection(&player->lock);
+}
+
+
+// Makes decoder the song to play, in place of whatever was loaded.  The player owns the decoder, even if
+// this fails.  The output stream isn't started.  gapless can be NULL.
+bool PlayerLoad(Player* player, HSTREAM decoder, const GaplessInfo* gapless)
+{
+	PlayerUnload(player);
+	BASS_CHANNELINFO info;
+	if (!BASS_ChannelGetInfo(decoder, &info))
+	{
+		BASS_StreamFree(decoder);
+		return false;
+	}
+	player->freq = info.freq;
+	player->chans = info.chans;
+	player->curr.decoder = decoder;
+	SetTrackTrim(&player->curr, gapless, info.chans);
+	if (!CreateOutputStream(player))
+	{
+		FreeTrack(&player->curr);
+		return false;
+	}
+	return true;
+}
+
+
+// Stops the output stream and frees it and all of the decoders
+void PlayerUnload(Player* player)
+{
+	// The stream is freed first, so its callback isn't using the decoders
+	if (player->stream)
+		BASS_StreamFree(player->stream);
+	player->stream = 0;
+	FreeTrack(&player->prev);
+	FreeTrack(&player->curr);
+	FreeTrack(&player->next);
+	player->change_pos = 0;
+	player->is_changed = false;
+	player->is_ended = false;
+	player->fade_len = player->fade_pos = 0;
+}
+
+
+// Gives the player the song to play after the current one, replacing any that was set before.  The start 
+// of it is decoded now, so it's ready to be joined on.  The player owns the decoder.  Returns false, and
+// frees the decoder, if it can't be joined to the current song.  gapless can be NULL.
+bool PlayerSetNext(Player* player, HSTREAM decoder, const GaplessInfo* gapless)
+{
+	PlayerClearNext(player);
+	BASS_CHANNELINFO info;
+	if (!player->stream || !BASS_ChannelGetInfo(decoder, &info) || info.freq != player->freq || 
+		info.chans != player->chans)
+	{
+		BASS_StreamFree(decoder);
+		return false;
+	}
+
+	PlayerTrack track = {};
+	track.decoder = decoder;
+	SetTrackTrim(&track, gapless, info.chans);
+	const DWORD frame_size = info.chans * sizeof(float);
+	DWORD preroll_size = (DWORD)((QWORD)info.freq * PLAYER_PREROLL_MS / 1000) * frame_size;
+	if (track.end && track.end - track.start < preroll_size)
+		preroll_size = (DWORD)(track.end - track.start);
+	track.preroll = (unsigned char*)AllocMemory(ALLOC_AUDIO, preroll_size);
+	if (track.preroll)
+	{
+		const DWORD decoded = BASS_ChannelGetData(decoder, track.preroll, preroll_size);
+		track.preroll_len = (decoded != (DWORD)-1) ? decoded : 0;
+	}
+
+	EnterCriticalSection(&player->lock);
+	bool is_set = !player->is_ended;		// Too late if the output stream already ended
+	if (is_set)
+		player->next = track;
+	LeaveCriticalSection(&player->lock);
+	if (!is_set)
+		FreeTrack(&track);
+	return is_set;
+}
+
+
+// Fades from the song being heard to decoder, starting now.  It's for when the user picks another song
+// while one is playing, so the caller shows the new song at once, and PlayerUpdate() won't say it started.
+// The output stream is replaced, so the fade doesn't wait for the audio already in its buffer.  The player
+// owns the decoder.  Returns false, and frees the decoder, if there is no crossfade or the songs can't be 
+// mixed.  gapless can be NULL.
+bool PlayerCrossfadeTo(Player* player, HSTREAM decoder, const GaplessInfo* gapless)
+{
+	BASS_CHANNELINFO info;
+	if (!player->stream || !player->crossfade_ms || !BASS_ChannelGetInfo(decoder, &info) || 
+		info.freq != player->freq || info.chans != player->chans)
+	{
+		BASS_StreamFree(decoder);
+		return false;
+	}
+	const QWORD pos = PlayerGetPosition(player);
+	const bool is_playing = (BASS_ChannelIsActive(player->stream) == BASS_ACTIVE_PLAYING);
+	BASS_StreamFree(player->stream);
+	player->stream = 0;
+
+	// The stream's callback can't run now, so the lock isn't needed.  The song being heard fades out from
+	// where it is heard, and what was read of it or of other songs after that is dropped.
+	PlayerTrack* heard = (PlayerTrack*)GetHeardTrack(player);
+	PlayerTrack outgoing = *heard;
+	*heard = {};
+	FreeTrack(&player->prev);
+	FreeTrack(&player->curr);
+	FreeTrack(&player->next);
+	player->prev = outgoing;
+	SeekTrack(&player->prev, pos);
+	player->curr.decoder = decoder;
+	SetTrackTrim(&player->curr, gapless, info.chans);
+	player->change_pos = pos;
+	player->is_changed = true;
+	player->is_ended = false;
+	StartFade(player);
+
+	if (!CreateOutputStream(player))
+	{
+		PlayerUnload(player);
+		return false;
+	}
+	if (is_playing)
+		BASS_ChannelPlay(player->stream, FALSE);
+	return true;
+}
+
+
+// Forgets the song set by PlayerSetNext(), if it hasn't started yet
+void PlayerClearNext(Player* player)
+{
+	EnterCriticalSection(&player->lock);
+	PlayerTrack next = player->next;
+	player->next = {};
+	LeaveCriticalSection(&player->lock);
+	FreeTrack(&next);
+}
+
+
+// Has the output stream started reading the next song, though it can't be heard yet or the crossfade
+// into it isn't over?
+bool PlayerIsChanging(Player* player)
+{
+	EnterCriticalSection(&player->lock);
+	const bool is_changing = (player->prev.decoder != 0);
+	LeaveCriticalSection(&player->lock);
+	return is_changing;
+}
+
+
+// Call regularly.  Returns true once the next song can be heard, which is some time after the output 
+// stream started reading it, since the end of the previous song was still in the output buffer.
+bool PlayerUpdate(Player* player)
+{
+	if (!player->stream)
+		return false;
+	const DWORD buffered = BASS_ChannelGetData(player->stream, NULL, BASS_DATA_AVAILABLE);
+	EnterCriticalSection(&player->lock);
+	PlayerTrack prev = {};
+	bool is_changed = false;
+	if (player->prev.decoder)
+	{
+		if (!player->is_changed && (buffered == (DWORD)-1 || player->curr.bytes_read >= buffered))
+		{
+			player->is_changed = true;
+			is_changed = true;
+		}
+		// prev is still read until the crossfade is over
+		if (player->is_changed && !player->fade_len)
+		{
+			prev = player->prev;
+			player->prev = {};
+		}
+	}
+	LeaveCriticalSection(&player->lock);
+	FreeTrack(&prev);
+	return is_changed;
+}
+
+
+// Position in bytes of the song being heard.  Bytes are in the format of the decoders (floating-point).
+QWORD PlayerGetPosition(Player* player)
+{
+	if (!player->stream)
+		return 0;
+	DWORD buffered = BASS_ChannelGetData(player->stream, NULL, BASS_DATA_AVAILABLE);
+	if (buffered == (DWORD)-1)
+		buffered = 0;
+	EnterCriticalSection(&player->lock);
+	QWORD pos;
+	if (player->prev.decoder && !player->is_changed)
+	{
+		// The start of curr is at the end of the output buffer, and the end of prev is before it
+		const QWORD prev_buffered = (buffered > player->curr.bytes_read) ? buffered - player->curr.bytes_read : 0;
+		pos = (player->change_pos > prev_buffered) ? player->change_pos - prev_buffered : 0;
+	}
+	else
+	{
+		pos = (player->curr.bytes_read > buffered) ? player->curr.bytes_read - buffered : 0;
+	}
+	LeaveCriticalSection(&player->lock);
+	return pos;
+}
+
+
+// Decoder of the song being heard, e.g. for its length or tags.  The player still owns it.
+HSTREAM PlayerGetDecoder(Player* player)
+{
+	EnterCriticalSection(&player->lock);
+	const HSTREAM decoder = GetHeardTrack(player)->decoder;
+	LeaveCriticalSection(&player->lock);
+	return decoder;
+}
+
+
+// Length in bytes of the song being heard, after trimming
+QWORD PlayerGetLength(Player* player)
+{
+	EnterCriticalSection(&player->lock);
+	const PlayerTrack* track = GetHeardTrack(player);
+	QWORD length = track->decoder ? GetTrackLength(track) : 0;
+	LeaveCriticalSection(&player->lock);
+	return (length != (QWORD)-1) ? length : 0;
+}
+
+
+// Seeks in the song being heard.  The output stream is replaced, since its buffer holds audio from
+// before the seek.  It keeps playing if it was playing.
+bool PlayerSetPosition(Player* player, QWORD pos)
+{
+	if (!player->stream)
+		return false;
+	const bool is_playing = (BASS_ChannelIsActive(player->stream) == BASS_ACTIVE_PLAYING);
+	BASS_StreamFree(player->stream);
+	player->stream = 0;
+
+	// The stream's callback can't run now, so the lock isn't needed
+	if (player->prev.decoder && !player->is_changed)
+	{
+		// Seeking back into the song that was ending.  The one after it goes back to being next.
+		FreeTrack(&player->next);
+		player->next = player->curr;
+		if (player->next.preroll)
+			FreeMemory(player->next.preroll);
+		player->next.preroll = NULL;
+		player->next.preroll_len = player->next.preroll_pos = 0;
+		player->next.bytes_read = 0;
+		player->next.is_ended = false;
+		BASS_ChannelSetPosition(player->next.decoder, player->next.start, BASS_POS_BYTE);
+		player->curr = player->prev;
+		player->prev = {};
+	}
+	else
+	{
+		// The rest of the crossfade into curr, if there is one, is dropped
+		FreeTrack(&player->prev);
+	}
+	player->is_changed = false;
+	player->fade_len = player->fade_pos = 0;
+	const bool is_set = SeekTrack(&player->curr, pos);
+	player->is_ended = false;
+
+	if (!CreateOutputStream(player))
+	{
+		PlayerUnload(player);
+		return false;
+	}
+	if (is_playing)
+		BASS_ChannelPlay(player->stream, FALSE);
+	return is_set;
+}
+
+
+void PlayerSetVolume(Player* player, float volume)
+{
+	player->volume = volume;
+	if (player->stream)
+		BASS_ChannelSetAttribute(player->stream, BASS_ATTRIB_VOL, volume);
+}
+
+
+// Sets how long songs fade into each other.  0 joins them without a fade.
+void PlayerSetCrossfade(Player* player, DWORD crossfade_ms, CrossfadeCurve curve)
+{
+	EnterCriticalSection(&player->lock);
+	player->crossfade_ms = min(crossfade_ms, PLAYER_MAX_CROSSFADE_MS);
+	player->crossfade_curve = curve;
+	LeaveCriticalSection(&player->lock);
+}
@@ -0,0 +1,110 @@
+/******************************************************************************
+player.h - Plays songs back to back through one output stream, without gaps
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+#include <Windows.h>
+#include "bass.h"
+#include "metadata.h"
+#include "mixer.h"
+
+// Songs are decoded by BASS decoding channels (BASS_STREAM_DECODE), and one user stream pulls the 
+// decoded audio and sends it to the speakers.  The next song is opened ahead of time, and the first
+// PLAYER_PREROLL_MS of it are decoded into memory.  When the song that is playing runs out in the
+// middle of a block, the rest of the block is filled from the next song, so the two songs are 
+// joined sample for sample and the switch doesn't wait for the UI timer or for the file to open.
+//
+// The output stream's callback runs on a BASS thread, so the decoders are protected by lock.  Only
+// the decoders are touched while holding it; BASS calls on the output stream are made outside of it.
+//
+// Songs can only be joined if they have the same sample rate and number of channels.  If they don't,
+// PlayerSetNext() refuses the next song, the output stream ends with the current song, and the
+// caller loads the next song the usual way.
+//
+// MP3 encoders add silence at the start and end of a song.  If the caller knows how much (GaplessInfo),
+// the decoder is moved past the start with BASS_POS_DECODETO and reading stops at the last real sample,
+// so a track's bytes_read and the positions and lengths the player gives are of the trimmed song.
+//
+// With a crossfade set, the next song starts when the current one has crossfade_ms left instead of when
+// it ends.  Both decoders are read for the length of the fade and mixed by MixCrossfade(), with the
+// outgoing song kept in prev until the fade is over.  PlayerCrossfadeTo() starts the same fade at once,
+// for when the user picks another song.
+
+#define PLAYER_DECODER_FLAGS	(BASS_STREAM_DECODE | BASS_SAMPLE_FLOAT)	// Flags for the decoders
+#define PLAYER_PREROLL_MS		250		// How much of the next song is decoded before it is needed
+#define PLAYER_MIX_BUFFER_LEN	4096	// Samples of the outgoing song mixed at a time during a crossfade
+#define PLAYER_MAX_CROSSFADE_MS	12000
+
+struct PlayerTrack {
+	HSTREAM decoder;
+	unsigned char* preroll;		// Start of the song, decoded ahead of time.  NULL if there is none.
+	DWORD preroll_len;
+	DWORD preroll_pos;			// How much of preroll has been read
+	QWORD bytes_read;			// Bytes the output stream has read from this song
+	QWORD start;				// Decoder position of the first byte to play
+	QWORD end;					// Decoder position after the last byte to play, or 0 to play until the decoder ends
+	bool is_ended;
+};
+
+// A zero-initialized Player must still be set up with PlayerInit()
+struct Player {
+	CRITICAL_SECTION lock;
+	HSTREAM stream;				// Output stream, or 0 if no song is loaded
+	DWORD freq;					// Format of the output stream
+	DWORD chans;
+	float volume;
+	PlayerTrack prev;			// Song that was read to the end or is fading out, but is still in the output
+								// buffer.  It is the song being heard until PlayerUpdate() says the next one
+								// started (is_changed).
+	PlayerTrack curr;			// Song the output stream is reading from
+	PlayerTrack next;			// Song to read when curr ends
+	QWORD change_pos;			// Position in prev where curr starts
+	bool is_changed;			// Has the start of curr been heard?  prev is kept until the fade is over.
+	bool is_ended;				// Did curr end with no next song?
+	DWORD crossfade_ms;			// 0 to join songs without a crossfade
+	CrossfadeCurve crossfade_curve;
+	QWORD fade_len;				// Bytes of the crossfade between prev and curr, or 0 if there is none
+	QWORD fade_pos;				// Bytes of the crossfade mixed so far
+};
+
+void PlayerInit(Player* player);
+void PlayerFree(Player* player);
+bool PlayerLoad(Player* player, HSTREAM decoder, const GaplessInfo* gapless);
+void PlayerUnload(Player* player);
+bool PlayerSetNext(Player* player, HSTREAM decoder, const GaplessInfo* gapless);
+bool PlayerCrossfadeTo(Player* player, HSTREAM decoder, const GaplessInfo* gapless);
+void PlayerClearNext(Player* player);
+bool PlayerIsChanging(Player* player);
+bool PlayerUpdate(Player* player);
+QWORD PlayerGetPosition(Player* player);
+HSTREAM PlayerGetDecoder(Player* player);
+QWORD PlayerGetLength(Player* player);
+bool PlayerSetPosition(Player* player, QWORD pos);
+void PlayerSetVolume(Player* player, float volume);
+void PlayerSetCrossfade(Player* player, DWORD crossfade_ms, CrossfadeCurve curve);
@@ -0,0 +1,408 @@
+/******************************************************************************
+playlist.cpp - Song order for the playlist, stored as a balanced tree
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "playlist.h"
+#include "util.h"
+#include <vector>
+
+
+static inline unsigned int NodeCount(const PlaylistNode* node)
+{
+	return node ? node->count : 0;
+}
+
+
+static inline unsigned long long NodeLength(const PlaylistNode* node)
+{
+	return node ? node->length_secs : 0;
+}
+
+
+// Recomputes the totals of the node from its children, and points the children back at it
+static inline void UpdateNode(PlaylistNode* node)
+{
+	node->count = 1 + NodeCount(node->left) + NodeCount(node->right);
+	node->length_secs = node->song->song_length_secs + NodeLength(node->left) + NodeLength(node->right);
+	if (node->left)
+		node->left->parent = node;
+	if (node->right)
+		node->right->parent = node;
+}
+
+
+// xorshift32
+static unsigned int NextPriority(Playlist* playlist)
+{
+	unsigned int x = playlist->rand_state ? playlist->rand_state : 0x2545F491;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	playlist->rand_state = x;
+	return x;
+}
+
+
+// Splits the tree into the first count nodes (left) and the rest (right)
+static void Split(PlaylistNode* node, unsigned int count, PlaylistNode** left, PlaylistNode** right)
+{
+	if (node == NULL)
+	{
+		*left = NULL;
+		*right = NULL;
+		return;
+	}
+	if (NodeCount(node->left) < count)
+	{
+		Split(node->right, count - NodeCount(node->left) - 1, &node->right, right);
+		*left = node;
+	}
+	else
+	{
+		Split(node->left, count, left, &node->left);
+		*right = node;
+	}
+	UpdateNode(node);
+}
+
+
+// Joins two trees.  Every node of left comes before every node of right.
+static PlaylistNode* Merge(PlaylistNode* left, PlaylistNode* right)
+{
+	if (left == NULL)
+		return right;
+	if (right == NULL)
+		return left;
+	if (left->priority > right->priority)
+	{
+		left->right = Merge(left->right, right);
+		UpdateNode(left);
+		return left;
+	}
+	right->left = Merge(left, right->left);
+	UpdateNode(right);
+	return right;
+}
+
+
+static inline void SetRoot(Playlist* playlist, PlaylistNode* root)
+{
+	playlist->root = root;
+	if (root)
+		root->parent = NULL;
+}
+
+
+unsigned int PlaylistCount(const Playlist* playlist)
+{
+	return NodeCount(playlist->root);
+}
+
+
+unsigned long long PlaylistTotalLength(const Playlist* playlist)
+{
+	return NodeLength(playlist->root);
+}
+
+
+// Total length of the songs at indexes 0 to idx - 1, i.e. the time until song idx starts
+unsigned long long PlaylistLengthBefore(const Playlist* playlist, unsigned int idx)
+{
+	unsigned long long length = 0;
+	const PlaylistNode* node = playlist->root;
+	while (node)
+	{
+		const unsigned int left_count = NodeCount(node->left);
+		if (idx <= left_count)
+		{
+			node = node->left;
+		}
+		else
+		{
+			length += NodeLength(node->left) + node->song->song_length_secs;
+			idx -= left_count + 1;
+			node = node->right;
+		}
+	}
+	return length;
+}
+
+
+// Returns NULL if idx is out of range
+PlaylistNode* PlaylistNodeAt(const Playlist* playlist, unsigned int idx)
+{
+	PlaylistNode* node = playlist->root;
+	while (node)
+	{
+		const unsigned int left_count = NodeCount(node->left);
+		if (idx < left_count)
+		{
+			node = node->left;
+		}
+		else if (idx == left_count)
+		{
+			return node;
+		}
+		else
+		{
+			idx -= left_count + 1;
+			node = node->right;
+		}
+	}
+	return NULL;
+}
+
+
+// Returns NULL if idx is out of range
+Song* PlaylistSongAt(const Playlist* playlist, unsigned int idx)
+{
+	PlaylistNode* node = PlaylistNodeAt(playlist, idx);
+	return node ? node->song : NULL;
+}
+
+
+unsigned int PlaylistIndexOf(const PlaylistNode* node)
+{
+	unsigned int idx = NodeCount(node->left);
+	for (; node->parent; node = node->parent)
+	{
+		if (node == node->parent->right)
+			idx += NodeCount(node->parent->left) + 1;
+	}
+	return idx;
+}
+
+
+// First node in list order, or NULL if the list is empty.  Use PlaylistNext() to walk the list
+// in O(n) total instead of calling PlaylistNodeAt() for each index.
+PlaylistNode* PlaylistFirst(const Playlist* playlist)
+{
+	PlaylistNode* node = playlist->root;
+	if (node)
+	{
+		while (node->left)
+			node = node->left;
+	}
+	return node;
+}
+
+
+// Next node in list order, or NULL at the end of the list
+PlaylistNode* PlaylistNext(const PlaylistNode* node)
+{
+	if (node->right)
+	{
+		node = node->right;
+		while (node->left)
+			node = node->left;
+		return (PlaylistNode*)node;
+	}
+	while (node->parent && node == node->parent->right)
+		node = node->parent;
+	return node->parent;
+}
+
+
+// Inserts the song so that it is at idx.  Returns the new node.
+PlaylistNode* PlaylistInsert(Playlist* playlist, unsigned int idx, Song* song)
+{
+	PlaylistNode* node = (PlaylistNode*)AllocMemory(ALLOC_PLAYLIST, sizeof(PlaylistNode));
+	node->song = song;
+	node->priority = NextPriority(playlist);
+	UpdateNode(node);
+
+	PlaylistNode* left;
+	PlaylistNode* right;
+	Split(playlist->root, idx, &left, &right);
+	SetRoot(playlist, Merge(Merge(left, node), right));
+	return node;
+}
+
+
+PlaylistNode* PlaylistPushBack(Playlist* playlist, Song* song)
+{
+	return PlaylistInsert(playlist, PlaylistCount(playlist), song);
+}
+
+
+// Removes the node from the list and frees it.  The song is NOT freed.
+void PlaylistDelete(Playlist* playlist, PlaylistNode* node)
+{
+	PlaylistNode* parent = node->parent;
+	PlaylistNode* children = Merge(node->left, node->right);
+	if (parent == NULL)
+	{
+		SetRoot(playlist, children);
+	}
+	else
+	{
+		if (parent->left == node)
+			parent->left = children;
+		else
+			parent->right = children;
+		for (; parent; parent = parent->parent)
+			UpdateNode(parent);
+	}
+	if (node->link && node->link->link == node)
+		node->link->link = NULL;
+	FreeMemory(node);
+}
+
+
+// Removes the nodes from the list and frees them.  The songs are NOT freed.  Deleting a few nodes
+// is O(log n) each, but when there are a lot of them, it's faster to mark them and rebuild the
+// tree from the rest in one O(n) pass.
+void PlaylistDeleteNodes(Playlist* playlist, PlaylistNode** nodes, unsigned int num_nodes)
+{
+	const unsigned int count = PlaylistCount(playlist);
+	if (num_nodes < count / 16)
+	{
+		for (unsigned int i = 0; i < num_nodes; i++)
+			PlaylistDelete(playlist, nodes[i]);
+		return;
+	}
+
+	for (unsigned int i = 0; i < num_nodes; i++)
+		nodes[i]->is_marked = true;
+	std::vector<PlaylistNode*> kept;
+	kept.reserve(count - num_nodes);
+	for (PlaylistNode* node = PlaylistFirst(playlist); node; node = PlaylistNext(node))
+	{
+		if (!node->is_marked)
+			kept.push_back(node);
+	}
+	PlaylistRebuild(playlist, kept.data(), kept.size());
+
+	for (unsigned int i = 0; i < num_nodes; i++)
+	{
+		if (nodes[i]->link && nodes[i]->link->link == nodes[i])
+			nodes[i]->link->link = NULL;
+		FreeMemory(nodes[i]);
+	}
+}
+
+
+// Moves the count songs starting at first so that they start at dest.  dest is an index in the 
+// list after the move, so it must be <= size - count.
+void PlaylistMove(Playlist* playlist, unsigned int first, unsigned int count, unsigned int dest)
+{
+	PlaylistNode* before;
+	PlaylistNode* moved;
+	PlaylistNode* after;
+	Split(playlist->root, first, &before, &after);
+	Split(after, count, &moved, &after);
+	PlaylistNode* rest = Merge(before, after);
+	Split(rest, dest, &before, &after);
+	SetRoot(playlist, Merge(Merge(before, moved), after));
+}
+
+
+// Replaces the order of the list with nodes, which must be every node in the list (or nodes 
+// that were taken from PlaylistGetNodes() before the list was cleared).  O(n):  the nodes keep
+// their priorities, so the tree can be built left to right with a stack.
+void PlaylistRebuild(Playlist* playlist, PlaylistNode** nodes, unsigned int num_nodes)
+{
+	// The right spine of the tree built so far
+	std::vector<PlaylistNode*> spine;
+	spine.reserve(64);
+	for (unsigned int i = 0; i < num_nodes; i++)
+	{
+		PlaylistNode* node = nodes[i];
+		node->left = NULL;
+		node->right = NULL;
+		PlaylistNode* last_popped = NULL;
+		while (spine.size() && spine.back()->priority < node->priority)
+		{
+			last_popped = spine.back();
+			spine.pop_back();
+		}
+		node->left = last_popped;
+		if (spine.size())
+			spine.back()->right = node;
+		spine.push_back(node);
+	}
+
+	// Totals can only be computed once the children are final, so do them bottom up
+	PlaylistNode* root = spine.size() ? spine[0] : NULL;
+	std::vector<PlaylistNode*> postorder;
+	postorder.reserve(num_nodes);
+	std::vector<PlaylistNode*> stack;
+	if (root)
+		stack.push_back(root);
+	while (stack.size())
+	{
+		PlaylistNode* node = stack.back();
+		stack.pop_back();
+		postorder.push_back(node);
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+	}
+	for (size_t i = postorder.size(); i > 0; i--)
+		UpdateNode(postorder[i - 1]);
+	SetRoot(playlist, root);
+}
+
+
+// Fills nodes (which must hold PlaylistCount() pointers) with the nodes in list order
+void PlaylistGetNodes(const Playlist* playlist, PlaylistNode** nodes)
+{
+	unsigned int i = 0;
+	for (PlaylistNode* node = PlaylistFirst(playlist); node; node = PlaylistNext(node))
+		nodes[i++] = node;
+}
+
+
+// Call after the song_length_secs of the node's song changes, to fix the totals
+void PlaylistSongLengthChanged(PlaylistNode* node)
+{
+	for (; node; node = node->parent)
+		UpdateNode(node);
+}
+
+
+// Frees every node.  The songs are NOT freed.
+void PlaylistClear(Playlist* playlist)
+{
+	std::vector<PlaylistNode*> stack;
+	if (playlist->root)
+		stack.push_back(playlist->root);
+	while (stack.size())
+	{
+		PlaylistNode* node = stack.back();
+		stack.pop_back();
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+		FreeMemory(node);
+	}
+	playlist->root = NULL;
+}
\ No newline at end of file
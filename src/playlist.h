@@ -0,0 +1,83 @@
+/******************************************************************************
+playlist.h - Song order for the playlist, stored as a balanced tree
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include "song.h"
+
+// A list of songs stored as a treap (a binary tree balanced by random priorities).  Every node
+// knows how many nodes are in its subtree and the total length of their songs, so these are 
+// all O(log n):
+//		- Getting the song at an index, and the index of a node
+//		- Inserting and deleting a song
+//		- Moving a range of songs somewhere else in the list
+//		- Getting the total length of the songs before an index, e.g. the time until song N plays
+//
+// A zero-initialized Playlist is a valid, empty list.  Nodes stay at the same address until they
+// are deleted, so a node pointer can be kept to find the song's current index later.
+
+struct PlayQueueEntry;
+
+struct PlaylistNode {
+	Song* song;
+	PlaylistNode* link;				// Optional node of the same song in another Playlist, e.g. play order <-> display order
+	PlaylistNode* left;
+	PlaylistNode* right;
+	PlaylistNode* parent;
+	unsigned int priority;			// Random.  Parents have a higher priority than their children.
+	unsigned int count;				// Number of nodes in this subtree, including this one
+	unsigned long long length_secs;	// Total song_length_secs of this subtree
+	bool is_marked;					// Used by PlaylistDeleteNodes()
+	unsigned int shuffle_ordinal;	// Ordinal of the song in the shuffle order (ShuffleAdd()), in the play order list
+	PlayQueueEntry* queue_entries;	// Entries of the node in the play next queue, or NULL if it isn't queued (play order list)
+};
+
+struct Playlist {
+	PlaylistNode* root;
+	unsigned int rand_state;		// For node priorities
+};
+
+unsigned int PlaylistCount(const Playlist* playlist);
+unsigned long long PlaylistTotalLength(const Playlist* playlist);
+unsigned long long PlaylistLengthBefore(const Playlist* playlist, unsigned int idx);
+PlaylistNode* PlaylistNodeAt(const Playlist* playlist, unsigned int idx);
+Song* PlaylistSongAt(const Playlist* playlist, unsigned int idx);
+unsigned int PlaylistIndexOf(const PlaylistNode* node);
+PlaylistNode* PlaylistFirst(const Playlist* playlist);
+PlaylistNode* PlaylistNext(const PlaylistNode* node);
+PlaylistNode* PlaylistInsert(Playlist* playlist, unsigned int idx, Song* song);
+PlaylistNode* PlaylistPushBack(Playlist* playlist, Song* song);
+void PlaylistDelete(Playlist* playlist, PlaylistNode* node);
+void PlaylistDeleteNodes(Playlist* playlist, PlaylistNode** nodes, unsigned int num_nodes);
+void PlaylistMove(Playlist* playlist, unsigned int first, unsigned int count, unsigned int dest);
+void PlaylistRebuild(Playlist* playlist, PlaylistNode** nodes, unsigned int num_nodes);
+void PlaylistGetNodes(const Playlist* playlist, PlaylistNode** nodes);
+void PlaylistSongLengthChanged(PlaylistNode* node);
+void PlaylistClear(Playlist* playlist);
\ No newline at end of file
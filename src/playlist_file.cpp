@@ -0,0 +1,911 @@
+/******************************************************************************
+playlist_file.cpp - Reading and writing M3U, M3U8, PLS, and XSPF playlist files
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "playlist_file.h"
+#include <stdio.h>
+#include <string.h>
+
+#define UTF8_BOM		"\xEF\xBB\xBF"
+
+enum XspfElement { XSPF_NONE, XSPF_LOCATION, XSPF_TITLE, XSPF_DURATION };
+
+
+static inline char LowerChar(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+
+static bool StartsWithNoCase(const char* str, size_t len, const char* prefix)
+{
+	size_t i = 0;
+	for (; prefix[i]; i++)
+	{
+		if (i >= len || LowerChar(str[i]) != LowerChar(prefix[i]))
+			return false;
+	}
+	return true;
+}
+
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+static void Trim(const char** str, size_t* len)
+{
+	while (*len > 0 && IsSpace(**str))
+	{
+		(*str)++;
+		(*len)--;
+	}
+	while (*len > 0 && IsSpace((*str)[*len - 1]))
+		(*len)--;
+}
+
+
+// Reads a number at the start of str.  Returns false if there are no digits.
+static bool ParseInt(const char* str, size_t len, int* value)
+{
+	size_t i = 0;
+	bool is_negative = false;
+	if (len > 0 && str[0] == '-')
+	{
+		is_negative = true;
+		i++;
+	}
+	if (i >= len || str[i] < '0' || str[i] > '9')
+		return false;
+
+	long long result = 0;
+	for (; i < len && str[i] >= '0' && str[i] <= '9'; i++)
+	{
+		if (result < 0x7FFFFFFF)
+			result = result * 10 + (str[i] - '0');
+	}
+	if (result > 0x7FFFFFFF)
+		result = 0x7FFFFFFF;
+	*value = (int)(is_negative ? -result : result);
+	return true;
+}
+
+
+static inline int HexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c = LowerChar(c);
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+
+static void PercentDecode(const char* str, size_t len, std::string* result)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		// Copy everything up to the next '%' at once
+		const char* percent = (const char*)memchr(str + i, '%', len - i);
+		const size_t run_len = (percent ? percent : str + len) - (str + i);
+		result->append(str + i, run_len);
+		i += run_len;
+		if (i >= len)
+			break;
+
+		int high, low;
+		if (i + 2 < len && (high = HexValue(str[i + 1])) >= 0
+			&& (low = HexValue(str[i + 2])) >= 0)
+		{
+			*result += (char)(high * 16 + low);
+			i += 2;
+		}
+		else
+		{
+			*result += str[i];
+		}
+	}
+}
+
+
+// file:///C:/Music/My%20Song.mp3 -> C:/Music/My Song.mp3, and file://server/share/a.mp3 -> \\server/share/a.mp3
+static void DecodeFileUri(const char* uri, size_t len, std::string* path)
+{
+	const char* str = uri + 5;		// Skip "file:"
+	len -= 5;
+	if (len >= 3 && memcmp(str, "///", 3) == 0)
+	{
+		str += 3;
+		len -= 3;
+	}
+	else if (len >= 12 && StartsWithNoCase(str, len, "//localhost/"))
+	{
+		str += 12;
+		len -= 12;
+	}
+	else if (len >= 2 && memcmp(str, "//", 2) == 0)
+	{
+		*path += "\\\\";
+		str += 2;
+		len -= 2;
+	}
+	PercentDecode(str, len, path);
+}
+
+
+// Length of the part of an absolute path that ".." can't go above, e.g. "C:\" or "\\server\share\"
+static size_t RootLength(const std::string& path)
+{
+	if (path.size() >= 2 && path[1] == ':')
+		return (path.size() >= 3 && path[2] == '\\') ? 3 : 2;
+	if (path.size() >= 2 && path[0] == '\\' && path[1] == '\\')
+	{
+		size_t share = path.find('\\', 2);
+		if (share == std::string::npos)
+			return path.size();
+		size_t end = path.find('\\', share + 1);
+		return (end == std::string::npos) ? path.size() : end + 1;
+	}
+	return 0;
+}
+
+
+// Removes "." and ".." and repeated separators from a directory, which is left ending with a backslash
+static void NormalizeDir(std::string* dir)
+{
+	const size_t root_len = RootLength(*dir);
+	std::string result(*dir, 0, root_len);
+	size_t pos = root_len;
+	while (pos < dir->size())
+	{
+		size_t end = dir->find('\\', pos);
+		if (end == std::string::npos)
+			end = dir->size();
+		const size_t len = end - pos;
+		if (len == 2 && (*dir)[pos] == '.' && (*dir)[pos + 1] == '.')
+		{
+			if (result.size() > root_len)
+			{
+				// Remove the last directory, which ends in a backslash
+				const size_t last = result.rfind('\\', result.size() - 2);
+				result.resize((last == std::string::npos || last + 1 < root_len) ? root_len : last + 1);
+			}
+		}
+		else if (len > 0 && !(len == 1 && (*dir)[pos] == '.'))
+		{
+			result.append(*dir, pos, len);
+			result += '\\';
+		}
+		pos = end + 1;
+	}
+	dir->swap(result);
+}
+
+
+// Turns reader->path into an absolute path in reader->resolved_path.  Returns false if it isn't a 
+// file path, e.g. an http:// stream.
+static bool ResolvePath(PlaylistFileReader* reader)
+{
+	std::string& path = reader->path;
+	if (path.find("://") != std::string::npos)
+		return false;
+	for (size_t i = 0; i < path.size(); i++)
+	{
+		if (path[i] == '/')
+			path[i] = '\\';
+	}
+	const size_t name_start = path.rfind('\\') + 1;		// 0 if there is no backslash
+	if (name_start >= path.size())
+		return false;
+
+	if (name_start != reader->relative_dir.size() || path.compare(0, name_start, reader->relative_dir) != 0)
+	{
+		reader->relative_dir.assign(path, 0, name_start);
+		if (RootLength(reader->relative_dir) > 0)
+		{
+			reader->resolved_dir = reader->relative_dir;
+		}
+		else if (path[0] == '\\')
+		{
+			// Relative to the root of the playlist's drive
+			const size_t drive_len = RootLength(reader->base_dir);
+			reader->resolved_dir.assign(reader->base_dir, 0, drive_len > 0 ? drive_len - 1 : 0);
+			reader->resolved_dir += reader->relative_dir;
+		}
+		else
+		{
+			reader->resolved_dir = reader->base_dir + reader->relative_dir;
+		}
+		NormalizeDir(&reader->resolved_dir);
+	}
+	reader->resolved_path = reader->resolved_dir;
+	reader->resolved_path.append(path, name_start, std::string::npos);
+	return true;
+}
+
+
+// Calls back with the entry that was read, if it has a usable path, and starts the next one
+static void EndEntry(PlaylistFileReader* reader)
+{
+	if (reader->has_path && ResolvePath(reader))
+	{
+		PlaylistFileEntry entry;
+		entry.path = reader->resolved_path.c_str();
+		entry.title = reader->has_title ? reader->title.c_str() : NULL;
+		entry.length_secs = reader->length_secs;
+		entry.is_utf8 = reader->is_utf8;
+		reader->callback(reader->context, &entry);
+	}
+	reader->path.clear();
+	reader->title.clear();
+	reader->has_path = false;
+	reader->has_title = false;
+	reader->length_secs = -1;
+}
+
+
+static void SetPath(PlaylistFileReader* reader, const char* str, size_t len)
+{
+	reader->path.clear();
+	if (StartsWithNoCase(str, len, "file:"))
+		DecodeFileUri(str, len, &reader->path);
+	else
+		reader->path.assign(str, len);
+	reader->has_path = len > 0;
+}
+
+
+// #EXTM3U
+// #EXTINF:<seconds>[ attributes],<title>
+// <path>
+static void ReadM3ULine(PlaylistFileReader* reader, const char* line, size_t len)
+{
+	Trim(&line, &len);
+	if (len == 0)
+		return;
+
+	if (line[0] == '#')
+	{
+		if (StartsWithNoCase(line, len, "#EXTINF:"))
+		{
+			if (!ParseInt(line + 8, len - 8, &reader->length_secs) || reader->length_secs < 0)
+				reader->length_secs = -1;
+			const char* comma = (const char*)memchr(line, ',', len);
+			if (comma)
+			{
+				const char* title = comma + 1;
+				size_t title_len = line + len - title;
+				Trim(&title, &title_len);
+				reader->title.assign(title, title_len);
+				reader->has_title = title_len > 0;
+			}
+		}
+		return;
+	}
+
+	SetPath(reader, line, len);
+	EndEntry(reader);
+}
+
+
+// [playlist]
+// File<n>=<path>
+// Title<n>=<title>
+// Length<n>=<seconds>
+// NumberOfEntries=<count>
+// The keys of an entry don't have to be in any order, but they are always next to each other.
+static void ReadPLSLine(PlaylistFileReader* reader, const char* line, size_t len)
+{
+	Trim(&line, &len);
+	const char* equals = (const char*)memchr(line, '=', len);
+	if (len == 0 || line[0] == '[' || line[0] == ';' || !equals)
+		return;
+
+	const char* value = equals + 1;
+	size_t value_len = line + len - value;
+	Trim(&value, &value_len);
+	const size_t key_len = equals - line;
+	size_t name_len;
+	if (StartsWithNoCase(line, key_len, "File"))
+		name_len = 4;
+	else if (StartsWithNoCase(line, key_len, "Title"))
+		name_len = 5;
+	else if (StartsWithNoCase(line, key_len, "Length"))
+		name_len = 6;
+	else
+		return;
+
+	int index;
+	if (!ParseInt(line + name_len, key_len - name_len, &index) || index < 0)
+		return;
+	if ((unsigned int)index != reader->pls_index)
+	{
+		EndEntry(reader);
+		reader->pls_index = index;
+	}
+
+	if (name_len == 4)
+	{
+		SetPath(reader, value, value_len);
+	}
+	else if (name_len == 5)
+	{
+		reader->title.assign(value, value_len);
+		reader->has_title = value_len > 0;
+	}
+	else if (!ParseInt(value, value_len, &reader->length_secs) || reader->length_secs < 0)
+	{
+		reader->length_secs = -1;
+	}
+}
+
+
+// Splits the chunk into lines.  A line is only copied if it continues into the next chunk.
+static void FeedLines(PlaylistFileReader* reader, const char* data, size_t len,
+	void (*read_line)(PlaylistFileReader*, const char*, size_t))
+{
+	const char* end = data + len;
+	while (data < end)
+	{
+		const char* newline = (const char*)memchr(data, '\n', end - data);
+		const char* part_end = newline ? newline : end;
+		const size_t part_len = part_end - data;
+		if (reader->is_skipping)
+		{
+			// Rest of a line that was too long
+		}
+		else if (reader->line.size() + part_len > PLAYLIST_FILE_MAX_LINE)
+		{
+			reader->line.clear();
+			reader->is_skipping = true;
+		}
+		else if (!newline)
+		{
+			reader->line.append(data, part_len);
+		}
+		else if (reader->line.empty())
+		{
+			read_line(reader, data, part_len);
+		}
+		else
+		{
+			reader->line.append(data, part_len);
+			read_line(reader, reader->line.data(), reader->line.size());
+			reader->line.clear();
+		}
+
+		if (!newline)
+			break;
+		reader->is_skipping = false;
+		data = newline + 1;
+	}
+}
+
+
+// Replaces the XML entities in text, e.g. "&amp;" -> "&"
+static void DecodeXmlText(const char* text, size_t len, std::string* result)
+{
+	result->clear();
+	for (size_t i = 0; i < len; i++)
+	{
+		// Copy everything up to the next entity at once
+		const char* ampersand = (const char*)memchr(text + i, '&', len - i);
+		const size_t run_len = (ampersand ? ampersand : text + len) - (text + i);
+		result->append(text + i, run_len);
+		i += run_len;
+		if (i >= len)
+			break;
+
+		const char* semicolon = (const char*)memchr(text + i, ';', len - i);
+		if (!semicolon || semicolon - (text + i) > 12)
+		{
+			*result += text[i];
+			continue;
+		}
+
+		const char* name = text + i + 1;
+		const size_t name_len = semicolon - name;
+		unsigned int code_point = 0;
+		if (name_len == 3 && memcmp(name, "amp", 3) == 0)
+			code_point = '&';
+		else if (name_len == 2 && memcmp(name, "lt", 2) == 0)
+			code_point = '<';
+		else if (name_len == 2 && memcmp(name, "gt", 2) == 0)
+			code_point = '>';
+		else if (name_len == 4 && memcmp(name, "quot", 4) == 0)
+			code_point = '"';
+		else if (name_len == 4 && memcmp(name, "apos", 4) == 0)
+			code_point = '\'';
+		else if (name_len > 1 && name[0] == '#')
+		{
+			const bool is_hex = (name[1] == 'x' || name[1] == 'X');
+			for (size_t j = is_hex ? 2 : 1; j < name_len && code_point <= 0x10FFFF; j++)
+			{
+				const int digit = is_hex ? HexValue(name[j]) : ((name[j] >= '0' && name[j] <= '9') ? name[j] - '0' : -1);
+				if (digit < 0)
+				{
+					code_point = 0;
+					break;
+				}
+				code_point = code_point * (is_hex ? 16 : 10) + digit;
+			}
+		}
+		if (code_point == 0 || code_point > 0x10FFFF)
+		{
+			*result += text[i];
+			continue;
+		}
+
+		// XSPF is always UTF-8
+		if (code_point < 0x80)
+		{
+			*result += (char)code_point;
+		}
+		else if (code_point < 0x800)
+		{
+			*result += (char)(0xC0 | (code_point >> 6));
+			*result += (char)(0x80 | (code_point & 0x3F));
+		}
+		else if (code_point < 0x10000)
+		{
+			*result += (char)(0xE0 | (code_point >> 12));
+			*result += (char)(0x80 | ((code_point >> 6) & 0x3F));
+			*result += (char)(0x80 | (code_point & 0x3F));
+		}
+		else
+		{
+			*result += (char)(0xF0 | (code_point >> 18));
+			*result += (char)(0x80 | ((code_point >> 12) & 0x3F));
+			*result += (char)(0x80 | ((code_point >> 6) & 0x3F));
+			*result += (char)(0x80 | (code_point & 0x3F));
+		}
+		i = semicolon - text;
+	}
+}
+
+
+// Stores the text of the <location>, <title>, or <duration> element that just ended
+static void ReadXspfText(PlaylistFileReader* reader)
+{
+	DecodeXmlText(reader->line.data(), reader->line.size(), &reader->text);
+	const char* str = reader->text.data();
+	size_t len = reader->text.size();
+	Trim(&str, &len);
+	if (reader->xspf_element == XSPF_LOCATION)
+	{
+		// Locations are URIs, so even relative ones are percent encoded
+		if (StartsWithNoCase(str, len, "file:"))
+		{
+			SetPath(reader, str, len);
+		}
+		else
+		{
+			reader->path.clear();
+			PercentDecode(str, len, &reader->path);
+			reader->has_path = len > 0;
+		}
+	}
+	else if (reader->xspf_element == XSPF_TITLE)
+	{
+		reader->title.assign(str, len);
+		reader->has_title = len > 0;
+	}
+	else if (reader->xspf_element == XSPF_DURATION)
+	{
+		int duration_ms;
+		reader->length_secs = (ParseInt(str, len, &duration_ms) && duration_ms >= 0) ? duration_ms / 1000 : -1;
+	}
+}
+
+
+// Handles the tag in reader->line, which is everything between '<' and '>'
+static void ReadXspfTag(PlaylistFileReader* reader)
+{
+	const std::string& tag = reader->line;
+	if (tag.empty() || tag[0] == '?' || tag[0] == '!')
+		return;
+
+	const bool is_end_tag = (tag[0] == '/');
+	const bool is_empty_element = (tag[tag.size() - 1] == '/');
+	size_t name_start = is_end_tag ? 1 : 0;
+	size_t name_end = name_start;
+	while (name_end < tag.size() && !IsSpace(tag[name_end]) && tag[name_end] != '/')
+		name_end++;
+	// Ignore the namespace prefix, if there is one
+	for (size_t i = name_start; i < name_end; i++)
+	{
+		if (tag[i] == ':')
+			name_start = i + 1;
+	}
+	const char* name = tag.data() + name_start;
+	const size_t name_len = name_end - name_start;
+
+	if (name_len == 5 && memcmp(name, "track", 5) == 0)
+	{
+		if (is_end_tag && reader->is_in_track)
+			EndEntry(reader);
+		reader->is_in_track = !is_end_tag && !is_empty_element;
+	}
+	else if (reader->is_in_track && !is_end_tag && !is_empty_element)
+	{
+		// Only the first location of a track is used.  The others are alternatives.
+		if (name_len == 8 && memcmp(name, "location", 8) == 0 && !reader->has_path)
+			reader->xspf_element = XSPF_LOCATION;
+		else if (name_len == 5 && memcmp(name, "title", 5) == 0)
+			reader->xspf_element = XSPF_TITLE;
+		else if (name_len == 8 && memcmp(name, "duration", 8) == 0)
+			reader->xspf_element = XSPF_DURATION;
+	}
+}
+
+
+// Adds part of a tag or element text to reader->line, unless it has gotten too long
+static void AppendXspfPart(PlaylistFileReader* reader, const char* data, size_t len)
+{
+	if (reader->is_skipping)
+		return;
+	if (reader->line.size() + len > PLAYLIST_FILE_MAX_LINE)
+	{
+		reader->line.clear();
+		reader->is_skipping = true;
+		return;
+	}
+	reader->line.append(data, len);
+}
+
+
+// XSPF is XML, but only <track>, <location>, <title>, and <duration> are needed, so instead of 
+// a full XML parser the chunk is split at '<' and '>'
+static void FeedXspf(PlaylistFileReader* reader, const char* data, size_t len)
+{
+	const char* end = data + len;
+	while (data < end)
+	{
+		if (reader->is_in_tag)
+		{
+			const char* close = (const char*)memchr(data, '>', end - data);
+			AppendXspfPart(reader, data, (close ? close : end) - data);
+			if (!close)
+				break;
+			data = close + 1;
+
+			// Comments can contain '>'
+			const std::string& tag = reader->line;
+			if (!reader->is_skipping && tag.compare(0, 3, "!--") == 0
+				&& (tag.size() < 5 || tag.compare(tag.size() - 2, 2, "--") != 0))
+			{
+				AppendXspfPart(reader, ">", 1);
+				continue;
+			}
+			if (!reader->is_skipping)
+				ReadXspfTag(reader);
+			reader->line.clear();
+			reader->is_skipping = false;
+			reader->is_in_tag = false;
+		}
+		else
+		{
+			const char* open = (const char*)memchr(data, '<', end - data);
+			if (reader->xspf_element != XSPF_NONE)
+				AppendXspfPart(reader, data, (open ? open : end) - data);
+			if (!open)
+				break;
+			data = open + 1;
+
+			if (reader->xspf_element != XSPF_NONE && !reader->is_skipping)
+				ReadXspfText(reader);
+			reader->xspf_element = XSPF_NONE;
+			reader->line.clear();
+			reader->is_skipping = false;
+			reader->is_in_tag = true;
+		}
+	}
+}
+
+
+PlaylistFileFormat GetPlaylistFileFormat(const char* path)
+{
+	const char* ext = strrchr(path, '.');
+	if (!ext || strchr(ext, '\\') || strchr(ext, '/'))
+		return PLAYLIST_FORMAT_NONE;
+
+	const size_t len = strlen(ext);
+	if (len == 4 && StartsWithNoCase(ext, len, ".m3u"))
+		return PLAYLIST_FORMAT_M3U;
+	if (len == 5 && StartsWithNoCase(ext, len, ".m3u8"))
+		return PLAYLIST_FORMAT_M3U8;
+	if (len == 4 && StartsWithNoCase(ext, len, ".pls"))
+		return PLAYLIST_FORMAT_PLS;
+	if (len == 5 && StartsWithNoCase(ext, len, ".xspf"))
+		return PLAYLIST_FORMAT_XSPF;
+	return PLAYLIST_FORMAT_NONE;
+}
+
+
+// playlist_path is the path of the playlist file, which relative paths in it are relative to
+void PlaylistFileReaderBegin(PlaylistFileReader* reader, PlaylistFileFormat format, const char* playlist_path,
+	PlaylistEntryCallback callback, void* context)
+{
+	reader->format = format;
+	reader->callback = callback;
+	reader->context = context;
+	reader->base_dir = playlist_path;
+	for (size_t i = 0; i < reader->base_dir.size(); i++)
+	{
+		if (reader->base_dir[i] == '/')
+			reader->base_dir[i] = '\\';
+	}
+	reader->base_dir.resize(reader->base_dir.rfind('\\') + 1);		// Empty if there is no directory
+	reader->is_utf8 = (format == PLAYLIST_FORMAT_M3U8 || format == PLAYLIST_FORMAT_XSPF);
+	reader->bom_len = 0;
+	reader->line.clear();
+	reader->is_skipping = false;
+	reader->path.clear();
+	reader->title.clear();
+	reader->has_path = false;
+	reader->has_title = false;
+	reader->length_secs = -1;
+	reader->pls_index = 0;
+	reader->is_in_tag = false;
+	reader->is_in_track = false;
+	reader->xspf_element = XSPF_NONE;
+
+	// Paths without a directory are in the playlist's own directory
+	reader->relative_dir.clear();
+	reader->resolved_dir = reader->base_dir;
+	NormalizeDir(&reader->resolved_dir);
+	if (reader->base_dir.empty())
+		reader->resolved_dir.clear();
+}
+
+
+void PlaylistFileReaderFeed(PlaylistFileReader* reader, const char* data, size_t len)
+{
+	// Check for a byte order mark, which could be split between chunks
+	while (reader->bom_len < 3 && len > 0)
+	{
+		if (data[0] != UTF8_BOM[reader->bom_len])
+		{
+			// Not a BOM, so the bytes that matched are part of the text
+			const unsigned int matched_len = reader->bom_len;
+			reader->bom_len = 3;
+			PlaylistFileReaderFeed(reader, UTF8_BOM, matched_len);
+			break;
+		}
+		reader->bom_len++;
+		data++;
+		len--;
+		if (reader->bom_len == 3)
+			reader->is_utf8 = true;
+	}
+
+	if (reader->format == PLAYLIST_FORMAT_M3U || reader->format == PLAYLIST_FORMAT_M3U8)
+		FeedLines(reader, data, len, ReadM3ULine);
+	else if (reader->format == PLAYLIST_FORMAT_PLS)
+		FeedLines(reader, data, len, ReadPLSLine);
+	else if (reader->format == PLAYLIST_FORMAT_XSPF)
+		FeedXspf(reader, data, len);
+}
+
+
+// Reads the last line, if the file doesn't end with a newline
+void PlaylistFileReaderEnd(PlaylistFileReader* reader)
+{
+	if (reader->format == PLAYLIST_FORMAT_M3U || reader->format == PLAYLIST_FORMAT_M3U8)
+	{
+		if (!reader->is_skipping && !reader->line.empty())
+			ReadM3ULine(reader, reader->line.data(), reader->line.size());
+	}
+	else if (reader->format == PLAYLIST_FORMAT_PLS)
+	{
+		if (!reader->is_skipping && !reader->line.empty())
+			ReadPLSLine(reader, reader->line.data(), reader->line.size());
+		EndEntry(reader);
+	}
+	reader->line.clear();
+	reader->is_skipping = false;
+}
+
+
+static void FlushWriter(PlaylistFileWriter* writer)
+{
+	if (writer->is_ok && !writer->buffer.empty())
+		writer->is_ok = writer->callback(writer->context, writer->buffer.data(), writer->buffer.size());
+	writer->buffer.clear();
+}
+
+
+static void WriteText(PlaylistFileWriter* writer, const char* text)
+{
+	writer->buffer += text;
+	if (writer->buffer.size() >= PLAYLIST_FILE_WRITE_BUFFER)
+		FlushWriter(writer);
+}
+
+
+// Titles are written on one line, so line breaks and other control characters become spaces
+static void WriteTitle(PlaylistFileWriter* writer, const char* title, bool is_xml)
+{
+	for (const char* c = title; *c; c++)
+	{
+		if ((unsigned char)*c < ' ')
+			writer->buffer += ' ';
+		else if (is_xml && *c == '&')
+			writer->buffer += "&amp;";
+		else if (is_xml && *c == '<')
+			writer->buffer += "&lt;";
+		else if (is_xml && *c == '>')
+			writer->buffer += "&gt;";
+		else
+			writer->buffer += *c;
+	}
+}
+
+
+// C:\Music\My Song.mp3 -> file:///C:/Music/My%20Song.mp3, and \\server\share\a.mp3 -> file://server/share/a.mp3
+static void WriteFileUri(PlaylistFileWriter* writer, const char* path)
+{
+	static const char hex_digits[] = "0123456789ABCDEF";
+	if (path[0] == '\\' && path[1] == '\\')
+	{
+		writer->buffer += "file://";
+		path += 2;
+	}
+	else
+	{
+		writer->buffer += "file:///";
+	}
+	for (const unsigned char* c = (const unsigned char*)path; *c; c++)
+	{
+		if (*c == '\\')
+		{
+			writer->buffer += '/';
+		}
+		else if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9')
+			|| strchr("-._~/:!$'()*+,;=@", *c))
+		{
+			writer->buffer += (char)*c;
+		}
+		else
+		{
+			writer->buffer += '%';
+			writer->buffer += hex_digits[*c >> 4];
+			writer->buffer += hex_digits[*c & 0xF];
+		}
+	}
+}
+
+
+// Text is written in the file format's encoding, so paths and titles must be UTF-8 for M3U8 and 
+// XSPF, and ANSI for M3U and PLS
+void PlaylistFileWriterBegin(PlaylistFileWriter* writer, PlaylistFileFormat format, 
+	PlaylistWriteCallback callback, void* context)
+{
+	writer->format = format;
+	writer->callback = callback;
+	writer->context = context;
+	writer->buffer.clear();
+	writer->buffer.reserve(PLAYLIST_FILE_WRITE_BUFFER + 4096);
+	writer->num_entries = 0;
+	writer->is_ok = true;
+
+	if (format == PLAYLIST_FORMAT_M3U || format == PLAYLIST_FORMAT_M3U8)
+	{
+		WriteText(writer, "#EXTM3U\r\n");
+	}
+	else if (format == PLAYLIST_FORMAT_PLS)
+	{
+		WriteText(writer, "[playlist]\r\n");
+	}
+	else if (format == PLAYLIST_FORMAT_XSPF)
+	{
+		WriteText(writer, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+			"<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\r\n"
+			"  <trackList>\r\n");
+	}
+}
+
+
+// title can be NULL and length_secs can be -1 if they aren't known
+void PlaylistFileWriteEntry(PlaylistFileWriter* writer, const char* path, const char* title, int length_secs)
+{
+	char number[64];
+	writer->num_entries++;
+	if (writer->format == PLAYLIST_FORMAT_M3U || writer->format == PLAYLIST_FORMAT_M3U8)
+	{
+		if (title || length_secs >= 0)
+		{
+			snprintf(number, sizeof(number), "#EXTINF:%d,", length_secs);
+			writer->buffer += number;
+			if (title)
+				WriteTitle(writer, title, false);
+			writer->buffer += "\r\n";
+		}
+		writer->buffer += path;
+		writer->buffer += "\r\n";
+	}
+	else if (writer->format == PLAYLIST_FORMAT_PLS)
+	{
+		snprintf(number, sizeof(number), "File%u=", writer->num_entries);
+		writer->buffer += number;
+		writer->buffer += path;
+		writer->buffer += "\r\n";
+		if (title)
+		{
+			snprintf(number, sizeof(number), "Title%u=", writer->num_entries);
+			writer->buffer += number;
+			WriteTitle(writer, title, false);
+			writer->buffer += "\r\n";
+		}
+		snprintf(number, sizeof(number), "Length%u=%d\r\n", writer->num_entries, length_secs);
+		writer->buffer += number;
+	}
+	else if (writer->format == PLAYLIST_FORMAT_XSPF)
+	{
+		writer->buffer += "    <track>\r\n      <location>";
+		WriteFileUri(writer, path);
+		writer->buffer += "</location>\r\n";
+		if (title)
+		{
+			writer->buffer += "      <title>";
+			WriteTitle(writer, title, true);
+			writer->buffer += "</title>\r\n";
+		}
+		if (length_secs >= 0)
+		{
+			snprintf(number, sizeof(number), "      <duration>%lld</duration>\r\n", length_secs * 1000LL);
+			writer->buffer += number;
+		}
+		writer->buffer += "    </track>\r\n";
+	}
+	if (writer->buffer.size() >= PLAYLIST_FILE_WRITE_BUFFER)
+		FlushWriter(writer);
+}
+
+
+// Returns false if any write failed
+bool PlaylistFileWriterEnd(PlaylistFileWriter* writer)
+{
+	char number[32];
+	if (writer->format == PLAYLIST_FORMAT_PLS)
+	{
+		snprintf(number, sizeof(number), "NumberOfEntries=%u\r\n", writer->num_entries);
+		WriteText(writer, number);
+		WriteText(writer, "Version=2\r\n");
+	}
+	else if (writer->format == PLAYLIST_FORMAT_XSPF)
+	{
+		WriteText(writer, "  </trackList>\r\n</playlist>\r\n");
+	}
+	FlushWriter(writer);
+	return writer->is_ok;
+}
@@ -0,0 +1,112 @@
+/******************************************************************************
+playlist_file.h - Reading and writing M3U, M3U8, PLS, and XSPF playlist files
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+// Playlist files shared with other players.  Readers are fed the file a chunk at a time and 
+// call back once per entry, so a playlist of any size is read in constant memory.  Lines are
+// found with memchr(), which the CRT vectorizes.  Relative paths are resolved against the 
+// directory of the playlist file, and since the entries of one directory are almost always 
+// next to each other, the last resolved directory is cached instead of normalizing every path.
+//
+// Nothing here uses the Windows API, so the readers and writers can be fuzzed and benchmarked
+// on any platform.  Paths are returned with backslash separators.  Text is passed through in
+// the file's encoding; PlaylistFileEntry::is_utf8 says which one it is.
+
+#define PLAYLIST_FILE_MAX_LINE		(64 * 1024)		// Longer lines and XSPF elements are skipped
+#define PLAYLIST_FILE_WRITE_BUFFER	(64 * 1024)		// Bytes buffered before the write callback is called
+
+enum PlaylistFileFormat { PLAYLIST_FORMAT_NONE, PLAYLIST_FORMAT_M3U, PLAYLIST_FORMAT_M3U8, 
+	PLAYLIST_FORMAT_PLS, PLAYLIST_FORMAT_XSPF };
+
+struct PlaylistFileEntry {
+	const char* path;			// Absolute path
+	const char* title;			// NULL if the playlist doesn't have one
+	int length_secs;			// -1 if unknown
+	bool is_utf8;				// Are path and title UTF-8?  Otherwise they are in the ANSI code page.
+};
+
+// Only valid during the call
+typedef void (*PlaylistEntryCallback)(void* context, const PlaylistFileEntry* entry);
+
+// Returns false to stop writing
+typedef bool (*PlaylistWriteCallback)(void* context, const char* data, size_t len);
+
+struct PlaylistFileReader {
+	PlaylistFileFormat format;
+	PlaylistEntryCallback callback;
+	void* context;
+	std::string base_dir;			// Directory of the playlist file, ending with a backslash
+	bool is_utf8;
+	unsigned int bom_len;			// Bytes of the UTF-8 byte order mark seen so far, or 3 if done checking
+	std::string line;				// Line (or XSPF tag/text) that continues in the next chunk
+	bool is_skipping;				// Current line or element is too long and is being skipped
+
+	// Entry being read
+	std::string path;
+	std::string title;
+	bool has_path;
+	bool has_title;
+	int length_secs;
+	unsigned int pls_index;			// Number in FileN=, TitleN=, LengthN=
+
+	// XSPF
+	bool is_in_tag;					// Between '<' and '>'
+	bool is_in_track;
+	int xspf_element;				// Element whose text is being collected
+	std::string text;				// Element text with the XML entities replaced
+
+	// Cache for resolving relative paths
+	std::string relative_dir;
+	std::string resolved_dir;
+	std::string resolved_path;
+};
+
+struct PlaylistFileWriter {
+	PlaylistFileFormat format;
+	PlaylistWriteCallback callback;
+	void* context;
+	std::string buffer;
+	unsigned int num_entries;
+	bool is_ok;						// Has every write succeeded?
+};
+
+PlaylistFileFormat GetPlaylistFileFormat(const char* path);
+void PlaylistFileReaderBegin(PlaylistFileReader* reader, PlaylistFileFormat format, const char* playlist_path,
+	PlaylistEntryCallback callback, void* context);
+void PlaylistFileReaderFeed(PlaylistFileReader* reader, const char* data, size_t len);
+void PlaylistFileReaderEnd(PlaylistFileReader* reader);
+void PlaylistFileWriterBegin(PlaylistFileWriter* writer, PlaylistFileFormat format, 
+	PlaylistWriteCallback callback, void* context);
+void PlaylistFileWriteEntry(PlaylistFileWriter* writer, const char* path, const char* title, int length_secs);
+bool PlaylistFileWriterEnd(PlaylistFileWriter* writer);
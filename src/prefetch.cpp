@@ -0,0 +1,173 @@
+/******************************************************************************
+prefetch.cpp - Locality-ordered read-ahead for metadata scans
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "prefetch.h"
+#include "locality.h"
+#include "util.h"
+#include <winioctl.h>
+#include <vector>
+
+// Is the path on a local fixed disk?  UNC paths (\\server\share) and mapped network drives aren't, and 
+// removable drives are left out too, since they are mostly flash and don't seek.  drive_types caches 
+// GetDriveType() for the drive letters A to Z, with DRIVE_UNKNOWN for the ones not looked up yet.
+static bool IsOnFixedDrive(const char* path, UINT* drive_types)
+{
+	const char letter = path[0] & ~0x20;
+	if (letter < 'A' || letter > 'Z' || path[1] != ':' || path[2] != '\\')
+		return false;
+	UINT* drive_type = &drive_types[letter - 'A'];
+	if (*drive_type == DRIVE_UNKNOWN)
+	{
+		const char root[] = { letter, ':', '\\', '\0' };
+		*drive_type = GetDriveTypeA(root);
+	}
+	return *drive_type == DRIVE_FIXED;
+}
+
+
+// Looks up where the file is on disk.  For NTFS/FAT volumes, this is the first logical cluster (LCN) of
+// the file's data.  For files too small to have their own clusters, it falls back to the file index, 
+// which at least roughly follows the order the files were created in.
+static void GetDiskPosition(LocalityKey* key)
+{
+	// Only need to read attributes, so this doesn't touch the file data
+	HANDLE file = CreateFileUtf8(key->path, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, 
+		OPEN_EXISTING, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	BY_HANDLE_FILE_INFORMATION file_info;
+	if (GetFileInformationByHandle(file, &file_info))
+	{
+		key->volume = file_info.dwVolumeSerialNumber;
+		key->disk_pos = ((ULONGLONG)file_info.nFileIndexHigh << 32) | file_info.nFileIndexLow;
+		key->has_disk_pos = true;
+	}
+
+	// Only the first extent is needed, so ERROR_MORE_DATA is expected for fragmented files
+	STARTING_VCN_INPUT_BUFFER vcn_input = {};
+	RETRIEVAL_POINTERS_BUFFER extents = {};
+	DWORD bytes_returned = 0;
+	if (DeviceIoControl(file, FSCTL_GET_RETRIEVAL_POINTERS, &vcn_input, sizeof(vcn_input),
+		&extents, sizeof(extents), &bytes_returned, NULL) || GetLastError() == ERROR_MORE_DATA)
+	{
+		if (extents.ExtentCount > 0 && extents.Extents[0].Lcn.QuadPart >= 0)
+		{
+			key->disk_pos = (ULONGLONG)extents.Extents[0].Lcn.QuadPart;
+			key->has_disk_pos = true;
+			key->has_extent = true;
+		}
+	}
+	CloseHandle(file);
+}
+
+
+// Fills order[] with the indices of paths[] in the order the files should be scanned.  See locality.h.
+void SortPathsByLocality(const char** paths, unsigned int count, unsigned int* order)
+{
+	if (!paths || !order)
+		return;
+
+	UINT drive_types[26] = {};
+	std::vector<LocalityKey> keys(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		keys[i] = {};
+		keys[i].path = paths[i];
+		keys[i].dir_len = GetDirectoryLength(paths[i]);
+		keys[i].idx = i;
+		// Opening the file to ask where it is would cost a round trip on a network share
+		if (IsOnFixedDrive(paths[i], drive_types))
+			GetDiskPosition(&keys[i]);
+	}
+
+	SortLocalityKeys(keys.data(), count);
+	for (unsigned int i = 0; i < count; i++)
+		order[i] = keys[i].idx;
+}
+
+
+// Starts reading the header region of the file in the background.  The data itself is discarded;
+// the point is to have it in the file cache before BASS opens the file.
+void PrefetchBegin(PrefetchRequest* request, const char* path)
+{
+	request->is_pending = false;
+
+	// FILE_FLAG_SEQUENTIAL_SCAN tells the cache manager to read ahead aggressively
+	request->file = CreateFileUtf8(path, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, 
+		FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN);
+	if (request->file == INVALID_HANDLE_VALUE)
+		return;
+
+	if (!request->buffer)
+		request->buffer = (unsigned char*)AllocMemory(ALLOC_METADATA, PREFETCH_HEADER_BYTES);
+	if (!request->buffer)
+	{
+		CloseHandle(request->file);
+		request->file = INVALID_HANDLE_VALUE;
+		return;
+	}
+
+	ZeroMemory(&request->overlapped, sizeof(request->overlapped));
+	if (ReadFile(request->file, request->buffer, PREFETCH_HEADER_BYTES, NULL, &request->overlapped) ||
+		GetLastError() == ERROR_IO_PENDING)
+	{
+		request->is_pending = true;
+	}
+	else
+	{
+		CloseHandle(request->file);
+		request->file = INVALID_HANDLE_VALUE;
+	}
+}
+
+
+// Waits for a read started by PrefetchBegin() to finish and closes the file.  The buffer is kept 
+// so the request can be reused.
+void PrefetchEnd(PrefetchRequest* request)
+{
+	if (request->is_pending)
+	{
+		DWORD bytes_read = 0;
+		GetOverlappedResult(request->file, &request->overlapped, &bytes_read, TRUE);
+		request->is_pending = false;
+	}
+	if (request->file && request->file != INVALID_HANDLE_VALUE)
+		CloseHandle(request->file);
+	request->file = INVALID_HANDLE_VALUE;
+}
+
+
+void PrefetchFree(PrefetchRequest* request)
+{
+	PrefetchEnd(request);
+	FreeMemory(request->buffer);
+	request->buffer = NULL;
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+/******************************************************************************
+prefetch.h - Header file for prefetch.cpp
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+#include <Windows.h>
+
+// Functions for scanning many audio files with as little disk seeking as possible.
+// The scan order is sorted so files are visited directory by directory, and within a 
+// directory by their position on disk on local disks, or by name on network shares (see
+// locality.h).  While BASS is probing one file, the headers of the next few files are
+// already being read in the background, so BASS finds them in the file cache.
+
+#define PREFETCH_HEADER_BYTES		(64 * 1024)		// Covers the ID3v2/Ogg headers of most files
+#define PREFETCH_MAX_IN_FLIGHT		8				// Max number of header reads outstanding at once
+
+struct PrefetchRequest {
+	HANDLE file;
+	OVERLAPPED overlapped;
+	unsigned char* buffer;		// PREFETCH_HEADER_BYTES.  Contents are thrown away.
+	bool is_pending;
+};
+
+void SortPathsByLocality(const char** paths, unsigned int count, unsigned int* order);
+void PrefetchBegin(PrefetchRequest* request, const char* path);
+void PrefetchEnd(PrefetchRequest* request);
+void PrefetchFree(PrefetchRequest* request);
\ No newline at end of file
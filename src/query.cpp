@@ -0,0 +1,658 @@
+/******************************************************************************
+query.cpp - Smart playlist queries compiled to predicates over the library index
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "query.h"
+#include <stdio.h>
+#include <string.h>
+
+enum QueryTokenType { TOKEN_END, TOKEN_WORD, TOKEN_STRING, TOKEN_OP, TOKEN_LPAREN, TOKEN_RPAREN };
+
+struct QueryToken {
+	QueryTokenType type;
+	const char* start;
+	size_t len;
+	LibraryFilterOp op;			// TOKEN_OP only
+};
+
+struct QueryParser {
+	const char* pos;
+	QueryToken token;			// Current token
+	QueryProgram* program;
+	char* error;
+	size_t error_len;
+	bool has_error;
+	int nesting;				// Depth of parentheses
+};
+
+struct QueryField {
+	const char* name;
+	LibraryColumn column;
+};
+
+static const QueryField g_query_fields[] = {
+	{ "artist", LIB_COL_ARTIST },
+	{ "album", LIB_COL_ALBUM },
+	{ "genre", LIB_COL_GENRE },
+	{ "track", LIB_COL_TRACK },
+	{ "disc", LIB_COL_DISC },
+	{ "year", LIB_COL_YEAR },
+	{ "duration", LIB_COL_DURATION },
+	{ "length", LIB_COL_DURATION },
+	{ "bitrate", LIB_COL_BITRATE },
+};
+
+
+static bool IsTextColumn(LibraryColumn column)
+{
+	return column == LIB_COL_ARTIST || column == LIB_COL_ALBUM || column == LIB_COL_GENRE;
+}
+
+
+// Case insensitive comparison of the token with a lowercase keyword
+static bool TokenIs(const QueryToken* token, const char* keyword)
+{
+	if (token->type != TOKEN_WORD || strlen(keyword) != token->len)
+		return false;
+	for (size_t i = 0; i < token->len; i++)
+	{
+		char c = token->start[i];
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		if (c != keyword[i])
+			return false;
+	}
+	return true;
+}
+
+
+static void SetParseError(QueryParser* parser, const char* message)
+{
+	if (parser->has_error)
+		return;
+	parser->has_error = true;
+	if (parser->token.type == TOKEN_END)
+		snprintf(parser->error, parser->error_len, "%s at end of query", message);
+	else
+		snprintf(parser->error, parser->error_len, "%s at \"%.*s\"", message, (int)parser->token.len, parser->token.start);
+}
+
+
+static void NextToken(QueryParser* parser)
+{
+	const char* pos = parser->pos;
+	while (*pos == ' ' || *pos == '\t')
+		pos++;
+
+	QueryToken* token = &parser->token;
+	token->start = pos;
+	token->len = 1;
+	switch (*pos)
+	{
+		case '\0':
+		{
+			token->type = TOKEN_END;
+			token->len = 0;
+		} break;
+
+		case '(':
+		{
+			token->type = TOKEN_LPAREN;
+		} break;
+
+		case ')':
+		{
+			token->type = TOKEN_RPAREN;
+		} break;
+
+		case '"':
+		{
+			const char* closing_quote = strchr(pos + 1, '"');
+			token->type = TOKEN_STRING;
+			token->start = pos + 1;
+			if (closing_quote == NULL)
+			{
+				token->len = strlen(pos + 1);
+				SetParseError(parser, "Missing closing quote");
+				parser->pos = pos + 1 + token->len;
+				return;
+			}
+			token->len = closing_quote - token->start;
+			pos = closing_quote;
+		} break;
+
+		case '=':
+		{
+			token->type = TOKEN_OP;
+			token->op = LIB_OP_EQ;
+		} break;
+
+		case '!':
+		{
+			token->type = TOKEN_OP;
+			token->op = LIB_OP_NE;
+			if (pos[1] != '=')
+			{
+				SetParseError(parser, "Expected !=");
+				break;
+			}
+			token->len = 2;
+		} break;
+
+		case '<':
+		{
+			token->type = TOKEN_OP;
+			token->op = LIB_OP_LT;
+			if (pos[1] == '=' || pos[1] == '>')
+			{
+				token->op = (pos[1] == '=') ? LIB_OP_LE : LIB_OP_NE;
+				token->len = 2;
+			}
+		} break;
+
+		case '>':
+		{
+			token->type = TOKEN_OP;
+			token->op = LIB_OP_GT;
+			if (pos[1] == '=')
+			{
+				token->op = LIB_OP_GE;
+				token->len = 2;
+			}
+		} break;
+
+		default:
+		{
+			token->type = TOKEN_WORD;
+			const char* word_end = pos;
+			while (*word_end && !strchr(" \t()=!<>\"", *word_end))
+				word_end++;
+			token->len = word_end - pos;
+		} break;
+	}
+	parser->pos = pos + ((token->type == TOKEN_STRING) ? 1 : token->len);
+}
+
+
+static void EmitInstruction(QueryParser* parser, QueryOpcode opcode)
+{
+	QueryInstruction instruction = {};
+	instruction.opcode = opcode;
+	parser->program->instructions.push_back(instruction);
+}
+
+
+// Parses a number, or a time such as "8:00" or "1:02:03", into seconds
+static bool ParseQueryNumber(const char* str, size_t len, unsigned int* value)
+{
+	unsigned int result = 0;
+	unsigned int group = 0;
+	bool has_digit = false;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (str[i] >= '0' && str[i] <= '9' && group < 100000000)
+		{
+			group = group * 10 + (str[i] - '0');
+			has_digit = true;
+		}
+		else if (str[i] == ':' && has_digit)
+		{
+			result = (result + group) * 60;
+			group = 0;
+			has_digit = false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	*value = result + group;
+	return has_digit;
+}
+
+
+static void ParseOr(QueryParser* parser);
+
+static void ParseComparison(QueryParser* parser)
+{
+	if (parser->token.type != TOKEN_WORD)
+	{
+		SetParseError(parser, "Expected a field name");
+		return;
+	}
+	QueryInstruction instruction = {};
+	instruction.opcode = QUERY_OP_COMPARE;
+	bool is_known_field = false;
+	for (size_t i = 0; i < sizeof(g_query_fields) / sizeof(g_query_fields[0]); i++)
+	{
+		if (TokenIs(&parser->token, g_query_fields[i].name))
+		{
+			instruction.column = g_query_fields[i].column;
+			is_known_field = true;
+			break;
+		}
+	}
+	if (!is_known_field)
+	{
+		SetParseError(parser, "Unknown field");
+		return;
+	}
+
+	NextToken(parser);
+	if (parser->token.type != TOKEN_OP)
+	{
+		SetParseError(parser, "Expected =, !=, <, <=, >, or >=");
+		return;
+	}
+	instruction.op = parser->token.op;
+
+	NextToken(parser);
+	if (parser->token.type != TOKEN_WORD && parser->token.type != TOKEN_STRING)
+	{
+		SetParseError(parser, "Expected a value");
+		return;
+	}
+	if (IsTextColumn(instruction.column))
+	{
+		if (instruction.op != LIB_OP_EQ && instruction.op != LIB_OP_NE)
+		{
+			SetParseError(parser, "Text can only be compared with = or !=");
+			return;
+		}
+		instruction.value = (unsigned int)parser->program->strings.size();
+		parser->program->strings.push_back(std::string(parser->token.start, parser->token.len));
+	}
+	else if (!ParseQueryNumber(parser->token.start, parser->token.len, &instruction.value))
+	{
+		SetParseError(parser, "Expected a number");
+		return;
+	}
+	parser->program->instructions.push_back(instruction);
+	NextToken(parser);
+}
+
+
+static void ParseNot(QueryParser* parser)
+{
+	if (parser->has_error)
+		return;
+
+	if (TokenIs(&parser->token, "not"))
+	{
+		NextToken(parser);
+		ParseNot(parser);
+		EmitInstruction(parser, QUERY_OP_NOT);
+	}
+	else if (parser->token.type == TOKEN_LPAREN)
+	{
+		if (++parser->nesting > QUERY_MAX_DEPTH)
+		{
+			SetParseError(parser, "Too many parentheses");
+			return;
+		}
+		NextToken(parser);
+		ParseOr(parser);
+		if (parser->token.type != TOKEN_RPAREN)
+		{
+			SetParseError(parser, "Expected )");
+			return;
+		}
+		parser->nesting--;
+		NextToken(parser);
+	}
+	else
+	{
+		ParseComparison(parser);
+	}
+}
+
+
+static void ParseAnd(QueryParser* parser)
+{
+	ParseNot(parser);
+	while (!parser->has_error && TokenIs(&parser->token, "and"))
+	{
+		NextToken(parser);
+		ParseNot(parser);
+		EmitInstruction(parser, QUERY_OP_AND);
+	}
+}
+
+
+static void ParseOr(QueryParser* parser)
+{
+	ParseAnd(parser);
+	while (!parser->has_error && TokenIs(&parser->token, "or"))
+	{
+		NextToken(parser);
+		ParseAnd(parser);
+		EmitInstruction(parser, QUERY_OP_OR);
+	}
+}
+
+
+// Compiles the query text into a postfix program.  Returns false and puts a message in error 
+// if the query is invalid.
+bool QueryCompile(const char* text, QueryProgram* program, char* error, size_t error_len)
+{
+	program->instructions.clear();
+	program->strings.clear();
+
+	QueryParser parser = {};
+	parser.pos = text ? text : "";
+	parser.program = program;
+	parser.error = error;
+	parser.error_len = error_len;
+	NextToken(&parser);
+	if (parser.token.type == TOKEN_END)
+	{
+		snprintf(error, error_len, "Empty query");
+		return false;
+	}
+	ParseOr(&parser);
+	if (!parser.has_error && parser.token.type != TOKEN_END)
+		SetParseError(&parser, "Expected AND or OR");
+	if (parser.has_error)
+		return false;
+
+	// Make sure the program fits on the evaluation stack
+	int depth = 0;
+	for (size_t i = 0; i < program->instructions.size(); i++)
+	{
+		const QueryOpcode opcode = program->instructions[i].opcode;
+		if (opcode == QUERY_OP_COMPARE)
+			depth++;
+		else if (opcode == QUERY_OP_AND || opcode == QUERY_OP_OR)
+			depth--;
+		if (depth > QUERY_MAX_DEPTH)
+		{
+			snprintf(error, error_len, "Query is too long");
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// Looks up the id of each text operand.  Text that no song has yet gets LIB_STRING_NOT_FOUND,
+// which doesn't equal any row's id.
+void QueryResolveStrings(const QueryProgram* program, const LibraryIndex* index, std::vector<unsigned int>& string_ids)
+{
+	string_ids.assign(program->strings.size(), LIB_STRING_NOT_FOUND);
+	for (size_t i = 0; i < program->instructions.size(); i++)
+	{
+		const QueryInstruction* instruction = &program->instructions[i];
+		if (instruction->opcode == QUERY_OP_COMPARE && IsTextColumn(instruction->column))
+		{
+			string_ids[instruction->value] = LibraryIndexFindString(index, instruction->column, 
+				program->strings[instruction->value].c_str());
+		}
+	}
+}
+
+
+static inline unsigned int GetOperand(const QueryInstruction* instruction, const std::vector<unsigned int>& string_ids)
+{
+	return IsTextColumn(instruction->column) ? string_ids[instruction->value] : instruction->value;
+}
+
+
+// Sets bit i of the result if values[i] passes the comparison.  The switch is outside of the
+// loops so that each loop is a simple compare the compiler can vectorize.
+static unsigned long long CompareBlock(const unsigned int* values, unsigned int count, LibraryFilterOp op, unsigned int operand)
+{
+	unsigned long long bits = 0;
+	switch (op)
+	{
+		case LIB_OP_EQ:
+			for (unsigned int i = 0; i < count; i++)
+				bits |= (unsigned long long)(values[i] == operand) << i;
+			break;
+		case LIB_OP_NE:
+			for (unsigned int i = 0; i < count; i++)
+				bits |= (unsigned long long)(values[i] != operand) << i;
+			break;
+		case LIB_OP_LT:
+			for (unsigned int i = 0; i < count; i++)
+				bits |= (unsigned long long)(values[i] < operand) << i;
+			break;
+		case LIB_OP_LE:
+			for (unsigned int i = 0; i < count; i++)
+				bits |= (unsigned long long)(values[i] <= operand) << i;
+			break;
+		case LIB_OP_GT:
+			for (unsigned int i = 0; i < count; i++)
+				bits |= (unsigned long long)(values[i] > operand) << i;
+			break;
+		case LIB_OP_GE:
+			for (unsigned int i = 0; i < count; i++)
+				bits |= (unsigned long long)(values[i] >= operand) << i;
+			break;
+	}
+	return bits;
+}
+
+
+// Evaluates the query for every row.  Bit (row % 64) of row_bits[row / 64] is set if the row matches.
+void QueryEvaluate(const QueryProgram* program, const LibraryIndex* index, const std::vector<unsigned int>& string_ids,
+	std::vector<unsigned long long>& row_bits)
+{
+	const unsigned int num_rows = (unsigned int)index->songs.size();
+	const unsigned int num_blocks = (num_rows + 63) / 64;
+	const QueryInstruction* instructions = program->instructions.data();
+	const size_t num_instructions = program->instructions.size();
+	row_bits.assign(num_blocks, 0);
+
+	unsigned long long stack[QUERY_MAX_DEPTH];
+	for (unsigned int block = 0; block < num_blocks; block++)
+	{
+		const unsigned int first_row = block * 64;
+		const unsigned int count = (num_rows - first_row < 64) ? num_rows - first_row : 64;
+		int top = 0;
+		for (size_t i = 0; i < num_instructions; i++)
+		{
+			const QueryInstruction* instruction = &instructions[i];
+			switch (instruction->opcode)
+			{
+				case QUERY_OP_COMPARE:
+				{
+					stack[top++] = CompareBlock(index->columns[instruction->column].data() + first_row, count, 
+						instruction->op, GetOperand(instruction, string_ids));
+				} break;
+
+				case QUERY_OP_AND:
+				{
+					top--;
+					stack[top - 1] &= stack[top];
+				} break;
+
+				case QUERY_OP_OR:
+				{
+					top--;
+					stack[top - 1] |= stack[top];
+				} break;
+
+				case QUERY_OP_NOT:
+				{
+					stack[top - 1] = ~stack[top - 1];
+				} break;
+			}
+		}
+		// NOT sets the bits past the last row, so mask them off
+		const unsigned long long valid_rows = (count == 64) ? ~0ULL : (1ULL << count) - 1;
+		row_bits[block] = stack[0] & valid_rows;
+	}
+}
+
+
+// Evaluates the query for one row
+bool QueryMatchesRow(const QueryProgram* program, const LibraryIndex* index, const std::vector<unsigned int>& string_ids,
+	unsigned int row)
+{
+	bool stack[QUERY_MAX_DEPTH];
+	int top = 0;
+	for (size_t i = 0; i < program->instructions.size(); i++)
+	{
+		const QueryInstruction* instruction = &program->instructions[i];
+		switch (instruction->opcode)
+		{
+			case QUERY_OP_COMPARE:
+			{
+				const unsigned int value = index->columns[instruction->column][row];
+				stack[top++] = CompareBlock(&value, 1, instruction->op, GetOperand(instruction, string_ids)) != 0;
+			} break;
+
+			case QUERY_OP_AND:
+			{
+				top--;
+				stack[top - 1] = stack[top - 1] && stack[top];
+			} break;
+
+			case QUERY_OP_OR:
+			{
+				top--;
+				stack[top - 1] = stack[top - 1] || stack[top];
+			} break;
+
+			case QUERY_OP_NOT:
+			{
+				stack[top - 1] = !stack[top - 1];
+			} break;
+		}
+	}
+	return top > 0 && stack[0];
+}
+
+
+static inline bool GetMemberBit(const SmartPlaylist* playlist, unsigned int row)
+{
+	return (playlist->members[row / 64] >> (row % 64)) & 1;
+}
+
+
+static inline void SetMemberBit(SmartPlaylist* playlist, unsigned int row, bool is_member)
+{
+	if (GetMemberBit(playlist, row) == is_member)
+		return;
+	playlist->members[row / 64] ^= 1ULL << (row % 64);
+	if (is_member)
+		playlist->num_members++;
+	else
+		playlist->num_members--;
+}
+
+
+// LibraryIndex listener.  Re-evaluates only the row that changed.
+static void SmartPlaylistRowUpdated(void* context, const LibraryIndex* index, unsigned int row)
+{
+	SmartPlaylist* playlist = (SmartPlaylist*)context;
+	const size_t num_blocks = (index->songs.size() + 63) / 64;
+	if (playlist->members.size() < num_blocks)
+		playlist->members.resize(num_blocks, 0);
+
+	// Text that no song had before may have just been added to the index, and ids that were freed
+	// may have been handed out to other text
+	bool is_resolved = playlist->string_generation == index->string_generation;
+	for (size_t i = 0; i < playlist->string_ids.size() && is_resolved; i++)
+		is_resolved = playlist->string_ids[i] != LIB_STRING_NOT_FOUND;
+	if (!is_resolved)
+	{
+		QueryResolveStrings(&playlist->program, index, playlist->string_ids);
+		playlist->string_generation = index->string_generation;
+	}
+	SetMemberBit(playlist, row, QueryMatchesRow(&playlist->program, index, playlist->string_ids, row));
+}
+
+
+// LibraryIndex listener.  The index moves last_row into the removed row, so do the same with the bits.
+static void SmartPlaylistRowRemoved(void* context, unsigned int row, unsigned int last_row)
+{
+	SmartPlaylist* playlist = (SmartPlaylist*)context;
+	SetMemberBit(playlist, row, GetMemberBit(playlist, last_row));
+	SetMemberBit(playlist, last_row, false);
+	playlist->members.resize((last_row + 63) / 64);
+}
+
+
+// LibraryIndex listener.  String ids are handed out again from scratch after a clear.
+static void SmartPlaylistCleared(void* context)
+{
+	SmartPlaylist* playlist = (SmartPlaylist*)context;
+	playlist->members.clear();
+	playlist->num_members = 0;
+	playlist->string_ids.assign(playlist->program.strings.size(), LIB_STRING_NOT_FOUND);
+}
+
+
+// Compiles the query and finds its members.  From then on, membership is updated one row at a time
+// as the index changes.  If the query doesn't compile, is_valid is false and error says why.
+SmartPlaylist* SmartPlaylistCreate(const char* name, const char* query, LibraryIndex* index)
+{
+	SmartPlaylist* playlist = new SmartPlaylist();
+	playlist->name = name;
+	playlist->query = query;
+	playlist->is_valid = QueryCompile(query, &playlist->program, playlist->error, QUERY_MAX_ERROR_LEN);
+	if (!playlist->is_valid)
+		return playlist;
+
+	QueryResolveStrings(&playlist->program, index, playlist->string_ids);
+	playlist->string_generation = index->string_generation;
+	QueryEvaluate(&playlist->program, index, playlist->string_ids, playlist->members);
+	playlist->num_members = 0;
+	for (size_t i = 0; i < playlist->members.size(); i++)
+	{
+		for (unsigned long long bits = playlist->members[i]; bits; bits &= bits - 1)
+			playlist->num_members++;
+	}
+
+	LibraryListener listener = {};
+	listener.context = playlist;
+	listener.on_update = SmartPlaylistRowUpdated;
+	listener.on_remove = SmartPlaylistRowRemoved;
+	listener.on_clear = SmartPlaylistCleared;
+	LibraryIndexAddListener(index, &listener);
+	return playlist;
+}
+
+
+void SmartPlaylistFree(SmartPlaylist* playlist, LibraryIndex* index)
+{
+	if (!playlist)
+		return;
+	LibraryIndexRemoveListener(index, playlist);
+	delete playlist;
+}
+
+
+bool SmartPlaylistContains(const SmartPlaylist* playlist, const Song* song)
+{
+	if (!playlist->is_valid || !song->is_indexed || song->index_row / 64 >= playlist->members.size())
+		return false;
+	return GetMemberBit(playlist, song->index_row);
+}
\ No newline at end of file
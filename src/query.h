@@ -0,0 +1,93 @@
+/******************************************************************************
+query.h - Smart playlist queries compiled to predicates over the library index
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "library_index.h"
+
+// Smart playlists are saved queries over the song metadata, e.g.
+//		genre = "Jazz" AND year >= 1990 AND duration < 8:00
+//
+// Grammar.  Keywords and field names are case insensitive.
+//		query		= and_expr { OR and_expr }
+//		and_expr	= not_expr { AND not_expr }
+//		not_expr	= NOT not_expr | "(" query ")" | comparison
+//		comparison	= field op value
+//		field		= artist | album | genre | track | disc | year | duration | bitrate
+//		op			= "=" | "!=" | "<>" | "<" | "<=" | ">" | ">="
+//		value		= "quoted text" | word | number | minutes:seconds
+// Text fields can only be compared with = and !=, and the comparison ignores case.
+//
+// A query compiles to a postfix program.  Each comparison reads one column of the LibraryIndex,
+// and AND, OR, and NOT combine the results.  QueryEvaluate() runs the program over blocks of
+// 64 rows, with one bit per row, so each comparison is a tight loop over a contiguous column.
+
+#define QUERY_MAX_DEPTH			32		// Max values on the evaluation stack
+#define QUERY_MAX_ERROR_LEN		128
+
+enum QueryOpcode { QUERY_OP_COMPARE, QUERY_OP_AND, QUERY_OP_OR, QUERY_OP_NOT };
+
+struct QueryInstruction {
+	QueryOpcode opcode;
+	LibraryColumn column;		// The rest are only used by QUERY_OP_COMPARE
+	LibraryFilterOp op;
+	unsigned int value;			// For text columns, index of the text in QueryProgram::strings
+};
+
+struct QueryProgram {
+	std::vector<QueryInstruction> instructions;
+	std::vector<std::string> strings;		// Text operands
+};
+
+// A saved query whose membership is kept up to date as songs are added, changed, and removed
+struct SmartPlaylist {
+	std::string name;
+	std::string query;
+	QueryProgram program;
+	bool is_valid;								// Did the query compile?
+	char error[QUERY_MAX_ERROR_LEN];			// Why it didn't
+	std::vector<unsigned long long> members;	// One bit per library index row
+	unsigned int num_members;
+	std::vector<unsigned int> string_ids;		// Ids of program.strings in the library index
+	unsigned int string_generation;				// LibraryIndex::string_generation when string_ids were looked up
+};
+
+bool QueryCompile(const char* text, QueryProgram* program, char* error, size_t error_len);
+void QueryResolveStrings(const QueryProgram* program, const LibraryIndex* index, std::vector<unsigned int>& string_ids);
+void QueryEvaluate(const QueryProgram* program, const LibraryIndex* index, const std::vector<unsigned int>& string_ids,
+	std::vector<unsigned long long>& row_bits);
+bool QueryMatchesRow(const QueryProgram* program, const LibraryIndex* index, const std::vector<unsigned int>& string_ids,
+	unsigned int row);
+
+SmartPlaylist* SmartPlaylistCreate(const char* name, const char* query, LibraryIndex* index);
+void SmartPlaylistFree(SmartPlaylist* playlist, LibraryIndex* index);
+bool SmartPlaylistContains(const SmartPlaylist* playlist, const Song* song);
\ No newline at end of file
@@ -0,0 +1,375 @@
+/******************************************************************************
+shuffle.cpp - Shuffled play order generated on demand
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "shuffle.h"
+#include <Windows.h>
+
+#define SHUFFLE_FEISTEL_ROUNDS	4
+#define SHUFFLE_DELETED			0xFFFFFFFF		// Generation of a deleted ordinal
+
+
+// Reference:  http://xoshiro.di.unimi.it/splitmix64.c
+static inline unsigned long long SplitMix64(unsigned long long x)
+{
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+
+static inline unsigned int RoundFunction(unsigned long long seed, unsigned int round, unsigned int half)
+{
+	return (unsigned int)SplitMix64(seed ^ ((unsigned long long)round << 32) ^ half);
+}
+
+
+// Bijection on 0 to 2^domain_bits - 1.  domain_bits must be even.
+static unsigned int Permute(unsigned long long seed, unsigned int domain_bits, unsigned int x)
+{
+	const unsigned int half_bits = domain_bits / 2;
+	const unsigned int half_mask = (1u << half_bits) - 1;
+	unsigned int left = x >> half_bits;
+	unsigned int right = x & half_mask;
+	for (unsigned int round = 0; round < SHUFFLE_FEISTEL_ROUNDS; round++)
+	{
+		const unsigned int new_right = left ^ (RoundFunction(seed, round, right) & half_mask);
+		left = right;
+		right = new_right;
+	}
+	return (left << half_bits) | right;
+}
+
+
+static unsigned int Unpermute(unsigned long long seed, unsigned int domain_bits, unsigned int y)
+{
+	const unsigned int half_bits = domain_bits / 2;
+	const unsigned int half_mask = (1u << half_bits) - 1;
+	unsigned int left = y >> half_bits;
+	unsigned int right = y & half_mask;
+	for (unsigned int round = SHUFFLE_FEISTEL_ROUNDS; round > 0; round--)
+	{
+		const unsigned int old_left = right ^ (RoundFunction(seed, round - 1, left) & half_mask);
+		right = left;
+		left = old_left;
+	}
+	return (left << half_bits) | right;
+}
+
+
+static inline unsigned int DomainSize(unsigned int domain_bits)
+{
+	return 1u << domain_bits;
+}
+
+
+// Smallest even number of bits that can hold every ordinal
+static unsigned int GetDomainBits(unsigned int num_ordinals)
+{
+	unsigned int bits = 2;
+	while (bits < 32 && (1ull << bits) < num_ordinals)
+		bits += 2;
+	return bits;
+}
+
+
+// Ordinal of the song played at step of run, or -1 if step is skipped
+static int SongAtStep(const ShuffleOrder* order, const ShuffleRun* run, unsigned int step)
+{
+	const unsigned int song = Permute(order->seed, run->domain_bits, (run->start + step) & (DomainSize(run->domain_bits) - 1));
+	return (song < order->generations.size() && order->generations[song] <= run->generation) ? (int)song : -1;
+}
+
+
+static unsigned int StepOfSong(const ShuffleOrder* order, const ShuffleRun* run, unsigned int song)
+{
+	return (Unpermute(order->seed, run->domain_bits, song) - run->start) & (DomainSize(run->domain_bits) - 1);
+}
+
+
+// Gives the songs the ordinals 0 to num_songs - 1, and starts a run with them at step 0
+static void ResetOrdinals(ShuffleOrder* order, unsigned int num_songs)
+{
+	order->generations.assign(num_songs, 0);
+	order->free_ordinals.clear();
+	order->num_songs = num_songs;
+	order->generation = 0;
+	order->run.first_step = 0;
+	order->run.domain_bits = GetDomainBits(num_songs);
+	order->run.generation = 0;
+	order->step = 0;
+	order->history.clear();
+}
+
+
+// Starts a new shuffle of the songs with ordinals 0 to num_songs - 1, in which first_song is
+// played first
+void ShuffleReset(ShuffleOrder* order, unsigned long long seed, unsigned int num_songs, unsigned int first_song)
+{
+	order->seed = seed;
+	ResetOrdinals(order, num_songs);
+	order->run.start = Unpermute(seed, order->run.domain_bits, first_song);
+}
+
+
+// Continues a saved shuffle of the songs with ordinals 0 to num_songs - 1 from curr_song
+void ShuffleRestore(ShuffleOrder* order, unsigned long long seed, unsigned int start, unsigned int num_songs, 
+	unsigned int curr_song)
+{
+	order->seed = seed;
+	ResetOrdinals(order, num_songs);
+	order->run.start = start & (DomainSize(order->run.domain_bits) - 1);
+	order->step = StepOfSong(order, &order->run, curr_song);
+}
+
+
+// Adds a song to the shuffle and returns its ordinal.  The song is played when the shuffle gets
+// to the step of its ordinal, which may be in this cycle or after the shuffle starts over.
+unsigned int ShuffleAdd(ShuffleOrder* order)
+{
+	order->generation++;
+	order->num_songs++;
+	if (order->free_ordinals.size())
+	{
+		const unsigned int song = order->free_ordinals.back();
+		order->free_ordinals.pop_back();
+		order->generations[song] = order->generation;
+		return song;
+	}
+	order->generations.push_back(order->generation);
+	return (unsigned int)order->generations.size() - 1;
+}
+
+
+// Removes the song with ordinal song from the shuffle.  Its steps are skipped from now on.
+void ShuffleDelete(ShuffleOrder* order, unsigned int song)
+{
+	if (song >= order->generations.size() || order->generations[song] == SHUFFLE_DELETED)
+		return;
+	order->generations[song] = SHUFFLE_DELETED;
+	order->free_ordinals.push_back(song);
+	order->num_songs--;
+}
+
+
+// Gets the run that the songs after the current one are played in.  It's the current run, unless
+// songs were added since it started.  Then a new run starts from the current song, so the songs
+// added aren't mistaken for songs the current run played.  If the domain had to grow, the songs
+// after the current one are reshuffled in the new run, which starts with the current song at 
+// step 0.  Returns true if it's a new run.
+static bool GetRunAhead(const ShuffleOrder* order, ShuffleRun* run, unsigned int* step)
+{
+	*run = order->run;
+	*step = order->step;
+	if (run->generation == order->generation)
+		return false;
+
+	const unsigned int domain_bits = GetDomainBits((unsigned int)order->generations.size());
+	if (domain_bits > run->domain_bits)
+	{
+		const unsigned int curr_song = Permute(order->seed, run->domain_bits, 
+			(run->start + order->step) & (DomainSize(run->domain_bits) - 1));
+		run->domain_bits = domain_bits;
+		run->start = Unpermute(order->seed, domain_bits, curr_song);
+		*step = 0;
+	}
+	run->first_step = *step;
+	run->generation = order->generation;
+	return true;
+}
+
+
+// Ordinal of the song at the current step, or -1 if there is none (e.g. it was deleted)
+int ShuffleCurrent(const ShuffleOrder* order)
+{
+	return order->num_songs ? SongAtStep(order, &order->run, order->step) : -1;
+}
+
+
+// Number of steps from the current song forward to the song with ordinal song.  The songs that
+// were already played in this cycle are the farthest, since they come after all the others.
+unsigned int ShuffleStepsAhead(const ShuffleOrder* order, unsigned int song)
+{
+	ShuffleRun run;
+	unsigned int step;
+	GetRunAhead(order, &run, &step);
+	return (StepOfSong(order, &run, song) - step) & (DomainSize(run.domain_bits) - 1);
+}
+
+
+// Finds the song after the current one without moving.  Returns -1 after the last step, unless
+// repeat is on, in which case the shuffle starts over from step 0.
+int ShuffleFindNext(const ShuffleOrder* order, bool repeat, ShufflePosition* next)
+{
+	if (order->num_songs == 0)
+		return -1;
+	ShuffleRun run;
+	unsigned int step;
+	bool is_new_run = GetRunAhead(order, &run, &step);
+	const unsigned int domain_size = DomainSize(run.domain_bits);
+	for (unsigned int i = 0; i < domain_size; i++)
+	{
+		step++;
+		if (step >= domain_size)
+		{
+			if (!repeat)
+				return -1;
+			// Starting over is a new run
+			step = 0;
+			run.first_step = 0;
+			is_new_run = true;
+		}
+		const int song = SongAtStep(order, &run, step);
+		if (song >= 0)
+		{
+			next->step = step;
+			next->run = run;
+			next->history_len = order->history.size() + (is_new_run ? 1 : 0);
+			return song;
+		}
+	}
+	return -1;
+}
+
+
+// Finds the song that was played before the current one without moving, going back through 
+// the history of runs.  At the very first song, wraps around to the last step if repeat is on.
+int ShuffleFindPrev(const ShuffleOrder* order, bool repeat, ShufflePosition* prev)
+{
+	if (order->num_songs == 0)
+		return -1;
+
+	// Earlier in the current run
+	for (unsigned int step = order->step; step > order->run.first_step; )
+	{
+		step--;
+		const int song = SongAtStep(order, &order->run, step);
+		if (song >= 0)
+		{
+			prev->step = step;
+			prev->run = order->run;
+			prev->history_len = order->history.size();
+			return song;
+		}
+	}
+
+	// Earlier runs.  When the current run was started by adding songs, it started with the song
+	// the last run ended with, so that song isn't played twice.  Deleted songs are skipped.
+	const int curr_song = ShuffleCurrent(order);
+	for (size_t i = order->history.size(); i > 0; i--)
+	{
+		const ShuffleRun* run = &order->history[i - 1];
+		for (unsigned int step = run->last_step; ; step--)
+		{
+			const int song = SongAtStep(order, run, step);
+			const bool is_curr_song = (i == order->history.size() && step == run->last_step && song == curr_song);
+			if (song >= 0 && !is_curr_song)
+			{
+				prev->step = step;
+				prev->run = *run;
+				prev->history_len = i - 1;
+				return song;
+			}
+			if (step == run->first_step)
+				break;
+		}
+	}
+
+	if (!repeat)
+		return -1;
+	ShuffleRun run;
+	unsigned int curr_step;
+	GetRunAhead(order, &run, &curr_step);
+	run.first_step = 0;
+	for (unsigned int step = DomainSize(run.domain_bits); step > curr_step + 1; )
+	{
+		step--;
+		const int song = SongAtStep(order, &run, step);
+		if (song >= 0)
+		{
+			prev->step = step;
+			prev->run = run;
+			prev->history_len = 0;
+			return song;
+		}
+	}
+	return -1;
+}
+
+
+// Ends the current run at the current step and keeps it in the history
+static void PushRun(ShuffleOrder* order)
+{
+	ShuffleRun run = order->run;
+	run.last_step = order->step;
+	order->history.push_back(run);
+	if (order->history.size() > SHUFFLE_MAX_HISTORY)
+		order->history.erase(order->history.begin());
+}
+
+
+// Moves to the position found by ShuffleFindNext() or ShuffleFindPrev()
+void ShuffleMoveTo(ShuffleOrder* order, const ShufflePosition* position)
+{
+	if (position->history_len > order->history.size())
+		PushRun(order);
+	else
+		order->history.resize(position->history_len);
+	order->run = position->run;
+	order->step = position->step;
+}
+
+
+// Plays the song with ordinal song out of order, e.g. when the user double-clicks it
+void ShuffleJumpTo(ShuffleOrder* order, unsigned int song)
+{
+	if (song >= order->generations.size() || order->generations[song] == SHUFFLE_DELETED)
+		return;
+	PushRun(order);
+	const unsigned int domain_bits = GetDomainBits((unsigned int)order->generations.size());
+	if (domain_bits > order->run.domain_bits)
+	{
+		// Songs were added since the current run started and they don't all fit in its domain
+		order->run.domain_bits = domain_bits;
+		order->run.start = Unpermute(order->seed, domain_bits, song);
+	}
+	order->step = StepOfSong(order, &order->run, song);
+	order->run.first_step = order->step;
+	order->run.generation = order->generation;
+}
+
+
+// Seed for a new shuffle
+unsigned long long NewShuffleSeed()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return SplitMix64((unsigned long long)counter.QuadPart ^ ((unsigned long long)GetTickCount() << 32));
+}
\ No newline at end of file
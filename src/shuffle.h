@@ -0,0 +1,93 @@
+/******************************************************************************
+shuffle.h - Shuffled play order generated on demand
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <vector>
+
+// Shuffled play order, generated as the songs are played instead of being stored.
+//
+// Each song in the shuffle has an ordinal, given when it is added, that doesn't change when other
+// songs are deleted or the playlist is sorted, moved, or restored by undo.  A keyed Feistel network
+// is a bijection on the numbers 0 to 2^domain_bits - 1.  Step k of the shuffle plays the song
+// with ordinal Permute(start + k), skipping any result that isn't the ordinal of a song.  The 
+// domain is the smallest even power of 2 >= the number of ordinals, so on average at most 3 out
+// of 4 results are skipped.  A deleted song's ordinal goes to the next song added, so the 
+// domain only grows with the size of the playlist.  Because the permutation only depends on the
+// seed, adding or deleting songs doesn't change the order of the other songs, and the order can
+// be saved by saving the seed and start.
+//
+// Jumping to a song out of order (e.g. double-clicking it) starts a new run of steps.  The 
+// previous runs are kept, so Prev goes back through the songs that were actually played.  Each
+// run is only 20 bytes, no matter how many songs it played.  A run remembers its domain and the
+// generation of songs it was played with, so songs added later aren't mistaken for songs it
+// played.  Adding songs starts a new run from the current song (reshuffling the songs after it
+// if the domain grows), so the earlier runs always go back through the same songs.
+
+#define SHUFFLE_MAX_HISTORY		1024	// Runs.  The oldest run is dropped after this.
+
+struct ShuffleRun {
+	unsigned int first_step;
+	unsigned int last_step;
+	unsigned int start;				// Domain position of step 0
+	unsigned int domain_bits;
+	unsigned int generation;		// Songs added after this generation aren't in the run
+};
+
+// Where the shuffle will be after moving to the next or previous song
+struct ShufflePosition {
+	unsigned int step;
+	ShuffleRun run;
+	unsigned int history_len;
+};
+
+struct ShuffleOrder {
+	unsigned long long seed;		// 0 if the shuffle hasn't been started
+	std::vector<unsigned int> generations;		// Generation each ordinal was given out in, or SHUFFLE_DELETED
+	std::vector<unsigned int> free_ordinals;	// Ordinals of deleted songs, to give to added songs
+	unsigned int num_songs;
+	unsigned int generation;		// Incremented when songs are added
+	ShuffleRun run;					// The current run, up to the current step
+	unsigned int step;				// Step of the current song
+	std::vector<ShuffleRun> history;	// Previous runs, most recent last
+};
+
+void ShuffleReset(ShuffleOrder* order, unsigned long long seed, unsigned int num_songs, unsigned int first_song);
+void ShuffleRestore(ShuffleOrder* order, unsigned long long seed, unsigned int start, unsigned int num_songs, 
+	unsigned int curr_song);
+unsigned int ShuffleAdd(ShuffleOrder* order);
+void ShuffleDelete(ShuffleOrder* order, unsigned int song);
+int ShuffleCurrent(const ShuffleOrder* order);
+unsigned int ShuffleStepsAhead(const ShuffleOrder* order, unsigned int song);
+int ShuffleFindNext(const ShuffleOrder* order, bool repeat, ShufflePosition* next);
+int ShuffleFindPrev(const ShuffleOrder* order, bool repeat, ShufflePosition* prev);
+void ShuffleMoveTo(ShuffleOrder* order, const ShufflePosition* position);
+void ShuffleJumpTo(ShuffleOrder* order, unsigned int song);
+unsigned long long NewShuffleSeed();
\ No newline at end of file
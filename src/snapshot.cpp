@@ -0,0 +1,438 @@
+/******************************************************************************
+snapshot.cpp - Binary snapshot of the playlist that is saved between runs
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "snapshot.h"
+#include "util.h"
+#include "path_table.h"
+#include <strsafe.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+static_assert(sizeof(SnapshotHeader) == 40, "SnapshotHeader layout changed");
+static_assert(sizeof(SnapshotRecord) == 80, "SnapshotRecord layout changed");
+static_assert(SNAPSHOT_RECORD_SIZE_V2 == 72, "Version 2 records can't be read");
+
+// Strings for the snapshot's string table.  Tags like artist and album are repeated for every
+// song, so they are only stored once.  Paths are almost always unique, so they skip the lookup.
+struct SnapshotStrings {
+	std::vector<char> data;
+	std::unordered_map<std::string, unsigned int> offsets;
+};
+
+
+static unsigned int AddSnapshotString(SnapshotStrings* strings, const char* str, bool is_shared)
+{
+	if (str == NULL)
+		return SNAPSHOT_NO_STRING;
+
+	const size_t len = lstrlen(str);
+	if (is_shared)
+	{
+		std::unordered_map<std::string, unsigned int>::iterator it = strings->offsets.find(str);
+		if (it != strings->offsets.end())
+			return it->second;
+	}
+	const unsigned int offset = (unsigned int)strings->data.size();
+	strings->data.insert(strings->data.end(), str, str + len + 1);
+	if (is_shared)
+		strings->offsets.emplace(str, offset);
+	return offset;
+}
+
+
+// WriteFile() takes a DWORD size, so big arrays are written in pieces
+static bool WriteAll(HANDLE file, const void* data, unsigned long long size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	while (size > 0)
+	{
+		const DWORD chunk_size = (size < (1 << 30)) ? (DWORD)size : (1 << 30);
+		DWORD bytes_written = 0;
+		if (!WriteFile(file, bytes, chunk_size, &bytes_written, NULL) || bytes_written != chunk_size)
+			return false;
+		bytes += chunk_size;
+		size -= chunk_size;
+	}
+	return true;
+}
+
+
+// Saves the songs in playlist_view, and the play order if it is different (i.e. shuffle is on 
+// and the view was sorted).  Returns false if the snapshot couldn't be written, in which case
+// the previous snapshot is left as it was.
+bool WritePlaylistSnapshot(const char* snapshot_path, const Playlist* playlist_view, const Playlist* playlist)
+{
+	const unsigned int num_songs = PlaylistCount(playlist_view);
+	std::vector<SnapshotRecord> records(num_songs);
+	SnapshotStrings strings;
+	strings.data.reserve((size_t)num_songs * 96);
+	unsigned int i = 0;
+	for (PlaylistNode* node = PlaylistFirst(playlist_view); node; node = PlaylistNext(node), i++)
+	{
+		const Song* song = node->song;
+		SnapshotRecord* record = &records[i];
+		char path[UTF8_MAX_PATH];
+		if (!SongGetPath(song, path, UTF8_MAX_PATH))
+			path[0] = '\0';
+		record->path = AddSnapshotString(&strings, path, false);
+		record->audio_hash = song->audio_hash;
+		if (song->has_audio_hash)
+			record->flags |= SNAPSHOT_HAS_AUDIO_HASH;
+		if (!song->has_info)
+		{
+			// Will be probed again when the snapshot is loaded
+			record->playlist_song_name = SNAPSHOT_NO_STRING;
+			for (int field = 0; field < SNAPSHOT_NUM_METADATA_FIELDS; field++)
+				record->metadata[field] = SNAPSHOT_NO_STRING;
+			continue;
+		}
+
+		const SongDetails* details = SongGetDetails(song);
+		record->flags |= SNAPSHOT_HAS_INFO;
+		if (details->is_stereo)
+			record->flags |= SNAPSHOT_IS_STEREO;
+		if (song->playlist_song_name == song->file_name)
+		{
+			record->flags |= SNAPSHOT_NAME_IS_FILE;
+			record->playlist_song_name = SNAPSHOT_NO_STRING;
+		}
+		else
+		{
+			record->playlist_song_name = AddSnapshotString(&strings, song->playlist_song_name, false);
+		}
+		const AudioFileMetadata* metadata = &details->metadata;
+		record->metadata[SNAPSHOT_TITLE] = AddSnapshotString(&strings, metadata->title, false);
+		record->metadata[SNAPSHOT_ARTIST] = AddSnapshotString(&strings, metadata->artist, true);
+		record->metadata[SNAPSHOT_ALBUM] = AddSnapshotString(&strings, metadata->album, true);
+		record->metadata[SNAPSHOT_GENRE] = AddSnapshotString(&strings, metadata->genre, true);
+		record->metadata[SNAPSHOT_TRACK_NUM] = AddSnapshotString(&strings, metadata->track_num, true);
+		record->metadata[SNAPSHOT_DISC_NUM] = AddSnapshotString(&strings, metadata->disc_num, true);
+		record->metadata[SNAPSHOT_DATE] = AddSnapshotString(&strings, metadata->date, true);
+		record->metadata[SNAPSHOT_COMMENT] = AddSnapshotString(&strings, metadata->comment_description, true);
+		record->song_length_bytes = details->song_length_bytes;
+		record->song_length_secs = song->song_length_secs;
+		record->bitrate = details->bitrate;
+		record->frequency = details->frequency;
+		record->format = (unsigned char)song->format;
+		if (details->gapless.start_trim <= MP3_MAX_START_TRIM)
+		{
+			record->gapless_start = (unsigned short)details->gapless.start_trim;
+			record->gapless_samples = details->gapless.num_samples;
+		}
+	}
+	// String offsets are 32 bits
+	if (strings.data.size() >= SNAPSHOT_NO_STRING)
+		return false;
+
+	// Play order, as indexes in playlist_view.  While it matches the view, the view is walked along with
+	// it.  After that, the indexes are looked up in a map, since PlaylistIndexOf() on every node would
+	// be a cache miss at every level of the tree.
+	std::vector<unsigned int> play_order;
+	std::unordered_map<const PlaylistNode*, unsigned int> view_indexes;
+	bool is_view_order = true;
+	PlaylistNode* view_node = PlaylistFirst(playlist_view);
+	i = 0;
+	for (PlaylistNode* node = PlaylistFirst(playlist); node; node = PlaylistNext(node), i++)
+	{
+		if (is_view_order)
+		{
+			if (node->link == view_node)
+			{
+				view_node = PlaylistNext(view_node);
+				continue;
+			}
+			is_view_order = false;
+			play_order.reserve(num_songs);
+			for (unsigned int j = 0; j < i; j++)
+				play_order.push_back(j);
+			view_indexes.reserve(num_songs);
+			unsigned int view_idx = 0;
+			for (view_node = PlaylistFirst(playlist_view); view_node; view_node = PlaylistNext(view_node))
+				view_indexes.emplace(view_node, view_idx++);
+		}
+		play_order.push_back(view_indexes[node->link]);
+	}
+
+	SnapshotHeader header = {};
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.num_songs = num_songs;
+	header.record_size = sizeof(SnapshotRecord);
+	unsigned long long offset = sizeof(SnapshotHeader) + (unsigned long long)num_songs * sizeof(SnapshotRecord);
+	if (!is_view_order)
+	{
+		header.play_order_offset = offset;
+		offset += (unsigned long long)num_songs * sizeof(unsigned int);
+	}
+	header.strings_offset = offset;
+	header.strings_size = strings.data.size();
+
+	char temp_path[MAX_PATH];
+	if (FAILED(StringCbPrintfA(temp_path, MAX_PATH, "%s.tmp", snapshot_path)))
+		return false;
+	HANDLE file = CreateFile(temp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	bool is_written = WriteAll(file, &header, sizeof(header))
+		&& WriteAll(file, records.data(), records.size() * sizeof(SnapshotRecord))
+		&& WriteAll(file, play_order.data(), play_order.size() * sizeof(unsigned int))
+		&& WriteAll(file, strings.data.data(), strings.data.size())
+		&& FlushFileBuffers(file);
+	CloseHandle(file);
+
+	// Only replace the old snapshot once the new one is completely on disk
+	if (is_written)
+		is_written = MoveFileEx(temp_path, snapshot_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+	if (!is_written)
+		DeleteFile(temp_path);
+	return is_written;
+}
+
+
+static inline bool IsValidString(unsigned int offset, unsigned long long strings_size)
+{
+	return offset == SNAPSHOT_NO_STRING || offset < strings_size;
+}
+
+
+// Copies record i of the snapshot.  Records of older versions are shorter, and the fields they don't 
+// have are zero.
+static void GetSnapshotRecord(const unsigned char* view, unsigned int i, SnapshotRecord* record)
+{
+	const SnapshotHeader* header = (const SnapshotHeader*)view;
+	*record = {};
+	memcpy(record, view + sizeof(SnapshotHeader) + (size_t)i * header->record_size, header->record_size);
+}
+
+
+// Checks every offset in the snapshot, so that the songs can be created without any more checks
+static bool IsValidSnapshot(const unsigned char* view, unsigned long long file_size)
+{
+	const SnapshotHeader* header = (const SnapshotHeader*)view;
+	if (header->magic != SNAPSHOT_MAGIC)
+		return false;
+	if (header->version == SNAPSHOT_VERSION)
+	{
+		if (header->record_size != sizeof(SnapshotRecord))
+			return false;
+	}
+	else if (header->version == SNAPSHOT_VERSION_UTF8 || header->version == SNAPSHOT_VERSION_ANSI)
+	{
+		if (header->record_size != SNAPSHOT_RECORD_SIZE_V2)
+			return false;
+	}
+	else
+	{
+		return false;
+	}
+
+	const unsigned int num_songs = header->num_songs;
+	const unsigned long long records_end = sizeof(SnapshotHeader) + (unsigned long long)num_songs * header->record_size;
+	if (records_end > file_size)
+		return false;
+	if (header->play_order_offset != 0)
+	{
+		if (header->play_order_offset < records_end || header->play_order_offset % sizeof(unsigned int) != 0
+			|| header->play_order_offset > file_size
+			|| (unsigned long long)num_songs * sizeof(unsigned int) > file_size - header->play_order_offset)
+			return false;
+	}
+	// The last string must be terminated, so that every string in the table is
+	if (header->strings_offset > file_size || header->strings_size > file_size - header->strings_offset)
+		return false;
+	if (header->strings_size == 0)
+		return num_songs == 0;
+	if (view[header->strings_offset + header->strings_size - 1] != '\0')
+		return false;
+
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		SnapshotRecord record_copy;
+		GetSnapshotRecord(view, i, &record_copy);
+		const SnapshotRecord* record = &record_copy;
+		if (record->path == SNAPSHOT_NO_STRING || !IsValidString(record->path, header->strings_size)
+			|| !IsValidString(record->playlist_song_name, header->strings_size) || record->format > FLAC)
+			return false;
+		for (int field = 0; field < SNAPSHOT_NUM_METADATA_FIELDS; field++)
+		{
+			if (!IsValidString(record->metadata[field], header->strings_size))
+				return false;
+		}
+	}
+
+	// The play order must contain every song exactly once
+	if (header->play_order_offset != 0)
+	{
+		const unsigned int* play_order = (const unsigned int*)(view + header->play_order_offset);
+		std::vector<bool> is_seen(num_songs);
+		for (unsigned int i = 0; i < num_songs; i++)
+		{
+			if (play_order[i] >= num_songs || is_seen[play_order[i]])
+				return false;
+			is_seen[play_order[i]] = true;
+		}
+	}
+	return true;
+}
+
+
+// Returns true if every string of the record is ASCII, which is the same in UTF-8 and any ANSI code page
+static bool IsAsciiRecord(const SnapshotRecord* record, const char* strings)
+{
+	unsigned int offsets[SNAPSHOT_NUM_METADATA_FIELDS + 2];
+	offsets[0] = record->path;
+	offsets[1] = record->playlist_song_name;
+	memcpy(offsets + 2, record->metadata, sizeof(record->metadata));
+	for (int i = 0; i < SNAPSHOT_NUM_METADATA_FIELDS + 2; i++)
+	{
+		if (offsets[i] != SNAPSHOT_NO_STRING && !IsAsciiText(strings + offsets[i], lstrlen(strings + offsets[i])))
+			return false;
+	}
+	return true;
+}
+
+
+// is_ansi is true if the snapshot was written before the strings were UTF-8
+static Song* CreateSongFromRecord(const SnapshotRecord* record, const char* strings, bool is_ansi)
+{
+	Song* song = SongCreate();
+	if (!song)
+		return NULL;
+
+	song->has_audio_hash = (record->flags & SNAPSHOT_HAS_AUDIO_HASH) != 0;
+	song->audio_hash = record->audio_hash;
+	if (is_ansi && !IsAsciiRecord(record, strings))
+	{
+		// Only the path is converted, and the tags are read from the file again
+		char path[UTF8_MAX_PATH];
+		LegacyTextToUtf8(strings + record->path, path, UTF8_MAX_PATH);
+		if (!SongSetPath(song, path))
+		{
+			FreeSong(song);
+			return NULL;
+		}
+		return song;
+	}
+	if (!(record->flags & SNAPSHOT_HAS_INFO))
+	{
+		if (!SongSetPath(song, strings + record->path))
+		{
+			FreeSong(song);
+			return NULL;
+		}
+		return song;
+	}
+
+	// The text points into the snapshot until SongSetDetails() copies it into the song's details block
+	const char* file_name;
+	song->dir_id = PathTableAddPath(strings + record->path, &file_name);
+	song->file_name = (char*)file_name;
+	SongDetails details = {};
+	char** metadata_fields[SNAPSHOT_NUM_METADATA_FIELDS] = {
+		&details.metadata.title, &details.metadata.artist, &details.metadata.album, &details.metadata.genre,
+		&details.metadata.track_num, &details.metadata.disc_num, &details.metadata.date, &details.metadata.comment_description
+	};
+	for (int field = 0; field < SNAPSHOT_NUM_METADATA_FIELDS; field++)
+	{
+		if (record->metadata[field] != SNAPSHOT_NO_STRING)
+			*metadata_fields[field] = (char*)(strings + record->metadata[field]);
+	}
+	const char* playlist_song_name = NULL;
+	if (!(record->flags & SNAPSHOT_NAME_IS_FILE) && record->playlist_song_name != SNAPSHOT_NO_STRING)
+		playlist_song_name = strings + record->playlist_song_name;
+	details.song_length_bytes = record->song_length_bytes;
+	details.bitrate = record->bitrate;
+	details.frequency = record->frequency;
+	details.is_stereo = (record->flags & SNAPSHOT_IS_STEREO) != 0;
+	details.gapless.start_trim = record->gapless_start;
+	details.gapless.num_samples = record->gapless_samples;
+	if (!SongSetDetails(song, &details, playlist_song_name, true))
+	{
+		song->file_name = NULL;
+		FreeSong(song);
+		return NULL;
+	}
+	song->song_length_secs = record->song_length_secs;
+	song->format = (FileFormat)record->format;
+	song->has_info = true;
+	song->is_valid = true;
+	// Album art is too big to cache, so it is read when the song is played
+	song->is_art_pending = (song->format == MP3);
+	return song;
+}
+
+
+// Creates the songs saved in the snapshot, in playlist_view order.  play_order is filled with 
+// playlist_view indexes in play order, or left empty if it is the same as playlist_view.
+// Returns false if there is no snapshot or it isn't valid.
+bool ReadPlaylistSnapshot(const char* snapshot_path, std::vector<Song*>& songs, std::vector<unsigned int>& play_order)
+{
+	HANDLE file = CreateFile(snapshot_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size = {};
+	HANDLE mapping = NULL;
+	const unsigned char* view = NULL;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)sizeof(SnapshotHeader))
+		mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+		view = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	const bool is_valid = view && IsValidSnapshot(view, file_size.QuadPart);
+	if (is_valid)
+	{
+		const SnapshotHeader* header = (const SnapshotHeader*)view;
+		const char* strings = (const char*)(view + header->strings_offset);
+		songs.reserve(songs.size() + header->num_songs);
+		for (unsigned int i = 0; i < header->num_songs; i++)
+		{
+			SnapshotRecord record;
+			GetSnapshotRecord(view, i, &record);
+			Song* song = CreateSongFromRecord(&record, strings, header->version == SNAPSHOT_VERSION_ANSI);
+			if (song)
+				songs.push_back(song);
+		}
+		if (header->play_order_offset != 0 && songs.size() == header->num_songs)
+		{
+			const unsigned int* saved_play_order = (const unsigned int*)(view + header->play_order_offset);
+			play_order.assign(saved_play_order, saved_play_order + header->num_songs);
+		}
+	}
+
+	if (view)
+		UnmapViewOfFile(view);
+	if (mapping)
+		CloseHandle(mapping);
+	CloseHandle(file);
+	return is_valid;
+}
\ No newline at end of file
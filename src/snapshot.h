@@ -0,0 +1,91 @@
+/******************************************************************************
+snapshot.h - Binary snapshot of the playlist that is saved between runs
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+#include <Windows.h>
+#include <stddef.h>
+#include <vector>
+#include "playlist.h"
+
+// The playlist is saved to a binary file next to settings.ini instead of one huge INI string.
+// Layout (little endian):
+//		SnapshotHeader
+//		SnapshotRecord[num_songs]		In playlist_view order.  Older versions have shorter records (record_size).
+//		unsigned int[num_songs]			Play order as playlist_view indices.  Only if play_order_offset != 0.
+//		String table					Null-terminated UTF-8 strings, referenced by byte offset
+// The file is written to a temp file and renamed over the old one, so a crash while saving 
+// never leaves a half-written playlist.  It is read through a file mapping and every offset is 
+// checked before anything is allocated, so a corrupt file is just ignored.
+
+#define SNAPSHOT_MAGIC			0x4C505057		// "WPPL"
+#define SNAPSHOT_VERSION		3
+#define SNAPSHOT_VERSION_UTF8	2				// Records end before gapless_samples
+#define SNAPSHOT_VERSION_ANSI	1				// Same as version 2, but the strings are in the ANSI code page
+#define SNAPSHOT_RECORD_SIZE_V2	offsetof(SnapshotRecord, gapless_samples)
+#define SNAPSHOT_NO_STRING		0xFFFFFFFF		// String offset for a NULL string
+
+// SnapshotRecord flags
+#define SNAPSHOT_HAS_INFO		0x01		// Metadata, length, and format are cached, so the file doesn't need to be probed
+#define SNAPSHOT_IS_STEREO		0x02
+#define SNAPSHOT_HAS_AUDIO_HASH	0x04
+#define SNAPSHOT_NAME_IS_FILE	0x08		// playlist_song_name is the file name
+
+enum SnapshotMetadataField {
+	SNAPSHOT_TITLE, SNAPSHOT_ARTIST, SNAPSHOT_ALBUM, SNAPSHOT_GENRE, SNAPSHOT_TRACK_NUM,
+	SNAPSHOT_DISC_NUM, SNAPSHOT_DATE, SNAPSHOT_COMMENT, SNAPSHOT_NUM_METADATA_FIELDS
+};
+
+struct SnapshotHeader {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int num_songs;
+	unsigned int record_size;				// sizeof(SnapshotRecord), so records can grow in later versions
+	unsigned long long play_order_offset;	// 0 if the play order is the same as playlist_view
+	unsigned long long strings_offset;
+	unsigned long long strings_size;
+};
+
+struct SnapshotRecord {
+	unsigned long long song_length_bytes;
+	unsigned long long audio_hash;
+	unsigned int path;
+	unsigned int playlist_song_name;
+	unsigned int metadata[SNAPSHOT_NUM_METADATA_FIELDS];
+	unsigned int song_length_secs;
+	unsigned int bitrate;
+	unsigned int frequency;
+	unsigned char format;
+	unsigned char flags;
+	unsigned short gapless_start;			// GaplessInfo of MP3s.  Zero in versions 1 and 2.
+	unsigned long long gapless_samples;
+};
+
+bool WritePlaylistSnapshot(const char* snapshot_path, const Playlist* playlist_view, const Playlist* playlist);
+bool ReadPlaylistSnapshot(const char* snapshot_path, std::vector<Song*>& songs, std::vector<unsigned int>& play_order);
\ No newline at end of file
@@ -0,0 +1,425 @@
+/******************************************************************************
+song.cpp - Allocation, paths, details, freeing, reference counting, and sharing of Song records
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "song.h"
+#include "util.h"
+#include "path_table.h"
+#include "memory_budget.h"
+#include "utf8.h"
+#include <string.h>
+#include <unordered_set>
+
+// Every song that is in a playlist or an undo version, by path.  All of the playlists share it, so a
+// file that is in several playlists is only read and stored once.  Songs are hashed and compared by
+// their directory id and file name, so the store only costs one pointer per song.
+
+struct SongPathHash {
+	size_t operator()(const Song* song) const
+	{
+		// FNV-1a of the directory id and the file name.  Case is ignored, the same as in the path table.
+		size_t hash = (size_t)14695981039346656037ULL;
+		hash = (hash ^ song->dir_id) * (size_t)1099511628211ULL;
+		return PathHashName(hash, song->file_name, strlen(song->file_name));
+	}
+};
+
+struct SongPathEqual {
+	bool operator()(const Song* a, const Song* b) const
+	{
+		const size_t len = strlen(a->file_name);
+		return a->dir_id == b->dir_id && strlen(b->file_name) == len && PathNamesEqual(a->file_name, b->file_name, len);
+	}
+};
+
+static std::unordered_set<Song*, SongPathHash, SongPathEqual> g_song_store;
+
+// Songs are allocated from 64 KB chunks instead of one heap block each.  VirtualAlloc() regions are aligned
+// to the 64 KB allocation granularity, so the chunk of a song is found by masking its address.  Free slots
+// are linked through their first bytes.  A chunk is given back as soon as its last song is freed, so clearing
+// a big playlist releases the memory a chunk at a time instead of a song at a time.
+#define SONG_CHUNK_SIZE			0x10000
+#define SONG_CHUNK_HEADER_SIZE	((sizeof(SongChunk) + 63) & ~(size_t)63)	// Keeps the songs on cache line boundaries
+#define SONG_CHUNK_SLOTS		((SONG_CHUNK_SIZE - SONG_CHUNK_HEADER_SIZE) / sizeof(Song))
+
+struct SongChunk {
+	SongChunk* prev;		// Neighbors in the list of chunks with free slots
+	SongChunk* next;
+	Song* free_slots;
+	unsigned int num_used;
+};
+
+static SongChunk* g_open_chunks;		// Chunks that have free slots
+static bool g_has_empty_chunk;			// One empty chunk is kept, so adding and removing a few songs doesn't map and unmap pages
+
+static_assert(sizeof(Song) <= 64, "Song no longer fits in a cache line");
+
+// Returned by SongGetDetails() for songs whose info hasn't been read, so callers don't have to check
+static const SongDetails g_no_details = {};
+
+
+static void LinkSongChunk(SongChunk* chunk)
+{
+	chunk->prev = NULL;
+	chunk->next = g_open_chunks;
+	if (g_open_chunks)
+		g_open_chunks->prev = chunk;
+	g_open_chunks = chunk;
+}
+
+
+static void UnlinkSongChunk(SongChunk* chunk)
+{
+	if (chunk->prev)
+		chunk->prev->next = chunk->next;
+	else
+		g_open_chunks = chunk->next;
+	if (chunk->next)
+		chunk->next->prev = chunk->prev;
+}
+
+
+// Returns a zeroed Song, or NULL if out of memory.  Free it with FreeSong() (or SongRelease() once it has
+// references).
+Song* SongCreate()
+{
+	if (g_open_chunks == NULL)
+	{
+		SongChunk* chunk = (SongChunk*)VirtualAlloc(NULL, SONG_CHUNK_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (chunk == NULL)
+			return NULL;
+		
+		// Link the slots so the first one is handed out first
+		Song* slots = (Song*)((char*)chunk + SONG_CHUNK_HEADER_SIZE);
+		chunk->free_slots = NULL;
+		for (size_t i = SONG_CHUNK_SLOTS; i-- > 0; )
+		{
+			*(Song**)&slots[i] = chunk->free_slots;
+			chunk->free_slots = &slots[i];
+		}
+		chunk->num_used = 0;
+		LinkSongChunk(chunk);
+		MemoryBudgetCount(MEM_SONG_RECORDS, SONG_CHUNK_SIZE, 0);
+		CountMemory(ALLOC_PLAYLIST, SONG_CHUNK_SIZE);
+		g_has_empty_chunk = true;
+	}
+
+	SongChunk* chunk = g_open_chunks;
+	Song* song = chunk->free_slots;
+	chunk->free_slots = *(Song**)song;
+	if (chunk->num_used++ == 0)
+		g_has_empty_chunk = false;
+	if (chunk->free_slots == NULL)
+		UnlinkSongChunk(chunk);
+	
+	ZeroMemory(song, sizeof(Song));
+	MemoryBudgetCount(MEM_SONG_RECORDS, 0, 1);
+	return song;
+}
+
+
+// Gives the song's slot back to its chunk, and the chunk back to Windows if it is empty
+static void DestroySong(Song* song)
+{
+	SongChunk* chunk = (SongChunk*)((ULONG_PTR)song & ~(ULONG_PTR)(SONG_CHUNK_SIZE - 1));
+	if (chunk->free_slots == NULL)
+		LinkSongChunk(chunk);
+	*(Song**)song = chunk->free_slots;
+	chunk->free_slots = song;
+	MemoryBudgetCount(MEM_SONG_RECORDS, 0, -1);
+	
+	if (--chunk->num_used == 0)
+	{
+		if (g_has_empty_chunk)
+		{
+			UnlinkSongChunk(chunk);
+			VirtualFree(chunk, 0, MEM_RELEASE);
+			MemoryBudgetCount(MEM_SONG_RECORDS, -SONG_CHUNK_SIZE, 0);
+			CountMemory(ALLOC_PLAYLIST, -SONG_CHUNK_SIZE);
+		}
+		else
+		{
+			g_has_empty_chunk = true;
+		}
+	}
+}
+
+
+static bool IsInDetailsBlock(const Song* song, const char* str)
+{
+	return song->details != NULL && str >= (const char*)song->details && 
+		str < (const char*)song->details + song->details->block_size;
+}
+
+
+// Returns the song's details.  All fields are zero if the song info hasn't been read.
+const SongDetails* SongGetDetails(const Song* song)
+{
+	return song->details ? song->details : &g_no_details;
+}
+
+
+// Replaces the song's details with a copy of details.  The copy and all of the song's text (the file name,
+// playlist_song_name, and the metadata text) go in one block.  The metadata text and playlist_song_name
+// still belong to the caller, but the album art now belongs to the song (see SongSetAlbumArt()).
+// playlist_song_name can be NULL to show the file name.  Unless is_file_name_borrowed (e.g. it points into
+// the mapped snapshot file), the old file name is freed.  Returns false if out of memory, and then the song
+// isn't changed.
+bool SongSetDetails(Song* song, const SongDetails* details, const char* playlist_song_name, bool is_file_name_borrowed)
+{
+	const AudioFileMetadata* metadata = &details->metadata;
+	const char* texts[] = { song->file_name, playlist_song_name, metadata->title, metadata->artist, metadata->album,
+		metadata->genre, metadata->track_num, metadata->disc_num, metadata->date, metadata->comment_description };
+	const int num_texts = sizeof(texts) / sizeof(texts[0]);
+	
+	size_t block_size = sizeof(SongDetails);
+	for (int i = 0; i < num_texts; i++)
+	{
+		if (texts[i])
+			block_size += strlen(texts[i]) + 1;
+	}
+	SongDetails* new_details = (SongDetails*)AllocMemory(ALLOC_METADATA, block_size);
+	if (new_details == NULL)
+		return false;
+	*new_details = *details;
+	new_details->block_size = (unsigned int)block_size;
+
+	char* copies[num_texts];
+	char* next = (char*)(new_details + 1);
+	for (int i = 0; i < num_texts; i++)
+	{
+		copies[i] = NULL;
+		if (texts[i] == NULL)
+			continue;
+		const size_t size = strlen(texts[i]) + 1;
+		memcpy(next, texts[i], size);
+		copies[i] = next;
+		next += size;
+	}
+	AudioFileMetadata* new_metadata = &new_details->metadata;
+	new_metadata->title = copies[2];
+	new_metadata->artist = copies[3];
+	new_metadata->album = copies[4];
+	new_metadata->genre = copies[5];
+	new_metadata->track_num = copies[6];
+	new_metadata->disc_num = copies[7];
+	new_metadata->date = copies[8];
+	new_metadata->comment_description = copies[9];
+
+	if (!is_file_name_borrowed && !IsInDetailsBlock(song, song->file_name))
+		FreeMemory(song->file_name);
+	ID3v2Image* album_art = new_details->metadata.album_art;
+	new_details->metadata.album_art = NULL;
+	if (song->details)
+	{
+		new_details->metadata.album_art = song->details->metadata.album_art;
+		MemoryBudgetCount(MEM_SONG_DETAILS, -(long long)song->details->block_size, -1);
+		FreeMemory(song->details);
+	}
+	song->details = new_details;
+	song->file_name = copies[0];
+	song->playlist_song_name = copies[1] ? copies[1] : copies[0];
+	MemoryBudgetCount(MEM_SONG_DETAILS, (long long)block_size, 1);
+	SongSetAlbumArt(song, album_art);
+	return true;
+}
+
+
+static void FreeAlbumArt(Song* song)
+{
+	ID3v2Image* album_art = song->details->metadata.album_art;
+	if (album_art == NULL)
+		return;
+	MemoryBudgetRemoveCached(song, MEM_ALBUM_ART);
+	FreeMemory(album_art->data);
+	FreeMemory(album_art);
+	song->details->metadata.album_art = NULL;
+}
+
+
+// Gives the album art to the song, which must have details, and registers it with the memory budget.
+// The old album art is freed.  The budget may evict the new album art right away.
+void SongSetAlbumArt(Song* song, ID3v2Image* album_art)
+{
+	if (song->details->metadata.album_art == album_art)
+		return;
+	FreeAlbumArt(song);
+	song->details->metadata.album_art = album_art;
+	if (album_art)
+		MemoryBudgetAddCached(song, MEM_ALBUM_ART, sizeof(ID3v2Image) + album_art->size);
+}
+
+
+// Frees data that the memory budget evicted.  Album art is read again when the song is played.
+void SongEvictCachedData(Song* song, MemoryCategory category)
+{
+	if (category == MEM_ALBUM_ART && song->details && song->details->metadata.album_art)
+	{
+		FreeAlbumArt(song);
+		song->is_art_pending = true;
+	}
+}
+
+
+// Puts the song length in buffer, e.g. "4:13".  Empty if the song info hasn't been read or the length
+// doesn't fit.  Every visible playlist row formats its length when drawn, so this avoids printf.
+void SongFormatLength(const Song* song, char* buffer, size_t buffer_size)
+{
+	if (buffer_size == 0)
+		return;
+	buffer[0] = '\0';
+	if (!song->has_info)
+		return;
+
+	// Built backwards from the end of text:  two digits of seconds, the colon, then the minutes
+	char text[16];
+	char* start = text + sizeof(text);
+	const unsigned int secs = song->song_length_secs % 60;
+	*--start = '\0';
+	*--start = (char)('0' + secs % 10);
+	*--start = (char)('0' + secs / 10);
+	*--start = ':';
+	unsigned int mins = song->song_length_secs / 60;
+	do
+	{
+		*--start = (char)('0' + mins % 10);
+		mins /= 10;
+	} while (mins > 0);
+
+	const size_t len = text + sizeof(text) - start;
+	if (len <= buffer_size)
+		memcpy(buffer, start, len);
+}
+
+
+// Returns the playlist text for the tags, "Artist - Title", in memory from arena.  Sometimes artist metadata is
+// ridiculously long, so the artist is cut after 30 characters (not bytes, so a character is never cut in half):
+//		Before: Miles Kane, Zach Dawes, Loren Shane Humphrey, Tyler Parkford - Cry On My Guitar
+//		After:  Miles Kane, Zach Dawes, Loren ... - Cry On My Guitar
+// Returns NULL if either tag is missing, so the file name is shown instead, or if out of memory.
+char* SongMakePlaylistName(const AudioFileMetadata* metadata, MetadataArena* arena)
+{
+	if (!metadata->artist || !metadata->title)
+		return NULL;
+	const size_t max_artist_len = 30;
+	const size_t artist_len = Utf8PrefixLength(metadata->artist, max_artist_len);
+	const bool is_cut = (metadata->artist[artist_len] != '\0');
+	const size_t title_len = strlen(metadata->title);
+	char* name = MetadataArenaAlloc(arena, artist_len + (is_cut ? 3 : 0) + 3 + title_len + 1);
+	if (name == NULL)
+		return NULL;
+
+	char* pos = name;
+	memcpy(pos, metadata->artist, artist_len);
+	pos += artist_len;
+	if (is_cut)
+	{
+		memcpy(pos, "...", 3);
+		pos += 3;
+	}
+	memcpy(pos, " - ", 3);
+	pos += 3;
+	memcpy(pos, metadata->title, title_len + 1);
+	return name;
+}
+
+
+// Sets the song's directory and file name from its full path.  Returns false if out of memory.
+bool SongSetPath(Song* song, const char* path)
+{
+	const char* file_name;
+	song->dir_id = PathTableAddPath(path, &file_name);
+	song->file_name = DuplicateString(ALLOC_PLAYLIST, file_name);
+	return song->file_name != NULL;
+}
+
+
+// Puts the song's full path together in buffer.  Returns false if it doesn't fit.
+bool SongGetPath(const Song* song, char* buffer, size_t buffer_size)
+{
+	return PathTableGetPath(song->dir_id, song->file_name, buffer, buffer_size);
+}
+
+
+// Free heap memory associated with the Song object.  Songs in a playlist are released with SongRelease()
+// instead, since undo history may still have them.
+void FreeSong(Song* song)
+{
+	if (song == NULL)
+		return;
+	
+	// The store hashes the file name, so the song must leave it first
+	if (song->is_stored)
+		g_song_store.erase(song);
+	if (song->playlist_song_name != song->file_name && !IsInDetailsBlock(song, song->playlist_song_name))
+	{
+		// If playlist_song_name == file_name when there is no metadata for the file
+		// Must check to avoid a double free bug
+		FreeMemory(song->playlist_song_name);
+	}
+	if (!IsInDetailsBlock(song, song->file_name))
+		FreeMemory(song->file_name);
+	if (song->details)
+	{
+		FreeAlbumArt(song);
+		MemoryBudgetCount(MEM_SONG_DETAILS, -(long long)song->details->block_size, -1);
+		FreeMemory(song->details);
+	}
+	DestroySong(song);
+}
+
+
+void SongAddRef(Song* song)
+{
+	song->ref_count++;
+}
+
+
+// Drops one reference to the song, and frees it when nothing has it anymore
+void SongRelease(Song* song)
+{
+	if (--song->ref_count == 0)
+		FreeSong(song);
+}
+
+
+// Returns the stored song with the same path as song, or NULL if there isn't one
+Song* SongStoreFind(const Song* song)
+{
+	auto it = g_song_store.find(const_cast<Song*>(song));
+	return (it != g_song_store.end()) ? *it : NULL;
+}
+
+
+// Adds the song to the store, unless another song with the same path is already there
+void SongStoreAdd(Song* song)
+{
+	if (!song->is_stored && song->file_name && g_song_store.insert(song).second)
+		song->is_stored = true;
+}
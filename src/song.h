@@ -0,0 +1,89 @@
+/******************************************************************************
+song.h - Song struct shared by the playlist and the library index
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include "bass.h"
+#include "metadata.h"
+#include "memory_budget.h"
+
+enum FileFormat : unsigned char { MP3, OGG, AAC, FLAC };
+
+struct PlaylistNode;
+
+// Song data that only the current song, the library index, sorting, and the playlist snapshot need.  It
+// is allocated in one block together with all of the song's text (see SongSetDetails()), so a song has
+// one allocation besides its album art.
+struct SongDetails {
+	AudioFileMetadata metadata;
+	QWORD song_length_bytes;	// Song length in bytes.  QWORD = unsigned int64
+	unsigned int bitrate;		// e.g. 256 kbps
+	unsigned int frequency;		// e.g. 44100 hertz
+	bool is_stereo;
+	GaplessInfo gapless;		// Encoder delay and padding to trim (MP3 only).  num_samples is 0 if unknown.
+	unsigned int block_size;	// Size of the block, including the text after this struct
+};
+
+// Entries in the playlist.  Only the fields that drawing the playlist and the loops over the whole
+// playlist read are kept here, so a song fits in one 64 byte cache line.  Everything else is in details.
+struct Song {
+	char* playlist_song_name;
+	char* file_name;			// e.g. Artist - Song.mp3
+	PlaylistNode* play_node;	// Node of the song in the play order of the shown playlist, or NULL if it isn't in it
+	SongDetails* details;		// NULL until the song info is read.  Use SongGetDetails() to read it.
+	unsigned long long audio_hash;	// Hash of the audio data without the tags.  Only valid if has_audio_hash.
+	unsigned int dir_id;		// Directory of the file in the path table.  SongGetPath() puts the full path together.
+	unsigned int song_length_secs;
+	unsigned int index_row;		// Row in the library index.  Only valid if is_indexed.
+	unsigned int ref_count;		// The playlists and the undo versions that have the song
+	FileFormat format;
+	bool is_valid;				// Invalid (e.g. deleted) songs will be drawn in playlist grayed out
+	bool has_info;				// Was song info already looked up?
+	bool is_art_pending;		// Info came from the playlist snapshot, so the album art hasn't been read yet
+	bool is_indexed;			// Does the song have a row in the library index?
+	bool has_audio_hash;
+	bool is_duplicate;			// Does another song in the playlist have the same audio_hash?
+	bool is_stored;				// Is the song in the song store?
+};
+
+Song* SongCreate();
+void FreeSong(Song* song);
+void SongAddRef(Song* song);
+void SongRelease(Song* song);
+bool SongSetPath(Song* song, const char* path);
+bool SongGetPath(const Song* song, char* buffer, size_t buffer_size);
+const SongDetails* SongGetDetails(const Song* song);
+bool SongSetDetails(Song* song, const SongDetails* details, const char* playlist_song_name, bool is_file_name_borrowed);
+void SongSetAlbumArt(Song* song, ID3v2Image* album_art);
+void SongEvictCachedData(Song* song, MemoryCategory category);
+void SongFormatLength(const Song* song, char* buffer, size_t buffer_size);
+char* SongMakePlaylistName(const AudioFileMetadata* metadata, MetadataArena* arena);
+Song* SongStoreFind(const Song* song);
+void SongStoreAdd(Song* song);
@@ -72,7 +72,7 @@ static void PaintButton(HWND hwnd, TextButtonState* button_data)
 	SetBkMode(mem_dc, TRANSPARENT);
 	SetTextColor(mem_dc, button_data->font_color);
 	HFONT oldfont = (HFONT)SelectObject(mem_dc, button_data->font);
-	DrawText(mem_dc, button_data->caption, -1, &client_rect, DT_SINGLELINE | DT_CENTER | DT_VCENTER);
+	DrawTextUtf8(mem_dc, button_data->caption, &client_rect, DT_SINGLELINE | DT_CENTER | DT_VCENTER);
 	SelectObject(dc, oldfont);
 	BitBlt(dc, 0, 0, width, height, mem_dc, 0, 0, SRCCOPY);
 	DeleteDC(mem_dc);
@@ -237,7 +237,7 @@ static LRESULT CALLBACK ButtonProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM l
 
 			char* new_caption = (char*)lParam;
 			if (new_caption)
-				button_data->caption = DuplicateString(new_caption);
+				button_data->caption = DuplicateString(ALLOC_UI, new_caption);
 			else
 				button_data->caption = NULL;
 
@@ -270,13 +270,13 @@ HWND CreateTextButton(const char* caption, const char* font_name, int font_size,
 	HMENU btn_id, HINSTANCE parent_inst, int x, int y, int width, int height)
 {
 	HWND btn_hwnd = 0;
-	TextButtonState* btn_data = (TextButtonState*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TextButtonState));
+	TextButtonState* btn_data = (TextButtonState*)AllocMemory(ALLOC_UI, sizeof(TextButtonState));
 	if (btn_data)
 	{
 		if (caption)
-			btn_data->caption = DuplicateString(caption);
+			btn_data->caption = DuplicateString(ALLOC_UI, caption);
 		if (font_name)
-			btn_data->font_name = DuplicateString(font_name);
+			btn_data->font_name = DuplicateString(ALLOC_UI, font_name);
 		btn_data->font_size = font_size;
 		btn_data->font_color = font_color;
 		btn_data->normal_color = btn_normal_color;
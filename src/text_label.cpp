@@ -90,7 +90,7 @@ static void PaintTextLabel(HWND hwnd, TextLabelData* label_data)
 
 	if (label_data->text)
 	{
-		if (!DrawTextA(mem_dc, label_data->text, -1, &client_rect, drawtext_fmt))
+		if (!DrawTextUtf8(mem_dc, label_data->text, &client_rect, drawtext_fmt))
 		{
 			DebugOut("Text Label Error:  DrawText() failed.\n");
 		}
@@ -165,7 +165,7 @@ static LRESULT CALLBACK TextLabelProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARA
 			
 			char* new_text = (char*)lParam;
 			if (new_text)
-				label_data->text = DuplicateString(new_text);
+				label_data->text = DuplicateString(ALLOC_UI, new_text);
 			else
 				label_data->text = NULL;
 
@@ -199,13 +199,13 @@ HWND CreateTextLabel(const char* text, const char* font_name, int font_size, boo
 	HWND parent_hwnd, HMENU lbl_id,	HINSTANCE parent_inst, int x, int y, int width, int height)
 {
 	HWND lbl_hwnd = 0;
-	TextLabelData* lbl_data = (TextLabelData*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TextLabelData));
+	TextLabelData* lbl_data = (TextLabelData*)AllocMemory(ALLOC_UI, sizeof(TextLabelData));
 	if (lbl_data)
 	{
 		if (text)
-			lbl_data->text = DuplicateString(text);
+			lbl_data->text = DuplicateString(ALLOC_UI, text);
 		
-		lbl_data->font_name = DuplicateString(font_name);
+		lbl_data->font_name = DuplicateString(ALLOC_UI, font_name);
 		lbl_data->font_size = font_size;
 		lbl_data->font_bold = font_bold;
 		lbl_data->background_color = background_color;
@@ -355,7 +355,7 @@ HWND CreateTrackbar(TrackbarType type, COLORREF background_color, COLORREF chann
 	HWND parent_hwnd, HINSTANCE parent_inst, int x, int y, int width, int height)
 {
 	HWND tb_hwnd = 0;
-	TrackbarData* tb = (TrackbarData*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TrackbarData));
+	TrackbarData* tb = (TrackbarData*)AllocMemory(ALLOC_UI, sizeof(TrackbarData));
 	if (tb)
 	{
 		tb->type = type;
@@ -0,0 +1,429 @@
+/******************************************************************************
+undo_history.cpp - Undo and redo of playlist edits
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "undo_history.h"
+#include "util.h"
+#include <Windows.h>
+#include <vector>
+
+
+unsigned int SeqCount(const SeqNode* node)
+{
+	return node ? node->count : 0;
+}
+
+
+static inline void UpdateNode(SeqNode* node)
+{
+	node->count = 1 + SeqCount(node->left) + SeqCount(node->right);
+}
+
+
+// xorshift32
+static unsigned int NextPriority(UndoHistory* history)
+{
+	unsigned int x = history->rand_state ? history->rand_state : 0x2545F491;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	history->rand_state = x;
+	return x;
+}
+
+
+// New node with one reference, charged to the current version
+static SeqNode* NewNode(UndoHistory* history, Song* song, unsigned int priority)
+{
+	SeqNode* node = (SeqNode*)AllocMemory(ALLOC_PLAYLIST, sizeof(SeqNode));
+	node->song = song;
+	node->priority = priority;
+	node->count = 1;
+	node->ref_count = 1;
+	SongAddRef(song);
+	history->versions[history->current].cost += sizeof(SeqNode);
+	return node;
+}
+
+
+static void AddRef(SeqNode* node)
+{
+	if (node)
+		node->ref_count++;
+}
+
+
+// Drops one reference to the node, and frees the nodes that aren't used anymore
+static void Release(SeqNode* node)
+{
+	std::vector<SeqNode*> stack;
+	if (node)
+		stack.push_back(node);
+	while (stack.size())
+	{
+		node = stack.back();
+		stack.pop_back();
+		if (--node->ref_count > 0)
+			continue;
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+		SongRelease(node->song);
+		FreeMemory(node);
+	}
+}
+
+
+// Returns a node that can be changed in place:  the node itself if the caller has the only
+// reference, otherwise a copy.  Either way, the caller's reference moves to the returned node.
+static SeqNode* Own(UndoHistory* history, SeqNode* node)
+{
+	if (node->ref_count == 1)
+		return node;
+
+	SeqNode* copy = NewNode(history, node->song, node->priority);
+	copy->left = node->left;
+	copy->right = node->right;
+	copy->count = node->count;
+	AddRef(copy->left);
+	AddRef(copy->right);
+	node->ref_count--;		// Still referenced by another version
+	return copy;
+}
+
+
+// Splits the tree into the first count nodes (left) and the rest (right).  Takes the caller's
+// reference to node, and gives the caller a reference to each half.
+static void Split(UndoHistory* history, SeqNode* node, unsigned int count, SeqNode** left, SeqNode** right)
+{
+	if (node == NULL)
+	{
+		*left = NULL;
+		*right = NULL;
+		return;
+	}
+	node = Own(history, node);
+	if (SeqCount(node->left) < count)
+	{
+		Split(history, node->right, count - SeqCount(node->left) - 1, &node->right, right);
+		*left = node;
+	}
+	else
+	{
+		Split(history, node->left, count, left, &node->left);
+		*right = node;
+	}
+	UpdateNode(node);
+}
+
+
+// Joins two trees.  Every node of left comes before every node of right.  Takes the caller's
+// references to both, and gives the caller a reference to the result.
+static SeqNode* Merge(UndoHistory* history, SeqNode* left, SeqNode* right)
+{
+	if (left == NULL)
+		return right;
+	if (right == NULL)
+		return left;
+	if (left->priority > right->priority)
+	{
+		left = Own(history, left);
+		left->right = Merge(history, left->right, right);
+		UpdateNode(left);
+		return left;
+	}
+	right = Own(history, right);
+	right->left = Merge(history, left, right->left);
+	UpdateNode(right);
+	return right;
+}
+
+
+// Builds a tree of the songs in O(n), the same way as PlaylistRebuild()
+static SeqNode* Build(UndoHistory* history, Song** songs, unsigned int num_songs)
+{
+	// The right spine of the tree built so far
+	std::vector<SeqNode*> spine;
+	spine.reserve(64);
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		SeqNode* node = NewNode(history, songs[i], NextPriority(history));
+		SeqNode* last_popped = NULL;
+		while (spine.size() && spine.back()->priority < node->priority)
+		{
+			last_popped = spine.back();
+			spine.pop_back();
+		}
+		node->left = last_popped;
+		if (spine.size())
+			spine.back()->right = node;
+		spine.push_back(node);
+	}
+
+	// Counts can only be computed once the children are final, so do them bottom up
+	SeqNode* root = spine.size() ? spine[0] : NULL;
+	std::vector<SeqNode*> postorder;
+	postorder.reserve(num_songs);
+	std::vector<SeqNode*> stack;
+	if (root)
+		stack.push_back(root);
+	while (stack.size())
+	{
+		SeqNode* node = stack.back();
+		stack.pop_back();
+		postorder.push_back(node);
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+	}
+	for (size_t i = postorder.size(); i > 0; i--)
+		UpdateNode(postorder[i - 1]);
+	return root;
+}
+
+
+// Fills songs (which must hold SeqCount() pointers) with the songs of the tree in order
+void SeqGetSongs(const SeqNode* node, Song** songs)
+{
+	std::vector<const SeqNode*> stack;
+	unsigned int i = 0;
+	while (node || stack.size())
+	{
+		while (node)
+		{
+			stack.push_back(node);
+			node = node->left;
+		}
+		node = stack.back();
+		stack.pop_back();
+		songs[i++] = node->song;
+		node = node->right;
+	}
+}
+
+
+static void ReleaseVersion(PlaylistVersion* version)
+{
+	Release(version->view);
+	Release(version->play);
+	version->view = NULL;
+	version->play = NULL;
+}
+
+
+static inline SeqNode** SequenceRoot(UndoHistory* history, UndoSequence sequence)
+{
+	PlaylistVersion* version = &history->versions[history->current];
+	return (sequence == UNDO_VIEW) ? &version->view : &version->play;
+}
+
+
+UndoHistory* UndoHistoryCreate(size_t budget)
+{
+	UndoHistory* history = new UndoHistory();
+	history->budget = budget;
+	UndoHistoryReset(history, NULL, 0);
+	return history;
+}
+
+
+void UndoHistoryFree(UndoHistory* history)
+{
+	for (size_t i = 0; i < history->versions.size(); i++)
+		ReleaseVersion(&history->versions[i]);
+	delete history;
+}
+
+
+// Throws away every version, and starts over with one version that has the songs in both orders
+void UndoHistoryReset(UndoHistory* history, Song** songs, unsigned int num_songs)
+{
+	for (size_t i = 0; i < history->versions.size(); i++)
+		ReleaseVersion(&history->versions[i]);
+	history->versions.clear();
+	history->versions.push_back(PlaylistVersion());
+	history->current = 0;
+	history->cost = 0;
+
+	PlaylistVersion* version = &history->versions[0];
+	version->view = Build(history, songs, num_songs);
+	version->play = version->view;
+	AddRef(version->play);
+}
+
+
+// Starts a new version, which is a copy of the current one until it is edited.  The versions
+// that could have been redone are thrown away.
+void UndoHistoryBeginEdit(UndoHistory* history)
+{
+	while (history->versions.size() > history->current + 1)
+	{
+		history->cost -= history->versions.back().cost;
+		ReleaseVersion(&history->versions.back());
+		history->versions.pop_back();
+	}
+
+	PlaylistVersion version = history->versions[history->current];
+	AddRef(version.view);
+	AddRef(version.play);
+	version.cost = 0;
+	history->versions.push_back(version);
+	history->current++;
+}
+
+
+// Deletes the songs at indexes, which must be in ascending order.  O(log n) each, unless so many
+// are deleted that rebuilding the tree from the rest is cheaper.
+void UndoHistoryDelete(UndoHistory* history, UndoSequence sequence, const unsigned int* indexes, unsigned int count)
+{
+	SeqNode** root = SequenceRoot(history, sequence);
+	const unsigned int num_songs = SeqCount(*root);
+	if (count >= num_songs / 16 && count > 1)
+	{
+		std::vector<Song*> songs(num_songs);
+		SeqGetSongs(*root, songs.data());
+		std::vector<Song*> kept;
+		kept.reserve(num_songs - count);
+		unsigned int next_deleted = 0;
+		for (unsigned int i = 0; i < num_songs; i++)
+		{
+			if (next_deleted < count && indexes[next_deleted] == i)
+				next_deleted++;
+			else
+				kept.push_back(songs[i]);
+		}
+		UndoHistoryAssign(history, sequence, kept.data(), kept.size());
+		return;
+	}
+
+	// Delete from the end, so the indexes that are left don't change
+	for (unsigned int i = count; i > 0; i--)
+	{
+		SeqNode* before;
+		SeqNode* deleted;
+		SeqNode* after;
+		Split(history, *root, indexes[i - 1], &before, &after);
+		Split(history, after, 1, &deleted, &after);
+		Release(deleted);
+		*root = Merge(history, before, after);
+	}
+}
+
+
+// Same as PlaylistMove()
+void UndoHistoryMove(UndoHistory* history, UndoSequence sequence, unsigned int first, unsigned int count, unsigned int dest)
+{
+	SeqNode** root = SequenceRoot(history, sequence);
+	SeqNode* before;
+	SeqNode* moved;
+	SeqNode* after;
+	Split(history, *root, first, &before, &after);
+	Split(history, after, count, &moved, &after);
+	SeqNode* rest = Merge(history, before, after);
+	Split(history, rest, dest, &before, &after);
+	*root = Merge(history, Merge(history, before, moved), after);
+}
+
+
+void UndoHistoryAppend(UndoHistory* history, UndoSequence sequence, Song** songs, unsigned int num_songs)
+{
+	SeqNode** root = SequenceRoot(history, sequence);
+	*root = Merge(history, *root, Build(history, songs, num_songs));
+}
+
+
+// Replaces the whole order, e.g. after sorting
+void UndoHistoryAssign(UndoHistory* history, UndoSequence sequence, Song** songs, unsigned int num_songs)
+{
+	SeqNode** root = SequenceRoot(history, sequence);
+	SeqNode* new_root = Build(history, songs, num_songs);
+	Release(*root);
+	*root = new_root;
+}
+
+
+// Makes the play order of the current version the same as its view order, e.g. when shuffle is off
+void UndoHistoryPlayFollowsView(UndoHistory* history)
+{
+	PlaylistVersion* version = &history->versions[history->current];
+	if (version->play == version->view)
+		return;
+	Release(version->play);
+	version->play = version->view;
+	AddRef(version->play);
+}
+
+
+// Finishes the version started by UndoHistoryBeginEdit(), and drops the oldest versions if the
+// history is over its budget.  The current version is always kept.
+void UndoHistoryEndEdit(UndoHistory* history)
+{
+	history->cost += history->versions[history->current].cost;
+	while (history->cost > history->budget && history->current > 0)
+	{
+		ReleaseVersion(&history->versions.front());
+		history->versions.pop_front();
+		history->current--;
+		history->cost -= history->versions.front().cost;		// Now the oldest, so it isn't counted
+	}
+}
+
+
+bool UndoHistoryCanUndo(const UndoHistory* history)
+{
+	return history->current > 0;
+}
+
+
+bool UndoHistoryCanRedo(const UndoHistory* history)
+{
+	return history->current + 1 < history->versions.size();
+}
+
+
+// Moves back one version and returns it, or returns NULL if there is nothing to undo
+const PlaylistVersion* UndoHistoryUndo(UndoHistory* history)
+{
+	if (!UndoHistoryCanUndo(history))
+		return NULL;
+	history->current--;
+	return &history->versions[history->current];
+}
+
+
+// Moves forward one version and returns it, or returns NULL if there is nothing to redo
+const PlaylistVersion* UndoHistoryRedo(UndoHistory* history)
+{
+	if (!UndoHistoryCanRedo(history))
+		return NULL;
+	history->current++;
+	return &history->versions[history->current];
+}
@@ -0,0 +1,91 @@
+/******************************************************************************
+undo_history.h - Undo and redo of playlist edits
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <deque>
+#include "song.h"
+
+// Every edit of the playlist makes a new version of it, which can be undone and redone.  A
+// version is an immutable treap of songs, like Playlist but persistent:  an edit copies only the
+// O(log n) nodes on the paths it changes, and shares the rest of the tree with the version before.
+// Moving, deleting or adding a song costs O(log n) memory no matter how big the playlist is.
+// Sorting or opening a new playlist changes every position, so those versions are O(n).
+//
+// Nodes are reference counted.  A node with only one reference isn't shared, so the edit can
+// change it in place instead of copying it.  Songs are reference counted too, so songs deleted
+// from the playlist stay alive while an old version still has them.
+//
+// Old versions are dropped when the nodes made for the versions add up to more than the budget.
+
+#define UNDO_MEMORY_BUDGET		(64 * 1024 * 1024)
+
+// Playlist orders stored in each version
+enum UndoSequence { UNDO_VIEW, UNDO_PLAY };
+
+struct SeqNode {
+	Song* song;
+	SeqNode* left;
+	SeqNode* right;
+	unsigned int priority;		// Random.  Parents have a higher priority than their children.
+	unsigned int count;			// Number of nodes in this subtree, including this one
+	unsigned int ref_count;		// Versions and parent nodes that point to this node
+};
+
+struct PlaylistVersion {
+	SeqNode* view;							// Songs in playlist_view order
+	SeqNode* play;							// Songs in playlist order.  Often the same tree as view.
+	size_t cost;							// Bytes of nodes made for this version
+};
+
+struct UndoHistory {
+	std::deque<PlaylistVersion> versions;	// Oldest first
+	size_t current;							// Version the playlist is at.  Later versions can be redone.
+	size_t cost;							// Total cost of every version except the oldest
+	size_t budget;
+	unsigned int rand_state;				// For node priorities
+};
+
+UndoHistory* UndoHistoryCreate(size_t budget);
+void UndoHistoryFree(UndoHistory* history);
+void UndoHistoryReset(UndoHistory* history, Song** songs, unsigned int num_songs);
+void UndoHistoryBeginEdit(UndoHistory* history);
+void UndoHistoryDelete(UndoHistory* history, UndoSequence sequence, const unsigned int* indexes, unsigned int count);
+void UndoHistoryMove(UndoHistory* history, UndoSequence sequence, unsigned int first, unsigned int count, unsigned int dest);
+void UndoHistoryAppend(UndoHistory* history, UndoSequence sequence, Song** songs, unsigned int num_songs);
+void UndoHistoryAssign(UndoHistory* history, UndoSequence sequence, Song** songs, unsigned int num_songs);
+void UndoHistoryPlayFollowsView(UndoHistory* history);
+void UndoHistoryEndEdit(UndoHistory* history);
+bool UndoHistoryCanUndo(const UndoHistory* history);
+bool UndoHistoryCanRedo(const UndoHistory* history);
+const PlaylistVersion* UndoHistoryUndo(UndoHistory* history);
+const PlaylistVersion* UndoHistoryRedo(UndoHistory* history);
+unsigned int SeqCount(const SeqNode* node);
+void SeqGetSongs(const SeqNode* node, Song** songs);
@@ -0,0 +1,364 @@
+/******************************************************************************
+utf8.cpp - Conversions between UTF-8 and the other text encodings
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "utf8.h"
+
+// UTF8_NO_SSE2 leaves only the plain loops, which the tests check the SSE2 ones against
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)) && !defined(UTF8_NO_SSE2)
+#include <emmintrin.h>
+#define UTF8_USE_SSE2
+#endif
+
+// How UTF-16 units are read by EncodeUtf16()
+enum Utf16Source { UTF16_WCHAR, UTF16_LE_BYTES, UTF16_BE_BYTES };
+
+
+// Returns the number of ASCII bytes at the start of text
+static size_t CountAscii(const unsigned char* text, size_t len)
+{
+	size_t pos = 0;
+#ifdef UTF8_USE_SSE2
+	// The top bit of every byte ends up in one bit of the mask
+	while (pos + 16 <= len && _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(text + pos))) == 0)
+		pos += 16;
+#endif
+	while (pos < len && text[pos] < 0x80)
+		pos++;
+	return pos;
+}
+
+
+// Decodes the UTF-8 sequence at the start of text into code_point.  Returns the number of bytes
+// used, which is 1 for an invalid sequence, so that decoding picks up again at the next byte.
+static size_t DecodeUtf8(const unsigned char* text, size_t len, unsigned int* code_point)
+{
+	const unsigned char lead = text[0];
+	size_t seq_len;
+	unsigned char min_second = 0x80;	// Rules out overlong sequences, surrogates, and code points past U+10FFFF
+	unsigned char max_second = 0xBF;
+	if (lead < 0x80)
+	{
+		*code_point = lead;
+		return 1;
+	}
+	else if (lead >= 0xC2 && lead <= 0xDF)
+	{
+		seq_len = 2;
+		*code_point = lead & 0x1F;
+	}
+	else if (lead >= 0xE0 && lead <= 0xEF)
+	{
+		seq_len = 3;
+		*code_point = lead & 0x0F;
+		if (lead == 0xE0)
+			min_second = 0xA0;
+		else if (lead == 0xED)
+			max_second = 0x9F;
+	}
+	else if (lead >= 0xF0 && lead <= 0xF4)
+	{
+		seq_len = 4;
+		*code_point = lead & 0x07;
+		if (lead == 0xF0)
+			min_second = 0x90;
+		else if (lead == 0xF4)
+			max_second = 0x8F;
+	}
+	else
+	{
+		*code_point = UTF8_REPLACEMENT_CHAR;
+		return 1;
+	}
+
+	if (seq_len > len || text[1] < min_second || text[1] > max_second)
+	{
+		*code_point = UTF8_REPLACEMENT_CHAR;
+		return 1;
+	}
+	for (size_t i = 1; i < seq_len; i++)
+	{
+		if ((text[i] & 0xC0) != 0x80)
+		{
+			*code_point = UTF8_REPLACEMENT_CHAR;
+			return 1;
+		}
+		*code_point = (*code_point << 6) | (text[i] & 0x3F);
+	}
+	return seq_len;
+}
+
+
+// Writes the code point to buffer as UTF-8, and returns the number of bytes
+static size_t EncodeUtf8(unsigned int code_point, char* buffer)
+{
+	if (code_point < 0x80)
+	{
+		buffer[0] = (char)code_point;
+		return 1;
+	}
+	if (code_point < 0x800)
+	{
+		buffer[0] = (char)(0xC0 | (code_point >> 6));
+		buffer[1] = (char)(0x80 | (code_point & 0x3F));
+		return 2;
+	}
+	if (code_point < 0x10000)
+	{
+		buffer[0] = (char)(0xE0 | (code_point >> 12));
+		buffer[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+		buffer[2] = (char)(0x80 | (code_point & 0x3F));
+		return 3;
+	}
+	buffer[0] = (char)(0xF0 | (code_point >> 18));
+	buffer[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+	buffer[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+	buffer[3] = (char)(0x80 | (code_point & 0x3F));
+	return 4;
+}
+
+
+// Adds the bytes of one character to out, unless they don't fit.  Returns false if they don't fit.
+static inline bool AppendBytes(const char* bytes, size_t num_bytes, char* out, size_t out_size, size_t* out_len)
+{
+	if (out)
+	{
+		if (*out_len + num_bytes >= out_size)
+			return false;
+		for (size_t i = 0; i < num_bytes; i++)
+			out[*out_len + i] = bytes[i];
+	}
+	*out_len += num_bytes;
+	return true;
+}
+
+
+static inline void Terminate(char* out, size_t out_size, size_t out_len)
+{
+	if (out && out_size > 0)
+		out[out_len] = '\0';
+}
+
+
+// Returns true if every byte of text is ASCII
+bool IsAsciiText(const char* text, size_t len)
+{
+	return CountAscii((const unsigned char*)text, len) == len;
+}
+
+
+// Returns true if text is well-formed UTF-8
+bool IsValidUtf8(const char* text, size_t len)
+{
+	const unsigned char* bytes = (const unsigned char*)text;
+	size_t pos = 0;
+	while (true)
+	{
+		pos += CountAscii(bytes + pos, len - pos);
+		if (pos == len)
+			return true;
+		unsigned int code_point;
+		const size_t seq_len = DecodeUtf8(bytes + pos, len - pos, &code_point);
+		if (code_point == UTF8_REPLACEMENT_CHAR && seq_len == 1)
+			return false;
+		pos += seq_len;
+	}
+}
+
+
+size_t Utf8ToUtf16(const char* text, size_t len, wchar_t* out, size_t out_size)
+{
+	const unsigned char* bytes = (const unsigned char*)text;
+	size_t pos = 0;
+	size_t out_len = 0;
+	while (pos < len)
+	{
+		// Copy the run of ASCII, widening each byte
+		size_t run = CountAscii(bytes + pos, len - pos);
+		if (out)
+		{
+			if (out_len + run >= out_size)
+				run = (out_size > out_len) ? out_size - out_len - 1 : 0;
+			size_t i = 0;
+#ifdef UTF8_USE_SSE2
+			if (sizeof(wchar_t) == 2)
+			{
+				const __m128i zero = _mm_setzero_si128();
+				for (; i + 16 <= run; i += 16)
+				{
+					const __m128i chars = _mm_loadu_si128((const __m128i*)(bytes + pos + i));
+					_mm_storeu_si128((__m128i*)(out + out_len + i), _mm_unpacklo_epi8(chars, zero));
+					_mm_storeu_si128((__m128i*)(out + out_len + i + 8), _mm_unpackhi_epi8(chars, zero));
+				}
+			}
+#endif
+			for (; i < run; i++)
+				out[out_len + i] = bytes[pos + i];
+		}
+		pos += run;
+		out_len += run;
+		if (pos == len)
+			break;
+		if (bytes[pos] < 0x80)
+			break;		// The output is full
+
+		unsigned int code_point;
+		const size_t seq_len = DecodeUtf8(bytes + pos, len - pos, &code_point);
+		const size_t num_units = (code_point >= 0x10000) ? 2 : 1;
+		if (out)
+		{
+			if (out_len + num_units >= out_size)
+				break;
+			if (num_units == 2)
+			{
+				out[out_len] = (wchar_t)(0xD800 + ((code_point - 0x10000) >> 10));
+				out[out_len + 1] = (wchar_t)(0xDC00 + ((code_point - 0x10000) & 0x3FF));
+			}
+			else
+			{
+				out[out_len] = (wchar_t)code_point;
+			}
+		}
+		pos += seq_len;
+		out_len += num_units;
+	}
+	if (out && out_size > 0)
+		out[out_len] = L'\0';
+	return out_len;
+}
+
+
+// Returns UTF-16 unit i of data
+static inline unsigned int ReadUtf16(const void* data, size_t i, Utf16Source source)
+{
+	if (source == UTF16_WCHAR)
+		return (unsigned int)((const wchar_t*)data)[i] & 0xFFFF;
+	const unsigned char* bytes = (const unsigned char*)data + i * 2;
+	return (source == UTF16_LE_BYTES) ? (bytes[0] | (bytes[1] << 8)) : ((bytes[0] << 8) | bytes[1]);
+}
+
+
+// Converts num_units UTF-16 units to UTF-8
+static size_t EncodeUtf16(const void* data, size_t num_units, Utf16Source source, char* out, size_t out_size)
+{
+	size_t pos = 0;
+	size_t out_len = 0;
+	while (pos < num_units)
+	{
+#ifdef UTF8_USE_SSE2
+		if (source == UTF16_WCHAR && sizeof(wchar_t) == 2 && out)
+		{
+			// Narrow 8 units at a time while they are all ASCII
+			const wchar_t* units = (const wchar_t*)data;
+			const __m128i high_bits = _mm_set1_epi16((short)0xFF80);
+			const __m128i zero = _mm_setzero_si128();
+			while (pos + 8 <= num_units && out_len + 8 < out_size)
+			{
+				const __m128i chars = _mm_loadu_si128((const __m128i*)(units + pos));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chars, high_bits), zero)) != 0xFFFF)
+					break;
+				_mm_storel_epi64((__m128i*)(out + out_len), _mm_packus_epi16(chars, zero));
+				pos += 8;
+				out_len += 8;
+			}
+			if (pos == num_units)
+				break;
+		}
+#endif
+		unsigned int code_point = ReadUtf16(data, pos, source);
+		size_t units_used = 1;
+		if (code_point >= 0xD800 && code_point <= 0xDBFF && pos + 1 < num_units)
+		{
+			const unsigned int low = ReadUtf16(data, pos + 1, source);
+			if (low >= 0xDC00 && low <= 0xDFFF)
+			{
+				code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+				units_used = 2;
+			}
+		}
+		if (code_point >= 0xD800 && code_point <= 0xDFFF)
+			code_point = UTF8_REPLACEMENT_CHAR;
+
+		char bytes[4];
+		if (!AppendBytes(bytes, EncodeUtf8(code_point, bytes), out, out_size, &out_len))
+			break;
+		pos += units_used;
+	}
+	Terminate(out, out_size, out_len);
+	return out_len;
+}
+
+
+size_t Utf16ToUtf8(const wchar_t* text, size_t len, char* out, size_t out_size)
+{
+	return EncodeUtf16(text, len, UTF16_WCHAR, out, out_size);
+}
+
+
+// Converts UTF-16 text stored as bytes in the given byte order, e.g. an ID3v2 frame.  len is in bytes.
+size_t Utf16BytesToUtf8(const unsigned char* data, size_t len, bool is_big_endian, char* out, size_t out_size)
+{
+	return EncodeUtf16(data, len / 2, is_big_endian ? UTF16_BE_BYTES : UTF16_LE_BYTES, out, out_size);
+}
+
+
+// ISO-8859-1 is the first 256 code points, so each byte is one character
+size_t Latin1ToUtf8(const unsigned char* data, size_t len, char* out, size_t out_size)
+{
+	size_t out_len = 0;
+	for (size_t pos = 0; pos < len; pos++)
+	{
+		char bytes[4];
+		if (!AppendBytes(bytes, EncodeUtf8(data[pos], bytes), out, out_size, &out_len))
+			break;
+	}
+	Terminate(out, out_size, out_len);
+	return out_len;
+}
+
+
+// Returns the number of bytes taken by the first max_chars characters of text, e.g. to shorten
+// text without cutting a character in half
+size_t Utf8PrefixLength(const char* text, size_t max_chars)
+{
+	size_t pos = 0;
+	size_t num_chars = 0;
+	while (text[pos])
+	{
+		// Continuation bytes belong to the character before them
+		if (((unsigned char)text[pos] & 0xC0) != 0x80)
+		{
+			if (num_chars == max_chars)
+				break;
+			num_chars++;
+		}
+		pos++;
+	}
+	return pos;
+}
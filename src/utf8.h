@@ -0,0 +1,61 @@
+/******************************************************************************
+utf8.h - Conversions between UTF-8 and the other text encodings
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+
+// All text inside the player (tags, paths, playlist names) is UTF-8.  It is converted to UTF-16 only
+// where it meets Windows, and tags are converted to UTF-8 as soon as they are read.  The conversions
+// write into buffers the caller provides, so they don't allocate, and this file doesn't use any
+// Windows functions, so it can be built and tested on other platforms.
+//
+// Each conversion takes the length of its input, so the input can contain null characters, e.g. the
+// list of files from the "Open File" dialog.  The output is always null terminated if out_size is
+// more than 0, and a character that doesn't fit is left out whole rather than cut in half.  The
+// number of bytes or UTF-16 units written is returned, not counting the terminator.  If out is NULL,
+// the length the whole input would need is returned instead.
+//
+// Invalid input, such as an unpaired surrogate or a bad UTF-8 sequence, becomes U+FFFD.  Runs of
+// ASCII, which is most text, are checked 16 bytes at a time with SSE2.
+
+#define UTF8_REPLACEMENT_CHAR	0xFFFD
+
+// Worst case output sizes, not counting the terminator
+#define UTF8_SIZE_OF_UTF16(len)		((len) * 3)		// Bytes for len UTF-16 units
+#define UTF8_SIZE_OF_LATIN1(len)	((len) * 2)		// Bytes for len ISO-8859-1 bytes
+
+bool IsAsciiText(const char* text, size_t len);
+bool IsValidUtf8(const char* text, size_t len);
+size_t Utf8ToUtf16(const char* text, size_t len, wchar_t* out, size_t out_size);
+size_t Utf16ToUtf8(const wchar_t* text, size_t len, char* out, size_t out_size);
+size_t Utf16BytesToUtf8(const unsigned char* data, size_t len, bool is_big_endian, char* out, size_t out_size);
+size_t Latin1ToUtf8(const unsigned char* data, size_t len, char* out, size_t out_size);
+size_t Utf8PrefixLength(const char* text, size_t max_chars);
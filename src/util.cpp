@@ -29,6 +29,7 @@ SOFTWARE.
 ******************************************************************************/
 
 #include "util.h"
+#include <strsafe.h>
 
 HFONT GetFont(const char* font_name, int font_size, bool is_bold, bool is_italic, bool is_underline)
 {
@@ -71,27 +72,210 @@ void InvalidateWindow(HWND hwnd)
 	InvalidateRect(hwnd, &rect, false);
 }
 
+// Every block from AllocMemory() starts with this header, so FreeMemory() knows which counters to take it
+// off of without asking the heap.  It is one allocation unit, so the caller's data stays aligned.
+struct AllocHeader {
+	size_t size;
+	size_t tag;
+};
+static_assert(sizeof(AllocHeader) == MEMORY_ALLOCATION_ALIGNMENT, "AllocHeader must keep blocks aligned");
+
+static AllocStats g_alloc_stats[ALLOC_NUM_TAGS];
+static const char* g_alloc_tag_names[ALLOC_NUM_TAGS] = { "Metadata", "Playlist", "Album art", "UI", "Audio" };
+
+
+// Adds bytes to the live bytes of tag (or takes them off if negative).  The counters are interlocked,
+// since the background threads allocate too.
+static void AddLiveBytes(AllocStats* stats, LONGLONG bytes)
+{
+	const LONGLONG live_bytes = InterlockedAdd64(&stats->live_bytes, bytes);
+	LONGLONG peak_bytes = stats->peak_bytes;
+	while (live_bytes > peak_bytes)
+	{
+		const LONGLONG prev = InterlockedCompareExchange64(&stats->peak_bytes, live_bytes, peak_bytes);
+		if (prev == peak_bytes)
+			break;
+		peak_bytes = prev;
+	}
+}
+
+
+// Counts an allocation of bytes under tag, or a free if bytes is negative
+void CountMemory(AllocTag tag, LONGLONG bytes)
+{
+	AllocStats* stats = &g_alloc_stats[tag];
+	AddLiveBytes(stats, bytes);
+	if (bytes < 0)
+		InterlockedIncrement64(&stats->num_frees);
+	else
+		InterlockedIncrement64(&stats->num_allocs);
+}
+
+
+// Allocates zeroed heap memory and counts it under tag.  Free it with FreeMemory().
+void* AllocMemory(AllocTag tag, size_t size)
+{
+	AllocHeader* header = (AllocHeader*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(AllocHeader) + size);
+	if (header == NULL)
+		return NULL;
+	header->size = size;
+	header->tag = tag;
+	CountMemory(tag, (LONGLONG)size);
+	return header + 1;
+}
+
+
+// Resizes a block from AllocMemory().  New bytes are zeroed.  Returns NULL if out of memory, and then
+// the old block is still valid.
+void* ReAllocMemory(void* ptr, size_t size)
+{
+	AllocHeader* header = (AllocHeader*)ptr - 1;
+	const size_t old_size = header->size;
+	const AllocTag tag = (AllocTag)header->tag;
+	header = (AllocHeader*)HeapReAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, header, sizeof(AllocHeader) + size);
+	if (header == NULL)
+		return NULL;
+	header->size = size;
+	AddLiveBytes(&g_alloc_stats[tag], (LONGLONG)size - (LONGLONG)old_size);
+	return header + 1;
+}
+
+
 // Allocates memory heap and returns a copy of the specified string.
 // Caller must free the heap memory when necessary.
 // (Similar to strdup() on Unix)
-char* DuplicateString(const char* str)
+char* DuplicateString(AllocTag tag, const char* str)
 {
 	if (str == NULL)
 		return NULL;
 
 	size_t len = lstrlen(str) + 1;
-	char* copy = (char*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, len);
+	char* copy = (char*)AllocMemory(tag, len);
 	if (copy)
 		memcpy(copy, str, len);
 	return copy;
 }
 
+
+// Frees a block from AllocMemory() or DuplicateString()
 void FreeMemory(void* ptr)
 {
 	if (ptr != NULL)
 	{
-		HeapFree(GetProcessHeap(), 0, ptr);
+		AllocHeader* header = (AllocHeader*)ptr - 1;
+		CountMemory((AllocTag)header->tag, -(LONGLONG)header->size);
+		HeapFree(GetProcessHeap(), 0, header);
+	}
+}
+
+
+void GetAllocStats(AllocStats stats[ALLOC_NUM_TAGS])
+{
+	for (int tag = 0; tag < ALLOC_NUM_TAGS; tag++)
+		stats[tag] = g_alloc_stats[tag];
+}
+
+
+// Puts a table of the allocation counters of every tag in buffer, one line per tag
+void FormatAllocStats(char* buffer, size_t buffer_size)
+{
+	StringCbCopyA(buffer, buffer_size, "Subsystem   Live KB   Peak KB    Allocs     Frees\r\n");
+	for (int tag = 0; tag < ALLOC_NUM_TAGS; tag++)
+	{
+		const AllocStats* stats = &g_alloc_stats[tag];
+		char line[128];
+		StringCbPrintfA(line, sizeof(line), "%-10s %8lld  %8lld  %8lld  %8lld\r\n", g_alloc_tag_names[tag],
+			stats->live_bytes / 1024, stats->peak_bytes / 1024, stats->num_allocs, stats->num_frees);
+		StringCbCatA(buffer, buffer_size, line);
+	}
+}
+
+
+// Writes FormatAllocStats() to a text file.  Returns false if the file can't be written.
+bool WriteAllocStatsFile(const char* path)
+{
+	HANDLE file = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	char text[ALLOC_STATS_TEXT_SIZE];
+	FormatAllocStats(text, sizeof(text));
+	DWORD bytes_written = 0;
+	const bool is_written = WriteFile(file, text, lstrlen(text), &bytes_written, NULL) != 0;
+	CloseHandle(file);
+	return is_written;
+}
+
+
+// Opens a file by its UTF-8 path
+HANDLE CreateFileUtf8(const char* path, DWORD access, DWORD share_mode, DWORD creation, DWORD flags)
+{
+	WCHAR wide_path[MAX_PATH];
+	const size_t path_len = lstrlen(path);
+	if (Utf8ToUtf16(path, path_len, wide_path, MAX_PATH) != Utf8ToUtf16(path, path_len, NULL, 0))
+	{
+		SetLastError(ERROR_FILENAME_EXCED_RANGE);
+		return INVALID_HANDLE_VALUE;
 	}
+	return CreateFileW(wide_path, access, share_mode, NULL, creation, flags, NULL);
+}
+
+
+// Converts text saved by an older version, or by another program, to UTF-8.  Text that is already
+// valid UTF-8 is copied as it is, and anything else is taken to be in the ANSI code page.
+void LegacyTextToUtf8(const char* text, char* buffer, size_t buffer_size)
+{
+	const size_t len = lstrlen(text);
+	if (IsValidUtf8(text, len))
+	{
+		StringCbCopyA(buffer, buffer_size, text);
+		return;
+	}
+
+	WCHAR wide_text[UI_TEXT_MAX];
+	const int wide_len = MultiByteToWideChar(CP_ACP, 0, text, (int)len, wide_text, UI_TEXT_MAX);
+	Utf16ToUtf8(wide_text, (wide_len > 0) ? wide_len : 0, buffer, buffer_size);
+}
+
+
+int DrawTextUtf8(HDC dc, const char* text, RECT* rect, UINT format)
+{
+	WCHAR wide_text[UI_TEXT_MAX];
+	const size_t wide_len = Utf8ToUtf16(text, lstrlen(text), wide_text, UI_TEXT_MAX);
+	return DrawTextW(dc, wide_text, (int)wide_len, rect, format);
+}
+
+
+void SetWindowTextUtf8(HWND hwnd, const char* text)
+{
+	WCHAR wide_text[UI_TEXT_MAX];
+	Utf8ToUtf16(text, lstrlen(text), wide_text, UI_TEXT_MAX);
+	SetWindowTextW(hwnd, wide_text);
+}
+
+
+void GetWindowTextUtf8(HWND hwnd, char* buffer, size_t buffer_size)
+{
+	WCHAR wide_text[UI_TEXT_MAX];
+	const int wide_len = GetWindowTextW(hwnd, wide_text, UI_TEXT_MAX);
+	Utf16ToUtf8(wide_text, wide_len, buffer, buffer_size);
+}
+
+
+int MessageBoxUtf8(HWND hwnd, const char* text, const char* caption, UINT type)
+{
+	WCHAR wide_text[UI_TEXT_MAX];
+	WCHAR wide_caption[UI_TEXT_MAX];
+	Utf8ToUtf16(text, lstrlen(text), wide_text, UI_TEXT_MAX);
+	Utf8ToUtf16(caption, lstrlen(caption), wide_caption, UI_TEXT_MAX);
+	return MessageBoxW(hwnd, wide_text, wide_caption, type);
+}
+
+
+BOOL AppendMenuUtf8(HMENU menu, UINT flags, UINT_PTR id, const char* text)
+{
+	WCHAR wide_text[UI_TEXT_MAX];
+	Utf8ToUtf16(text, lstrlen(text), wide_text, UI_TEXT_MAX);
+	return AppendMenuW(menu, flags, id, wide_text);
 }
 
 
@@ -30,15 +30,47 @@ SOFTWARE.
 
 #pragma once
 #include <Windows.h>
+#include "utf8.h"
+
+// Subsystems that heap memory is counted under.  Everything from AllocMemory() and DuplicateString() is
+// counted, and memory from VirtualAlloc() is added with CountMemory().
+enum AllocTag { ALLOC_METADATA, ALLOC_PLAYLIST, ALLOC_ART, ALLOC_UI, ALLOC_AUDIO, ALLOC_NUM_TAGS };
+
+struct AllocStats {
+	LONGLONG live_bytes;
+	LONGLONG peak_bytes;
+	LONGLONG num_allocs;
+	LONGLONG num_frees;
+};
+
+#define ALLOC_STATS_TEXT_SIZE	1024		// Enough for FormatAllocStats()
+
+// Paths and text are UTF-8 inside the player.  These are the sizes of the buffers they are converted
+// through at the Windows boundary.
+#define UTF8_MAX_PATH			(MAX_PATH * 3)	// A MAX_PATH path in UTF-8
+#define UI_TEXT_MAX				1024			// UTF-16 units of text shown in a control, menu, or message box
 
 HFONT GetFont(const char* font_name, int font_size, bool is_bold, bool is_italic, bool is_underline);
 void WINAPIV DebugOut(const TCHAR *fmt, ...);
 const char* GetFilenameExt(const char *filename);
 void InvalidateWindow(HWND hwnd);
-char* DuplicateString(const char* str);
+void* AllocMemory(AllocTag tag, size_t size);
+void* ReAllocMemory(void* ptr, size_t size);
+char* DuplicateString(AllocTag tag, const char* str);
 void FreeMemory(void* ptr);
+void CountMemory(AllocTag tag, LONGLONG bytes);
+void GetAllocStats(AllocStats stats[ALLOC_NUM_TAGS]);
+void FormatAllocStats(char* buffer, size_t buffer_size);
+bool WriteAllocStatsFile(const char* path);
 HBITMAP CreateBitmapMask(HBITMAP bitmap, COLORREF transparent_color);
 void PaintTransparentBitmap(HDC dc, HBITMAP bitmap, HBITMAP mask, COLORREF bg_color, int x, int y);
+HANDLE CreateFileUtf8(const char* path, DWORD access, DWORD share_mode, DWORD creation, DWORD flags);
+void LegacyTextToUtf8(const char* text, char* buffer, size_t buffer_size);
+int DrawTextUtf8(HDC dc, const char* text, RECT* rect, UINT format);
+void SetWindowTextUtf8(HWND hwnd, const char* text);
+void GetWindowTextUtf8(HWND hwnd, char* buffer, size_t buffer_size);
+int MessageBoxUtf8(HWND hwnd, const char* text, const char* caption, UINT type);
+BOOL AppendMenuUtf8(HMENU menu, UINT flags, UINT_PTR id, const char* text);
 void RemoveFilenameFromPath(char* file_name, size_t len);
 void GetFilenameFromPath(char* path, size_t path_buffer_len, char* file_name,
 	size_t file_name_buffer_len);
\ No newline at end of file
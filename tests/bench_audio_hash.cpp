@@ -0,0 +1,139 @@
+/******************************************************************************
+bench_audio_hash.cpp - Throughput of XXH64 and of hashing the audio of MP3 and Ogg files
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Times:
+//
+//   xxh64			hashing a buffer in memory
+//   mp3			HashAudioData() on an MP3 with ID3v2, APE, and ID3v1 tags
+//   ogg			HashAudioData() on an Ogg file of 4 KB pages, which also walks the pages
+//
+// The files are written to /tmp and read once before they are timed, so they come from the file
+// cache and the time is the hashing, not the disk.
+//
+//   build/bench_audio_hash [megabytes]
+
+#include "audio_hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+static unsigned char read_buffer[AUDIO_HASH_READ_SIZE];
+
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static void SaveFile(const char* path, const std::vector<unsigned char>& data)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL || fwrite(data.data(), 1, data.size(), file) != data.size())
+	{
+		fprintf(stderr, "Can't write %s\n", path);
+		exit(1);
+	}
+	fclose(file);
+}
+
+
+static void BenchFile(const char* name, const char* path, FileFormat format, size_t len)
+{
+	unsigned long long hash;
+	HashAudioData(path, format, read_buffer, &hash);		// Into the file cache
+	const int num_runs = 5;
+	auto start = std::chrono::steady_clock::now();
+	for (int run = 0; run < num_runs; run++)
+		HashAudioData(path, format, read_buffer, &hash);
+	const double ms = MillisecondsSince(start) / num_runs;
+	printf("%-6s %8.2f ms  %6.0f MB/s  %016llx\n", name, ms, len / (1024.0 * 1024.0) / (ms / 1000), hash);
+	unlink(path);
+}
+
+
+int main(int argc, char** argv)
+{
+	const size_t len = ((argc > 1) ? strtoul(argv[1], NULL, 10) : 256) * 1024 * 1024;
+	std::mt19937 random(12345);
+	std::vector<unsigned char> data(len);
+	for (size_t i = 0; i + 4 <= len; i += 4)
+	{
+		const unsigned int value = random();
+		memcpy(&data[i], &value, 4);
+	}
+	printf("%zu MB\n", len / (1024 * 1024));
+
+	unsigned long long hash = 0;
+	const int num_runs = 5;
+	auto start = std::chrono::steady_clock::now();
+	for (int run = 0; run < num_runs; run++)
+	{
+		XXH64State state;
+		XXH64Reset(&state, run);
+		XXH64Update(&state, data.data(), data.size());
+		hash ^= XXH64Digest(&state);
+	}
+	const double ms = MillisecondsSince(start) / num_runs;
+	printf("xxh64  %8.2f ms  %6.0f MB/s  %016llx\n", ms, len / (1024.0 * 1024.0) / (ms / 1000), hash);
+
+	// MP3:  a 64 KB ID3v2 tag, the frames, then an APE tag and an ID3v1 tag
+	std::vector<unsigned char> mp3 = { 'I', 'D', '3', 3, 0, 0, 0, 4, 0, 0 };
+	mp3.resize(ID3V2_HEADER_LEN + 0x10000);
+	mp3.insert(mp3.end(), data.begin(), data.end());
+	unsigned char ape_footer[32] = { 'A', 'P', 'E', 'T', 'A', 'G', 'E', 'X', 0xD0, 0x07, 0, 0, 32 };
+	mp3.insert(mp3.end(), ape_footer, ape_footer + sizeof(ape_footer));
+	unsigned char id3v1[128] = { 'T', 'A', 'G' };
+	mp3.insert(mp3.end(), id3v1, id3v1 + sizeof(id3v1));
+	SaveFile("/tmp/bench_audio_hash.mp3", mp3);
+	mp3 = std::vector<unsigned char>();
+	BenchFile("mp3", "/tmp/bench_audio_hash.mp3", MP3, len);
+
+	// Ogg:  pages of 16 segments of 255 bytes, with a granule position so none is a header page
+	std::vector<unsigned char> ogg;
+	ogg.reserve(len + len / 64);
+	const size_t body_len = 16 * 255;
+	for (size_t pos = 0; pos + body_len <= len; pos += body_len)
+	{
+		unsigned char header[27 + 16] = { 'O', 'g', 'g', 'S', 0, 0, 1 };
+		header[26] = 16;
+		memset(header + 27, 255, 16);
+		ogg.insert(ogg.end(), header, header + sizeof(header));
+		ogg.insert(ogg.end(), data.begin() + pos, data.begin() + pos + body_len);
+	}
+	SaveFile("/tmp/bench_audio_hash.ogg", ogg);
+	ogg = std::vector<unsigned char>();
+	BenchFile("ogg", "/tmp/bench_audio_hash.ogg", OGG, len);
+	return 0;
+}
@@ -0,0 +1,183 @@
+/******************************************************************************
+bench_collate.cpp - Time to sort a large playlist by a column
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Makes synthetic songs (albums of numbered tracks by a few thousand artists, in random order) and 
+// times the keys SortPlaylist() builds for the album sort and for the title sort:
+//
+//   keys			building the collation key of every song
+//   sort			sorting by the keys, ascending and then descending
+//   stable_sort	std::stable_sort() calling memcmp() on the same keys, for comparison
+//
+//   build/bench_collate [num_songs]
+
+#include "collate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Entry {
+	std::string artist;
+	std::string album;
+	std::string title;
+	std::string file_name;
+	unsigned int disc;
+	unsigned int track;
+};
+
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// Random words made of syllables, capitalized now and then
+static std::string RandomWords(std::mt19937& random, int max_words)
+{
+	static const char* const syllables[] = { "ba", "be", "ca", "da", "el", "fo", "ga", "he", "in", "jo",
+		"ka", "la", "me", "no", "or", "pa", "qu", "ri", "so", "tu", "ve", "wa", "xi", "yo", "ze", "st", "th" };
+	std::string words;
+	for (int i = 0, num_words = 1 + random() % max_words; i < num_words; i++)
+	{
+		if (i)
+			words += ' ';
+		const size_t word_start = words.size();
+		for (int j = 0, len = 1 + random() % 3; j < len; j++)
+			words += syllables[random() % (sizeof(syllables) / sizeof(syllables[0]))];
+		if (random() % 2 == 0)
+			words[word_start] -= 'a' - 'A';
+	}
+	return words;
+}
+
+
+static void BuildKeys(CollationKeys* keys, const std::vector<Entry>& entries, bool by_album)
+{
+	CollationKeysBegin(keys, entries.size());
+	for (const Entry& entry : entries)
+	{
+		CollationKeysNext(keys);
+		if (by_album)
+		{
+			AppendCollationText(keys, entry.album.c_str());
+			AppendCollationNumber(keys, entry.disc);
+			AppendCollationNumber(keys, entry.track);
+			AppendCollationText(keys, entry.artist.c_str());
+			AppendCollationText(keys, entry.title.c_str());
+		}
+		else
+		{
+			AppendCollationText(keys, entry.title.c_str());
+			AppendCollationText(keys, entry.artist.c_str());
+			AppendCollationText(keys, entry.album.c_str());
+		}
+		AppendCollationText(keys, entry.file_name.c_str());
+	}
+	CollationKeysEnd(keys);
+}
+
+
+static void Bench(const char* name, const std::vector<Entry>& entries, bool by_album)
+{
+	CollationKeys keys;
+	auto start = std::chrono::steady_clock::now();
+	BuildKeys(&keys, entries, by_album);
+	const double keys_ms = MillisecondsSince(start);
+
+	std::vector<unsigned int> order(entries.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	start = std::chrono::steady_clock::now();
+	SortByCollationKeys(&keys, false, order);
+	const double ascending_ms = MillisecondsSince(start);
+
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	start = std::chrono::steady_clock::now();
+	SortByCollationKeys(&keys, true, order);
+	const double descending_ms = MillisecondsSince(start);
+
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	const char* buffer = keys.buffer.data();
+	const size_t* offsets = keys.offsets.data();
+	start = std::chrono::steady_clock::now();
+	std::stable_sort(order.begin(), order.end(), [buffer, offsets](unsigned int a, unsigned int b) {
+		const size_t a_len = offsets[a + 1] - offsets[a];
+		const size_t b_len = offsets[b + 1] - offsets[b];
+		const int result = memcmp(buffer + offsets[a], buffer + offsets[b], std::min(a_len, b_len));
+		return result ? (result < 0) : (a_len < b_len);
+	});
+	const double stable_sort_ms = MillisecondsSince(start);
+
+	printf("%-6s keys %7.2f ms  sort %7.2f ms  descending %7.2f ms  stable_sort %7.2f ms\n", name, keys_ms, 
+		ascending_ms, descending_ms, stable_sort_ms);
+}
+
+
+int main(int argc, char** argv)
+{
+	const size_t num_songs = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200000;
+	std::mt19937 random(12345);
+	std::vector<std::string> artists(num_songs / 60 + 1);
+	for (std::string& artist : artists)
+		artist = RandomWords(random, 3);
+
+	std::vector<Entry> entries;
+	entries.reserve(num_songs);
+	while (entries.size() < num_songs)
+	{
+		const std::string artist = artists[random() % artists.size()];
+		const std::string album = RandomWords(random, 4);
+		const unsigned int num_discs = (random() % 10 == 0) ? 2 : 1;
+		for (unsigned int disc = 1; disc <= num_discs; disc++)
+		{
+			for (unsigned int track = 1, num_tracks = 8 + random() % 8; track <= num_tracks; track++)
+			{
+				Entry entry = { artist, album, RandomWords(random, 5), "", disc, track };
+				entry.file_name = "C:\\Music\\" + artist + "\\" + album + "\\" + std::to_string(track) + " " + 
+					entry.title + ".mp3";
+				entries.push_back(entry);
+			}
+		}
+	}
+	entries.resize(num_songs);
+	std::shuffle(entries.begin(), entries.end(), random);
+	printf("%zu songs\n", num_songs);
+
+	Bench("album", entries, true);
+	Bench("title", entries, false);
+	return 0;
+}
@@ -0,0 +1,130 @@
+/******************************************************************************
+bench_crossfade.cpp - Benchmark of the CPU used by crossfades
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Times, in nanoseconds per stereo frame at 44.1 kHz:
+//
+//   mix			MixCrossfade() on its own, with SSE2 and with the plain loop
+//   playback		the output stream's callback playing one song, and in the middle of a 12 second
+//					crossfade, where two decoders are read and mixed.  The fake decoders make their
+//					samples cheaply, so this is the player's own cost; real decoding comes on top.
+//
+//   build/bench_crossfade [seconds]
+
+#define NOMINMAX
+#include "player.h"
+#include "fake_bass.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+namespace scalar {
+#define MIXER_NO_SSE2
+#include "mixer.cpp"
+#undef MIXER_NO_SSE2
+}
+
+static double NanosecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static void BenchMix(unsigned int num_frames)
+{
+	const unsigned int block_frames = PLAYER_MIX_BUFFER_LEN / FAKE_CHANS;
+	std::vector<float> from(PLAYER_MIX_BUFFER_LEN, 0.25f);
+	std::vector<float> to(PLAYER_MIX_BUFFER_LEN, -0.5f);
+	std::vector<float> out(PLAYER_MIX_BUFFER_LEN);
+	for (CrossfadeCurve curve : { CROSSFADE_EQUAL_POWER, CROSSFADE_LINEAR })
+	{
+		const char* curve_name = (curve == CROSSFADE_LINEAR) ? "linear" : "equal power";
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int pos = 0; pos < num_frames; pos += block_frames)
+			MixCrossfade(out.data(), from.data(), to.data(), block_frames, FAKE_CHANS, pos, num_frames, curve);
+		printf("mix %-12s SSE2  %6.2f ns/frame\n", curve_name, NanosecondsSince(start) / num_frames);
+
+		start = std::chrono::steady_clock::now();
+		for (unsigned int pos = 0; pos < num_frames; pos += block_frames)
+			scalar::MixCrossfade(out.data(), from.data(), to.data(), block_frames, FAKE_CHANS, pos, num_frames, curve);
+		printf("mix %-12s plain %6.2f ns/frame\n", curve_name, NanosecondsSince(start) / num_frames);
+	}
+}
+
+
+// Reads num_frames from the output stream the way BASS does, one update at a time
+static double TimeStream(Player* player, unsigned int num_frames)
+{
+	float block[FAKE_UPDATE_FRAMES * FAKE_CHANS];
+	const unsigned int num_blocks = num_frames / FAKE_UPDATE_FRAMES;
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < num_blocks; i++)
+		NullDeviceRead(player->stream, block, sizeof(block));
+	return NanosecondsSince(start) / (num_blocks * FAKE_UPDATE_FRAMES);
+}
+
+
+static void BenchPlayback(unsigned int num_frames)
+{
+	Player player = {};
+	PlayerInit(&player);
+	const QWORD song_len = num_frames * 3;
+
+	PlayerSetCrossfade(&player, 0, CROSSFADE_LINEAR);
+	PlayerLoad(&player, CreateFakeDecoder(0, song_len), NULL);
+	printf("playback one song    %6.2f ns/frame\n", TimeStream(&player, num_frames));
+	PlayerUnload(&player);
+
+	for (CrossfadeCurve curve : { CROSSFADE_EQUAL_POWER, CROSSFADE_LINEAR })
+	{
+		PlayerSetCrossfade(&player, PLAYER_MAX_CROSSFADE_MS, curve);
+		PlayerLoad(&player, CreateFakeDecoder(0, song_len), NULL);
+		TimeStream(&player, FAKE_FREQ);
+		PlayerCrossfadeTo(&player, CreateFakeDecoder(song_len, song_len), NULL);
+		// The fade is PLAYER_MAX_CROSSFADE_MS long, so only time what fits in it
+		const unsigned int fade_frames = std::min(num_frames, (unsigned int)(PLAYER_MAX_CROSSFADE_MS / 1000 * FAKE_FREQ));
+		printf("playback %-11s %6.2f ns/frame over %.1f s of fade\n", (curve == CROSSFADE_LINEAR) ? "linear" : "equal power",
+			TimeStream(&player, fade_frames), (double)fade_frames / FAKE_FREQ);
+		PlayerUnload(&player);
+	}
+	PlayerFree(&player);
+}
+
+
+int main(int argc, char** argv)
+{
+	const double seconds = (argc > 1) ? atof(argv[1]) : 12.0;
+	const unsigned int num_frames = (unsigned int)(seconds * FAKE_FREQ);
+	SetFakeSignalCheap(true);
+	printf("%.1f s of stereo audio at %d Hz\n", seconds, FAKE_FREQ);
+	BenchMix(num_frames * 20);
+	BenchPlayback(num_frames);
+	return 0;
+}
@@ -0,0 +1,159 @@
+/******************************************************************************
+bench_fuzzy.cpp - Time per keystroke of the playlist search, and of editing a filtered playlist
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Builds a search index of synthetic songs (song name, album, and folder, as BuildSearchIndex()
+// does) and times:
+//
+//   index			building the index from scratch, which the program does once per playlist
+//   keystroke		each search as a query is typed one character at a time
+//   edit			appending or deleting songs while the filter is on, then searching again, 
+//					compared with building the index again and searching
+//
+//   build/bench_fuzzy [num_songs]
+
+#include "fuzzy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Entry {
+	std::string song_name;
+	std::string album;
+	std::string folder;
+};
+
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static void AddEntry(FuzzyMatcher* matcher, const Entry& entry)
+{
+	FuzzyMatcherNext(matcher);
+	FuzzyMatcherAppendField(matcher, entry.song_name.c_str());
+	FuzzyMatcherAppendField(matcher, entry.album.c_str());
+	FuzzyMatcherAppendField(matcher, entry.folder.c_str());
+}
+
+
+static void BuildIndex(FuzzyMatcher* matcher, const std::vector<Entry>& entries)
+{
+	FuzzyMatcherBegin(matcher, entries.size());
+	for (const Entry& entry : entries)
+		AddEntry(matcher, entry);
+}
+
+
+// Random words made of syllables, so the letters are spread about as they are in real titles
+static std::string RandomWords(std::mt19937& random, int max_words)
+{
+	static const char* const syllables[] = { "ba", "be", "ca", "da", "el", "fo", "ga", "he", "in", "jo",
+		"ka", "la", "me", "no", "or", "pa", "qu", "ri", "so", "tu", "ve", "wa", "xi", "yo", "ze", "st", "th" };
+	std::string words;
+	for (int i = 0, num_words = 1 + random() % max_words; i < num_words; i++)
+	{
+		if (i)
+			words += ' ';
+		for (int j = 0, len = 1 + random() % 3; j < len; j++)
+			words += syllables[random() % (sizeof(syllables) / sizeof(syllables[0]))];
+		if (random() % 4 == 0)
+			words[words.size() - 1] -= 'a' - 'A';
+	}
+	return words;
+}
+
+
+int main(int argc, char** argv)
+{
+	const size_t num_songs = (argc > 1) ? strtoul(argv[1], NULL, 10) : 500000;
+	std::mt19937 random(12345);
+	std::vector<Entry> entries(num_songs);
+	for (Entry& entry : entries)
+	{
+		entry.song_name = RandomWords(random, 4);
+		entry.album = RandomWords(random, 3);
+		entry.folder = "C:\\Music\\" + RandomWords(random, 2) + "\\" + entry.album;
+	}
+	printf("%zu songs\n", num_songs);
+
+	FuzzyMatcher* matcher = FuzzyMatcherCreate();
+	auto start = std::chrono::steady_clock::now();
+	BuildIndex(matcher, entries);
+	printf("index              %8.2f ms\n", MillisecondsSince(start));
+
+	const char* const query = "the bat";
+	for (size_t len = 1; len <= strlen(query); len++)
+	{
+		const std::string typed(query, len);
+		start = std::chrono::steady_clock::now();
+		const size_t num_results = FuzzyMatcherSearch(matcher, typed.c_str()).size();
+		printf("keystroke %-8s %8.2f ms  %zu results\n", ("\"" + typed + "\"").c_str(), MillisecondsSince(start), 
+			num_results);
+	}
+
+	// Add 100 songs and search again with the same query, as UpdatePlaylistWindow() does.  The
+	// text buffer grows now and then, so this is the average of 10 times.
+	std::vector<Entry> added(1000);
+	for (Entry& entry : added)
+		entry.song_name = RandomWords(random, 4);
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < added.size(); i += 100)
+	{
+		for (size_t j = i; j < i + 100; j++)
+			AddEntry(matcher, added[j]);
+		FuzzyMatcherSearch(matcher, query);
+	}
+	printf("append 100 + search %7.2f ms\n", MillisecondsSince(start) / 10);
+
+	// Delete 100 songs spread through the playlist
+	std::vector<unsigned int> positions(100);
+	for (unsigned int i = 0; i < positions.size(); i++)
+		positions[i] = i * (num_songs / positions.size());
+	start = std::chrono::steady_clock::now();
+	FuzzyMatcherRemove(matcher, positions.data(), positions.size());
+	FuzzyMatcherSearch(matcher, query);
+	printf("delete 100 + search %7.2f ms\n", MillisecondsSince(start));
+
+	// What every edit cost when the index was built again each time
+	entries.insert(entries.end(), added.begin(), added.end());
+	start = std::chrono::steady_clock::now();
+	BuildIndex(matcher, entries);
+	FuzzyMatcherSearch(matcher, query);
+	printf("rebuild + search   %8.2f ms\n", MillisecondsSince(start));
+
+	FuzzyMatcherFree(matcher);
+	return 0;
+}
@@ -0,0 +1,150 @@
+/******************************************************************************
+bench_library_index.cpp - Time of keeping the library index up to date
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Makes synthetic songs (albums of numbered tracks by a few thousand artists) and times the
+// library index as a playlist is loaded, edited, and emptied:
+//
+//   add		LibraryIndexUpdate() of every song, as when a playlist is loaded
+//   update		LibraryIndexUpdate() of every song again after its length changed
+//   remove		LibraryIndexRemove() of every song, in random order
+//   clear		LibraryIndexClear() of a full index
+//
+// Then songs are replaced one at a time with songs by new artists, as when a playlist is refilled,
+// and the artist pool is shown to stay the size of the playlist.
+//
+//   build/bench_library_index [num_songs]
+
+#define NOMINMAX
+#include "library_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static bool SetTags(Song* song, const char* artist, unsigned int album, unsigned int track)
+{
+	char album_name[32], track_num[8], date[8];
+	snprintf(album_name, sizeof(album_name), "Album %u", album);
+	snprintf(track_num, sizeof(track_num), "%u/12", track);
+	snprintf(date, sizeof(date), "%u", 1950 + album % 75);
+	SongDetails details = {};
+	details.metadata.artist = (char*)artist;
+	details.metadata.album = album_name;
+	details.metadata.genre = (char*)"Rock";
+	details.metadata.track_num = track_num;
+	details.metadata.date = date;
+	details.bitrate = 320;
+	song->song_length_secs = 200 + track;
+	return SongSetDetails(song, &details, NULL, false);
+}
+
+
+int main(int argc, char** argv)
+{
+	const unsigned int num_songs = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+	std::mt19937 random(12345);
+
+	std::vector<std::string> artists(3000);
+	for (size_t i = 0; i < artists.size(); i++)
+		artists[i] = "Artist " + std::to_string(i);
+	std::vector<Song*> songs(num_songs);
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		songs[i] = SongCreate();
+		if (!songs[i] || !SetTags(songs[i], artists[(i / 12) % artists.size()].c_str(), i / 12, i % 12 + 1))
+		{
+			printf("Out of memory\n");
+			return 1;
+		}
+	}
+	std::shuffle(songs.begin(), songs.end(), random);
+
+	LibraryIndex* index = LibraryIndexCreate();
+	auto start = std::chrono::steady_clock::now();
+	for (Song* song : songs)
+		LibraryIndexUpdate(index, song);
+	const double add_ms = MillisecondsSince(start);
+
+	// The exact lengths are found as the songs are played
+	for (Song* song : songs)
+		song->song_length_secs++;
+	start = std::chrono::steady_clock::now();
+	for (Song* song : songs)
+		LibraryIndexUpdate(index, song);
+	const double update_ms = MillisecondsSince(start);
+
+	std::shuffle(songs.begin(), songs.end(), random);
+	start = std::chrono::steady_clock::now();
+	for (Song* song : songs)
+		LibraryIndexRemove(index, song);
+	const double remove_ms = MillisecondsSince(start);
+
+	for (Song* song : songs)
+		LibraryIndexUpdate(index, song);
+	start = std::chrono::steady_clock::now();
+	LibraryIndexClear(index);
+	const double clear_ms = MillisecondsSince(start);
+
+	printf("%u songs\n", num_songs);
+	printf("add     %8.1f ms\n", add_ms);
+	printf("update  %8.1f ms\n", update_ms);
+	printf("remove  %8.1f ms\n", remove_ms);
+	printf("clear   %8.1f ms\n", clear_ms);
+
+	// A playlist of 10,000 songs whose songs are replaced num_songs times by songs with new artists
+	const unsigned int playlist_size = (num_songs < 10000) ? num_songs : 10000;
+	for (unsigned int i = 0; i < playlist_size; i++)
+		LibraryIndexUpdate(index, songs[i]);
+	start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		Song* song = songs[i % playlist_size];
+		LibraryIndexRemove(index, song);
+		const std::string artist = "New Artist " + std::to_string(i);
+		SetTags(song, artist.c_str(), i, 1);
+		LibraryIndexUpdate(index, song);
+	}
+	printf("\n%u replaced songs in a playlist of %u:  %.1f ms, %zu artist ids, %zu album ids\n", num_songs, playlist_size,
+		MillisecondsSince(start), index->artists.names.size(), index->albums.names.size());
+
+	LibraryIndexFree(index);
+	for (Song* song : songs)
+		FreeSong(song);
+	return 0;
+}
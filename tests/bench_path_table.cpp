@@ -0,0 +1,156 @@
+/******************************************************************************
+bench_path_table.cpp - Memory used by song paths, with and without the path table
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Stores the paths of a synthetic library (10,000 artists, 5 albums each, 20 tracks per album, in
+// C:\Users\listener\Music\Artist\Album\Track - Artist - Title.mp3) the way songs stored them before
+// the path table and the way they do now:
+//
+//   before			each song has its own copy of its full path and of its file name
+//   after			each song has a directory id in the path table and its own file name
+//
+// For each, it prints the heap used by the paths, the resident size of the process, and the time
+// to add every path and to put every full path back together.  Each way runs in its own process, 
+// so the resident sizes don't include the other.  The heap is measured with glibc's mallinfo2().
+//
+//   build/bench_path_table [num_songs]
+
+#include "path_table.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static char* CopyString(const char* str)
+{
+	const size_t size = strlen(str) + 1;
+	char* copy = (char*)malloc(size);
+	memcpy(copy, str, size);
+	return copy;
+}
+
+
+static double ResidentMegabytes(void)
+{
+	FILE* file = fopen("/proc/self/status", "r");
+	if (file == NULL)
+		return 0;
+	char line[256];
+	double kilobytes = 0;
+	while (fgets(line, sizeof(line), file))
+	{
+		if (!strncmp(line, "VmRSS:", 6))
+			kilobytes = strtod(line + 6, NULL);
+	}
+	fclose(file);
+	return kilobytes / 1024;
+}
+
+
+static void MakePath(unsigned int song_num, char* path, size_t path_size)
+{
+	const unsigned int track = song_num % 20;
+	const unsigned int album = (song_num / 20) % 5;
+	const unsigned int artist = song_num / 100;
+	snprintf(path, path_size, "C:\\Users\\listener\\Music\\Artist Name %04u\\Album Title %02u (%u)\\"
+		"%02u - Artist Name %04u - Song Title %u.mp3", artist, album, 1990 + album, track + 1, artist, song_num);
+}
+
+
+static void Bench(bool use_table, unsigned int num_songs)
+{
+	std::vector<char*> file_names(num_songs);
+	std::vector<char*> paths(use_table ? 0 : num_songs);
+	std::vector<unsigned int> dir_ids(use_table ? num_songs : 0);
+	const size_t heap_start = mallinfo2().uordblks;
+
+	char path[260];
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		MakePath(i, path, sizeof(path));
+		if (use_table)
+		{
+			const char* file_name;
+			dir_ids[i] = PathTableAddPath(path, &file_name);
+			file_names[i] = CopyString(file_name);
+		}
+		else
+		{
+			paths[i] = CopyString(path);
+			file_names[i] = CopyString(strrchr(path, '\\') + 1);
+		}
+	}
+	const double add_ms = MillisecondsSince(start);
+	const double heap_mb = (mallinfo2().uordblks - heap_start) / (1024.0 * 1024.0);
+
+	size_t total_len = 0;
+	start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		if (use_table)
+			PathTableGetPath(dir_ids[i], file_names[i], path, sizeof(path));
+		else
+			strcpy(path, paths[i]);
+		total_len += strlen(path);
+	}
+	const double get_ms = MillisecondsSince(start);
+
+	printf("%-6s  %7.1f MB of path heap  %5.0f MB resident  add %7.1f ms  get path %6.1f ms  (%zu bytes)\n", 
+		use_table ? "after" : "before", heap_mb, ResidentMegabytes(), add_ms, get_ms, total_len);
+}
+
+
+int main(int argc, char** argv)
+{
+	const unsigned int num_songs = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+	printf("%u songs\n", num_songs);
+	fflush(stdout);
+	for (bool use_table : { false, true })
+	{
+		const pid_t pid = fork();
+		if (pid == 0)
+		{
+			Bench(use_table, num_songs);
+			exit(0);
+		}
+		waitpid(pid, NULL, 0);
+	}
+	return 0;
+}
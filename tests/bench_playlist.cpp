@@ -0,0 +1,131 @@
+/******************************************************************************
+bench_playlist.cpp - Time of the playlist lookups that playing the next song does
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// For playlists of 1,000 to 1,000,000 songs, times:
+//
+//   index of		PlaylistIndexOf() of a random node, e.g. the row of the current song
+//   node at		PlaylistNodeAt() of a random index
+//   next			choosing the next song in order, as FindNextSong() and TakeNextSong() do:  the index
+//					of the current node, then the node after it
+//   next shuffled	choosing the next song in the shuffle order:  ShuffleFindNext(), the index of its
+//					node, then ShuffleMoveTo()
+//   length before	PlaylistLengthBefore() of a random index, i.e. the time until that song plays
+//
+// Each is the average of 1,000,000 calls, in nanoseconds.
+//
+//   build/bench_playlist [max_songs]
+
+#include "playlist.h"
+#include "shuffle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+static double NanosecondsSince(std::chrono::steady_clock::time_point start, unsigned int num_calls)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / num_calls;
+}
+
+
+static void Bench(unsigned int num_songs)
+{
+	const unsigned int num_calls = 1000000;
+	std::mt19937 random(12345);
+	std::vector<Song> songs(num_songs);
+	Playlist playlist = {};
+	std::vector<PlaylistNode*> nodes(num_songs);
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		songs[i].song_length_secs = 120 + random() % 300;
+		nodes[i] = PlaylistPushBack(&playlist, &songs[i]);
+	}
+	const double build_ns = NanosecondsSince(start, num_songs);
+
+	std::vector<unsigned int> indexes(num_calls);
+	for (unsigned int& idx : indexes)
+		idx = random() % num_songs;
+	unsigned long long sum = 0;
+
+	start = std::chrono::steady_clock::now();
+	for (unsigned int idx : indexes)
+		sum += PlaylistIndexOf(nodes[idx]);
+	const double index_of_ns = NanosecondsSince(start, num_calls);
+
+	start = std::chrono::steady_clock::now();
+	for (unsigned int idx : indexes)
+		sum += (size_t)PlaylistNodeAt(&playlist, idx);
+	const double node_at_ns = NanosecondsSince(start, num_calls);
+
+	// Play through the playlist from a random song, with repeat on
+	PlaylistNode* curr_node = nodes[indexes[0]];
+	start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < num_calls; i++)
+	{
+		const unsigned int curr_idx = PlaylistIndexOf(curr_node);
+		curr_node = PlaylistNodeAt(&playlist, (curr_idx + 1 < num_songs) ? curr_idx + 1 : 0);
+	}
+	const double next_ns = NanosecondsSince(start, num_calls);
+	sum += (size_t)curr_node;
+
+	// The shuffle order numbers the songs in the order they were added, which is nodes[]
+	ShuffleOrder shuffle = {};
+	ShuffleReset(&shuffle, 0x5EED, num_songs, indexes[0]);
+	start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < num_calls; i++)
+	{
+		ShufflePosition position;
+		const int ordinal = ShuffleFindNext(&shuffle, true, &position);
+		sum += PlaylistIndexOf(nodes[ordinal]);
+		ShuffleMoveTo(&shuffle, &position);
+	}
+	const double next_shuffled_ns = NanosecondsSince(start, num_calls);
+
+	start = std::chrono::steady_clock::now();
+	for (unsigned int idx : indexes)
+		sum += PlaylistLengthBefore(&playlist, idx);
+	const double length_before_ns = NanosecondsSince(start, num_calls);
+
+	printf("%9u %9.0f %9.0f %9.0f %9.0f %9.0f %9.0f   %llu\n", num_songs, build_ns, index_of_ns, node_at_ns, next_ns, 
+		next_shuffled_ns, length_before_ns, sum % 10);
+	PlaylistClear(&playlist);
+}
+
+
+int main(int argc, char** argv)
+{
+	const unsigned int max_songs = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+	printf("    songs    append  index of   node at      next  shuffled    length   (ns per call)\n");
+	for (unsigned int num_songs = 1000; num_songs <= max_songs; num_songs *= 10)
+		Bench(num_songs);
+	return 0;
+}
@@ -0,0 +1,158 @@
+/******************************************************************************
+bench_playlist_file.cpp - Time and memory of reading big playlist files
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Writes a playlist of each format to /tmp with PlaylistFileWriter (paths in a few thousand album
+// directories, with titles and lengths), then reads it back 64KB at a time, as Winphonic reads
+// a playlist file, and shows:
+//
+//   write		writing the file
+//   read		reading every entry
+//   peak RSS	the most memory the process has used so far, which stays the same however big the
+//				files are, since neither the writer nor the reader keeps more than a chunk and a line
+//
+//   build/bench_playlist_file [megabytes_per_file]
+
+#include "playlist_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+#define READ_CHUNK_SIZE		(64 * 1024)
+
+struct ReadTotals {
+	unsigned long long num_entries;
+	unsigned long long path_bytes;
+};
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static double PeakRssMB(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+}
+
+
+static bool WriteToFile(void* context, const char* data, size_t len)
+{
+	return fwrite(data, 1, len, (FILE*)context) == len;
+}
+
+
+static void CountEntry(void* context, const PlaylistFileEntry* entry)
+{
+	ReadTotals* totals = (ReadTotals*)context;
+	totals->num_entries++;
+	totals->path_bytes += strlen(entry->path);
+}
+
+
+int main(int argc, char** argv)
+{
+	const unsigned long long file_size = ((argc > 1) ? strtoull(argv[1], NULL, 10) : 300) * 1000000ULL;
+	const struct {
+		PlaylistFileFormat format;
+		const char* path;
+	} formats[] = {
+		{ PLAYLIST_FORMAT_M3U8, "/tmp/bench_playlist_file.m3u8" },
+		{ PLAYLIST_FORMAT_PLS, "/tmp/bench_playlist_file.pls" },
+		{ PLAYLIST_FORMAT_XSPF, "/tmp/bench_playlist_file.xspf" },
+	};
+	std::vector<char> chunk(READ_CHUNK_SIZE);
+
+	printf("format       MB    entries    write ms     read ms    read MB/s   peak RSS MB\n");
+	for (const auto& format : formats)
+	{
+		FILE* file = fopen(format.path, "wb");
+		if (!file)
+		{
+			printf("Couldn't write %s\n", format.path);
+			return 1;
+		}
+		PlaylistFileWriter writer;
+		PlaylistFileWriterBegin(&writer, format.format, WriteToFile, file);
+		auto start = std::chrono::steady_clock::now();
+		unsigned long long num_written = 0;
+		char path[256], title[128];
+		while ((unsigned long long)ftell(file) < file_size)
+		{
+			const unsigned int album = (unsigned int)(num_written / 12);
+			snprintf(path, sizeof(path), "D:\\Music\\Artist %u\\Album %u\\%02u Song & Dance.mp3", album % 3000, album,
+				(unsigned int)(num_written % 12) + 1);
+			snprintf(title, sizeof(title), "Artist %u - Song %llu", album % 3000, num_written);
+			PlaylistFileWriteEntry(&writer, path, title, 180 + (int)(num_written % 120));
+			num_written++;
+		}
+		const bool is_written = PlaylistFileWriterEnd(&writer);
+		fclose(file);
+		const double write_ms = MillisecondsSince(start);
+		if (!is_written)
+		{
+			printf("Couldn't write %s\n", format.path);
+			return 1;
+		}
+
+		file = fopen(format.path, "rb");
+		ReadTotals totals = {};
+		PlaylistFileReader reader;
+		unsigned long long num_bytes = 0;
+		start = std::chrono::steady_clock::now();
+		PlaylistFileReaderBegin(&reader, format.format, "D:\\Lists\\big.m3u8", CountEntry, &totals);
+		size_t len;
+		while ((len = fread(chunk.data(), 1, chunk.size(), file)) > 0)
+		{
+			PlaylistFileReaderFeed(&reader, chunk.data(), len);
+			num_bytes += len;
+		}
+		PlaylistFileReaderEnd(&reader);
+		const double read_ms = MillisecondsSince(start);
+		fclose(file);
+		unlink(format.path);
+		if (totals.num_entries != num_written)
+		{
+			printf("Wrote %llu entries, but read %llu\n", num_written, totals.num_entries);
+			return 1;
+		}
+
+		const char* const names[] = { "", "M3U", "M3U8", "PLS", "XSPF" };
+		printf("%-6s %8.0f %10llu %11.0f %11.0f %12.0f %13.1f\n", names[format.format], num_bytes / 1e6, totals.num_entries,
+			write_ms, read_ms, num_bytes / 1e6 / (read_ms / 1000), PeakRssMB());
+	}
+	return 0;
+}
@@ -0,0 +1,151 @@
+/******************************************************************************
+bench_query.cpp - Time of the smart playlist queries over a large library
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Makes synthetic songs (albums by a few thousand artists, with a few dozen genres), adds them to
+// a LibraryIndex, and times a few typical queries:
+//
+//   evaluate	QueryEvaluate() over every row, as when a smart playlist is created
+//   per row	QueryMatchesRow() on every row, for comparison
+//   update		keeping a smart playlist up to date through LibraryIndexUpdate() of single rows,
+//				per 1,000 updates
+//
+//   build/bench_query [num_songs]
+
+#define NOMINMAX
+#include "query.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char** argv)
+{
+	const unsigned int num_songs = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+	std::mt19937 random(12345);
+
+	std::vector<std::string> artists(3000), genres(40);
+	for (size_t i = 0; i < artists.size(); i++)
+		artists[i] = "Artist " + std::to_string(i);
+	for (size_t i = 0; i < genres.size(); i++)
+		genres[i] = "Genre " + std::to_string(i);
+	genres[0] = "Jazz";
+
+	std::vector<Song*> songs(num_songs);
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		char album[32], date[16];
+		snprintf(album, sizeof(album), "Album %u", (unsigned int)(random() % 50000));
+		snprintf(date, sizeof(date), "%u-01-01", 1950 + (unsigned int)(random() % 75));
+		SongDetails details = {};
+		details.metadata.artist = (char*)artists[random() % artists.size()].c_str();
+		details.metadata.album = album;
+		details.metadata.genre = (char*)genres[random() % genres.size()].c_str();
+		details.metadata.date = date;
+		details.bitrate = (random() % 2) ? 320 : 192;
+		songs[i] = SongCreate();
+		if (!songs[i] || !SongSetDetails(songs[i], &details, NULL, false))
+		{
+			printf("Out of memory\n");
+			return 1;
+		}
+		songs[i]->song_length_secs = 60 + random() % 600;
+	}
+
+	LibraryIndex* index = LibraryIndexCreate();
+	auto start = std::chrono::steady_clock::now();
+	for (Song* song : songs)
+		LibraryIndexUpdate(index, song);
+	printf("%u songs, indexed in %.1f ms\n\n", num_songs, MillisecondsSince(start));
+
+	const char* const queries[] = {
+		"genre = Jazz",
+		"genre = Jazz and year >= 1990 and duration < 8:00",
+		"(artist = \"Artist 7\" or artist = \"Artist 42\") and not bitrate < 256",
+		"year < 1960 or year >= 2020 or duration > 9:00 and not genre = \"Genre 3\"",
+	};
+	printf("  members  evaluate   per row    update   (ms)   query\n");
+	for (const char* query : queries)
+	{
+		QueryProgram program;
+		char error[QUERY_MAX_ERROR_LEN];
+		if (!QueryCompile(query, &program, error, sizeof(error)))
+		{
+			printf("%s: %s\n", query, error);
+			return 1;
+		}
+		std::vector<unsigned int> string_ids;
+		QueryResolveStrings(&program, index, string_ids);
+
+		std::vector<unsigned long long> row_bits;
+		start = std::chrono::steady_clock::now();
+		QueryEvaluate(&program, index, string_ids, row_bits);
+		const double evaluate_ms = MillisecondsSince(start);
+		unsigned int num_members = 0;
+		for (unsigned long long bits : row_bits)
+			num_members += __builtin_popcountll(bits);
+
+		unsigned int num_row_members = 0;
+		start = std::chrono::steady_clock::now();
+		for (unsigned int row = 0; row < num_songs; row++)
+			num_row_members += QueryMatchesRow(&program, index, string_ids, row);
+		const double per_row_ms = MillisecondsSince(start);
+		if (num_row_members != num_members)
+		{
+			printf("%s: QueryEvaluate() found %u members, but QueryMatchesRow() found %u\n", query, num_members, num_row_members);
+			return 1;
+		}
+
+		SmartPlaylist* playlist = SmartPlaylistCreate("Bench", query, index);
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < 1000; i++)
+		{
+			Song* song = songs[random() % num_songs];
+			song->song_length_secs = 60 + random() % 600;
+			LibraryIndexUpdate(index, song);
+		}
+		const double update_ms = MillisecondsSince(start);
+		SmartPlaylistFree(playlist, index);
+
+		printf("%9u %9.2f %9.2f %9.3f          %s\n", num_members, evaluate_ms, per_row_ms, update_ms, query);
+	}
+
+	LibraryIndexFree(index);
+	for (Song* song : songs)
+		FreeSong(song);
+	return 0;
+}
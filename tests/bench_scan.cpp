@@ -0,0 +1,241 @@
+/******************************************************************************
+bench_scan.cpp - Files per second of a metadata scan with a cold page cache
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Scans the files under a directory the way GetPlaylistSongInfo() does:  each file is opened and the
+// first PREFETCH_HEADER_BYTES read, as BASS does when probing it.  The scan is run three times, each
+// time with a cold page cache:
+//
+//   playlist order		the order the files are in a shuffled playlist, with no read-ahead
+//   locality order		sorted by SortLocalityKeys(), with no read-ahead
+//   locality + ahead	sorted, and the headers of the next PREFETCH_MAX_IN_FLIGHT files requested 
+//						with posix_fadvise(POSIX_FADV_WILLNEED) while one is probed
+//
+// On Windows the keys come from FSCTL_GET_RETRIEVAL_POINTERS and the read-ahead is overlapped reads
+// (prefetch.cpp).  Here they come from FIEMAP, or the inode number where FIEMAP isn't supported.
+// Looking up the keys is part of the timed scan, as it is in the program.
+//
+//   build/bench_scan <directory> [max_files]
+//
+// Run as root (in a test container, for example) so the page cache is dropped through 
+// /proc/sys/vm/drop_caches before each pass.  Otherwise each file's pages are dropped with 
+// POSIX_FADV_DONTNEED, which leaves the directories and inodes cached.
+
+#include "locality.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+// Same as prefetch.h, which can't be included here since it is Win32
+#define PREFETCH_HEADER_BYTES		(64 * 1024)
+#define PREFETCH_MAX_IN_FLIGHT		8
+
+static std::vector<std::string> g_paths;
+static size_t g_max_files;
+
+
+static int AddFile(const char* path, const struct stat* st, int type, struct FTW*)
+{
+	if (type == FTW_F && S_ISREG(st->st_mode) && st->st_size > 0)
+		g_paths.push_back(path);
+	return (g_paths.size() >= g_max_files) ? 1 : 0;
+}
+
+
+// Returns true if the whole page cache was dropped, or false if only the pages of the files were
+static bool DropCaches(const std::vector<std::string>& paths)
+{
+	sync();
+	FILE* drop_caches = fopen("/proc/sys/vm/drop_caches", "w");
+	if (drop_caches)
+	{
+		const bool is_dropped = fputs("3", drop_caches) >= 0;
+		if (fclose(drop_caches) == 0 && is_dropped)
+			return true;
+	}
+	for (const std::string& path : paths)
+	{
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			continue;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+	return false;
+}
+
+
+// The Linux side of GetDiskPosition() in prefetch.cpp
+static void GetDiskPosition(LocalityKey* key)
+{
+	const int fd = open(key->path, O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat st;
+	if (fstat(fd, &st) == 0)
+	{
+		key->volume = st.st_dev;
+		key->disk_pos = st.st_ino;
+		key->has_disk_pos = true;
+	}
+
+	// Only the first extent is needed
+	unsigned long long extents[(sizeof(struct fiemap) + sizeof(struct fiemap_extent)) / sizeof(unsigned long long)] = {};
+	struct fiemap* map = (struct fiemap*)extents;
+	map->fm_length = ~0ULL;
+	map->fm_extent_count = 1;
+	if (ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0)
+	{
+		key->disk_pos = map->fm_extents[0].fe_physical;
+		key->has_extent = true;
+	}
+	close(fd);
+}
+
+
+// Reads the header of a file, as BASS does when probing it
+static size_t ProbeFile(const char* path, unsigned char* buffer)
+{
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	const ssize_t bytes_read = pread(fd, buffer, PREFETCH_HEADER_BYTES, 0);
+	close(fd);
+	return (bytes_read > 0) ? (size_t)bytes_read : 0;
+}
+
+
+static void ReportPass(const char* name, size_t num_files, size_t bytes, 
+	std::chrono::steady_clock::time_point start, unsigned int num_extents)
+{
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%-20s %8.0f files/s  %7.3f s  %6.1f MB read", name, num_files / secs, secs, bytes / 1e6);
+	if (num_extents != (unsigned int)-1)
+		printf("  (%u of %zu positions from FIEMAP)", num_extents, num_files);
+	printf("\n");
+}
+
+
+static void RunPass(const char* name, const std::vector<std::string>& paths, bool is_sorted, bool is_read_ahead)
+{
+	static unsigned char buffer[PREFETCH_HEADER_BYTES];
+	const size_t num_files = paths.size();
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<unsigned int> order(num_files);
+	unsigned int num_extents = (unsigned int)-1;
+	for (unsigned int i = 0; i < num_files; i++)
+		order[i] = i;
+	if (is_sorted)
+	{
+		std::vector<LocalityKey> keys(num_files);
+		num_extents = 0;
+		for (unsigned int i = 0; i < num_files; i++)
+		{
+			keys[i] = {};
+			keys[i].path = paths[i].c_str();
+			keys[i].dir_len = GetDirectoryLength(keys[i].path);
+			keys[i].idx = i;
+			GetDiskPosition(&keys[i]);
+			num_extents += keys[i].has_extent;
+		}
+		SortLocalityKeys(keys.data(), (unsigned int)num_files);
+		for (unsigned int i = 0; i < num_files; i++)
+			order[i] = keys[i].idx;
+	}
+
+	// The read-ahead keeps the files open until they are probed, like PrefetchBegin() and PrefetchEnd()
+	int ahead_fds[PREFETCH_MAX_IN_FLIGHT];
+	size_t next_ahead = 0;
+	size_t bytes = 0;
+	for (size_t i = 0; i < num_files; i++)
+	{
+		while (is_read_ahead && next_ahead < num_files && next_ahead < i + PREFETCH_MAX_IN_FLIGHT)
+		{
+			const int fd = open(paths[order[next_ahead]].c_str(), O_RDONLY);
+			if (fd >= 0)
+				posix_fadvise(fd, 0, PREFETCH_HEADER_BYTES, POSIX_FADV_WILLNEED);
+			ahead_fds[next_ahead % PREFETCH_MAX_IN_FLIGHT] = fd;
+			next_ahead++;
+		}
+		bytes += ProbeFile(paths[order[i]].c_str(), buffer);
+		if (is_read_ahead && ahead_fds[i % PREFETCH_MAX_IN_FLIGHT] >= 0)
+			close(ahead_fds[i % PREFETCH_MAX_IN_FLIGHT]);
+	}
+	ReportPass(name, num_files, bytes, start, num_extents);
+}
+
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <directory> [max_files]\n", argv[0]);
+		return 2;
+	}
+	g_max_files = (argc > 2) ? strtoul(argv[2], NULL, 10) : 5000;
+	nftw(argv[1], AddFile, 64, FTW_PHYS);
+	if (g_paths.empty())
+	{
+		fprintf(stderr, "No files found under %s\n", argv[1]);
+		return 1;
+	}
+
+	// Songs are added to playlists in no particular disk order, and a shuffled playlist is the worst case
+	std::mt19937 random(12345);
+	std::shuffle(g_paths.begin(), g_paths.end(), random);
+	printf("%zu files under %s\n", g_paths.size(), argv[1]);
+
+	const struct {
+		const char* name;
+		bool is_sorted;
+		bool is_read_ahead;
+	} passes[] = { { "playlist order", false, false }, { "locality order", true, false }, 
+		{ "locality + ahead", true, true } };
+	for (const auto& pass : passes)
+	{
+		const bool is_all_dropped = DropCaches(g_paths);
+		if (&pass == passes)
+			printf("Cold cache through %s\n", is_all_dropped ? "drop_caches" : "POSIX_FADV_DONTNEED per file");
+		RunPass(pass.name, g_paths, pass.is_sorted, pass.is_read_ahead);
+	}
+	return 0;
+}
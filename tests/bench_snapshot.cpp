@@ -0,0 +1,161 @@
+/******************************************************************************
+bench_snapshot.cpp - Time of saving and loading the playlist snapshot
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Makes a playlist of synthetic songs (albums of numbered tracks by a few thousand artists, all with
+// their info read) in shuffled play order, and times:
+//
+//   save		WritePlaylistSnapshot(), including the flush to disk
+//   load		ReadPlaylistSnapshot(), which checks the file and creates every song
+//
+// The snapshot is written to /tmp.
+//
+//   build/bench_snapshot [num_songs]
+
+#include "snapshot.h"
+#include "song.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char** argv)
+{
+	const unsigned int num_songs = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+	const char* snapshot_path = "/tmp/bench_snapshot.wpl";
+	std::mt19937 random(12345);
+
+	std::vector<std::string> artists(3000);
+	for (size_t i = 0; i < artists.size(); i++)
+		artists[i] = "Artist " + std::to_string(i);
+
+	Playlist playlist_view = {};
+	Playlist playlist = {};
+	std::vector<PlaylistNode*> view_nodes(num_songs);
+	unsigned int track = 0;
+	unsigned int album = 0;
+	const char* artist = NULL;
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		if (track == 0 || track == 12)
+		{
+			track = 0;
+			album++;
+			artist = artists[random() % artists.size()].c_str();
+		}
+		track++;
+		char path[256], album_name[32], title[32], track_num[8];
+		snprintf(album_name, sizeof(album_name), "Album %u", album);
+		snprintf(title, sizeof(title), "Song %u", i);
+		snprintf(track_num, sizeof(track_num), "%u/12", track);
+		snprintf(path, sizeof(path), "D:\\Music\\%s\\%s\\%02u %s.mp3", artist, album_name, track, title);
+
+		Song* song = SongCreate();
+		if (!song || !SongSetPath(song, path))
+		{
+			printf("Out of memory\n");
+			return 1;
+		}
+		SongDetails details = {};
+		details.metadata.title = title;
+		details.metadata.artist = (char*)artist;
+		details.metadata.album = album_name;
+		details.metadata.genre = (char*)"Rock";
+		details.metadata.track_num = track_num;
+		details.metadata.date = (char*)"1999";
+		details.song_length_bytes = 8000000;
+		details.bitrate = 320;
+		details.frequency = 44100;
+		details.is_stereo = true;
+		if (!SongSetDetails(song, &details, NULL, false))
+		{
+			printf("Out of memory\n");
+			return 1;
+		}
+		song->song_length_secs = 200;
+		song->has_info = true;
+		view_nodes[i] = PlaylistPushBack(&playlist_view, song);
+	}
+	std::vector<unsigned int> play_order(num_songs);
+	for (unsigned int i = 0; i < num_songs; i++)
+		play_order[i] = i;
+	std::shuffle(play_order.begin(), play_order.end(), random);
+	for (unsigned int idx : play_order)
+	{
+		PlaylistNode* node = PlaylistPushBack(&playlist, view_nodes[idx]->song);
+		node->link = view_nodes[idx];
+		view_nodes[idx]->link = node;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	if (!WritePlaylistSnapshot(snapshot_path, &playlist_view, &playlist))
+	{
+		printf("Couldn't write %s\n", snapshot_path);
+		return 1;
+	}
+	const double save_ms = MillisecondsSince(start);
+	FILE* file = fopen(snapshot_path, "rb");
+	fseek(file, 0, SEEK_END);
+	const long file_size = ftell(file);
+	fclose(file);
+
+	std::vector<Song*> songs;
+	std::vector<unsigned int> read_play_order;
+	start = std::chrono::steady_clock::now();
+	const bool is_read = ReadPlaylistSnapshot(snapshot_path, songs, read_play_order);
+	const double load_ms = MillisecondsSince(start);
+	if (!is_read || songs.size() != num_songs || read_play_order != play_order)
+	{
+		printf("The snapshot didn't load back\n");
+		return 1;
+	}
+
+	printf("%u songs, %.1f MB\n", num_songs, file_size / 1e6);
+	printf("save  %8.1f ms\n", save_ms);
+	printf("load  %8.1f ms\n", load_ms);
+
+	for (Song* song : songs)
+		FreeSong(song);
+	for (PlaylistNode* node : view_nodes)
+		FreeSong(node->song);
+	PlaylistClear(&playlist_view);
+	PlaylistClear(&playlist);
+	unlink(snapshot_path);
+	return 0;
+}
@@ -0,0 +1,458 @@
+/******************************************************************************
+bench_song.cpp - Time the loops that read songs
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// First times how songs are added to a playlist and cleared from it, as GetSongInfo() and OpenSongs() do,
+// for num_added songs with ID3v2 tags in ASCII, UTF-16 and UTF-8, best of 7 rounds:
+//
+//   add			SongCreate(), SongSetPath(), ParseID3v2() into the metadata arena,
+//					SongMakePlaylistName(), and SongSetDetails()
+//   clear			FreeSong() of every song
+//
+// Then makes synthetic songs with tags and compares the hot/cold split Song (a 64 byte record, with the
+// tags in a separate details block) with the single record Song used before the split (the tags and
+// the file info inline, about 200 bytes), for:
+//
+//   paint			what drawing a playlist row reads:  the color (valid, current, duplicate), the
+//					name, and the length text.  Paged through the whole playlist, in ns per row.
+//   length sum		adding up the length of every song, as the status bar total does, in ms
+//   duplicates		gathering the audio hash of every song and flagging the duplicates, as
+//					MarkDuplicateSongs() does, in ms
+//   current song	what UpdateInfoLabels() reads for a random current song:  title, artist, album,
+//					bitrate, frequency, and channels, in ns per song
+//
+// Each runs over the songs in the order they were created and in a shuffled order (e.g. after the
+// playlist was sorted).  The playlist treap is left out, as bench_playlist times it.
+//
+//   build/bench_song [num_songs] [num_added]
+
+#define NOMINMAX
+#include "song.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define ROWS_PER_PAGE	40
+#define ADD_ROUNDS		7
+
+// Song as it was before the split into hot and cold data
+struct WideSong {
+	bool is_current;
+	bool is_valid;
+	AudioFileMetadata metadata;
+	char* playlist_song_name;
+	char song_length_str[8];
+	unsigned int song_length_secs;
+	QWORD song_length_bytes;
+	unsigned int dir_id;
+	char* file_name;
+	unsigned int bitrate;
+	unsigned int frequency;
+	bool is_stereo;
+	FileFormat format;
+	bool has_info;
+	bool is_art_pending;
+	bool is_indexed;
+	unsigned int index_row;
+	unsigned long long audio_hash;
+	bool has_audio_hash;
+	bool is_duplicate;
+	void* queue_entries;
+	unsigned int ref_count;
+	bool is_stored;
+	char* string_block;
+	unsigned int string_block_size;
+};
+
+struct Timings {
+	double paint_ns;
+	double length_sum_ms;
+	double duplicates_ms;
+	double current_song_ns;
+};
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static void AppendFrame(std::string& frames, const char* id, const std::string& data)
+{
+	const size_t size = data.size();
+	frames.append(id, 4);
+	for (int shift = 24; shift >= 0; shift -= 8)
+		frames += (char)(size >> shift);
+	frames.append(2, '\0');		// Flags
+	frames += data;
+}
+
+
+// Frame data for text in the ID3v2 encoding:  0 = ISO-8859-1, 1 = UTF-16 with a BOM, 3 = UTF-8
+static std::string EncodeFrameText(const std::string& text, unsigned char encoding)
+{
+	std::string data(1, (char)encoding);
+	if (encoding == ID3V2_FRAME_TEXT_ENC_UTF16_BOM)
+	{
+		data += "\xFF\xFE";
+		for (char c : text)
+		{
+			data += c;
+			data += '\0';
+		}
+		data.append(2, '\0');
+	}
+	else
+	{
+		data += text;
+		data += '\0';
+	}
+	return data;
+}
+
+
+// ID3v2.3 tag with the frames that GetSongInfo() reads, followed by padding
+static std::string MakeTag(unsigned int i)
+{
+	const unsigned int album = i / 12;
+	const unsigned char encodings[] = { ID3V2_FRAME_TEXT_ENC_ASCII, ID3V2_FRAME_TEXT_ENC_UTF16_BOM, ID3V2_FRAME_TEXT_ENC_UTF8 };
+	const unsigned char encoding = encodings[i % 3];
+	std::string frames;
+	AppendFrame(frames, ID3V2_TITLE_FRAME_ID, EncodeFrameText("Song " + std::to_string(i) + " (Radio Edit)", encoding));
+	AppendFrame(frames, ID3V2_ARTIST_FRAME_ID, EncodeFrameText("Artist " + std::to_string(album % 3000), encoding));
+	AppendFrame(frames, ID3V2_ALBUM_FRAME_ID, EncodeFrameText("Album " + std::to_string(album), encoding));
+	AppendFrame(frames, ID3V2_GENRE_FRAME_ID, EncodeFrameText("Rock", encoding));
+	AppendFrame(frames, ID3V2_TRACK_NUM_FRAME_ID, EncodeFrameText(std::to_string(i % 12 + 1) + "/12", encoding));
+	AppendFrame(frames, ID3V2_YEAR_FRAME_ID, EncodeFrameText(std::to_string(1950 + album % 75), encoding));
+	AppendFrame(frames, ID3V2_COMMENT_FRAME_ID, std::string("\0eng\0Ripped from CD", 20));
+
+	// The tag size is synchsafe:  7 bits per byte
+	const size_t size = frames.size() + ID3V2_HEADER_LEN;
+	std::string tag("ID3\3\0\0", 6);
+	for (int shift = 21; shift >= 0; shift -= 7)
+		tag += (char)((size >> shift) & 0x7F);
+	return tag + frames + std::string(ID3V2_HEADER_LEN, '\0');
+}
+
+
+static void BenchAddClear(unsigned int num_songs)
+{
+	std::vector<std::string> tags(num_songs);
+	std::vector<std::string> paths(num_songs);
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		tags[i] = MakeTag(i);
+		paths[i] = "D:\\Music\\Artist " + std::to_string(i / 12 % 3000) + "\\Album " + std::to_string(i / 12) + "\\Song " +
+			std::to_string(i) + ".mp3";
+	}
+
+	std::vector<Song*> songs(num_songs);
+	MetadataArena arena = {};
+	double add_ms = 0;
+	double clear_ms = 0;
+	for (int round = 0; round < ADD_ROUNDS; round++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < num_songs; i++)
+		{
+			Song* song = SongCreate();
+			if (song == NULL || !SongSetPath(song, paths[i].c_str()))
+			{
+				printf("Out of memory\n");
+				exit(1);
+			}
+			SongDetails details = {};
+			ParseID3v2(tags[i].data(), &details.metadata, &arena);
+			const char* playlist_song_name = SongMakePlaylistName(&details.metadata, &arena);
+			details.bitrate = 320;
+			details.frequency = 44;
+			details.is_stereo = true;
+			song->has_info = SongSetDetails(song, &details, playlist_song_name, false);
+			MetadataArenaReset(&arena);
+			songs[i] = song;
+		}
+		const double round_add_ms = MillisecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		for (Song* song : songs)
+			FreeSong(song);
+		const double round_clear_ms = MillisecondsSince(start);
+		if (round == 0 || round_add_ms < add_ms)
+			add_ms = round_add_ms;
+		if (round == 0 || round_clear_ms < clear_ms)
+			clear_ms = round_clear_ms;
+	}
+	MetadataArenaFree(&arena);
+	printf("%u songs:  add %.1f ms, clear %.1f ms\n\n", num_songs, add_ms, clear_ms);
+}
+
+
+static char* AppendString(char** cursor, const char* text)
+{
+	char* start = *cursor;
+	const size_t len = strlen(text) + 1;
+	memcpy(start, text, len);
+	*cursor += len;
+	return start;
+}
+
+
+static Timings BenchHotCold(const std::vector<Song*>& songs, const std::vector<unsigned int>& current_songs)
+{
+	const unsigned int num_songs = (unsigned int)songs.size();
+	Timings timings = {};
+	const Song* curr_song = songs[num_songs / 2];
+	unsigned long long sum = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int page = 0; page < num_songs; page += ROWS_PER_PAGE)
+	{
+		for (unsigned int i = page; i < num_songs && i < page + ROWS_PER_PAGE; i++)
+		{
+			const Song* song = songs[i];
+			char length[32];
+			sum += !song->is_valid ? 1 : (song == curr_song) ? 2 : song->is_duplicate ? 3 : 4;
+			SongFormatLength(song, length, sizeof(length));
+			sum += strlen(length) + strlen(song->playlist_song_name);
+		}
+	}
+	timings.paint_ns = MillisecondsSince(start) * 1e6 / num_songs;
+
+	start = std::chrono::steady_clock::now();
+	for (const Song* song : songs)
+		sum += song->song_length_secs;
+	timings.length_sum_ms = MillisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	std::unordered_map<unsigned long long, unsigned int> hash_counts;
+	hash_counts.reserve(num_songs);
+	for (const Song* song : songs)
+	{
+		if (song->has_audio_hash)
+			hash_counts[song->audio_hash]++;
+	}
+	for (Song* song : songs)
+	{
+		song->is_duplicate = song->has_audio_hash && hash_counts[song->audio_hash] > 1;
+		sum += song->is_duplicate;
+	}
+	timings.duplicates_ms = MillisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	for (unsigned int idx : current_songs)
+	{
+		const SongDetails* details = SongGetDetails(songs[idx]);
+		sum += strlen(details->metadata.title) + strlen(details->metadata.artist) + strlen(details->metadata.album);
+		sum += details->bitrate + details->frequency + details->is_stereo;
+	}
+	timings.current_song_ns = MillisecondsSince(start) * 1e6 / current_songs.size();
+
+	if (sum == 0)
+		printf("Nothing was read\n");
+	return timings;
+}
+
+
+static Timings BenchWide(const std::vector<WideSong*>& songs, const std::vector<unsigned int>& current_songs)
+{
+	const unsigned int num_songs = (unsigned int)songs.size();
+	Timings timings = {};
+	unsigned long long sum = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int page = 0; page < num_songs; page += ROWS_PER_PAGE)
+	{
+		for (unsigned int i = page; i < num_songs && i < page + ROWS_PER_PAGE; i++)
+		{
+			const WideSong* song = songs[i];
+			char length[32];
+			sum += !song->is_valid ? 1 : song->is_current ? 2 : song->is_duplicate ? 3 : 4;
+			memcpy(length, song->song_length_str, sizeof(song->song_length_str));
+			sum += strlen(length) + strlen(song->playlist_song_name);
+		}
+	}
+	timings.paint_ns = MillisecondsSince(start) * 1e6 / num_songs;
+
+	start = std::chrono::steady_clock::now();
+	for (const WideSong* song : songs)
+		sum += song->song_length_secs;
+	timings.length_sum_ms = MillisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	std::unordered_map<unsigned long long, unsigned int> hash_counts;
+	hash_counts.reserve(num_songs);
+	for (const WideSong* song : songs)
+	{
+		if (song->has_audio_hash)
+			hash_counts[song->audio_hash]++;
+	}
+	for (WideSong* song : songs)
+	{
+		song->is_duplicate = song->has_audio_hash && hash_counts[song->audio_hash] > 1;
+		sum += song->is_duplicate;
+	}
+	timings.duplicates_ms = MillisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	for (unsigned int idx : current_songs)
+	{
+		const WideSong* song = songs[idx];
+		sum += strlen(song->metadata.title) + strlen(song->metadata.artist) + strlen(song->metadata.album);
+		sum += song->bitrate + song->frequency + song->is_stereo;
+	}
+	timings.current_song_ns = MillisecondsSince(start) * 1e6 / current_songs.size();
+
+	if (sum == 0)
+		printf("Nothing was read\n");
+	return timings;
+}
+
+
+static void PrintTimings(const char* name, const Timings& timings)
+{
+	printf("%-24s %10.1f %12.1f %12.1f %14.1f\n", name, timings.paint_ns, timings.length_sum_ms, timings.duplicates_ms,
+		timings.current_song_ns);
+}
+
+
+int main(int argc, char** argv)
+{
+	const unsigned int num_songs = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+	const unsigned int num_added = (argc > 2) ? strtoul(argv[2], NULL, 10) : 100000;
+	BenchAddClear(num_added);
+
+	std::mt19937 random(12345);
+
+	// Both kinds of song are made in the same order, so their records and text interleave in memory
+	// as they do when a playlist is loaded
+	std::vector<Song*> songs(num_songs);
+	std::vector<WideSong> wide_slab(num_songs);
+	std::vector<WideSong*> wide_songs(num_songs);
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		char title[64], artist[64], album[64], name[160], path[320];
+		const unsigned int album_num = i / 12;
+		snprintf(title, sizeof(title), "Song %u", i);
+		snprintf(artist, sizeof(artist), "Artist %u", album_num % 3000);
+		snprintf(album, sizeof(album), "Album %u", album_num);
+		snprintf(name, sizeof(name), "%s - %s", artist, title);
+		snprintf(path, sizeof(path), "D:\\Music\\%s\\%s\\%02u %s.mp3", artist, album, i % 12 + 1, title);
+		const unsigned int length_secs = 120 + random() % 300;
+		const unsigned long long audio_hash = random() % (num_songs + num_songs / 50);
+
+		Song* song = SongCreate();
+		if (song == NULL || !SongSetPath(song, path))
+		{
+			printf("Out of memory\n");
+			return 1;
+		}
+		SongDetails details = {};
+		details.metadata.title = title;
+		details.metadata.artist = artist;
+		details.metadata.album = album;
+		details.song_length_bytes = length_secs * 40000ULL;
+		details.bitrate = 320;
+		details.frequency = 44100;
+		details.is_stereo = true;
+		if (!SongSetDetails(song, &details, name, false))
+		{
+			printf("Out of memory\n");
+			return 1;
+		}
+		song->song_length_secs = length_secs;
+		song->audio_hash = audio_hash;
+		song->has_audio_hash = true;
+		song->has_info = true;
+		song->is_valid = true;
+		songs[i] = song;
+
+		WideSong* wide = &wide_slab[i];
+		wide->string_block_size = (unsigned int)(strlen(path) + strlen(name) + strlen(title) + strlen(artist) + strlen(album) + 5);
+		wide->string_block = (char*)malloc(wide->string_block_size);
+		if (wide->string_block == NULL)
+		{
+			printf("Out of memory\n");
+			return 1;
+		}
+		char* cursor = wide->string_block;
+		wide->file_name = AppendString(&cursor, strrchr(path, '\\') + 1);
+		wide->playlist_song_name = AppendString(&cursor, name);
+		wide->metadata.title = AppendString(&cursor, title);
+		wide->metadata.artist = AppendString(&cursor, artist);
+		wide->metadata.album = AppendString(&cursor, album);
+		snprintf(wide->song_length_str, sizeof(wide->song_length_str), "%u:%02u", length_secs / 60, length_secs % 60);
+		wide->song_length_secs = length_secs;
+		wide->song_length_bytes = details.song_length_bytes;
+		wide->bitrate = details.bitrate;
+		wide->frequency = details.frequency;
+		wide->is_stereo = true;
+		wide->audio_hash = audio_hash;
+		wide->has_audio_hash = true;
+		wide->has_info = true;
+		wide->is_valid = true;
+		wide_songs[i] = wide;
+	}
+	wide_songs[num_songs / 2]->is_current = true;
+
+	std::vector<unsigned int> current_songs(1000000);
+	for (unsigned int& idx : current_songs)
+		idx = random() % num_songs;
+
+	printf("%u songs, Song is %u bytes, the single record Song was %u bytes\n\n", num_songs, (unsigned int)sizeof(Song),
+		(unsigned int)sizeof(WideSong));
+	printf("                         paint ns   length ms   duplicates ms   current ns\n");
+	PrintTimings("hot/cold, created order", BenchHotCold(songs, current_songs));
+	PrintTimings("one record, created order", BenchWide(wide_songs, current_songs));
+
+	std::vector<unsigned int> order(num_songs);
+	for (unsigned int i = 0; i < num_songs; i++)
+		order[i] = i;
+	std::shuffle(order.begin(), order.end(), random);
+	std::vector<Song*> shuffled_songs(num_songs);
+	std::vector<WideSong*> shuffled_wide_songs(num_songs);
+	for (unsigned int i = 0; i < num_songs; i++)
+	{
+		shuffled_songs[i] = songs[order[i]];
+		shuffled_wide_songs[i] = wide_songs[order[i]];
+	}
+	PrintTimings("hot/cold, shuffled", BenchHotCold(shuffled_songs, current_songs));
+	PrintTimings("one record, shuffled", BenchWide(shuffled_wide_songs, current_songs));
+
+	for (Song* song : songs)
+		FreeSong(song);
+	for (WideSong& wide : wide_slab)
+		free(wide.string_block);
+	return 0;
+}
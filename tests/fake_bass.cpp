@@ -0,0 +1,290 @@
+/******************************************************************************
+fake_bass.cpp - Stand-ins for BASS and the sound card, for testing the player
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#define NOMINMAX
+#include "fake_bass.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+struct FakeDecoder {
+	QWORD signal_start;
+	QWORD junk_before;
+	QWORD num_frames;
+	QWORD total_frames;			// With the junk
+	QWORD pos;					// In frames
+	DWORD freq;
+};
+
+struct FakeOutput {
+	STREAMPROC* proc;
+	void* user;
+	std::vector<float> buffer;	// Read from the stream but not yet played
+	bool is_playing;
+	bool is_ended;
+};
+
+std::vector<float> null_device_heard;
+
+static std::map<DWORD, FakeDecoder> decoders;
+static std::map<DWORD, FakeOutput> outputs;
+// Like BASS, the output stream is locked while its STREAMPROC is called, but the decoders aren't
+static std::recursive_mutex output_lock;
+static std::recursive_mutex decoder_lock;
+static DWORD next_handle = 1;
+static int num_decode_to;
+static bool is_signal_cheap;
+
+
+float FakeSignal(QWORD frame, DWORD chan)
+{
+	if (is_signal_cheap)
+		return (float)(frame & 1023) * (1.0f / 1024);
+	return (float)sin(frame * 0.0123 + chan);
+}
+
+
+// For benchmarks, where computing sin() would cost more than the player
+void SetFakeSignalCheap(bool is_cheap)
+{
+	is_signal_cheap = is_cheap;
+}
+
+
+// Returns a decoder of num_frames of the signal from signal_start, with junk_before and junk_after frames
+// of junk around it
+HSTREAM CreateFakeDecoder(QWORD signal_start, QWORD num_frames, QWORD junk_before, QWORD junk_after, DWORD freq)
+{
+	std::lock_guard<std::recursive_mutex> lock(decoder_lock);
+	const DWORD handle = next_handle++;
+	decoders[handle] = { signal_start, junk_before, num_frames, junk_before + num_frames + junk_after, 0, freq };
+	return handle;
+}
+
+
+// Decoders that haven't been freed with BASS_StreamFree()
+int GetFakeDecodersOpen(void)
+{
+	std::lock_guard<std::recursive_mutex> lock(decoder_lock);
+	return (int)decoders.size();
+}
+
+
+// Times BASS_ChannelSetPosition() was called with BASS_POS_DECODETO
+int GetFakeDecodeToCount(void)
+{
+	return num_decode_to;
+}
+
+
+void NullDeviceStep(HSTREAM stream)
+{
+	std::lock_guard<std::recursive_mutex> lock(output_lock);
+	auto it = outputs.find(stream);
+	if (it == outputs.end() || !it->second.is_playing)
+		return;
+
+	FakeOutput& output = it->second;
+	while (!output.is_ended && output.buffer.size() / FAKE_CHANS + FAKE_UPDATE_FRAMES <= FAKE_BUFFER_FRAMES)
+	{
+		float block[FAKE_UPDATE_FRAMES * FAKE_CHANS];
+		DWORD len = output.proc(stream, block, sizeof(block), output.user);
+		if (len & BASS_STREAMPROC_END)
+			output.is_ended = true;
+		len &= ~BASS_STREAMPROC_END;
+		output.buffer.insert(output.buffer.end(), block, block + len / sizeof(float));
+	}
+	const size_t play_len = std::min(output.buffer.size(), (size_t)FAKE_PLAY_FRAMES * FAKE_CHANS);
+	null_device_heard.insert(null_device_heard.end(), output.buffer.begin(), output.buffer.begin() + play_len);
+	output.buffer.erase(output.buffer.begin(), output.buffer.begin() + play_len);
+	if (output.is_ended && output.buffer.empty())
+		output.is_playing = false;
+}
+
+
+// Calls the stream's STREAMPROC for length bytes, without playing them, to time it
+DWORD NullDeviceRead(HSTREAM stream, float* buffer, DWORD length)
+{
+	std::lock_guard<std::recursive_mutex> lock(output_lock);
+	const FakeOutput& output = outputs.at(stream);
+	return output.proc(stream, buffer, length, output.user);
+}
+
+
+QWORD NullDeviceHeardFrames(void)
+{
+	std::lock_guard<std::recursive_mutex> lock(output_lock);
+	return null_device_heard.size() / FAKE_CHANS;
+}
+
+
+// Returns the largest difference between num_frames of what was heard from heard_start, and the signal
+// from signal_start.  Returns infinity if fewer frames were heard.
+double NullDeviceError(QWORD heard_start, QWORD num_frames, QWORD signal_start)
+{
+	std::lock_guard<std::recursive_mutex> lock(output_lock);
+	if (null_device_heard.size() / FAKE_CHANS < heard_start + num_frames)
+		return INFINITY;
+	double max_error = 0;
+	for (QWORD i = 0; i < num_frames; i++)
+	{
+		for (DWORD chan = 0; chan < FAKE_CHANS; chan++)
+		{
+			const double error = fabs(null_device_heard[(heard_start + i) * FAKE_CHANS + chan] - FakeSignal(signal_start + i, chan));
+			max_error = std::max(max_error, error);
+		}
+	}
+	return max_error;
+}
+
+
+// BASS =========================================================================================
+
+HSTREAM BASS_StreamCreate(DWORD freq, DWORD chans, DWORD flags, STREAMPROC* proc, void* user)
+{
+	std::lock_guard<std::recursive_mutex> lock(output_lock);
+	if (freq != FAKE_FREQ || chans != FAKE_CHANS || flags != BASS_SAMPLE_FLOAT)
+		return 0;
+	const DWORD handle = next_handle++;
+	outputs[handle] = { proc, user, std::vector<float>(), false, false };
+	return handle;
+}
+
+
+BOOL BASS_StreamFree(HSTREAM handle)
+{
+	{
+		std::lock_guard<std::recursive_mutex> lock(decoder_lock);
+		if (decoders.erase(handle))
+			return TRUE;
+	}
+	std::lock_guard<std::recursive_mutex> lock(output_lock);
+	return outputs.erase(handle) != 0;
+}
+
+
+BOOL BASS_ChannelGetInfo(DWORD handle, BASS_CHANNELINFO* info)
+{
+	std::lock_guard<std::recursive_mutex> lock(decoder_lock);
+	auto it = decoders.find(handle);
+	if (it == decoders.end())
+		return FALSE;
+	memset(info, 0, sizeof(*info));
+	info->freq = it->second.freq;
+	info->chans = FAKE_CHANS;
+	return TRUE;
+}
+
+
+// Decodes from a decoder, or with BASS_DATA_AVAILABLE, returns how much of the output stream is buffered
+DWORD BASS_ChannelGetData(DWORD handle, void* buffer, DWORD length)
+{
+	{
+		std::lock_guard<std::recursive_mutex> lock(output_lock);
+		auto output = outputs.find(handle);
+		if (output != outputs.end())
+			return (DWORD)(output->second.buffer.size() * sizeof(float));
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(decoder_lock);
+	FakeDecoder& decoder = decoders.at(handle);
+	if (decoder.pos == decoder.total_frames)
+		return (DWORD)-1;
+	const QWORD num_frames = std::min((QWORD)(length / FAKE_FRAME_BYTES), decoder.total_frames - decoder.pos);
+	float* samples = (float*)buffer;
+	for (QWORD i = 0; i < num_frames; i++)
+	{
+		const QWORD frame = decoder.pos + i;
+		const bool is_junk = frame < decoder.junk_before || frame >= decoder.junk_before + decoder.num_frames;
+		for (DWORD chan = 0; chan < FAKE_CHANS; chan++)
+			*samples++ = is_junk ? FAKE_JUNK_SAMPLE : FakeSignal(decoder.signal_start + frame - decoder.junk_before, chan);
+	}
+	decoder.pos += num_frames;
+	return (DWORD)(num_frames * FAKE_FRAME_BYTES);
+}
+
+
+DWORD BASS_ChannelIsActive(DWORD handle)
+{
+	{
+		std::lock_guard<std::recursive_mutex> lock(output_lock);
+		auto output = outputs.find(handle);
+		if (output != outputs.end())
+			return output->second.is_playing ? BASS_ACTIVE_PLAYING : BASS_ACTIVE_STOPPED;
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(decoder_lock);
+	const FakeDecoder& decoder = decoders.at(handle);
+	return (decoder.pos < decoder.total_frames) ? BASS_ACTIVE_PLAYING : BASS_ACTIVE_STOPPED;
+}
+
+
+BOOL BASS_ChannelSetPosition(DWORD handle, QWORD pos, DWORD mode)
+{
+	std::lock_guard<std::recursive_mutex> lock(decoder_lock);
+	FakeDecoder& decoder = decoders.at(handle);
+	if (mode & BASS_POS_DECODETO)
+	{
+		// BASS can only decode forward to a position
+		if (pos < decoder.pos * FAKE_FRAME_BYTES)
+			return FALSE;
+		num_decode_to++;
+	}
+	decoder.pos = std::min(pos / FAKE_FRAME_BYTES, decoder.total_frames);
+	return TRUE;
+}
+
+
+QWORD BASS_ChannelGetLength(DWORD handle, DWORD mode)
+{
+	std::lock_guard<std::recursive_mutex> lock(decoder_lock);
+	return decoders.at(handle).total_frames * FAKE_FRAME_BYTES;
+}
+
+
+BOOL BASS_ChannelSetAttribute(DWORD handle, DWORD attrib, float value)
+{
+	std::lock_guard<std::recursive_mutex> lock(output_lock);
+	return outputs.count(handle) != 0;
+}
+
+
+BOOL BASS_ChannelPlay(DWORD handle, BOOL restart)
+{
+	std::lock_guard<std::recursive_mutex> lock(output_lock);
+	auto output = outputs.find(handle);
+	if (output == outputs.end())
+		return FALSE;
+	output->second.is_playing = true;
+	return TRUE;
+}
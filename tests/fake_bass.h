@@ -0,0 +1,66 @@
+/******************************************************************************
+fake_bass.h - Stand-ins for BASS and the sound card, for testing the player
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <Windows.h>
+#include "bass.h"
+#include <vector>
+
+// The fake decoders play one endless signal, FakeSignal(), and each song is a stretch of it, so songs
+// played one after the other without a gap are the signal without a break.  A decoder can also have
+// junk samples (FAKE_JUNK_SAMPLE) before and after its stretch, like the encoder delay and padding of
+// an MP3.  Decoders are always float, stereo, and FAKE_FREQ unless given another sample rate.
+//
+// The null device stands in for the sound card.  Each step plays FAKE_PLAY_FRAMES of the output
+// stream into null_device_heard, and like BASS it keeps a buffer of FAKE_BUFFER_FRAMES, refilled
+// FAKE_UPDATE_FRAMES at a time by calling the stream's STREAMPROC.  A step can be taken on another
+// thread while the player is used, as BASS's update thread would.
+
+#define FAKE_FREQ				44100
+#define FAKE_CHANS				2
+#define FAKE_FRAME_BYTES		(FAKE_CHANS * sizeof(float))
+#define FAKE_BUFFER_FRAMES		(FAKE_FREQ / 2)		// 500 ms
+#define FAKE_UPDATE_FRAMES		(FAKE_FREQ / 25)	// 40 ms
+#define FAKE_PLAY_FRAMES		(FAKE_FREQ / 100)	// 10 ms
+#define FAKE_JUNK_SAMPLE		9.0f
+
+extern std::vector<float> null_device_heard;
+
+float FakeSignal(QWORD frame, DWORD chan);
+void SetFakeSignalCheap(bool is_cheap);
+HSTREAM CreateFakeDecoder(QWORD signal_start, QWORD num_frames, QWORD junk_before = 0, QWORD junk_after = 0,
+	DWORD freq = FAKE_FREQ);
+int GetFakeDecodersOpen(void);
+int GetFakeDecodeToCount(void);
+void NullDeviceStep(HSTREAM stream);
+DWORD NullDeviceRead(HSTREAM stream, float* buffer, DWORD length);
+QWORD NullDeviceHeardFrames(void);
+double NullDeviceError(QWORD heard_start, QWORD num_frames, QWORD signal_start);
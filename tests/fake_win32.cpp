@@ -0,0 +1,347 @@
+/******************************************************************************
+fake_win32.cpp - Win32 functions and the parts of util.cpp the tested modules call, on POSIX
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include <Windows.h>
+#include "util.h"
+#include "locality.h"
+#include "prefetch.h"
+#include <strsafe.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// A file or mapping is a file descriptor, and a thread is a pthread
+struct FakeHandle {
+	int fd;
+	bool is_thread;
+	bool is_joined;
+	pthread_t thread;
+	LPTHREAD_START_ROUTINE start;
+	LPVOID param;
+};
+
+// Lengths of the mapped views, which munmap() needs
+static std::map<const void*, size_t> views;
+static std::mutex views_lock;
+
+struct AllocHeader {
+	size_t size;
+	size_t tag;
+};
+
+static AllocStats alloc_stats[ALLOC_NUM_TAGS];
+
+
+static HANDLE NewFileHandle(int fd)
+{
+	if (fd < 0)
+		return INVALID_HANDLE_VALUE;
+	FakeHandle* handle = new FakeHandle();
+	handle->fd = fd;
+	return handle;
+}
+
+
+HANDLE CreateFile(const char* path, DWORD access, DWORD share_mode, void* security, DWORD creation, DWORD flags, 
+	HANDLE template_file)
+{
+	int open_flags = (access & GENERIC_WRITE) ? ((access & GENERIC_READ) ? O_RDWR : O_WRONLY) : O_RDONLY;
+	if (creation == CREATE_ALWAYS)
+		open_flags |= O_CREAT | O_TRUNC;
+	return NewFileHandle(open(path, open_flags, 0644));
+}
+
+
+BOOL ReadFile(HANDLE file, void* buffer, DWORD len, DWORD* bytes_read, OVERLAPPED* overlapped)
+{
+	const ssize_t result = read(((FakeHandle*)file)->fd, buffer, len);
+	*bytes_read = (result > 0) ? (DWORD)result : 0;
+	return result >= 0;
+}
+
+
+BOOL WriteFile(HANDLE file, const void* buffer, DWORD len, DWORD* bytes_written, OVERLAPPED* overlapped)
+{
+	const ssize_t result = write(((FakeHandle*)file)->fd, buffer, len);
+	*bytes_written = (result > 0) ? (DWORD)result : 0;
+	return result >= 0;
+}
+
+
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, LARGE_INTEGER* new_pos, DWORD method)
+{
+	const off_t pos = lseek(((FakeHandle*)file)->fd, distance.QuadPart, SEEK_SET);
+	if (new_pos)
+		new_pos->QuadPart = pos;
+	return pos >= 0;
+}
+
+
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size)
+{
+	struct stat info;
+	if (fstat(((FakeHandle*)file)->fd, &info) != 0)
+		return FALSE;
+	size->QuadPart = info.st_size;
+	return TRUE;
+}
+
+
+BOOL FlushFileBuffers(HANDLE file)
+{
+	return fsync(((FakeHandle*)file)->fd) == 0;
+}
+
+
+BOOL MoveFileEx(const char* existing_path, const char* new_path, DWORD flags)
+{
+	return rename(existing_path, new_path) == 0;
+}
+
+
+BOOL DeleteFile(const char* path)
+{
+	return unlink(path) == 0;
+}
+
+
+// A thread that hasn't been waited for is detached, as closing its handle doesn't stop it
+BOOL CloseHandle(HANDLE handle)
+{
+	FakeHandle* fake_handle = (FakeHandle*)handle;
+	if (fake_handle == NULL || handle == INVALID_HANDLE_VALUE)
+		return FALSE;
+	if (fake_handle->is_thread && !fake_handle->is_joined)
+		pthread_detach(fake_handle->thread);
+	else if (!fake_handle->is_thread)
+		close(fake_handle->fd);
+	delete fake_handle;
+	return TRUE;
+}
+
+
+HANDLE CreateFileMapping(HANDLE file, void* security, DWORD protect, DWORD max_size_high, DWORD max_size_low, 
+	const char* name)
+{
+	const HANDLE mapping = NewFileHandle(dup(((FakeHandle*)file)->fd));
+	return (mapping == INVALID_HANDLE_VALUE) ? NULL : mapping;
+}
+
+
+void* MapViewOfFile(HANDLE mapping, DWORD access, DWORD offset_high, DWORD offset_low, size_t len)
+{
+	const int fd = ((FakeHandle*)mapping)->fd;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+		return NULL;
+	void* view = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED)
+		return NULL;
+	std::lock_guard<std::mutex> lock(views_lock);
+	views[view] = info.st_size;
+	return view;
+}
+
+
+BOOL UnmapViewOfFile(const void* view)
+{
+	std::lock_guard<std::mutex> lock(views_lock);
+	std::map<const void*, size_t>::iterator it = views.find(view);
+	if (it == views.end())
+		return FALSE;
+	munmap((void*)view, it->second);
+	views.erase(it);
+	return TRUE;
+}
+
+
+void* VirtualAlloc(void* address, size_t size, DWORD type, DWORD protect)
+{
+	void* memory = NULL;
+	if (posix_memalign(&memory, 0x10000, size) != 0)
+		return NULL;
+	memset(memory, 0, size);
+	return memory;
+}
+
+
+BOOL VirtualFree(void* address, size_t size, DWORD type)
+{
+	free(address);
+	return TRUE;
+}
+
+
+static void* ThreadStart(void* param)
+{
+	FakeHandle* handle = (FakeHandle*)param;
+	handle->start(handle->param);
+	return NULL;
+}
+
+
+HANDLE CreateThread(void* security, size_t stack_size, LPTHREAD_START_ROUTINE start, LPVOID param, DWORD flags, 
+	DWORD* thread_id)
+{
+	FakeHandle* handle = new FakeHandle();
+	handle->is_thread = true;
+	handle->start = start;
+	handle->param = param;
+	if (pthread_create(&handle->thread, NULL, ThreadStart, handle) != 0)
+	{
+		delete handle;
+		return NULL;
+	}
+	return handle;
+}
+
+
+// Only threads can be waited for
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds)
+{
+	FakeHandle* fake_handle = (FakeHandle*)handle;
+	if (!fake_handle->is_joined)
+		pthread_join(fake_handle->thread, NULL);
+	fake_handle->is_joined = true;
+	return 0;
+}
+
+
+// util.cpp =======================================================================================
+
+void CountMemory(AllocTag tag, LONGLONG bytes)
+{
+	AllocStats* stats = &alloc_stats[tag];
+	const LONGLONG live_bytes = __atomic_add_fetch(&stats->live_bytes, bytes, __ATOMIC_SEQ_CST);
+	LONGLONG peak_bytes = __atomic_load_n(&stats->peak_bytes, __ATOMIC_SEQ_CST);
+	while (live_bytes > peak_bytes && !__atomic_compare_exchange_n(&stats->peak_bytes, &peak_bytes, live_bytes, 
+		false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+		;
+	__atomic_add_fetch((bytes < 0) ? &stats->num_frees : &stats->num_allocs, 1, __ATOMIC_SEQ_CST);
+}
+
+
+void* AllocMemory(AllocTag tag, size_t size)
+{
+	AllocHeader* header = (AllocHeader*)calloc(1, sizeof(AllocHeader) + size);
+	if (header == NULL)
+		return NULL;
+	header->size = size;
+	header->tag = tag;
+	CountMemory(tag, (LONGLONG)size);
+	return header + 1;
+}
+
+
+void* ReAllocMemory(void* ptr, size_t size)
+{
+	AllocHeader* header = (AllocHeader*)ptr - 1;
+	const size_t old_size = header->size;
+	header = (AllocHeader*)realloc(header, sizeof(AllocHeader) + size);
+	if (header == NULL)
+		return NULL;
+	if (size > old_size)
+		memset((char*)(header + 1) + old_size, 0, size - old_size);
+	header->size = size;
+	__atomic_add_fetch(&alloc_stats[header->tag].live_bytes, (LONGLONG)size - (LONGLONG)old_size, __ATOMIC_SEQ_CST);
+	return header + 1;
+}
+
+
+char* DuplicateString(AllocTag tag, const char* str)
+{
+	if (str == NULL)
+		return NULL;
+	const size_t size = strlen(str) + 1;
+	char* copy = (char*)AllocMemory(tag, size);
+	if (copy)
+		memcpy(copy, str, size);
+	return copy;
+}
+
+
+void FreeMemory(void* ptr)
+{
+	if (ptr != NULL)
+	{
+		AllocHeader* header = (AllocHeader*)ptr - 1;
+		CountMemory((AllocTag)header->tag, -(LONGLONG)header->size);
+		free(header);
+	}
+}
+
+
+void GetAllocStats(AllocStats stats[ALLOC_NUM_TAGS])
+{
+	for (int tag = 0; tag < ALLOC_NUM_TAGS; tag++)
+		stats[tag] = alloc_stats[tag];
+}
+
+
+HANDLE CreateFileUtf8(const char* path, DWORD access, DWORD share_mode, DWORD creation, DWORD flags)
+{
+	return CreateFile(path, access, share_mode, NULL, creation, flags, NULL);
+}
+
+
+// Text that isn't UTF-8 is taken to be Latin-1, which is close to the usual ANSI code page
+void LegacyTextToUtf8(const char* text, char* buffer, size_t buffer_size)
+{
+	const size_t len = strlen(text);
+	if (IsValidUtf8(text, len))
+		StringCbCopyA(buffer, buffer_size, text);
+	else
+		Latin1ToUtf8((const unsigned char*)text, len, buffer, buffer_size);
+}
+
+
+// prefetch.cpp ===================================================================================
+
+// Where a file is on the disk isn't looked up, so files are visited directory by directory and then 
+// by name, as on a network share
+void SortPathsByLocality(const char** paths, unsigned int count, unsigned int* order)
+{
+	std::vector<LocalityKey> keys(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		keys[i] = {};
+		keys[i].path = paths[i];
+		keys[i].dir_len = GetDirectoryLength(paths[i]);
+		keys[i].idx = i;
+	}
+	SortLocalityKeys(keys.data(), count);
+	for (unsigned int i = 0; i < count; i++)
+		order[i] = keys[i].idx;
+}
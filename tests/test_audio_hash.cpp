@@ -0,0 +1,314 @@
+/******************************************************************************
+test_audio_hash.cpp - Tests of XXH64 and of hashing audio without its tags
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#define NOMINMAX
+#include "audio_hash.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+static char temp_dir[] = "/tmp/test_audio_hash_XXXXXX";
+static unsigned char read_buffer[AUDIO_HASH_READ_SIZE];
+
+
+static unsigned long long Hash(const void* data, size_t len, unsigned long long seed = 0)
+{
+	XXH64State state;
+	XXH64Reset(&state, seed);
+	XXH64Update(&state, data, len);
+	return XXH64Digest(&state);
+}
+
+
+// Writes the file and returns the hash of its audio, or 0 if it couldn't be hashed
+static unsigned long long HashFile(const Bytes& data, FileFormat format)
+{
+	const std::string path = std::string(temp_dir) + "/song";
+	FILE* file = fopen(path.c_str(), "wb");
+	CHECK(file && fwrite(data.data(), 1, data.size(), file) == data.size());
+	fclose(file);
+	unsigned long long hash = 0;
+	CHECK(HashAudioData(path.c_str(), format, read_buffer, &hash));
+	unlink(path.c_str());
+	return hash;
+}
+
+
+static Bytes RandomBytes(std::mt19937& random, size_t len)
+{
+	Bytes bytes(len);
+	for (unsigned char& byte : bytes)
+		byte = (unsigned char)random();
+	return bytes;
+}
+
+
+static Bytes Join(std::initializer_list<Bytes> parts)
+{
+	Bytes joined;
+	for (const Bytes& part : parts)
+		joined.insert(joined.end(), part.begin(), part.end());
+	return joined;
+}
+
+
+// The reference implementation's hashes of "", "abc", and the start of a generated buffer
+static void TestXXH64(void)
+{
+	CHECK(Hash("", 0) == 0xEF46DB3751D8E999ULL);
+	CHECK(Hash("abc", 3) == 0x44BC2CF5AD770999ULL);
+
+	unsigned char data[1000];
+	unsigned int value = 2654435761u;
+	for (unsigned int i = 0; i < sizeof(data); i++)
+	{
+		data[i] = (unsigned char)(value >> 24);
+		value = value * 2654435761u + i;
+	}
+	static const struct {
+		size_t len;
+		unsigned long long hash;			// Seed 0
+		unsigned long long seeded_hash;		// Seed 0x9E3779B185EBCA87
+	} vectors[] = {
+		{ 1, 0x4fce394cc88952d8ULL, 0xff1a3bfe85aad592ULL },
+		{ 3, 0xc9aec4937dc75944ULL, 0x4bbc3e89a1729cceULL },
+		{ 4, 0x288675280810899fULL, 0xadfc29efd3221bfbULL },
+		{ 8, 0x0b97277fc7c41da1ULL, 0xc43fd0a6b5b14d82ULL },
+		{ 14, 0xa8fe1b631f4ab863ULL, 0xe24b6114df26c964ULL },
+		{ 31, 0x2fc5ebb789b9377eULL, 0xbb9e4b2a4bbdfe04ULL },
+		{ 32, 0x685a78aaf36bb7edULL, 0x6e11ca96ecd5ccdcULL },
+		{ 33, 0xf9b16e1a70e7000fULL, 0x681ff3a16fb76c93ULL },
+		{ 63, 0x602c9dd3148f9b51ULL, 0x9320d1f7524c2819ULL },
+		{ 64, 0x237d45d2bfa781ecULL, 0xc4ab5e7234ebce7dULL },
+		{ 100, 0xe329bff814e25d5fULL, 0x2e0788fa9ed7299bULL },
+		{ 1000, 0xb6a811335962858cULL, 0x57699deb52ad7dc5ULL },
+	};
+	for (const auto& vector : vectors)
+	{
+		CHECK(Hash(data, vector.len) == vector.hash);
+		CHECK(Hash(data, vector.len, 0x9E3779B185EBCA87ULL) == vector.seeded_hash);
+
+		// The same hash however the input is split between calls
+		for (size_t split_len : { 1, 5, 31, 32, 33 })
+		{
+			XXH64State state;
+			XXH64Reset(&state, 0);
+			for (size_t pos = 0; pos < vector.len; pos += split_len)
+				XXH64Update(&state, data + pos, std::min(split_len, vector.len - pos));
+			CHECK(XXH64Digest(&state) == vector.hash);
+		}
+	}
+}
+
+
+// ID3v2 tag of len bytes after the header, with its size as a syncsafe integer
+static Bytes ID3v2Tag(std::mt19937& random, unsigned int len, bool has_footer = false)
+{
+	Bytes tag = { 'I', 'D', '3', 4, 0, (unsigned char)(has_footer ? 0x10 : 0), (unsigned char)((len >> 21) & 0x7F), 
+		(unsigned char)((len >> 14) & 0x7F), (unsigned char)((len >> 7) & 0x7F), (unsigned char)(len & 0x7F) };
+	const Bytes frames = RandomBytes(random, len);
+	tag.insert(tag.end(), frames.begin(), frames.end());
+	if (has_footer)
+	{
+		Bytes footer(tag.begin(), tag.begin() + ID3V2_HEADER_LEN);
+		memcpy(footer.data(), "3DI", 3);
+		tag.insert(tag.end(), footer.begin(), footer.end());
+	}
+	return tag;
+}
+
+
+static Bytes ID3v1Tag(const char* title)
+{
+	Bytes tag(128);
+	memcpy(tag.data(), "TAG", 3);
+	memcpy(tag.data() + 3, title, strlen(title));
+	return tag;
+}
+
+
+// APEv2 tag with items_len bytes of items, and a header if has_header
+static Bytes APETag(std::mt19937& random, unsigned int items_len, bool has_header)
+{
+	Bytes footer(32);
+	memcpy(footer.data(), "APETAGEX", 8);
+	const unsigned int version = 2000;
+	const unsigned int tag_size = items_len + 32;
+	const unsigned int flags = has_header ? 0xA0000000 : 0;
+	memcpy(footer.data() + 8, &version, 4);
+	memcpy(footer.data() + 12, &tag_size, 4);
+	memcpy(footer.data() + 20, &flags, 4);
+	Bytes header = footer;
+	return has_header ? Join({ header, RandomBytes(random, items_len), footer }) : Join({ RandomBytes(random, items_len), footer });
+}
+
+
+// The same MP3 frames hash the same with any mix of ID3v2, ID3v1, and APE tags around them
+static void TestMP3Tags(void)
+{
+	std::mt19937 random(31);
+	Bytes audio = RandomBytes(random, 300000);
+	audio[0] = 0xFF;
+	audio[1] = 0xFB;
+	const unsigned long long expected = Hash(audio.data(), audio.size());
+	CHECK(HashFile(audio, MP3) == expected);
+
+	CHECK(HashFile(Join({ ID3v2Tag(random, 1000), audio }), MP3) == expected);
+	CHECK(HashFile(Join({ ID3v2Tag(random, 70000), audio }), MP3) == expected);
+	CHECK(HashFile(Join({ ID3v2Tag(random, 500), ID3v2Tag(random, 40), audio }), MP3) == expected);
+	CHECK(HashFile(Join({ ID3v2Tag(random, 500, true), audio }), MP3) == expected);
+	CHECK(HashFile(Join({ audio, ID3v1Tag("Title") }), MP3) == expected);
+	CHECK(HashFile(Join({ audio, APETag(random, 200, true) }), MP3) == expected);
+	CHECK(HashFile(Join({ audio, APETag(random, 200, false), ID3v1Tag("Other title") }), MP3) == expected);
+	CHECK(HashFile(Join({ ID3v2Tag(random, 3000), audio, APETag(random, 64, true), ID3v1Tag("") }), MP3) == expected);
+
+	// Changing the audio changes the hash
+	Bytes changed = audio;
+	changed[changed.size() / 2] ^= 1;
+	CHECK(HashFile(Join({ ID3v2Tag(random, 1000), changed }), MP3) != expected);
+
+	// A file that's only tags has no audio
+	CHECK(HashFile(Join({ ID3v2Tag(random, 100), ID3v1Tag("") }), MP3) == Hash("", 0));
+
+	// A tag size past the end of the file doesn't read outside it
+	Bytes ape = APETag(random, 10, false);
+	const unsigned int huge_size = 0x7FFFFFFF;
+	memcpy(ape.data() + ape.size() - 20, &huge_size, 4);
+	CHECK(HashFile(Join({ audio, ape }), MP3) == Hash("", 0));
+}
+
+
+// An Ogg page.  Page sequence numbers and checksums aren't checked by the hash, so they are random.
+static Bytes OggPage(std::mt19937& random, unsigned long long granule, const Bytes& body)
+{
+	Bytes page = { 'O', 'g', 'g', 'S', 0, 0 };
+	for (int i = 0; i < 8; i++)
+		page.push_back((unsigned char)(granule >> (i * 8)));
+	const Bytes serial_sequence_checksum = RandomBytes(random, 12);
+	page.insert(page.end(), serial_sequence_checksum.begin(), serial_sequence_checksum.end());
+	Bytes segments;
+	size_t len = body.size();
+	do
+	{
+		segments.push_back((unsigned char)std::min(len, (size_t)255));
+		len -= segments.back();
+	} while (segments.back() == 255);
+	CHECK(segments.size() <= 255);
+	page.push_back((unsigned char)segments.size());
+	return Join({ page, segments, body });
+}
+
+
+// Vorbis header pages with a comment packet of comments_len bytes, then audio pages of the bodies
+static Bytes OggFile(std::mt19937& random, unsigned int comments_len, const std::vector<Bytes>& bodies, 
+	const Bytes& between_pages = Bytes())
+{
+	Bytes file = Join({ OggPage(random, 0, RandomBytes(random, 30)), OggPage(random, 0, RandomBytes(random, comments_len)), 
+		OggPage(random, 0, RandomBytes(random, 3000)) });
+	unsigned long long granule = 0;
+	for (const Bytes& body : bodies)
+	{
+		granule += 1024;
+		file = Join({ file, OggPage(random, granule, body), between_pages });
+	}
+	return file;
+}
+
+
+// The audio pages of an Ogg file hash the same whatever the comments are, and however the pages
+// fall across the reads
+static void TestOggComments(void)
+{
+	std::mt19937 random(32);
+	std::vector<Bytes> bodies;
+	XXH64State state;
+	XXH64Reset(&state, 0);
+	size_t total_len = 0;
+	while (total_len < 3 * AUDIO_HASH_READ_SIZE)
+	{
+		bodies.push_back(RandomBytes(random, random() % 20000));
+		XXH64Update(&state, bodies.back().data(), bodies.back().size());
+		total_len += bodies.back().size();
+	}
+	const unsigned long long expected = XXH64Digest(&state);
+
+	CHECK(HashFile(OggFile(random, 100, bodies), OGG) == expected);
+	CHECK(HashFile(OggFile(random, 60000, bodies), OGG) == expected);
+	CHECK(HashFile(OggFile(random, 0, bodies), OGG) == expected);
+
+	// Junk between pages is skipped until the next capture pattern
+	CHECK(HashFile(OggFile(random, 100, bodies, { 'O', 'g', 'x', 0, 0 }), OGG) == expected);
+
+	// A truncated last page is left out
+	Bytes truncated = OggFile(random, 100, bodies);
+	truncated.resize(truncated.size() - 1);
+	XXH64Reset(&state, 0);
+	for (size_t i = 0; i + 1 < bodies.size(); i++)
+		XXH64Update(&state, bodies[i].data(), bodies[i].size());
+	CHECK(HashFile(truncated, OGG) == XXH64Digest(&state));
+
+	std::vector<Bytes> changed = bodies;
+	changed[changed.size() / 2][0] ^= 1;
+	CHECK(HashFile(OggFile(random, 100, changed), OGG) != expected);
+}
+
+
+// Files that can't be opened, and formats without an audio hash, aren't hashed
+static void TestUnhashed(void)
+{
+	unsigned long long hash = 0;
+	CHECK(!HashAudioData("/nonexistent/song.mp3", MP3, read_buffer, &hash));
+
+	const std::string path = std::string(temp_dir) + "/song.flac";
+	FILE* file = fopen(path.c_str(), "wb");
+	CHECK(file && fputs("fLaC", file) >= 0);
+	fclose(file);
+	CHECK(!HashAudioData(path.c_str(), FLAC, read_buffer, &hash));
+	unlink(path.c_str());
+}
+
+
+int main()
+{
+	CHECK(mkdtemp(temp_dir));
+	TestXXH64();
+	TestMP3Tags();
+	TestOggComments();
+	TestUnhashed();
+	rmdir(temp_dir);
+	return 0;
+}
@@ -0,0 +1,228 @@
+/******************************************************************************
+test_collate.cpp - Tests of the collation keys and the sort by them
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "collate.h"
+#include "check.h"
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+// Builds one key per string, with a single text field each
+static void BuildTextKeys(CollationKeys* keys, const std::vector<std::string>& strings)
+{
+	CollationKeysBegin(keys, strings.size());
+	for (const std::string& str : strings)
+	{
+		CollationKeysNext(keys);
+		AppendCollationText(keys, str.c_str());
+	}
+	CollationKeysEnd(keys);
+}
+
+
+static std::vector<unsigned int> Sort(const CollationKeys* keys, bool descending)
+{
+	std::vector<unsigned int> order(keys->offsets.size() - 1);
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	SortByCollationKeys(keys, descending, order);
+	return order;
+}
+
+
+static std::vector<std::string> SortStrings(const std::vector<std::string>& strings, bool descending = false)
+{
+	CollationKeys keys;
+	BuildTextKeys(&keys, strings);
+	std::vector<std::string> sorted;
+	for (unsigned int idx : Sort(&keys, descending))
+		sorted.push_back(strings[idx]);
+	return sorted;
+}
+
+
+// Compares keys a and b as the sort does: memcmp(), then the shorter key first
+static int CompareKeys(const CollationKeys* keys, unsigned int a, unsigned int b)
+{
+	const size_t a_len = keys->offsets[a + 1] - keys->offsets[a];
+	const size_t b_len = keys->offsets[b + 1] - keys->offsets[b];
+	const int result = memcmp(keys->buffer.data() + keys->offsets[a], keys->buffer.data() + keys->offsets[b], 
+		std::min(a_len, b_len));
+	if (result)
+		return result;
+	return (a_len < b_len) ? -1 : (a_len > b_len);
+}
+
+
+// Runs of digits compare by value, wherever they are in the string
+static void TestNaturalNumbers(void)
+{
+	CHECK(SortStrings({ "track 10", "track 2", "track 1" }) == 
+		std::vector<std::string>({ "track 1", "track 2", "track 10" }));
+	CHECK(SortStrings({ "10 b", "9 b", "100 a" }) == std::vector<std::string>({ "9 b", "10 b", "100 a" }));
+	CHECK(SortStrings({ "a10b2", "a10b10", "a9b99" }) == std::vector<std::string>({ "a9b99", "a10b2", "a10b10" }));
+
+	// Leading zeros don't count, but "0" is still a number
+	CHECK(SortStrings({ "007", "7", "06", "0" })[0] == "0");
+	CHECK(SortStrings({ "008", "7", "06" }) == std::vector<std::string>({ "06", "7", "008" }));
+	CollationKeys keys;
+	BuildTextKeys(&keys, { "track 007", "Track 7" });
+	CHECK(CompareKeys(&keys, 0, 1) == 0);
+
+	// A number sorts before a letter, as in Explorer
+	CHECK(SortStrings({ "a", "1" }) == std::vector<std::string>({ "1", "a" }));
+
+	// A run longer than a 32 bit number still compares by length first
+	CHECK(SortStrings({ "99999999999999999999 x", "100000000000000000000 x" })[0] == "99999999999999999999 x");
+
+	// Numbers fields store 4 bytes, most significant first
+	CollationKeysBegin(&keys, 3);
+	for (unsigned int value : { 0x01000000u, 0xFFu, 0x100u })
+	{
+		CollationKeysNext(&keys);
+		AppendCollationNumber(&keys, value);
+	}
+	CollationKeysEnd(&keys);
+	CHECK(Sort(&keys, false) == std::vector<unsigned int>({ 1, 2, 0 }));
+}
+
+
+// Letters compare without case, control characters are dropped, and a prefix sorts first
+static void TestCaseFolding(void)
+{
+	CollationKeys keys;
+	BuildTextKeys(&keys, { "ABBA", "abba", "AbBa" });
+	CHECK(CompareKeys(&keys, 0, 1) == 0 && CompareKeys(&keys, 1, 2) == 0);
+
+	CHECK(SortStrings({ "beta", "Alpha", "alphabet", "ALP" }) == 
+		std::vector<std::string>({ "ALP", "Alpha", "alphabet", "beta" }));
+
+	// A field ends with a 0 byte, so the next field doesn't decide between "ab" and "abc"
+	CollationKeysBegin(&keys, 2);
+	CollationKeysNext(&keys);
+	AppendCollationText(&keys, "abc");
+	AppendCollationText(&keys, "a");
+	CollationKeysNext(&keys);
+	AppendCollationText(&keys, "ab");
+	AppendCollationText(&keys, "z");
+	CollationKeysEnd(&keys);
+	CHECK(Sort(&keys, false) == std::vector<unsigned int>({ 1, 0 }));
+
+	// NULL is the same as an empty field, and control characters can't end the field early
+	BuildTextKeys(&keys, { "a\tb", "ab" });
+	CHECK(CompareKeys(&keys, 0, 1) == 0);
+	CollationKeysBegin(&keys, 2);
+	CollationKeysNext(&keys);
+	AppendCollationText(&keys, NULL);
+	CollationKeysNext(&keys);
+	AppendCollationText(&keys, "");
+	CollationKeysEnd(&keys);
+	CHECK(CompareKeys(&keys, 0, 1) == 0);
+}
+
+
+// Equal keys keep their order, whichever way the sort goes
+static void TestStability(void)
+{
+	const std::vector<std::string> strings = { "b", "A", "B", "a", "b", "a" };
+	CollationKeys keys;
+	BuildTextKeys(&keys, strings);
+	CHECK(Sort(&keys, false) == std::vector<unsigned int>({ 1, 3, 5, 0, 2, 4 }));
+	CHECK(Sort(&keys, true) == std::vector<unsigned int>({ 0, 2, 4, 1, 3, 5 }));
+
+	// Keys that only differ after the first 8 bytes, or that tie on 8 bytes and then end
+	BuildTextKeys(&keys, { "long common prefix 2", "long common prefix 1", "long com", "long common prefix 1", 
+		"long com" });
+	CHECK(Sort(&keys, false) == std::vector<unsigned int>({ 2, 4, 1, 3, 0 }));
+	CHECK(Sort(&keys, true) == std::vector<unsigned int>({ 0, 1, 3, 2, 4 }));
+
+	// Sorting part of the list only moves the indices given
+	std::vector<unsigned int> order = { 4, 0, 2 };
+	SortByCollationKeys(&keys, false, order);
+	CHECK(order == std::vector<unsigned int>({ 4, 2, 0 }));
+	order.clear();
+	SortByCollationKeys(&keys, true, order);
+	CHECK(order.empty());
+}
+
+
+// Random keys with many ties and shared prefixes sort as std::stable_sort() sorts them with 
+// memcmp().  Descending order, which reverses the runs of equal keys, is checked the same way.
+static void TestRandomKeys(void)
+{
+	std::mt19937 random(2018);
+	for (int round = 0; round < 200; round++)
+	{
+		const unsigned int num_keys = 1 + random() % 300;
+		const int alphabet = 1 + random() % 4;
+		CollationKeys keys;
+		CollationKeysBegin(&keys, num_keys);
+		for (unsigned int i = 0; i < num_keys; i++)
+		{
+			CollationKeysNext(&keys);
+			for (int field = 0, num_fields = 1 + random() % 3; field < num_fields; field++)
+			{
+				if (random() % 3 == 0)
+				{
+					AppendCollationNumber(&keys, random() % 3);
+					continue;
+				}
+				std::string text(random() % 20, ' ');
+				for (char& c : text)
+					c = "aB1 0"[random() % (alphabet + 1)];
+				AppendCollationText(&keys, text.c_str());
+			}
+		}
+		CollationKeysEnd(&keys);
+
+		std::vector<unsigned int> expected(num_keys);
+		for (unsigned int i = 0; i < num_keys; i++)
+			expected[i] = i;
+		std::stable_sort(expected.begin(), expected.end(), 
+			[&keys](unsigned int a, unsigned int b) { return CompareKeys(&keys, a, b) < 0; });
+		CHECK(Sort(&keys, false) == expected);
+
+		std::stable_sort(expected.begin(), expected.end(), 
+			[&keys](unsigned int a, unsigned int b) { return CompareKeys(&keys, a, b) > 0; });
+		CHECK(Sort(&keys, true) == expected);
+	}
+}
+
+
+int main()
+{
+	TestNaturalNumbers();
+	TestCaseFolding();
+	TestStability();
+	TestRandomKeys();
+	return 0;
+}
@@ -0,0 +1,201 @@
+/******************************************************************************
+test_fuzzy.cpp - Tests of the fuzzy matcher, with the entries edited between searches
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Every search is compared with a search of a matcher built from scratch with the same entries,
+// while entries are appended, removed, moved, and reordered between the keystrokes of a query.
+
+#include "fuzzy.h"
+#include "check.h"
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Entry {
+	std::string song_name;
+	std::string album;
+	std::string folder;
+};
+
+
+static void AddEntry(FuzzyMatcher* matcher, const Entry& entry)
+{
+	FuzzyMatcherNext(matcher);
+	FuzzyMatcherAppendField(matcher, entry.song_name.c_str());
+	FuzzyMatcherAppendField(matcher, entry.album.c_str());
+	FuzzyMatcherAppendField(matcher, entry.folder.c_str());
+}
+
+
+static std::vector<unsigned int> SearchFromScratch(const std::vector<Entry>& entries, const char* query)
+{
+	FuzzyMatcher* matcher = FuzzyMatcherCreate();
+	FuzzyMatcherBegin(matcher, entries.size());
+	for (const Entry& entry : entries)
+		AddEntry(matcher, entry);
+	std::vector<unsigned int> results = FuzzyMatcherSearch(matcher, query);
+	FuzzyMatcherFree(matcher);
+	return results;
+}
+
+
+static Entry RandomEntry(std::mt19937& random)
+{
+	static const char* const words[] = { "The", "Beatles", "Help!", "Abbey", "Road", "Here", "Comes",
+		"Sun", "Let", "It", "Be", "Yesterday", "Blue", "Note", "1959", "Kind", "of", "So", "What" };
+	const int num_words = sizeof(words) / sizeof(words[0]);
+	Entry entry;
+	for (int i = 0, count = 1 + random() % 4; i < count; i++)
+		entry.song_name += std::string(i ? " " : "") + words[random() % num_words];
+	entry.album = words[random() % num_words];
+	entry.folder = std::string("C:\\Music\\") + words[random() % num_words];
+	return entry;
+}
+
+
+static void TestScoring(void)
+{
+	FuzzyMatcher* matcher = FuzzyMatcherCreate();
+	FuzzyMatcherBegin(matcher, 3);
+	AddEntry(matcher, { "Help!", "Help!", "C:\\Music\\Beatles" });
+	AddEntry(matcher, { "Hey Jude", "Past Masters", "C:\\Music\\Beatles" });
+	AddEntry(matcher, { "The Beatles - Help!", "", "" });
+	AddEntry(matcher, { "So What", "Kind of Blue", "C:\\Music\\Miles Davis" });
+
+	// The whole query in the song name scores higher than a match in the folder
+	std::vector<unsigned int> results = FuzzyMatcherSearch(matcher, "bthlp");
+	CHECK(results.size() == 1 && results[0] == 2);
+	results = FuzzyMatcherSearch(matcher, "HELP");
+	CHECK(results.size() == 2 && results[0] == 0 && results[1] == 2);
+	results = FuzzyMatcherSearch(matcher, "beatles");
+	CHECK(results.size() == 3 && results[0] == 2);
+	results = FuzzyMatcherSearch(matcher, "kind blue");
+	CHECK(results.size() == 1 && results[0] == 3);
+	results = FuzzyMatcherSearch(matcher, "xyz");
+	CHECK(results.empty());
+
+	// Text is case folded when stored, and the field separator can't be matched
+	char text[] = "help!\x1f" "help!";
+	CHECK(FuzzyScore(text, strlen(text), "hh", 2) > 0);
+	CHECK(FuzzyScore(text, strlen(text), "hx", 2) == 0);
+	FuzzyMatcherFree(matcher);
+}
+
+
+// Makes the same random edit to entries and to matcher
+static void EditEntries(FuzzyMatcher* matcher, std::vector<Entry>& entries, std::mt19937& random)
+{
+	switch (random() % 5)
+	{
+		case 0:		// Append
+		{
+			for (int i = 0, count = 1 + random() % 20; i < count; i++)
+			{
+				entries.push_back(RandomEntry(random));
+				AddEntry(matcher, entries.back());
+			}
+		} break;
+
+		case 1:		// Remove
+		{
+			std::vector<unsigned int> positions;
+			for (unsigned int i = 0; i < entries.size(); i++)
+			{
+				if (random() % 4 == 0)
+					positions.push_back(i);
+			}
+			FuzzyMatcherRemove(matcher, positions.data(), positions.size());
+			for (size_t i = positions.size(); i-- > 0;)
+				entries.erase(entries.begin() + positions[i]);
+		} break;
+
+		case 2:		// Move, like the move up and move down buttons
+		{
+			if (entries.size() < 2)
+				break;
+			const unsigned int first = random() % entries.size();
+			const unsigned int count = 1 + random() % (entries.size() - first);
+			const unsigned int dest = random() % (entries.size() - count + 1);
+			std::vector<Entry> moved(entries.begin() + first, entries.begin() + first + count);
+			entries.erase(entries.begin() + first, entries.begin() + first + count);
+			entries.insert(entries.begin() + dest, moved.begin(), moved.end());
+			FuzzyMatcherMove(matcher, first, count, dest);
+		} break;
+
+		case 3:		// Reorder, like a sort or an undo
+		{
+			std::vector<unsigned int> old_positions(entries.size());
+			for (unsigned int i = 0; i < entries.size(); i++)
+				old_positions[i] = i;
+			std::shuffle(old_positions.begin(), old_positions.end(), random);
+			std::vector<Entry> reordered(entries.size());
+			for (unsigned int i = 0; i < entries.size(); i++)
+				reordered[i] = entries[old_positions[i]];
+			entries.swap(reordered);
+			FuzzyMatcherReorder(matcher, old_positions.data(), old_positions.size());
+		} break;
+
+		default:	// Nothing changes
+			break;
+	}
+}
+
+
+static void TestEdits(void)
+{
+	std::mt19937 random(2024);
+	std::vector<Entry> entries;
+	FuzzyMatcher* matcher = FuzzyMatcherCreate();
+	FuzzyMatcherBegin(matcher, 0);
+	const char* const queries[] = { "the sun", "beatles", "blue note", "1959", "abbey road", "hcs", "wt" };
+	for (int round = 0; round < 400; round++)
+	{
+		// Type a query one character at a time, as in the search box, with the playlist sometimes
+		// edited between two keystrokes
+		const char* query = queries[random() % (sizeof(queries) / sizeof(queries[0]))];
+		for (size_t len = 1; len <= strlen(query); len++)
+		{
+			if (random() % 2 == 0)
+				EditEntries(matcher, entries, random);
+			const std::string typed(query, len);
+			CHECK(FuzzyMatcherSearch(matcher, typed.c_str()) == SearchFromScratch(entries, typed.c_str()));
+		}
+	}
+	FuzzyMatcherFree(matcher);
+}
+
+
+int main()
+{
+	TestScoring();
+	TestEdits();
+	return 0;
+}
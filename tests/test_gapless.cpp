@@ -0,0 +1,358 @@
+/******************************************************************************
+test_gapless.cpp - Tests of trimming MP3 encoder delay and padding, and of reading how much to trim
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#define NOMINMAX
+#include "player.h"
+#include "metadata.h"
+#include "fake_bass.h"
+#include "check.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Like LAME's: the encoder delay and MP3_DECODER_DELAY of junk before the song, and the padding after it
+struct TrimmedSong {
+	QWORD junk_before;
+	QWORD num_frames;
+	QWORD junk_after;
+	bool has_gapless_info;		// Without it the whole decoder is played, so it can't have junk
+};
+
+
+static HSTREAM CreateSongDecoder(const TrimmedSong& song, QWORD signal_start, GaplessInfo* gapless)
+{
+	gapless->start_trim = (unsigned int)song.junk_before;
+	gapless->num_samples = song.num_frames;
+	return CreateFakeDecoder(signal_start, song.num_frames, song.junk_before, song.junk_after);
+}
+
+
+// Songs with their junk trimmed off play as one continuous waveform.  Junk is FAKE_JUNK_SAMPLE, so one
+// sample of it that isn't trimmed, or one sample of the song that is, shows up as an error.
+static void TestPlayThrough(Player* player)
+{
+	const TrimmedSong songs[] = {
+		{ 576 + MP3_DECODER_DELAY, FAKE_FREQ * 2 + 333, 1200 - MP3_DECODER_DELAY, true },
+		{ 1105, FAKE_FREQ + 7, 700, true },
+		{ 0, FAKE_FREQ * 3 / 2, 0, false },
+		{ 2112, FAKE_FREQ * 2, 1000, true },
+		{ MP3_DECODER_DELAY + 1152, FAKE_FREQ * 3, 4000, true },
+	};
+	const int num_songs = sizeof(songs) / sizeof(songs[0]);
+	QWORD starts[num_songs];
+	QWORD total_frames = 0;
+	for (int i = 0; i < num_songs; i++)
+	{
+		starts[i] = total_frames;
+		total_frames += songs[i].num_frames;
+	}
+
+	null_device_heard.clear();
+	const int num_decode_to = GetFakeDecodeToCount();
+	GaplessInfo gapless;
+	HSTREAM decoder = CreateSongDecoder(songs[0], starts[0], &gapless);
+	CHECK(PlayerLoad(player, decoder, &gapless));
+	CHECK(PlayerGetLength(player) == songs[0].num_frames * FAKE_FRAME_BYTES);
+	BASS_ChannelPlay(player->stream, FALSE);
+	int curr = 0;
+	int next = 0;
+	for (int step = 1; BASS_ChannelIsActive(player->stream) == BASS_ACTIVE_PLAYING; step++)
+	{
+		NullDeviceStep(player->stream);
+		if (step % 10 != 0)
+			continue;
+
+		if (PlayerUpdate(player))
+		{
+			curr++;
+			CHECK(PlayerGetLength(player) == songs[curr].num_frames * FAKE_FRAME_BYTES);
+		}
+		// Positions are in the trimmed song, so 0 is its first real sample
+		CHECK(PlayerGetPosition(player) == (NullDeviceHeardFrames() - starts[curr]) * FAKE_FRAME_BYTES);
+		if (next == curr && curr + 1 < num_songs && !PlayerIsChanging(player))
+		{
+			next++;
+			decoder = CreateSongDecoder(songs[next], starts[next], &gapless);
+			CHECK(PlayerSetNext(player, decoder, songs[next].has_gapless_info ? &gapless : NULL));
+		}
+	}
+	while (PlayerUpdate(player))
+		curr++;
+	CHECK(curr == num_songs - 1);
+	CHECK(NullDeviceHeardFrames() == total_frames);
+	CHECK(NullDeviceError(0, total_frames, 0) == 0);
+
+	// The junk at the start is skipped by decoding past it, which BASS does to the sample
+	int num_trimmed = 0;
+	for (int i = 0; i < num_songs; i++)
+		num_trimmed += (songs[i].has_gapless_info && songs[i].junk_before > 0);
+	CHECK(GetFakeDecodeToCount() - num_decode_to == num_trimmed);
+}
+
+
+// Seeking in a trimmed song is from its first real sample, and a seek back while the next song is
+// buffered rewinds the next song to its first real sample too
+static void TestSeek(Player* player)
+{
+	const TrimmedSong song1 = { 2112, FAKE_FREQ * 2, 1000, true };
+	const TrimmedSong song2 = { 1105, FAKE_FREQ + 7, 700, true };
+	GaplessInfo gapless;
+
+	null_device_heard.clear();
+	CHECK(PlayerLoad(player, CreateSongDecoder(song1, 0, &gapless), &gapless));
+	BASS_ChannelPlay(player->stream, FALSE);
+	CHECK(PlayerSetPosition(player, (FAKE_FREQ / 2) * FAKE_FRAME_BYTES));
+	while (BASS_ChannelIsActive(player->stream) == BASS_ACTIVE_PLAYING)
+		NullDeviceStep(player->stream);
+	CHECK(NullDeviceHeardFrames() == song1.num_frames - FAKE_FREQ / 2);
+	CHECK(NullDeviceError(0, song1.num_frames - FAKE_FREQ / 2, FAKE_FREQ / 2) == 0);
+
+	CHECK(PlayerLoad(player, CreateSongDecoder(song1, 0, &gapless), &gapless));
+	BASS_ChannelPlay(player->stream, FALSE);
+	CHECK(PlayerSetNext(player, CreateSongDecoder(song2, song1.num_frames, &gapless), &gapless));
+	while (!PlayerIsChanging(player))
+		NullDeviceStep(player->stream);
+	null_device_heard.clear();
+	CHECK(PlayerSetPosition(player, 1000 * FAKE_FRAME_BYTES));
+	while (BASS_ChannelIsActive(player->stream) == BASS_ACTIVE_PLAYING)
+	{
+		NullDeviceStep(player->stream);
+		PlayerUpdate(player);
+	}
+	const QWORD num_frames = song1.num_frames + song2.num_frames - 1000;
+	CHECK(NullDeviceHeardFrames() == num_frames);
+	CHECK(NullDeviceError(0, num_frames, 1000) == 0);
+}
+
+
+// A song shorter than PLAYER_PREROLL_MS is trimmed inside the preroll
+static void TestShortSong(Player* player)
+{
+	const TrimmedSong song1 = { 576 + MP3_DECODER_DELAY, FAKE_FREQ, 600, true };
+	const TrimmedSong song2 = { 576 + MP3_DECODER_DELAY, 100, 1500, true };
+	GaplessInfo gapless;
+
+	null_device_heard.clear();
+	CHECK(PlayerLoad(player, CreateSongDecoder(song1, 0, &gapless), &gapless));
+	BASS_ChannelPlay(player->stream, FALSE);
+	CHECK(PlayerSetNext(player, CreateSongDecoder(song2, song1.num_frames, &gapless), &gapless));
+	while (BASS_ChannelIsActive(player->stream) == BASS_ACTIVE_PLAYING)
+	{
+		NullDeviceStep(player->stream);
+		PlayerUpdate(player);
+	}
+	CHECK(NullDeviceHeardFrames() == song1.num_frames + 100);
+	CHECK(NullDeviceError(0, song1.num_frames + 100, 0) == 0);
+}
+
+
+// The first frame of an MP3 encoded by LAME or FFmpeg:  frame header, side information (all zero),
+// Xing or Info tag, and the LAME extension with the delay and padding
+static std::vector<unsigned char> LameFrame(int version, bool is_mono, bool has_crc, unsigned int flags,
+	unsigned int num_frames, const char* encoder, unsigned int delay, unsigned int padding)
+{
+	const unsigned char header[4] = { 0xFF, (unsigned char)(0xE0 | (version << 3) | (1 << 1) | (has_crc ? 0 : 1)),
+		0x90, (unsigned char)(is_mono ? 0xC0 : 0x00) };
+	std::vector<unsigned char> frame(header, header + 4);
+	if (has_crc)
+		frame.insert(frame.end(), 2, 0);
+	const size_t side_info_len = (version == 3) ? (is_mono ? 17 : 32) : (is_mono ? 9 : 17);
+	frame.insert(frame.end(), side_info_len, 0);
+	frame.insert(frame.end(), { 'I', 'n', 'f', 'o', 0, 0, 0, (unsigned char)flags });
+	if (flags & 0x01)
+		frame.insert(frame.end(), { (unsigned char)(num_frames >> 24), (unsigned char)(num_frames >> 16), (unsigned char)(num_frames >> 8), (unsigned char)num_frames });
+	if (flags & 0x02)
+		frame.insert(frame.end(), 4, 0x11);		// File size
+	if (flags & 0x04)
+		frame.insert(frame.end(), 100, 0x22);	// TOC
+	if (flags & 0x08)
+		frame.insert(frame.end(), 4, 0x33);		// Quality
+
+	const size_t lame = frame.size();
+	frame.insert(frame.end(), 36, 0);
+	memcpy(&frame[lame], encoder, 9);
+	frame[lame + 21] = (unsigned char)(delay >> 4);
+	frame[lame + 22] = (unsigned char)(((delay & 0x0F) << 4) | (padding >> 8));
+	frame[lame + 23] = (unsigned char)padding;
+	return frame;
+}
+
+
+static void TestLameHeader(void)
+{
+	static const struct {
+		int version;			// 3 = MPEG-1, 2 = MPEG-2, 0 = MPEG-2.5
+		bool is_mono;
+		bool has_crc;
+		unsigned int flags;
+		unsigned int num_frames;
+		const char* encoder;
+		unsigned int delay;
+		unsigned int padding;
+		unsigned long long num_samples;
+	} cases[] = {
+		{ 3, false, false, 0x0F, 1000, "LAME3.100", 576, 1296, 1000ULL * 1152 - 576 - 1296 },
+		{ 3, true, false, 0x01, 500, "LAME3.99r", 576, 900, 500ULL * 1152 - 576 - 900 },
+		{ 2, false, false, 0x05, 800, "Lavf58.76", 1105, 4095, 800ULL * 576 - 1105 - 4095 },
+		{ 0, true, true, 0x07, 300, "Lavc60.31", 4095, 12, 300ULL * 576 - 4095 - 12 },
+	};
+
+	for (const auto& test : cases)
+	{
+		std::vector<unsigned char> data = LameFrame(test.version, test.is_mono, test.has_crc, test.flags,
+			test.num_frames, test.encoder, test.delay, test.padding);
+		const size_t tag_len = data.size();
+		data.resize(tag_len + 300, 0x55);		// The rest of the audio
+		GaplessInfo gapless = {};
+		CHECK(ParseLameHeader(data.data(), data.size(), &gapless));
+		CHECK(gapless.start_trim == test.delay + MP3_DECODER_DELAY);
+		CHECK(gapless.num_samples == test.num_samples);
+
+		// The frame can come after some junk
+		data.insert(data.begin(), 3, 0x00);
+		gapless = {};
+		CHECK(ParseLameHeader(data.data(), data.size(), &gapless));
+		CHECK(gapless.num_samples == test.num_samples);
+
+		// Cut short anywhere before the end of the delay and padding, it isn't found.  Each cut is a 
+		// buffer of its own, so reading past it can be caught by the address sanitizer.
+		for (size_t len = 0; len < tag_len - 12 + 3; len++)
+		{
+			std::vector<unsigned char> cut(data.begin(), data.begin() + len);
+			CHECK(!ParseLameHeader(cut.data(), cut.size(), &gapless));
+		}
+	}
+
+	// No number of frames, an encoder without the LAME extension, and more delay and padding than samples
+	GaplessInfo gapless = {};
+	std::vector<unsigned char> data = LameFrame(3, false, false, 0x0E, 1000, "LAME3.100", 576, 1000);
+	CHECK(!ParseLameHeader(data.data(), data.size(), &gapless));
+	data = LameFrame(3, false, false, 0x01, 1000, "GOGO-NO-C", 576, 1000);
+	CHECK(!ParseLameHeader(data.data(), data.size(), &gapless));
+	data = LameFrame(3, false, false, 0x01, 1, "LAME3.100", 576, 1000);
+	CHECK(!ParseLameHeader(data.data(), data.size(), &gapless));
+	CHECK(gapless.start_trim == 0 && gapless.num_samples == 0);
+
+	// Random bytes that look like frame headers don't read outside the buffer
+	srand(1);
+	for (int i = 0; i < 100000; i++)
+	{
+		std::vector<unsigned char> random_data(rand() % 300);
+		for (unsigned char& byte : random_data)
+			byte = (rand() % 4) ? 0xFF : (unsigned char)rand();
+		ParseLameHeader(random_data.data(), random_data.size(), &gapless);
+	}
+}
+
+
+// A COMM frame:  text encoding, language, description, and text
+static std::vector<unsigned char> CommentFrame(int encoding, const char* desc, const char* text)
+{
+	std::vector<unsigned char> data = { (unsigned char)encoding, 'e', 'n', 'g' };
+	for (const char* str : { desc, text })
+	{
+		if (encoding == ID3V2_FRAME_TEXT_ENC_UTF16_BOM)
+			data.insert(data.end(), { 0xFF, 0xFE });
+		for (const char* c = str; ; c++)
+		{
+			if (encoding == ID3V2_FRAME_TEXT_ENC_UTF16_BOM)
+				data.insert(data.end(), { (unsigned char)*c, 0 });
+			else if (encoding == ID3V2_FRAME_TEXT_ENC_UTF16_BE)
+				data.insert(data.end(), { 0, (unsigned char)*c });
+			else
+				data.push_back(*c);
+			if (*c == '\0')
+				break;
+		}
+	}
+	return data;
+}
+
+
+// An ID3v2.3 tag with a title frame, the comment frame, and padding
+static std::vector<unsigned char> TagWithComment(const std::vector<unsigned char>& comment)
+{
+	std::vector<unsigned char> tag = { 'I', 'D', '3', 3, 0, 0, 0, 0, 0, 0 };
+	tag.insert(tag.end(), { 'T', 'I', 'T', '2', 0, 0, 0, 5, 0, 0, 0, 'S', 'o', 'n', 'g' });
+	const unsigned int comment_size = (unsigned int)comment.size();
+	tag.insert(tag.end(), { 'C', 'O', 'M', 'M', (unsigned char)(comment_size >> 24), (unsigned char)(comment_size >> 16),
+		(unsigned char)(comment_size >> 8), (unsigned char)comment_size, 0, 0 });
+	tag.insert(tag.end(), comment.begin(), comment.end());
+	tag.insert(tag.end(), 64, 0);
+	const unsigned int tag_size = (unsigned int)tag.size() - ID3V2_HEADER_LEN;
+	tag[6] = (tag_size >> 21) & 0x7F;
+	tag[7] = (tag_size >> 14) & 0x7F;
+	tag[8] = (tag_size >> 7) & 0x7F;
+	tag[9] = tag_size & 0x7F;
+	return tag;
+}
+
+
+static void TestITunesGapless(void)
+{
+	const char* smpb = " 00000000 00000840 000001CC 0000000000ADFE34 00000000 00000000";
+	for (int encoding = ID3V2_FRAME_TEXT_ENC_ASCII; encoding <= ID3V2_FRAME_TEXT_ENC_UTF8; encoding++)
+	{
+		const std::vector<unsigned char> tag = TagWithComment(CommentFrame(encoding, ID3V2_ITUNES_GAPLESS_DESC, smpb));
+		GaplessInfo gapless = {};
+		CHECK(ID3v2_GetITunesGapless((const char*)tag.data(), &gapless));
+		CHECK(gapless.start_trim == 0x840);
+		CHECK(gapless.num_samples == 0xADFE34);
+	}
+
+	// Another comment, too few numbers, a start trim no encoder would make, and a frame bigger than the tag
+	GaplessInfo gapless = {};
+	std::vector<unsigned char> tag = TagWithComment(CommentFrame(ID3V2_FRAME_TEXT_ENC_ASCII, "iTunNORM", smpb));
+	CHECK(!ID3v2_GetITunesGapless((const char*)tag.data(), &gapless));
+	tag = TagWithComment(CommentFrame(ID3V2_FRAME_TEXT_ENC_ASCII, ID3V2_ITUNES_GAPLESS_DESC, " 00000000 00000840"));
+	CHECK(!ID3v2_GetITunesGapless((const char*)tag.data(), &gapless));
+	tag = TagWithComment(CommentFrame(ID3V2_FRAME_TEXT_ENC_ASCII, ID3V2_ITUNES_GAPLESS_DESC, " 00000000 00100000 00000000 0000000000ADFE34"));
+	CHECK(!ID3v2_GetITunesGapless((const char*)tag.data(), &gapless));
+	tag = TagWithComment(CommentFrame(ID3V2_FRAME_TEXT_ENC_ASCII, ID3V2_ITUNES_GAPLESS_DESC, smpb));
+	tag[ID3V2_HEADER_LEN + ID3V2_FRAME_HEADER_LEN + 5 + 4] = 0x7F;		// High byte of the COMM frame's size
+	CHECK(!ID3v2_GetITunesGapless((const char*)tag.data(), &gapless));
+	CHECK(gapless.start_trim == 0 && gapless.num_samples == 0);
+}
+
+
+int main()
+{
+	Player player = {};
+	PlayerInit(&player);
+	TestPlayThrough(&player);
+	TestSeek(&player);
+	TestShortSong(&player);
+	PlayerFree(&player);
+	CHECK(GetFakeDecodersOpen() == 0);
+
+	TestLameHeader();
+	TestITunesGapless();
+	return 0;
+}
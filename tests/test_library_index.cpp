@@ -0,0 +1,388 @@
+/******************************************************************************
+test_library_index.cpp - Tests of the columnar library index
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#define NOMINMAX
+#include "library_index.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// The tags of a test song, as numbers where the index parses them
+struct Tags {
+	std::string artist;
+	std::string album;
+	std::string genre;
+	unsigned int track;
+	unsigned int disc;
+	unsigned int year;
+	unsigned int secs;
+	unsigned int bitrate;
+};
+
+static const LibraryColumn g_text_columns[] = { LIB_COL_ARTIST, LIB_COL_ALBUM, LIB_COL_GENRE };
+
+
+static void SetTags(Song* song, const Tags& tags)
+{
+	char track[16], disc[16], date[16];
+	snprintf(track, sizeof(track), "%u/20", tags.track);
+	snprintf(disc, sizeof(disc), "%u", tags.disc);
+	snprintf(date, sizeof(date), "%u-05-01", tags.year);
+
+	SongDetails details = {};
+	details.metadata.artist = tags.artist.empty() ? NULL : (char*)tags.artist.c_str();
+	details.metadata.album = tags.album.empty() ? NULL : (char*)tags.album.c_str();
+	details.metadata.genre = tags.genre.empty() ? NULL : (char*)tags.genre.c_str();
+	details.metadata.track_num = tags.track ? track : NULL;
+	details.metadata.disc_num = tags.disc ? disc : NULL;
+	details.metadata.date = tags.year ? date : NULL;
+	details.bitrate = tags.bitrate;
+	song->song_length_secs = tags.secs;
+	CHECK(SongSetDetails(song, &details, NULL, false));
+}
+
+
+// Names are reused in different cases, so they get the same id
+static Tags RandomTags(std::mt19937& random, unsigned int num_names)
+{
+	const char* const cases[] = { "Name %u", "NAME %u", "name %u" };
+	char name[32];
+	Tags tags = {};
+	snprintf(name, sizeof(name), cases[random() % 3], (unsigned int)(random() % num_names));
+	tags.artist = (random() % 10) ? name : "";
+	snprintf(name, sizeof(name), cases[random() % 3], (unsigned int)(random() % (num_names * 3)));
+	tags.album = (random() % 10) ? name : "";
+	snprintf(name, sizeof(name), "Genre %u", (unsigned int)(random() % 5));
+	tags.genre = (random() % 4) ? name : "";
+	tags.track = random() % 21;
+	tags.disc = random() % 3;
+	tags.year = (random() % 4) ? 1950 + random() % 75 : 0;
+	tags.secs = random() % 1000;
+	tags.bitrate = 64 + random() % 257;
+	return tags;
+}
+
+
+static const std::string& GetTag(const Tags& tags, LibraryColumn column)
+{
+	return (column == LIB_COL_ARTIST) ? tags.artist : (column == LIB_COL_ALBUM) ? tags.album : tags.genre;
+}
+
+
+static const StringPool* GetPool(const LibraryIndex* index, LibraryColumn column)
+{
+	return (column == LIB_COL_ARTIST) ? &index->artists : (column == LIB_COL_ALBUM) ? &index->albums : &index->genres;
+}
+
+
+// Checks every row against the tags of its song, and that each pool has exactly the strings
+// the rows have, with the right counts
+static void CheckIndex(const LibraryIndex* index, const std::map<Song*, Tags>& indexed)
+{
+	CHECK(index->songs.size() == indexed.size());
+	for (int col = 0; col < LIB_NUM_COLUMNS; col++)
+		CHECK(index->columns[col].size() == indexed.size());
+
+	for (unsigned int row = 0; row < index->songs.size(); row++)
+	{
+		const Song* song = index->songs[row];
+		CHECK(song->is_indexed && song->index_row == row);
+		const auto found = indexed.find((Song*)song);
+		CHECK(found != indexed.end());
+		const Tags& tags = found->second;
+		CHECK(index->columns[LIB_COL_TRACK][row] == tags.track);
+		CHECK(index->columns[LIB_COL_DISC][row] == tags.disc);
+		CHECK(index->columns[LIB_COL_YEAR][row] == tags.year);
+		CHECK(index->columns[LIB_COL_DURATION][row] == tags.secs);
+		CHECK(index->columns[LIB_COL_BITRATE][row] == tags.bitrate);
+		for (LibraryColumn column : g_text_columns)
+		{
+			const unsigned int id = index->columns[column][row];
+			const std::string& tag = GetTag(tags, column);
+			CHECK((id == 0) == tag.empty());
+			CHECK(strcasecmp(LibraryIndexGetString(index, column, id), tag.c_str()) == 0);
+			CHECK(LibraryIndexFindString(index, column, tag.c_str()) == id);
+		}
+	}
+
+	for (LibraryColumn column : g_text_columns)
+	{
+		const StringPool* pool = GetPool(index, column);
+		std::vector<unsigned int> ref_counts(pool->names.size(), 0);
+		for (unsigned int row = 0; row < index->songs.size(); row++)
+			ref_counts[index->columns[column][row]]++;
+		CHECK(pool->ref_counts.size() == pool->names.size());
+		CHECK(pool->ids.size() + pool->free_ids.size() + 1 == pool->names.size());
+		for (unsigned int id = 1; id < pool->names.size(); id++)
+		{
+			CHECK(pool->ref_counts[id] == ref_counts[id]);
+			CHECK(pool->names[id].empty() == (ref_counts[id] == 0));
+		}
+		for (unsigned int id : pool->free_ids)
+			CHECK(id > 0 && pool->ref_counts[id] == 0);
+	}
+}
+
+
+static void TestParseTags(void)
+{
+	CHECK(ParseTagNumber(NULL) == 0);
+	CHECK(ParseTagNumber("") == 0);
+	CHECK(ParseTagNumber("3/12") == 3);
+	CHECK(ParseTagNumber("  07") == 7);
+	CHECK(ParseTagNumber("A1") == 0);
+	CHECK(ParseTagNumber("99999999999999999999") < 1000000);
+
+	CHECK(ParseTagYear(NULL) == 0);
+	CHECK(ParseTagYear("1997") == 1997);
+	CHECK(ParseTagYear("2004-05-01") == 2004);
+	CHECK(ParseTagYear("05/01/2004") == 2004);
+	CHECK(ParseTagYear("May 1969") == 1969);
+	CHECK(ParseTagYear("12345 2001") == 2001);
+	CHECK(ParseTagYear("'69") == 0);
+}
+
+
+// Ids ignore the case of the text, and keep the first spelling.  Once no row has the text, its id
+// is freed, string_generation changes, and the id goes to the next new text.
+static void TestStringIds(void)
+{
+	LibraryIndex* index = LibraryIndexCreate();
+	CHECK(strcmp(LibraryIndexGetString(index, LIB_COL_ARTIST, 0), "") == 0);
+	CHECK(LibraryIndexGetString(index, LIB_COL_ARTIST, 1) == NULL);
+	CHECK(LibraryIndexGetString(index, LIB_COL_YEAR, 0) == NULL);
+	CHECK(LibraryIndexFindString(index, LIB_COL_ARTIST, "") == 0);
+	CHECK(LibraryIndexFindString(index, LIB_COL_ARTIST, NULL) == 0);
+	CHECK(LibraryIndexFindString(index, LIB_COL_ARTIST, "The Beatles") == LIB_STRING_NOT_FOUND);
+	CHECK(LibraryIndexFindString(index, LIB_COL_YEAR, "1969") == LIB_STRING_NOT_FOUND);
+
+	Tags tags = {};
+	tags.artist = "The Beatles";
+	Song* first = SongCreate();
+	SetTags(first, tags);
+	LibraryIndexUpdate(index, first);
+	tags.artist = "THE BEATLES";
+	Song* second = SongCreate();
+	SetTags(second, tags);
+	LibraryIndexUpdate(index, second);
+	const unsigned int beatles_id = index->columns[LIB_COL_ARTIST][0];
+	CHECK(beatles_id != 0 && index->columns[LIB_COL_ARTIST][1] == beatles_id);
+	CHECK(LibraryIndexFindString(index, LIB_COL_ARTIST, "the beatles") == beatles_id);
+	CHECK(strcmp(LibraryIndexGetString(index, LIB_COL_ARTIST, beatles_id), "The Beatles") == 0);
+	CHECK(index->artists.ref_counts[beatles_id] == 2);
+
+	// Still there while one song has it
+	const unsigned int generation = index->string_generation;
+	LibraryIndexRemove(index, first);
+	CHECK(LibraryIndexFindString(index, LIB_COL_ARTIST, "The Beatles") == beatles_id);
+	CHECK(index->string_generation == generation);
+
+	// Changing the last song's artist frees the id, which the next new artist gets
+	tags.artist = "Nirvana";
+	SetTags(second, tags);
+	LibraryIndexUpdate(index, second);
+	CHECK(LibraryIndexFindString(index, LIB_COL_ARTIST, "The Beatles") == LIB_STRING_NOT_FOUND);
+	CHECK(index->string_generation != generation);
+	tags.artist = "Queen";
+	SetTags(first, tags);
+	LibraryIndexUpdate(index, first);
+	CHECK(index->columns[LIB_COL_ARTIST][first->index_row] == beatles_id);
+	CHECK(strcmp(LibraryIndexGetString(index, LIB_COL_ARTIST, beatles_id), "Queen") == 0);
+	CHECK(index->artists.names.size() == 3);
+
+	// A clear frees every id
+	const unsigned int clear_generation = index->string_generation;
+	LibraryIndexClear(index);
+	CHECK(!first->is_indexed && !second->is_indexed);
+	CHECK(index->string_generation != clear_generation);
+	CHECK(index->artists.names.size() == 1 && index->artists.ids.empty());
+	CHECK(LibraryIndexFindString(index, LIB_COL_ARTIST, "Queen") == LIB_STRING_NOT_FOUND);
+
+	LibraryIndexFree(index);
+	FreeSong(first);
+	FreeSong(second);
+}
+
+
+// Random adds, changes, removes, and clears, checked against the tags of the indexed songs
+static void TestRandomEdits(void)
+{
+	std::mt19937 random(1);
+	LibraryIndex* index = LibraryIndexCreate();
+	std::vector<Song*> songs;
+	std::map<Song*, Tags> indexed;
+	for (int step = 0; step < 3000; step++)
+	{
+		const unsigned int action = random() % 100;
+		if (action < 40 || songs.empty())
+		{
+			songs.push_back(SongCreate());
+			const Tags tags = RandomTags(random, 30);
+			SetTags(songs.back(), tags);
+			LibraryIndexUpdate(index, songs.back());
+			indexed[songs.back()] = tags;
+		}
+		else if (action < 70)
+		{
+			Song* song = songs[random() % songs.size()];
+			const Tags tags = RandomTags(random, 30);
+			SetTags(song, tags);
+			LibraryIndexUpdate(index, song);
+			indexed[song] = tags;
+		}
+		else if (action < 99)
+		{
+			Song* song = songs[random() % songs.size()];
+			LibraryIndexRemove(index, song);
+			CHECK(!song->is_indexed);
+			indexed.erase(song);
+		}
+		else
+		{
+			LibraryIndexClear(index);
+			indexed.clear();
+		}
+		CheckIndex(index, indexed);
+	}
+
+	LibraryIndexFree(index);
+	for (Song* song : songs)
+		FreeSong(song);
+}
+
+
+// Songs come and go with new names, e.g. a playlist that is cleared and refilled one song at a time.
+// The pools only grow to the most names the rows had at once.
+static void TestBoundedPools(void)
+{
+	LibraryIndex* index = LibraryIndexCreate();
+	std::vector<Song*> songs(100);
+	for (Song*& song : songs)
+		song = SongCreate();
+	for (unsigned int i = 0; i < 100000; i++)
+	{
+		Song* song = songs[i % songs.size()];
+		LibraryIndexRemove(index, song);
+		Tags tags = {};
+		tags.artist = "Artist " + std::to_string(i);
+		tags.album = "Album " + std::to_string(i / 2);
+		SetTags(song, tags);
+		LibraryIndexUpdate(index, song);
+	}
+	CHECK(index->artists.names.size() == 101);
+	CHECK(index->albums.names.size() <= 102);
+	CHECK(index->artists.ids.size() == 100);
+
+	LibraryIndexFree(index);
+	for (Song* song : songs)
+		FreeSong(song);
+}
+
+
+// Listeners hear about each change:  on_remove before the last row is moved into the removed row
+struct ListenerLog {
+	std::vector<std::string> calls;
+	const LibraryIndex* index;
+};
+
+
+static void OnUpdate(void* context, const LibraryIndex* index, unsigned int row)
+{
+	ListenerLog* log = (ListenerLog*)context;
+	CHECK(index == log->index && row < index->songs.size());
+	log->calls.push_back("update " + std::to_string(row));
+}
+
+
+static void OnRemove(void* context, unsigned int row, unsigned int last_row)
+{
+	ListenerLog* log = (ListenerLog*)context;
+	CHECK(last_row + 1 == log->index->songs.size() && log->index->songs[row]->index_row == row);
+	log->calls.push_back("remove " + std::to_string(row) + " " + std::to_string(last_row));
+}
+
+
+static void OnClear(void* context)
+{
+	ListenerLog* log = (ListenerLog*)context;
+	CHECK(log->index->songs.empty());
+	log->calls.push_back("clear");
+}
+
+
+static void TestListeners(void)
+{
+	LibraryIndex* index = LibraryIndexCreate();
+	ListenerLog log;
+	log.index = index;
+	LibraryListener listener = { &log, OnUpdate, OnRemove, OnClear };
+	LibraryIndexAddListener(index, &listener);
+
+	Song* songs[3];
+	for (Song*& song : songs)
+	{
+		song = SongCreate();
+		SetTags(song, Tags());
+		LibraryIndexUpdate(index, song);
+	}
+	LibraryIndexUpdate(index, songs[1]);
+	LibraryIndexRemove(index, songs[0]);
+	LibraryIndexRemove(index, songs[0]);		// Not indexed any more
+	LibraryIndexUpdate(index, NULL);
+	LibraryIndexRemove(index, songs[1]);
+	LibraryIndexClear(index);
+	const std::vector<std::string> expected = { "update 0", "update 1", "update 2", "update 1", "remove 0 2",
+		"remove 1 1", "clear" };
+	CHECK(log.calls == expected);
+
+	LibraryIndexRemoveListener(index, &log);
+	LibraryIndexUpdate(index, songs[2]);
+	CHECK(log.calls.size() == expected.size());
+
+	LibraryIndexFree(index);
+	for (Song* song : songs)
+		FreeSong(song);
+}
+
+
+int main()
+{
+	TestParseTags();
+	TestStringIds();
+	TestRandomEdits();
+	TestBoundedPools();
+	TestListeners();
+	return 0;
+}
@@ -0,0 +1,194 @@
+/******************************************************************************
+test_mixer.cpp - Tests of the crossfade mixer, and of its SSE2 loop against the plain one
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "mixer.h"
+#include "check.h"
+#include <math.h>
+#include <algorithm>
+#include <string.h>
+#include <random>
+#include <vector>
+
+// The same mixer without SSE2, in its own namespace so both can be called
+namespace scalar {
+#define MIXER_NO_SSE2
+#include "mixer.cpp"
+#undef MIXER_NO_SSE2
+}
+
+typedef void (*MixFunction)(float* out, const float* from, const float* to, unsigned int num_frames, unsigned int chans,
+	unsigned long long fade_pos, unsigned long long fade_len, CrossfadeCurve curve);
+
+static const MixFunction mixers[] = { MixCrossfade, scalar::MixCrossfade };
+
+static double Expected(double from, double to, unsigned long long pos, unsigned long long len, CrossfadeCurve curve)
+{
+	const double t = (pos < len) ? (double)pos / len : 1.0;
+	if (curve == CROSSFADE_LINEAR)
+		return from * (1 - t) + to * t;
+	return from * cos(t * M_PI / 2) + to * sin(t * M_PI / 2);
+}
+
+
+static std::vector<float> RandomSamples(std::mt19937& random, size_t num_samples, float scale)
+{
+	std::uniform_real_distribution<float> sample(-scale, scale);
+	std::vector<float> samples(num_samples);
+	for (float& value : samples)
+		value = sample(random);
+	return samples;
+}
+
+
+// Every length, including ones that aren't a multiple of the 4 frames mixed at a time, and every channel
+// count are mixed as the curve says, by both loops
+static void TestCurves(void)
+{
+	std::mt19937 random(7);
+	for (MixFunction mix : mixers)
+	{
+		for (CrossfadeCurve curve : { CROSSFADE_EQUAL_POWER, CROSSFADE_LINEAR })
+		{
+			for (unsigned int chans : { 1, 2, 3, 6 })
+			{
+				for (int trial = 0; trial < 200; trial++)
+				{
+					const unsigned int num_frames = random() % 1000;
+					const unsigned long long fade_len = 1 + random() % 600000;
+					const unsigned long long fade_pos = random() % (fade_len + 10);
+					const std::vector<float> from = RandomSamples(random, num_frames * chans, 1.0f);
+					const std::vector<float> to = RandomSamples(random, num_frames * chans + 1, 1.0f);
+
+					// to is read one float in, so the loads aren't aligned
+					std::vector<float> out(num_frames * chans);
+					mix(out.data(), from.data(), to.data() + 1, num_frames, chans, fade_pos, fade_len, curve);
+					for (unsigned int i = 0; i < num_frames * chans; i++)
+						CHECK(fabs(out[i] - Expected(from[i], to[i + 1], fade_pos + i / chans, fade_len, curve)) < 1e-5);
+
+					// Mixing in place, in blocks of any length, gives the same samples as one call
+					std::vector<float> in_place(to.begin() + 1, to.end());
+					for (unsigned int done = 0; done < num_frames; )
+					{
+						const unsigned int block = std::min(1 + (unsigned int)(random() % 67), num_frames - done);
+						float* block_out = in_place.data() + done * chans;
+						mix(block_out, from.data() + done * chans, block_out, block, chans, fade_pos + done, fade_len, curve);
+						done += block;
+					}
+					CHECK(memcmp(in_place.data(), out.data(), out.size() * sizeof(float)) == 0);
+				}
+			}
+		}
+	}
+}
+
+
+// The SSE2 loop gives the same samples as the plain one
+static void TestSse2(void)
+{
+	std::mt19937 random(11);
+	for (int trial = 0; trial < 5000; trial++)
+	{
+		const CrossfadeCurve curve = (trial % 2) ? CROSSFADE_LINEAR : CROSSFADE_EQUAL_POWER;
+		const unsigned int chans = 1 + trial % 2;
+		const unsigned int num_frames = random() % 300;
+		const unsigned long long fade_len = 1 + random() % 1000000;
+		const unsigned long long fade_pos = random() % (fade_len + 20);
+		const std::vector<float> from = RandomSamples(random, num_frames * chans, 1.0f);
+		const std::vector<float> to = RandomSamples(random, num_frames * chans, 1.0f);
+
+		std::vector<float> out(num_frames * chans);
+		std::vector<float> scalar_out(num_frames * chans);
+		MixCrossfade(out.data(), from.data(), to.data(), num_frames, chans, fade_pos, fade_len, curve);
+		scalar::MixCrossfade(scalar_out.data(), from.data(), to.data(), num_frames, chans, fade_pos, fade_len, curve);
+		// Positions past 2^24 frames can round differently as floats, but that is over 6 minutes into a fade
+		for (size_t i = 0; i < out.size(); i++)
+			CHECK(out[i] == scalar_out[i]);
+	}
+}
+
+
+// The gains stay between 0 and 1 before and after the fade, and the mixer doesn't clip:  floats louder
+// than full scale are mixed like any others, and clipping is left to the output
+static void TestLimits(void)
+{
+	std::mt19937 random(13);
+	const unsigned int num_frames = 37;
+	const std::vector<float> from = RandomSamples(random, num_frames * 2, 4.0f);
+	const std::vector<float> to = RandomSamples(random, num_frames * 2, 4.0f);
+	for (MixFunction mix : mixers)
+	{
+		for (CrossfadeCurve curve : { CROSSFADE_EQUAL_POWER, CROSSFADE_LINEAR })
+		{
+			// The equal power gains are within 4e-6 of 0 and 1 at the ends, and the linear ones are exact
+			const double tolerance = (curve == CROSSFADE_LINEAR) ? 0 : 1e-5;
+			std::vector<float> out(num_frames * 2);
+			mix(out.data(), from.data(), to.data(), num_frames, 2, 0, 1000000, curve);
+			CHECK(fabs(out[0] - from[0]) <= tolerance * fabs(from[0]));
+			for (size_t i = 0; i < out.size(); i++)
+				CHECK(fabs(out[i] - from[i]) < 1e-3);
+
+			// Past the end of the fade, only the next song is heard
+			mix(out.data(), from.data(), to.data(), num_frames, 2, 5000, 100, curve);
+			for (size_t i = 0; i < out.size(); i++)
+				CHECK(fabs(out[i] - to[i]) <= tolerance * fabs(to[i]));
+			mix(out.data(), from.data(), to.data(), num_frames, 2, 90, 100, curve);
+			for (size_t i = 20; i < out.size(); i++)
+				CHECK(fabs(out[i] - to[i]) <= tolerance * fabs(to[i]));
+
+			// Halfway through a fade of a song into itself, equal power is louder by sqrt(2)
+			mix(out.data(), to.data(), to.data(), num_frames, 2, 50, 100, curve);
+			const double middle_gain = (curve == CROSSFADE_LINEAR) ? 1.0 : sqrt(2.0);
+			CHECK(fabs(out[0] - to[0] * middle_gain) < 1e-5 * fabs(to[0]));
+			CHECK(fabs(out[1] - to[1] * middle_gain) < 1e-5 * fabs(to[1]));
+		}
+
+		// Nothing is clipped to full scale
+		const float loud_from[8] = { 3, -3, 3, -3, 3, -3, 3, -3 };
+		const float loud_to[8] = { 5, -5, 5, -5, 5, -5, 5, -5 };
+		float loud_out[8];
+		mix(loud_out, loud_from, loud_to, 4, 2, 2, 4, CROSSFADE_LINEAR);
+		const float loud_expected[8] = { 4, -4, 4.5f, -4.5f, 5, -5, 5, -5 };
+		CHECK(memcmp(loud_out, loud_expected, sizeof(loud_out)) == 0);
+
+		// A fade of no length leaves out alone
+		std::vector<float> out(num_frames * 2, 0.5f);
+		mix(out.data(), from.data(), to.data(), num_frames, 2, 0, 0, CROSSFADE_LINEAR);
+		CHECK(out == std::vector<float>(num_frames * 2, 0.5f));
+	}
+}
+
+
+int main()
+{
+	TestCurves();
+	TestSse2();
+	TestLimits();
+	return 0;
+}
@@ -0,0 +1,169 @@
+/******************************************************************************
+test_path_table.cpp - Tests of the table of song directories
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "path_table.h"
+#include "check.h"
+#include <string.h>
+#include <string>
+
+// Adds path and returns the path put back together from the table
+static std::string RoundTrip(const char* path, unsigned int* dir_id = NULL)
+{
+	const char* file_name;
+	const unsigned int id = PathTableAddPath(path, &file_name);
+	CHECK(file_name >= path && file_name <= path + strlen(path));
+	char buffer[260];
+	CHECK(PathTableGetPath(id, file_name, buffer, sizeof(buffer)));
+	if (dir_id)
+		*dir_id = id;
+	return buffer;
+}
+
+
+static std::string GetDirectory(unsigned int dir_id)
+{
+	char buffer[260];
+	CHECK(PathTableGetDirectory(dir_id, buffer, sizeof(buffer)));
+	return buffer;
+}
+
+
+static void TestRoundTrip(void)
+{
+	unsigned int dir_id;
+	CHECK(RoundTrip("C:\\Music\\Artist\\Album\\01 - Song.mp3", &dir_id) == "C:\\Music\\Artist\\Album\\01 - Song.mp3");
+	CHECK(GetDirectory(dir_id) == "C:\\Music\\Artist\\Album");
+
+	const char* file_name;
+	CHECK(PathTableAddPath("C:\\Music\\Artist\\Album\\02 - Song.mp3", &file_name) == dir_id);
+	CHECK(!strcmp(file_name, "02 - Song.mp3"));
+
+	// A file name alone has no directory
+	CHECK(PathTableAddPath("song.mp3", &file_name) == PATH_NO_DIRECTORY);
+	CHECK(!strcmp(file_name, "song.mp3"));
+	CHECK(RoundTrip("song.mp3") == "song.mp3");
+	CHECK(GetDirectory(PATH_NO_DIRECTORY) == "");
+
+	// Empty components, as in a doubled backslash, are kept
+	CHECK(RoundTrip("C:\\Music\\\\song.mp3") == "C:\\Music\\\\song.mp3");
+	CHECK(RoundTrip("C:\\Music\\Artist\\") == "C:\\Music\\Artist\\");
+}
+
+
+// Directories that share a beginning share its components
+static void TestSharedPrefixes(void)
+{
+	const unsigned int jazz = PathTableAddDirectory("E:\\Shared\\Jazz", 14);
+	const unsigned int shared = PathTableAddDirectory("E:\\Shared", 9);
+	const unsigned int drive = PathTableAddDirectory("E:", 2);
+	CHECK(shared != jazz && drive != shared);
+	CHECK(GetDirectory(shared) == "E:\\Shared");
+
+	// Adding a directory under one that's there adds only its last component
+	const unsigned int rock = PathTableAddDirectory("E:\\Shared\\Rock", 14);
+	CHECK(rock == jazz + 1);
+	const unsigned int album = PathTableAddDirectory("E:\\Shared\\Rock\\Album", 20);
+	CHECK(album == rock + 1);
+	CHECK(PathTableAddDirectory("E:\\Shared\\Jazz", 14) == jazz);
+
+	// The length given is what counts, not the terminator
+	CHECK(PathTableAddDirectory("E:\\Shared\\Rock\\Album", 14) == rock);
+
+	// A component is matched under its own parent only
+	const unsigned int other = PathTableAddDirectory("F:\\Jazz", 7);
+	CHECK(other != jazz);
+	CHECK(GetDirectory(other) == "F:\\Jazz");
+}
+
+
+// Lookups ignore the case of A-Z, and a directory keeps the case it was first added with
+static void TestCase(void)
+{
+	unsigned int first_id;
+	CHECK(RoundTrip("G:\\Music\\The Band\\song.mp3", &first_id) == "G:\\Music\\The Band\\song.mp3");
+	unsigned int dir_id;
+	CHECK(RoundTrip("g:\\MUSIC\\the band\\Other.MP3", &dir_id) == "G:\\Music\\The Band\\Other.MP3");
+	CHECK(dir_id == first_id);
+
+	// Other bytes, such as UTF-8, have to match exactly
+	CHECK(PathTableAddDirectory("G:\\Music\\\xC3\xA9t\xC3\xA9", 14) != PathTableAddDirectory("G:\\Music\\\xC3\x89t\xC3\x89", 14));
+
+	CHECK(PathNamesEqual("ABC", "abc", 3) && !PathNamesEqual("abc", "abd", 3));
+	CHECK(PathHashName(1, "Music", 5) == PathHashName(1, "mUSIC", 5));
+	CHECK(PathHashName(1, "Music", 5) != PathHashName(2, "Music", 5));
+}
+
+
+// UNC paths start with two empty components, and drive roots have nothing after the drive
+static void TestRoots(void)
+{
+	unsigned int dir_id;
+	CHECK(RoundTrip("\\\\server\\share\\Music\\song.mp3", &dir_id) == "\\\\server\\share\\Music\\song.mp3");
+	CHECK(GetDirectory(dir_id) == "\\\\server\\share\\Music");
+	CHECK(PathTableAddDirectory("\\\\SERVER\\Share", 14) == PathTableAddDirectory("\\\\server\\share", 14));
+	CHECK(PathTableAddDirectory("\\\\other\\share", 13) != PathTableAddDirectory("\\\\server\\share", 14));
+
+	CHECK(RoundTrip("H:\\song.mp3", &dir_id) == "H:\\song.mp3");
+	CHECK(GetDirectory(dir_id) == "H:");
+	CHECK(dir_id == PathTableAddDirectory("h:", 2));
+	CHECK(RoundTrip("H:\\") == "H:\\");
+
+	// A path that starts with a backslash is under the empty component
+	CHECK(RoundTrip("\\song.mp3", &dir_id) == "\\song.mp3");
+	CHECK(GetDirectory(dir_id) == "");
+	CHECK(dir_id != PATH_NO_DIRECTORY);
+}
+
+
+// A path is only written if it fits, terminator and all
+static void TestBufferSize(void)
+{
+	const char* file_name;
+	const unsigned int dir_id = PathTableAddPath("C:\\Music\\b.mp3", &file_name);
+	char buffer[20];
+	CHECK(!PathTableGetPath(dir_id, file_name, buffer, 14));
+	CHECK(PathTableGetPath(dir_id, file_name, buffer, 15) && !strcmp(buffer, "C:\\Music\\b.mp3"));
+	CHECK(!PathTableGetDirectory(dir_id, buffer, 8));
+	CHECK(PathTableGetDirectory(dir_id, buffer, 9) && !strcmp(buffer, "C:\\Music"));
+	CHECK(!PathTableGetPath(PATH_NO_DIRECTORY, "b.mp3", buffer, 5));
+	CHECK(PathTableGetPath(PATH_NO_DIRECTORY, "b.mp3", buffer, 6) && !strcmp(buffer, "b.mp3"));
+	CHECK(!PathTableGetDirectory(PATH_NO_DIRECTORY, buffer, 0));
+}
+
+
+int main()
+{
+	TestRoundTrip();
+	TestSharedPrefixes();
+	TestCase();
+	TestRoots();
+	TestBufferSize();
+	return 0;
+}
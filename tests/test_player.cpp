@@ -0,0 +1,214 @@
+/******************************************************************************
+test_player.cpp - Tests that the player joins songs without a gap, on a null output device
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "player.h"
+#include "fake_bass.h"
+#include "check.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define TIMER_STEPS		10		// Steps of the null device per tick of the UI timer (100 ms)
+
+// Songs are stretches of one signal, so without a gap what is heard is the signal from frame 0, with
+// exactly as many frames as the songs have.  A gap of even one sample would add frames and break it.
+static void CheckHeardWithoutGap(QWORD total_frames)
+{
+	CHECK(NullDeviceHeardFrames() == total_frames);
+	CHECK(NullDeviceError(0, total_frames, 0) == 0);
+}
+
+
+// Plays songs through like the UI does: the next song is given to the player as soon as the last change
+// is heard (PrepareNextSong()), and changes are picked up on the timer (NextSongStarted())
+static void TestPlayThrough(Player* player)
+{
+	const QWORD lengths[] = { FAKE_FREQ * 3 + 17, FAKE_FREQ + 3, FAKE_FREQ * 2 + 1001, FAKE_FREQ * 6 / 10 + 999, FAKE_FREQ * 4 };
+	const int num_songs = sizeof(lengths) / sizeof(lengths[0]);
+	QWORD starts[num_songs];
+	QWORD total_frames = 0;
+	for (int i = 0; i < num_songs; i++)
+	{
+		starts[i] = total_frames;
+		total_frames += lengths[i];
+	}
+
+	null_device_heard.clear();
+	CHECK(PlayerLoad(player, CreateFakeDecoder(starts[0], lengths[0]), NULL));
+	CHECK(PlayerGetLength(player) == lengths[0] * FAKE_FRAME_BYTES);
+	BASS_ChannelPlay(player->stream, FALSE);
+	int curr = 0;
+	int next = 0;
+	for (int step = 1; BASS_ChannelIsActive(player->stream) == BASS_ACTIVE_PLAYING; step++)
+	{
+		NullDeviceStep(player->stream);
+		if (step % TIMER_STEPS != 0)
+			continue;
+
+		if (PlayerUpdate(player))
+		{
+			curr++;
+			CHECK(PlayerGetLength(player) == lengths[curr] * FAKE_FRAME_BYTES);
+			// The UI hears about the change on the first tick after it can be heard
+			CHECK(NullDeviceHeardFrames() - starts[curr] <= TIMER_STEPS * FAKE_PLAY_FRAMES);
+		}
+		CHECK(PlayerGetPosition(player) == (NullDeviceHeardFrames() - starts[curr]) * FAKE_FRAME_BYTES);
+		if (next == curr && curr + 1 < num_songs && !PlayerIsChanging(player))
+		{
+			next++;
+			CHECK(PlayerSetNext(player, CreateFakeDecoder(starts[next], lengths[next]), NULL));
+		}
+	}
+	while (PlayerUpdate(player))
+		curr++;
+	CHECK(curr == num_songs - 1);
+	CheckHeardWithoutGap(total_frames);
+}
+
+
+// A song shorter than the output buffer ends before the UI can give the player the song after it, so
+// the output stream ends after it and the UI loads the next song the usual way
+static void TestShortSong(Player* player)
+{
+	null_device_heard.clear();
+	CHECK(PlayerLoad(player, CreateFakeDecoder(0, FAKE_FREQ), NULL));
+	BASS_ChannelPlay(player->stream, FALSE);
+	CHECK(PlayerSetNext(player, CreateFakeDecoder(FAKE_FREQ, 999), NULL));
+	for (int step = 1; BASS_ChannelIsActive(player->stream) == BASS_ACTIVE_PLAYING; step++)
+	{
+		NullDeviceStep(player->stream);
+		if (step % TIMER_STEPS == 0 && PlayerUpdate(player) && !PlayerIsChanging(player))
+			CHECK(!PlayerSetNext(player, CreateFakeDecoder(FAKE_FREQ + 999, FAKE_FREQ), NULL));
+	}
+	PlayerUpdate(player);
+	CheckHeardWithoutGap(FAKE_FREQ + 999);
+}
+
+
+// Seeking back while the start of the next song is in the output buffer takes it out again, and the
+// next song is joined on again when the current one ends
+static void TestSeekWhileChanging(Player* player)
+{
+	null_device_heard.clear();
+	CHECK(PlayerLoad(player, CreateFakeDecoder(0, FAKE_FREQ), NULL));
+	BASS_ChannelPlay(player->stream, FALSE);
+	CHECK(PlayerSetNext(player, CreateFakeDecoder(FAKE_FREQ, FAKE_FREQ), NULL));
+	while (!PlayerIsChanging(player))
+		NullDeviceStep(player->stream);
+
+	const QWORD seek_frame = FAKE_FREQ / 2;
+	null_device_heard.clear();
+	CHECK(PlayerSetPosition(player, seek_frame * FAKE_FRAME_BYTES));
+	CHECK(PlayerGetPosition(player) == seek_frame * FAKE_FRAME_BYTES);
+	while (BASS_ChannelIsActive(player->stream) == BASS_ACTIVE_PLAYING)
+	{
+		NullDeviceStep(player->stream);
+		PlayerUpdate(player);
+	}
+	CHECK(NullDeviceHeardFrames() == 2 * FAKE_FREQ - seek_frame);
+	CHECK(NullDeviceError(0, 2 * FAKE_FREQ - seek_frame, seek_frame) == 0);
+}
+
+
+// Songs can only be joined if they have the same format
+static void TestOtherFormat(Player* player)
+{
+	CHECK(PlayerLoad(player, CreateFakeDecoder(0, FAKE_FREQ / 10), NULL));
+	const HSTREAM decoder = CreateFakeDecoder(0, FAKE_FREQ, 0, 0, 48000);
+	CHECK(!PlayerSetNext(player, decoder, NULL));
+	BASS_StreamFree(decoder);
+	PlayerUnload(player);
+}
+
+
+// The null device plays on its own thread, as fast as it can, while the UI thread gives the player
+// the next songs, picks up the changes, and asks for the position
+static void TestThreaded(Player* player)
+{
+	const int num_songs = 40;
+	std::vector<QWORD> starts(num_songs);
+	std::vector<QWORD> lengths(num_songs);
+	QWORD total_frames = 0;
+	for (int i = 0; i < num_songs; i++)
+	{
+		lengths[i] = FAKE_FREQ + (i * 7919) % FAKE_FREQ;
+		starts[i] = total_frames;
+		total_frames += lengths[i];
+	}
+
+	null_device_heard.clear();
+	CHECK(PlayerLoad(player, CreateFakeDecoder(starts[0], lengths[0]), NULL));
+	BASS_ChannelPlay(player->stream, FALSE);
+	const HSTREAM stream = player->stream;
+	std::atomic<bool> is_done(false);
+	std::thread device([&] {
+		while (!is_done)
+		{
+			NullDeviceStep(stream);
+			std::this_thread::yield();
+		}
+	});
+
+	int curr = 0;
+	int next = 0;
+	while (BASS_ChannelIsActive(stream) == BASS_ACTIVE_PLAYING)
+	{
+		if (PlayerUpdate(player))
+			curr++;
+		if (next == curr && curr + 1 < num_songs && !PlayerIsChanging(player))
+		{
+			next++;
+			CHECK(PlayerSetNext(player, CreateFakeDecoder(starts[next], lengths[next]), NULL));
+		}
+		CHECK(PlayerGetPosition(player) <= lengths[curr] * FAKE_FRAME_BYTES);
+		std::this_thread::yield();
+	}
+	is_done = true;
+	device.join();
+	while (PlayerUpdate(player))
+		curr++;
+	CHECK(curr == num_songs - 1);
+	CheckHeardWithoutGap(total_frames);
+}
+
+
+int main()
+{
+	Player player = {};
+	PlayerInit(&player);
+	TestPlayThrough(&player);
+	TestShortSong(&player);
+	TestSeekWhileChanging(&player);
+	TestOtherFormat(&player);
+	TestThreaded(&player);
+	PlayerFree(&player);
+	CHECK(GetFakeDecodersOpen() == 0);
+	return 0;
+}
@@ -0,0 +1,208 @@
+/******************************************************************************
+test_playlist.cpp - Tests of the playlist treap against a plain array
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#define NOMINMAX
+#include "playlist.h"
+#include "util.h"
+#include "check.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Checks the tree (priorities, parent pointers, and subtree totals) and returns its node count
+static unsigned int CheckSubtree(const PlaylistNode* node, const PlaylistNode* parent)
+{
+	if (node == NULL)
+		return 0;
+	CHECK(node->parent == parent);
+	CHECK(!node->left || node->left->priority <= node->priority);
+	CHECK(!node->right || node->right->priority <= node->priority);
+	const unsigned int count = 1 + CheckSubtree(node->left, node) + CheckSubtree(node->right, node);
+	CHECK(node->count == count);
+	CHECK(node->length_secs == node->song->song_length_secs + (node->left ? node->left->length_secs : 0) + 
+		(node->right ? node->right->length_secs : 0));
+	return count;
+}
+
+
+// The playlist has the songs of expected in the same order, and every order statistic agrees
+static void CheckPlaylist(const Playlist* playlist, const std::vector<PlaylistNode*>& expected)
+{
+	CHECK(CheckSubtree(playlist->root, NULL) == expected.size());
+	CHECK(PlaylistCount(playlist) == expected.size());
+	unsigned long long length = 0;
+	const PlaylistNode* node = PlaylistFirst(playlist);
+	for (unsigned int i = 0; i < expected.size(); i++)
+	{
+		CHECK(node == expected[i]);
+		CHECK(PlaylistNodeAt(playlist, i) == expected[i]);
+		CHECK(PlaylistSongAt(playlist, i) == expected[i]->song);
+		CHECK(PlaylistIndexOf(expected[i]) == i);
+		CHECK(PlaylistLengthBefore(playlist, i) == length);
+		length += expected[i]->song->song_length_secs;
+		node = PlaylistNext(node);
+	}
+	CHECK(node == NULL);
+	CHECK(PlaylistTotalLength(playlist) == length);
+	CHECK(PlaylistLengthBefore(playlist, (unsigned int)expected.size()) == length);
+	CHECK(PlaylistNodeAt(playlist, (unsigned int)expected.size()) == NULL);
+	CHECK(PlaylistSongAt(playlist, (unsigned int)expected.size()) == NULL);
+}
+
+
+static void TestEmpty(void)
+{
+	Playlist playlist = {};
+	CheckPlaylist(&playlist, {});
+	CHECK(PlaylistFirst(&playlist) == NULL);
+	PlaylistRebuild(&playlist, NULL, 0);
+	PlaylistClear(&playlist);
+	CheckPlaylist(&playlist, {});
+}
+
+
+// Random inserts, deletes, moves, rebuilds, and length changes, checked against an array after each
+static void TestRandomEdits(void)
+{
+	std::mt19937 random(32);
+	std::vector<Song> songs(2000);
+	for (Song& song : songs)
+		song.song_length_secs = random() % 600;
+
+	Playlist playlist = {};
+	std::vector<PlaylistNode*> expected;
+	size_t next_song = 0;
+	for (int step = 0; step < 3000; step++)
+	{
+		const unsigned int count = (unsigned int)expected.size();
+		const unsigned int action = random() % 10;
+		if (action < 4 || count == 0)
+		{
+			Song* song = &songs[next_song++ % songs.size()];
+			const unsigned int idx = (random() % 4 == 0) ? count : random() % (count + 1);
+			PlaylistNode* node = (idx == count) ? PlaylistPushBack(&playlist, song) : PlaylistInsert(&playlist, idx, song);
+			CHECK(node->song == song);
+			expected.insert(expected.begin() + idx, node);
+		}
+		else if (action < 6)
+		{
+			const unsigned int idx = random() % count;
+			PlaylistDelete(&playlist, expected[idx]);
+			expected.erase(expected.begin() + idx);
+		}
+		else if (action < 8)
+		{
+			const unsigned int first = random() % count;
+			const unsigned int num_moved = 1 + random() % (count - first);
+			const unsigned int dest = random() % (count - num_moved + 1);
+			PlaylistMove(&playlist, first, num_moved, dest);
+			std::vector<PlaylistNode*> moved(expected.begin() + first, expected.begin() + first + num_moved);
+			expected.erase(expected.begin() + first, expected.begin() + first + num_moved);
+			expected.insert(expected.begin() + dest, moved.begin(), moved.end());
+		}
+		else if (action < 9)
+		{
+			std::shuffle(expected.begin(), expected.end(), random);
+			PlaylistRebuild(&playlist, expected.data(), count);
+		}
+		else
+		{
+			PlaylistNode* node = expected[random() % count];
+			node->song->song_length_secs = random() % 600;
+			PlaylistSongLengthChanged(node);
+		}
+		CheckPlaylist(&playlist, expected);
+	}
+
+	std::vector<PlaylistNode*> nodes(PlaylistCount(&playlist));
+	PlaylistGetNodes(&playlist, nodes.data());
+	CHECK(nodes == expected);
+	PlaylistClear(&playlist);
+	CheckPlaylist(&playlist, {});
+}
+
+
+// Deleting a few nodes deletes them one at a time, and deleting many rebuilds the tree from the 
+// rest.  Either way the links to the deleted nodes are cleared.
+static void TestDeleteNodes(void)
+{
+	std::mt19937 random(33);
+	for (unsigned int num_deleted : { 1u, 10u, 100u, 999u, 1000u })
+	{
+		std::vector<Song> songs(1000);
+		Playlist playlist = {};
+		Playlist other = {};
+		std::vector<PlaylistNode*> expected;
+		for (Song& song : songs)
+		{
+			song.song_length_secs = random() % 600;
+			PlaylistNode* node = PlaylistPushBack(&playlist, &song);
+			node->link = PlaylistPushBack(&other, &song);
+			node->link->link = node;
+			expected.push_back(node);
+		}
+
+		std::vector<PlaylistNode*> shuffled = expected;
+		std::shuffle(shuffled.begin(), shuffled.end(), random);
+		std::vector<PlaylistNode*> deleted(shuffled.begin(), shuffled.begin() + num_deleted);
+		std::vector<PlaylistNode*> links;
+		for (PlaylistNode* node : deleted)
+			links.push_back(node->link);
+		PlaylistDeleteNodes(&playlist, deleted.data(), num_deleted);
+		for (PlaylistNode* node : links)
+			CHECK(node->link == NULL);
+
+		std::sort(deleted.begin(), deleted.end());
+		expected.erase(std::remove_if(expected.begin(), expected.end(), [&deleted](PlaylistNode* node) {
+			return std::binary_search(deleted.begin(), deleted.end(), node); }), expected.end());
+		CheckPlaylist(&playlist, expected);
+		PlaylistClear(&playlist);
+		PlaylistClear(&other);
+	}
+}
+
+
+// Every node is freed by the time the playlists are cleared
+static void TestNoLeaks(void)
+{
+	AllocStats stats[ALLOC_NUM_TAGS];
+	GetAllocStats(stats);
+	CHECK(stats[ALLOC_PLAYLIST].live_bytes == 0);
+}
+
+
+int main()
+{
+	TestEmpty();
+	TestRandomEdits();
+	TestDeleteNodes();
+	TestNoLeaks();
+	return 0;
+}
@@ -0,0 +1,360 @@
+/******************************************************************************
+test_playlist_file.cpp - Tests of reading M3U, PLS, and XSPF playlist files
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "playlist_file.h"
+#include "check.h"
+#include <algorithm>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Entry {
+	std::string path;
+	std::string title;			// "(none)" if the entry doesn't have one
+	int length_secs;
+};
+
+
+static void AddEntry(void* context, const PlaylistFileEntry* entry)
+{
+	Entry result = { entry->path, entry->title ? entry->title : "(none)", entry->length_secs };
+	((std::vector<Entry>*)context)->push_back(result);
+}
+
+
+// Reads the playlist text in chunks of chunk_len bytes, or all at once if chunk_len is 0
+static std::vector<Entry> Read(PlaylistFileFormat format, const char* playlist_path, const std::string& text,
+	size_t chunk_len = 0)
+{
+	std::vector<Entry> entries;
+	PlaylistFileReader reader;
+	PlaylistFileReaderBegin(&reader, format, playlist_path, AddEntry, &entries);
+	const bool is_whole = (chunk_len == 0);
+	if (is_whole)
+		chunk_len = text.size();
+	for (size_t pos = 0; pos < text.size(); pos += chunk_len)
+		PlaylistFileReaderFeed(&reader, text.data() + pos, std::min(chunk_len, text.size() - pos));
+	PlaylistFileReaderEnd(&reader);
+
+	// The text is read the same way however it is split into chunks
+	if (is_whole && text.size() > 1)
+	{
+		for (size_t len : { (size_t)1, (size_t)7, (size_t)4096 })
+		{
+			const std::vector<Entry> chunked = Read(format, playlist_path, text, len);
+			CHECK(chunked.size() == entries.size());
+			for (size_t i = 0; i < entries.size(); i++)
+			{
+				CHECK(chunked[i].path == entries[i].path);
+				CHECK(chunked[i].title == entries[i].title);
+				CHECK(chunked[i].length_secs == entries[i].length_secs);
+			}
+		}
+	}
+	return entries;
+}
+
+
+static void TestFileUris(void)
+{
+	const std::vector<Entry> entries = Read(PLAYLIST_FORMAT_M3U8, "C:\\Lists\\a.m3u8",
+		"file:///C:/Music/My%20Song.mp3\n"
+		"file://localhost/C:/Music/100%25.mp3\n"
+		"file://server/share/Caf%C3%A9.mp3\n"
+		"FILE:///D:/Lower%2dcase%2Fhex.mp3\n"
+		"file:///C:/Bad%2G%.mp3\n"
+		"file:///C:/End%2\n"
+		"http://example.com/stream.mp3\n");
+	CHECK(entries.size() == 6);
+	CHECK(entries[0].path == "C:\\Music\\My Song.mp3");
+	CHECK(entries[1].path == "C:\\Music\\100%.mp3");
+	CHECK(entries[2].path == "\\\\server\\share\\Caf\xC3\xA9.mp3");
+	CHECK(entries[3].path == "D:\\Lower-case\\hex.mp3");
+	// Percent signs that don't start an escape are kept
+	CHECK(entries[4].path == "C:\\Bad%2G%.mp3");
+	CHECK(entries[5].path == "C:\\End%2");
+
+	// XSPF locations are URIs even when they are relative
+	const std::vector<Entry> xspf = Read(PLAYLIST_FORMAT_XSPF, "C:\\Lists\\a.xspf",
+		"<playlist><trackList>"
+		"<track><location>file:///C:/Music/A%20B.mp3</location><title>A &amp; B</title>"
+		"<duration>61500</duration></track>"
+		"<track><location>Sub/C%20D.mp3</location><location>ignored.mp3</location></track>"
+		"</trackList></playlist>");
+	CHECK(xspf.size() == 2);
+	CHECK(xspf[0].path == "C:\\Music\\A B.mp3");
+	CHECK(xspf[0].title == "A & B");
+	CHECK(xspf[0].length_secs == 61);
+	CHECK(xspf[1].path == "C:\\Lists\\Sub\\C D.mp3");
+	CHECK(xspf[1].title == "(none)");
+}
+
+
+// ".." never goes above the drive or the share
+static void TestRelativePaths(void)
+{
+	const std::vector<Entry> entries = Read(PLAYLIST_FORMAT_M3U, "C:\\Lists\\Rock\\a.m3u",
+		"b.mp3\n"
+		"..\\c.mp3\n"
+		"../../../../d.mp3\n"
+		".\\Live\\.\\..\\e.mp3\n"
+		"\\Top\\..\\..\\f.mp3\n"
+		"D:\\x\\..\\..\\g.mp3\n"
+		"Sub\\\\h.mp3\n");
+	CHECK(entries.size() == 7);
+	CHECK(entries[0].path == "C:\\Lists\\Rock\\b.mp3");
+	CHECK(entries[1].path == "C:\\Lists\\c.mp3");
+	CHECK(entries[2].path == "C:\\d.mp3");
+	CHECK(entries[3].path == "C:\\Lists\\Rock\\e.mp3");
+	CHECK(entries[4].path == "C:\\f.mp3");
+	CHECK(entries[5].path == "D:\\g.mp3");
+	CHECK(entries[6].path == "C:\\Lists\\Rock\\Sub\\h.mp3");
+
+	const std::vector<Entry> unc = Read(PLAYLIST_FORMAT_M3U, "\\\\server\\share\\Lists\\a.m3u",
+		"..\\..\\..\\a.mp3\n"
+		"file://server/share/x/../../../b.mp3\n");
+	CHECK(unc.size() == 2);
+	CHECK(unc[0].path == "\\\\server\\share\\a.mp3");
+	CHECK(unc[1].path == "\\\\server\\share\\b.mp3");
+}
+
+
+static void TestM3U(void)
+{
+	const std::vector<Entry> entries = Read(PLAYLIST_FORMAT_M3U, "C:\\Lists\\a.m3u",
+		"\xEF\xBB\xBF#EXTM3U\r\n"
+		"#EXTINF:123,Artist - Title\r\n"
+		"a.mp3\r\n"
+		"\r\n"
+		"# A comment\r\n"
+		"#EXTINF:-1 tvg-id=\"x\",  Spaces  \r\n"
+		"b.mp3\r\n"
+		"c.mp3");
+	CHECK(entries.size() == 3);
+	CHECK(entries[0].path == "C:\\Lists\\a.mp3");
+	CHECK(entries[0].title == "Artist - Title");
+	CHECK(entries[0].length_secs == 123);
+	CHECK(entries[1].title == "Spaces");
+	CHECK(entries[1].length_secs == -1);
+	CHECK(entries[2].path == "C:\\Lists\\c.mp3");
+	CHECK(entries[2].title == "(none)");
+	CHECK(entries[2].length_secs == -1);
+}
+
+
+// The keys of an entry can come in any order, and the entries don't have to be numbered in order
+static void TestPLSKeyOrder(void)
+{
+	const std::vector<Entry> entries = Read(PLAYLIST_FORMAT_PLS, "C:\\Lists\\a.pls",
+		"[playlist]\n"
+		"Title1=One\n"
+		"Length1=10\n"
+		"File1=one.mp3\n"
+		"length3=30\n"
+		"FILE3=three.mp3\n"
+		"File2=two.mp3\n"
+		"Title2=Two\n"
+		"; A comment\n"
+		"Title4=No file\n"
+		"NumberOfEntries=4\n"
+		"File5=five.mp3\n"
+		"Version=2\n"
+		"Length5=-5\n");
+	CHECK(entries.size() == 4);
+	CHECK(entries[0].path == "C:\\Lists\\one.mp3");
+	CHECK(entries[0].title == "One");
+	CHECK(entries[0].length_secs == 10);
+	CHECK(entries[1].path == "C:\\Lists\\three.mp3");
+	CHECK(entries[1].title == "(none)");
+	CHECK(entries[1].length_secs == 30);
+	CHECK(entries[2].path == "C:\\Lists\\two.mp3");
+	CHECK(entries[2].title == "Two");
+	CHECK(entries[2].length_secs == -1);
+	CHECK(entries[3].path == "C:\\Lists\\five.mp3");
+	CHECK(entries[3].length_secs == -1);
+}
+
+
+// Lines longer than PLAYLIST_FILE_MAX_LINE are skipped without losing the lines around them
+static void TestLongLines(void)
+{
+	const std::string long_name(PLAYLIST_FILE_MAX_LINE + 100, 'x');
+	const std::string max_name(PLAYLIST_FILE_MAX_LINE - 4, 'y');
+	const std::vector<Entry> entries = Read(PLAYLIST_FORMAT_M3U, "C:\\a.m3u",
+		"a.mp3\n" + long_name + ".mp3\nb.mp3\n" + max_name + ".mp3\n" + long_name);
+	CHECK(entries.size() == 3);
+	CHECK(entries[0].path == "C:\\a.mp3");
+	CHECK(entries[1].path == "C:\\b.mp3");
+	CHECK(entries[2].path == "C:\\" + max_name + ".mp3");
+
+	const std::vector<Entry> pls = Read(PLAYLIST_FORMAT_PLS, "C:\\a.pls",
+		"[playlist]\nFile1=a.mp3\nTitle1=" + long_name + "\nFile2=b.mp3\n");
+	CHECK(pls.size() == 2);
+	CHECK(pls[0].title == "(none)");
+	CHECK(pls[1].path == "C:\\b.mp3");
+
+	const std::vector<Entry> xspf = Read(PLAYLIST_FORMAT_XSPF, "C:\\a.xspf",
+		"<track><location>" + long_name + "</location></track>"
+		"<track><title>" + long_name + "</title><location>b.mp3</location></track>"
+		"<track><!-- <track> " + long_name + " --><location>c.mp3</location></track>");
+	CHECK(xspf.size() == 2);
+	CHECK(xspf[0].path == "C:\\b.mp3");
+	CHECK(xspf[0].title == "(none)");
+	CHECK(xspf[1].path == "C:\\c.mp3");
+}
+
+
+// What is written reads back the same
+static void TestWriteRead(void)
+{
+	const char* const paths[] = { "C:\\Music\\A & B #1.mp3", "\\\\server\\share\\100%.mp3", "D:\\x.mp3" };
+	const char* const titles[] = { "A & <B>", NULL, "Line\nbreak" };
+	const int lengths[] = { 61, -1, 0 };
+	for (PlaylistFileFormat format : { PLAYLIST_FORMAT_M3U, PLAYLIST_FORMAT_PLS, PLAYLIST_FORMAT_XSPF })
+	{
+		std::string text;
+		PlaylistFileWriter writer;
+		PlaylistFileWriterBegin(&writer, format, [](void* context, const char* data, size_t len)
+			{
+				((std::string*)context)->append(data, len);
+				return true;
+			}, &text);
+		for (int i = 0; i < 3; i++)
+			PlaylistFileWriteEntry(&writer, paths[i], titles[i], lengths[i]);
+		CHECK(PlaylistFileWriterEnd(&writer));
+
+		const std::vector<Entry> entries = Read(format, "E:\\a.m3u", text);
+		CHECK(entries.size() == 3);
+		for (int i = 0; i < 3; i++)
+		{
+			CHECK(entries[i].path == paths[i]);
+			CHECK(entries[i].length_secs == lengths[i] || (format == PLAYLIST_FORMAT_M3U && !titles[i]));
+		}
+		CHECK(entries[0].title == titles[0]);
+		CHECK(entries[2].title == "Line break");
+	}
+}
+
+
+// Reads the text fed in random pieces, some of them empty
+static std::vector<Entry> ReadRandomChunks(PlaylistFileFormat format, const std::string& text, std::mt19937& random)
+{
+	std::vector<Entry> entries;
+	PlaylistFileReader reader;
+	PlaylistFileReaderBegin(&reader, format, "C:\\Lists\\a.m3u", AddEntry, &entries);
+	size_t pos = 0;
+	while (pos < text.size())
+	{
+		const size_t max_len = (random() % 2) ? 16 : PLAYLIST_FILE_MAX_LINE * 2;
+		const size_t len = std::min((size_t)(random() % (max_len + 1)), text.size() - pos);
+		PlaylistFileReaderFeed(&reader, text.data() + pos, len);
+		pos += len;
+	}
+	PlaylistFileReaderEnd(&reader);
+	return entries;
+}
+
+
+// Random text made of the pieces that the parsers look for, including pieces that make lines and 
+// elements just under and just over PLAYLIST_FILE_MAX_LINE.  However the text is split into chunks,
+// the same entries are read, and nothing is read outside of the chunks (which the sanitizers would catch).
+static void TestRandomChunks(void)
+{
+	const std::string long_piece(PLAYLIST_FILE_MAX_LINE - 8, 'x');
+	const std::vector<std::string> m3u_pieces = { "#EXTM3U", "#EXTINF:", "123", "-1", ",", " Title ", "\r\n", "\n", 
+		"\r", "a.mp3", "..\\", "../", "Sub\\", "C:\\", "\\\\server\\share\\", "file:///C:/x%20y", "%", "%2", 
+		"\xEF\xBB\xBF", "\xEF\xBB", "\xC3\xA9", " ", "#", "http://host/", long_piece };
+	const std::vector<std::string> pls_pieces = { "[playlist]", "File", "file", "Title", "Length", "1", "2", "10", "=",
+		"a.mp3", "-5", "\n", "\r\n", "; Comment", "NumberOfEntries=", "Version=2", "..\\", " ", "\xEF\xBB\xBF", long_piece };
+	const std::vector<std::string> xspf_pieces = { "<track>", "</track>", "<track/>", "<location>", "</location>", 
+		"<title>", "</title>", "<duration>", "61500", "</duration>", "<xspf:location>", "&amp;", "&lt;", "&#65;", 
+		"&#x42;", "&bogus;", "&", "<!--", "-->", "--", "<", ">", "/", " ", "a.mp3", "file:///C:/a%20b.mp3", 
+		"\xEF\xBB\xBF", "\n", long_piece };
+	const struct {
+		PlaylistFileFormat format;
+		const std::vector<std::string>* pieces;
+	} formats[] = { 
+		{ PLAYLIST_FORMAT_M3U, &m3u_pieces }, { PLAYLIST_FORMAT_M3U8, &m3u_pieces }, 
+		{ PLAYLIST_FORMAT_PLS, &pls_pieces }, { PLAYLIST_FORMAT_XSPF, &xspf_pieces } 
+	};
+
+	std::mt19937 random(1);
+	unsigned int num_entries = 0;
+	for (const auto& format : formats)
+	{
+		const std::vector<std::string>& pieces = *format.pieces;
+		for (int i = 0; i < 300; i++)
+		{
+			std::string text;
+			const int num_pieces = random() % 400;
+			for (int j = 0; j < num_pieces; j++)
+			{
+				// The long piece is rare, so most lines are short
+				const size_t piece = random() % (pieces.size() * 4);
+				if (piece < pieces.size() - 1)
+					text += pieces[piece];
+				else if (piece == pieces.size() - 1)
+					text += pieces.back().substr(0, random() % (pieces.back().size() + 1));
+				else
+					text += (char)(' ' + random() % 95);
+			}
+
+			const std::vector<Entry> expected = Read(format.format, "C:\\Lists\\a.m3u", text);
+			for (int j = 0; j < 3; j++)
+			{
+				const std::vector<Entry> entries = ReadRandomChunks(format.format, text, random);
+				CHECK(entries.size() == expected.size());
+				for (size_t k = 0; k < entries.size(); k++)
+				{
+					CHECK(entries[k].path == expected[k].path);
+					CHECK(entries[k].title == expected[k].title);
+					CHECK(entries[k].length_secs == expected[k].length_secs);
+					CHECK(entries[k].path.size() <= PLAYLIST_FILE_MAX_LINE + 3 + strlen("C:\\Lists\\"));
+				}
+			}
+			num_entries += (unsigned int)expected.size();
+		}
+	}
+	CHECK(num_entries > 1000);
+}
+
+
+int main()
+{
+	TestFileUris();
+	TestRelativePaths();
+	TestM3U();
+	TestPLSKeyOrder();
+	TestLongLines();
+	TestWriteRead();
+	TestRandomChunks();
+	return 0;
+}
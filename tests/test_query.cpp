@@ -0,0 +1,382 @@
+/******************************************************************************
+test_query.cpp - Tests of the smart playlist queries
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#define NOMINMAX
+#include "query.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// The tags of a test song, as numbers where the index parses them
+struct Tags {
+	const char* artist;
+	const char* album;
+	const char* genre;
+	unsigned int track;
+	unsigned int disc;
+	unsigned int year;
+	unsigned int secs;
+	unsigned int bitrate;
+};
+
+static const char* const g_artists[] = { NULL, "Miles Davis", "MILES DAVIS", "John Coltrane", "Björk", "Sigur Rós" };
+static const char* const g_albums[] = { NULL, "Kind of Blue", "Blue Train", "Homogenic", "()" };
+static const char* const g_genres[] = { NULL, "", "Jazz", "jazz", "Electronic", "Post-Rock" };
+
+template <typename T, size_t N>
+static T Pick(std::mt19937& random, T const (&values)[N])
+{
+	return values[random() % N];
+}
+
+
+static Tags RandomTags(std::mt19937& random)
+{
+	Tags tags = {};
+	tags.artist = Pick(random, g_artists);
+	tags.album = Pick(random, g_albums);
+	tags.genre = Pick(random, g_genres);
+	tags.track = random() % 14;
+	tags.disc = random() % 3;
+	tags.year = (random() % 4 == 0) ? 0 : 1955 + random() % 50;
+	tags.secs = random() % 700;
+	tags.bitrate = (random() % 2) ? 320 : 128 + random() % 3 * 64;
+	return tags;
+}
+
+
+// Gives the song its tags, written the way the files have them.  Missing numbers are left out.
+static void SetTags(Song* song, const Tags& tags, std::mt19937& random)
+{
+	char track[16], disc[16], date[16];
+	snprintf(track, sizeof(track), (random() % 2) ? "%u" : "%u/14", tags.track);
+	snprintf(disc, sizeof(disc), "%u/2", tags.disc);
+	snprintf(date, sizeof(date), (random() % 2) ? "%u-05-01" : "05/01/%u", tags.year);
+
+	SongDetails details = {};
+	details.metadata.artist = (char*)tags.artist;
+	details.metadata.album = (char*)tags.album;
+	details.metadata.genre = (char*)tags.genre;
+	details.metadata.track_num = tags.track ? track : NULL;
+	details.metadata.disc_num = tags.disc ? disc : NULL;
+	details.metadata.date = tags.year ? date : NULL;
+	details.bitrate = tags.bitrate;
+	song->song_length_secs = tags.secs;
+	CHECK(SongSetDetails(song, &details, NULL, false));
+}
+
+
+static bool TextEquals(const char* tag, const char* value)
+{
+	return strcasecmp(tag ? tag : "", value) == 0;
+}
+
+
+static std::vector<unsigned long long> Evaluate(const QueryProgram* program, const LibraryIndex* index)
+{
+	std::vector<unsigned int> string_ids;
+	QueryResolveStrings(program, index, string_ids);
+	std::vector<unsigned long long> row_bits;
+	QueryEvaluate(program, index, string_ids, row_bits);
+	return row_bits;
+}
+
+
+static bool GetBit(const std::vector<unsigned long long>& row_bits, unsigned int row)
+{
+	return row / 64 < row_bits.size() && ((row_bits[row / 64] >> (row % 64)) & 1);
+}
+
+
+static void CheckCompileError(const char* query, const char* expected_error)
+{
+	QueryProgram program;
+	char error[QUERY_MAX_ERROR_LEN] = {};
+	const bool is_valid = QueryCompile(query, &program, error, sizeof(error));
+	if (is_valid || strcmp(error, expected_error) != 0)
+		fprintf(stderr, "Query: %s\nExpected error: %s\nGot: %s\n", query, expected_error, is_valid ? "(no error)" : error);
+	CHECK(!is_valid);
+	CHECK(strcmp(error, expected_error) == 0);
+}
+
+
+// Each kind of mistake gets its own message, which points at the token that caused it
+static void TestParseErrors(void)
+{
+	CheckCompileError("", "Empty query");
+	CheckCompileError("  \t ", "Empty query");
+	CheckCompileError("composer = Bach", "Unknown field at \"composer\"");
+	CheckCompileError("= 3", "Expected a field name at \"=\"");
+	CheckCompileError("year 1990", "Expected =, !=, <, <=, >, or >= at \"1990\"");
+	CheckCompileError("year >=", "Expected a value at end of query");
+	CheckCompileError("year = (", "Expected a value at \"(\"");
+	CheckCompileError("year ! 1990", "Expected != at \"!\"");
+	CheckCompileError("artist < \"Miles\"", "Text can only be compared with = or != at \"Miles\"");
+	CheckCompileError("year = 19x0", "Expected a number at \"19x0\"");
+	CheckCompileError("duration < :30", "Expected a number at \":30\"");
+	CheckCompileError("duration < 8:", "Expected a number at \"8:\"");
+	CheckCompileError("artist = \"Miles", "Missing closing quote at \"Miles\"");
+	CheckCompileError("(year = 1990", "Expected ) at end of query");
+	CheckCompileError("year = 1990)", "Expected AND or OR at \")\"");
+	CheckCompileError("year = 1990 year = 1991", "Expected AND or OR at \"year\"");
+	CheckCompileError("year = 1990 and", "Expected a field name at end of query");
+	CheckCompileError("not", "Expected a field name at end of query");
+
+	// Parentheses nest QUERY_MAX_DEPTH deep, but then the program is one value too deep for the stack
+	std::string nested = "year = 0";
+	for (int i = 1; i <= QUERY_MAX_DEPTH; i++)
+		nested = "year = " + std::to_string(i) + " or (" + nested + ")";
+	CheckCompileError(nested.c_str(), "Query is too long");
+	CheckCompileError(("(" + nested + ")").c_str(), "Too many parentheses at \"(\"");
+
+	// A long query that isn't deep is fine
+	std::string flat = "year = 0";
+	for (int i = 1; i < 1000; i++)
+		flat += " or year = " + std::to_string(i);
+	QueryProgram program;
+	char error[QUERY_MAX_ERROR_LEN];
+	CHECK(QueryCompile(flat.c_str(), &program, error, sizeof(error)));
+	CHECK(program.instructions.size() == 1999);
+
+	// The message is cut to fit the buffer
+	char short_error[8];
+	CHECK(!QueryCompile("composer = Bach", &program, short_error, sizeof(short_error)));
+	CHECK(strcmp(short_error, "Unknown") == 0);
+}
+
+
+// Keywords and field names ignore case, and AND binds tighter than OR
+static void TestCompile(void)
+{
+	QueryProgram program;
+	char error[QUERY_MAX_ERROR_LEN];
+	CHECK(QueryCompile("Genre = \"Jazz\" oR YEAR>=1990 AnD NoT duration<8:00", &program, error, sizeof(error)));
+	const QueryOpcode expected_opcodes[] = { QUERY_OP_COMPARE, QUERY_OP_COMPARE, QUERY_OP_COMPARE, QUERY_OP_NOT,
+		QUERY_OP_AND, QUERY_OP_OR };
+	CHECK(program.instructions.size() == 6);
+	for (int i = 0; i < 6; i++)
+		CHECK(program.instructions[i].opcode == expected_opcodes[i]);
+	CHECK(program.instructions[0].column == LIB_COL_GENRE && program.instructions[0].op == LIB_OP_EQ);
+	CHECK(program.strings.size() == 1 && program.strings[program.instructions[0].value] == "Jazz");
+	CHECK(program.instructions[1].column == LIB_COL_YEAR && program.instructions[1].op == LIB_OP_GE);
+	CHECK(program.instructions[1].value == 1990);
+	CHECK(program.instructions[2].column == LIB_COL_DURATION && program.instructions[2].op == LIB_OP_LT);
+	CHECK(program.instructions[2].value == 480);
+
+	// Times are minutes:seconds or hours:minutes:seconds, and "length" is another name for duration
+	CHECK(QueryCompile("length <= 1:02:03", &program, error, sizeof(error)));
+	CHECK(program.instructions[0].column == LIB_COL_DURATION && program.instructions[0].value == 3723);
+
+	// <> is !=, and a word can be a value without quotes
+	CHECK(QueryCompile("artist <> Björk", &program, error, sizeof(error)));
+	CHECK(program.instructions[0].op == LIB_OP_NE && program.strings[0] == "Björk");
+
+	// Compiling again replaces the old program
+	CHECK(QueryCompile("bitrate > 256", &program, error, sizeof(error)));
+	CHECK(program.instructions.size() == 1 && program.strings.empty());
+}
+
+
+// Every field and operator, checked against the tags row by row.  Text ignores the case of ASCII
+// letters only.  There are enough rows that the last block of 64 is partial.
+static void TestOperators(void)
+{
+	std::mt19937 random(1);
+	LibraryIndex* index = LibraryIndexCreate();
+	std::vector<Tags> tags;
+	std::vector<Song*> songs;
+	for (int i = 0; i < 1000; i++)
+	{
+		tags.push_back(RandomTags(random));
+		songs.push_back(SongCreate());
+		SetTags(songs.back(), tags.back(), random);
+		LibraryIndexUpdate(index, songs.back());
+	}
+
+	struct Case {
+		const char* query;
+		std::function<bool(const Tags&)> matches;
+	};
+	const Case cases[] = {
+		{ "artist = \"miles davis\"", [](const Tags& t) { return TextEquals(t.artist, "Miles Davis"); } },
+		{ "artist != \"Miles Davis\"", [](const Tags& t) { return !TextEquals(t.artist, "Miles Davis"); } },
+		{ "artist = \"BJöRK\"", [](const Tags& t) { return TextEquals(t.artist, "Björk"); } },
+		{ "album = \"()\"", [](const Tags& t) { return TextEquals(t.album, "()"); } },
+		{ "album = \"Nobody has this\"", [](const Tags&) { return false; } },
+		{ "album != \"Nobody has this\"", [](const Tags&) { return true; } },
+		{ "genre = \"\"", [](const Tags& t) { return TextEquals(t.genre, ""); } },
+		{ "genre = Jazz", [](const Tags& t) { return TextEquals(t.genre, "jazz"); } },
+		{ "track = 0", [](const Tags& t) { return t.track == 0; } },
+		{ "track < 4", [](const Tags& t) { return t.track < 4; } },
+		{ "disc <= 1", [](const Tags& t) { return t.disc <= 1; } },
+		{ "disc <> 1", [](const Tags& t) { return t.disc != 1; } },
+		{ "year > 1990", [](const Tags& t) { return t.year > 1990; } },
+		{ "year >= 1990", [](const Tags& t) { return t.year >= 1990; } },
+		{ "year = 0", [](const Tags& t) { return t.year == 0; } },
+		{ "duration < 8:00", [](const Tags& t) { return t.secs < 480; } },
+		{ "length >= 0:09:59", [](const Tags& t) { return t.secs >= 599; } },
+		{ "bitrate = 320", [](const Tags& t) { return t.bitrate == 320; } },
+		{ "not bitrate = 320", [](const Tags& t) { return t.bitrate != 320; } },
+		{ "not not bitrate = 320", [](const Tags& t) { return t.bitrate == 320; } },
+		{ "genre = jazz and year >= 1990 and duration < 8:00", 
+			[](const Tags& t) { return TextEquals(t.genre, "jazz") && t.year >= 1990 && t.secs < 480; } },
+		{ "artist = \"John Coltrane\" or album = \"Homogenic\" and track = 1", 
+			[](const Tags& t) { return TextEquals(t.artist, "John Coltrane") || (TextEquals(t.album, "Homogenic") && t.track == 1); } },
+		{ "(artist = \"John Coltrane\" or album = \"Homogenic\") and track = 1", 
+			[](const Tags& t) { return (TextEquals(t.artist, "John Coltrane") || TextEquals(t.album, "Homogenic")) && t.track == 1; } },
+		{ "not (year < 1970 or year > 1980) and not genre = \"\"", 
+			[](const Tags& t) { return !(t.year < 1970 || t.year > 1980) && !TextEquals(t.genre, ""); } },
+	};
+
+	for (const Case& test : cases)
+	{
+		QueryProgram program;
+		char error[QUERY_MAX_ERROR_LEN];
+		CHECK(QueryCompile(test.query, &program, error, sizeof(error)));
+		std::vector<unsigned int> string_ids;
+		QueryResolveStrings(&program, index, string_ids);
+		std::vector<unsigned long long> row_bits;
+		QueryEvaluate(&program, index, string_ids, row_bits);
+		CHECK(row_bits.size() == (songs.size() + 63) / 64);
+		unsigned int num_matches = 0;
+		for (unsigned int i = 0; i < songs.size(); i++)
+		{
+			const unsigned int row = songs[i]->index_row;
+			const bool is_match = test.matches(tags[i]);
+			if (GetBit(row_bits, row) != is_match)
+				fprintf(stderr, "Query: %s\nRow %u should %smatch\n", test.query, row, is_match ? "" : "not ");
+			CHECK(GetBit(row_bits, row) == is_match);
+			CHECK(QueryMatchesRow(&program, index, string_ids, row) == is_match);
+			num_matches += is_match;
+		}
+
+		// NOT doesn't set the bits past the last row
+		unsigned int num_bits = 0;
+		for (unsigned long long bits : row_bits)
+			num_bits += __builtin_popcountll(bits);
+		CHECK(num_bits == num_matches);
+	}
+
+	LibraryIndexFree(index);
+	for (Song* song : songs)
+		FreeSong(song);
+}
+
+
+// After every add, change, remove, and clear, the members that each smart playlist kept up to
+// date one row at a time must be the same as evaluating its query over the whole index
+static void TestIncrementalMembership(void)
+{
+	std::mt19937 random(2);
+	LibraryIndex* index = LibraryIndexCreate();
+	const char* const queries[] = {
+		"genre = jazz and year >= 1990",
+		"artist = \"Miles Davis\" or duration > 10:00",
+		"not album = \"Blue Train\"",
+		"artist = \"Newcomer\"",			// No song has it until later
+		"not (artist = \"Björk\" or artist = \"Newcomer\") and bitrate < 300",
+		"composer = Bach",					// Invalid, so never has members
+	};
+	const int num_queries = sizeof(queries) / sizeof(queries[0]);
+	SmartPlaylist* playlists[num_queries];
+	for (int i = 0; i < num_queries; i++)
+		playlists[i] = SmartPlaylistCreate("Test", queries[i], index);
+	CHECK(!playlists[num_queries - 1]->is_valid);
+
+	std::vector<Song*> songs;		// All songs, whether or not they are in the index
+	for (int step = 0; step < 4000; step++)
+	{
+		const unsigned int action = random() % 100;
+		if (action < 45 || songs.empty())
+		{
+			songs.push_back(SongCreate());
+			SetTags(songs.back(), RandomTags(random), random);
+			LibraryIndexUpdate(index, songs.back());
+		}
+		else if (action < 70)
+		{
+			Song* song = songs[random() % songs.size()];
+			Tags tags = RandomTags(random);
+			if (random() % 8 == 0)
+				tags.artist = "newcomer";
+			SetTags(song, tags, random);
+			LibraryIndexUpdate(index, song);
+		}
+		else if (action < 99)
+		{
+			LibraryIndexRemove(index, songs[random() % songs.size()]);
+		}
+		else
+		{
+			LibraryIndexClear(index);
+		}
+
+		for (int i = 0; i < num_queries; i++)
+		{
+			const SmartPlaylist* playlist = playlists[i];
+			if (!playlist->is_valid)
+			{
+				CHECK(playlist->members.empty() && playlist->num_members == 0);
+				continue;
+			}
+			const std::vector<unsigned long long> expected = Evaluate(&playlist->program, index);
+			unsigned int num_members = 0;
+			for (unsigned long long bits : expected)
+				num_members += __builtin_popcountll(bits);
+			CHECK(playlist->num_members == num_members);
+			for (size_t block = 0; block < playlist->members.size(); block++)
+				CHECK(playlist->members[block] == (block < expected.size() ? expected[block] : 0));
+			for (const Song* song : songs)
+				CHECK(SmartPlaylistContains(playlist, song) == (song->is_indexed && GetBit(expected, song->index_row)));
+		}
+	}
+
+	for (int i = 0; i < num_queries; i++)
+		SmartPlaylistFree(playlists[i], index);
+	CHECK(index->listeners.empty());
+	LibraryIndexFree(index);
+	for (Song* song : songs)
+		FreeSong(song);
+}
+
+
+int main()
+{
+	TestParseErrors();
+	TestCompile();
+	TestOperators();
+	TestIncrementalMembership();
+	return 0;
+}
@@ -0,0 +1,213 @@
+/******************************************************************************
+test_shuffle.cpp - Tests of the shuffle order as songs are added, deleted, and gone back through
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "shuffle.h"
+#include "check.h"
+#include <set>
+#include <vector>
+
+static int Next(ShuffleOrder* order, bool repeat = false)
+{
+	ShufflePosition position;
+	const int song = ShuffleFindNext(order, repeat, &position);
+	if (song >= 0)
+		ShuffleMoveTo(order, &position);
+	return song;
+}
+
+
+static int Prev(ShuffleOrder* order)
+{
+	ShufflePosition position;
+	const int song = ShuffleFindPrev(order, false, &position);
+	if (song >= 0)
+		ShuffleMoveTo(order, &position);
+	return song;
+}
+
+
+// Every song is played once before the shuffle ends, for every size up to a few domains
+static void TestCycle(void)
+{
+	for (unsigned int num_songs = 1; num_songs <= 300; num_songs++)
+	{
+		ShuffleOrder order = {};
+		ShuffleReset(&order, 0x1234 + num_songs, num_songs, num_songs / 2);
+		CHECK(ShuffleCurrent(&order) == (int)num_songs / 2);
+		std::set<int> played = { ShuffleCurrent(&order) };
+		for (int song; (song = Next(&order)) >= 0; )
+			CHECK(played.insert(song).second);
+		CHECK(played.size() == num_songs);
+
+		// With repeat on, the shuffle starts over with the same order
+		const int first = Next(&order, true);
+		CHECK(first >= 0 && first < (int)num_songs);
+	}
+}
+
+
+// Deleting songs, played or not, doesn't make any other song play twice or not at all
+static void TestDelete(void)
+{
+	const unsigned int num_songs = 200;
+	ShuffleOrder order = {};
+	ShuffleReset(&order, 99, num_songs, 0);
+	std::vector<int> played = { 0 };
+	for (int i = 0; i < 50; i++)
+		played.push_back(Next(&order));
+
+	// Delete every third song, so some of both the played and the unplayed ones go
+	std::set<int> deleted;
+	for (unsigned int song = 0; song < num_songs; song += 3)
+	{
+		ShuffleDelete(&order, song);
+		deleted.insert(song);
+	}
+	std::set<int> all_played(played.begin(), played.end());
+	for (int song; (song = Next(&order)) >= 0; )
+	{
+		CHECK(deleted.count(song) == 0);
+		CHECK(all_played.insert(song).second);
+	}
+	for (unsigned int song = 0; song < num_songs; song++)
+		CHECK(all_played.count(song) || deleted.count(song));
+
+	// Prev goes back through the songs that were played, skipping the deleted ones
+	for (size_t i = played.size(); i-- > 0; )
+	{
+		if (!deleted.count(played[i]))
+			continue;
+		played.erase(played.begin() + i);
+	}
+	while (Prev(&order) >= 0 && ShuffleCurrent(&order) != played.back())
+		;
+	for (size_t i = played.size() - 1; i-- > 0; )
+		CHECK(Prev(&order) == played[i]);
+	CHECK(Prev(&order) == -1);
+}
+
+
+// A deleted song's ordinal goes to the next song added, and adding songs within the domain
+// doesn't disturb the order of the others
+static void TestAdd(void)
+{
+	ShuffleOrder order = {};
+	ShuffleReset(&order, 7, 10, 0);
+	std::vector<int> expected;
+	{
+		ShuffleOrder copy = order;
+		for (int song; (song = Next(&copy)) >= 0; )
+			expected.push_back(song);
+	}
+	ShuffleDelete(&order, 4);
+	CHECK(ShuffleAdd(&order) == 4);
+	CHECK(ShuffleAdd(&order) == 10);		// 16 ordinals fit in the same domain
+	std::vector<int> played;
+	for (int song; (song = Next(&order)) >= 0; )
+	{
+		if (song != 10)
+			played.push_back(song);
+	}
+	CHECK(played == expected);
+}
+
+
+// Adding enough songs to grow the domain reshuffles the rest, but going back still goes through
+// the songs that were played, across the runs, jumps, and domains
+static void TestHistoryAcrossDomains(void)
+{
+	ShuffleOrder order = {};
+	ShuffleReset(&order, 2024, 12, 5);
+	std::vector<int> played = { 5 };
+	for (int i = 0; i < 4; i++)
+		played.push_back(Next(&order));
+	for (int i = 0; i < 30; i++)
+		ShuffleAdd(&order);
+	for (int i = 0; i < 6; i++)
+		played.push_back(Next(&order));
+	ShuffleJumpTo(&order, 40);
+	played.push_back(40);
+	for (int i = 0; i < 3; i++)
+		played.push_back(Next(&order));
+	for (int i = 0; i < 200; i++)
+		ShuffleAdd(&order);
+	played.push_back(Next(&order));
+
+	CHECK(ShuffleCurrent(&order) == played.back());
+	for (size_t i = played.size() - 1; i-- > 0; )
+		CHECK(Prev(&order) == played[i]);
+	CHECK(Prev(&order) == -1);
+
+	// Going forward again from the start carries on in the first run, and reaches the new songs
+	std::set<int> seen(played.begin(), played.begin() + 1);
+	bool has_new_song = false;
+	for (int song; (song = Next(&order)) >= 0; )
+	{
+		CHECK(song < 12 + 30 + 200);
+		has_new_song |= (song >= 12);
+	}
+	CHECK(has_new_song);
+}
+
+
+// The songs coming up are nearer than the ones after them, and the ones already played are the farthest
+static void TestStepsAhead(void)
+{
+	ShuffleOrder order = {};
+	ShuffleReset(&order, 31337, 100, 3);
+	for (int i = 0; i < 40; i++)
+		Next(&order);
+	ShuffleAdd(&order);
+	ShuffleDelete(&order, 17);
+	CHECK(ShuffleStepsAhead(&order, ShuffleCurrent(&order)) == 0);
+
+	ShuffleOrder ahead = order;
+	unsigned int prev_steps = 0;
+	for (int song; (song = Next(&ahead)) >= 0; )
+	{
+		const unsigned int steps = ShuffleStepsAhead(&order, song);
+		CHECK(steps > prev_steps);
+		prev_steps = steps;
+	}
+	ShuffleOrder behind = order;
+	for (int song; (song = Prev(&behind)) >= 0; )
+		CHECK(ShuffleStepsAhead(&order, song) > prev_steps);
+}
+
+
+int main()
+{
+	TestCycle();
+	TestDelete();
+	TestAdd();
+	TestHistoryAcrossDomains();
+	TestStepsAhead();
+	return 0;
+}
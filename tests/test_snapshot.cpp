@@ -0,0 +1,633 @@
+/******************************************************************************
+test_snapshot.cpp - Tests of saving and loading the playlist snapshot
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "snapshot.h"
+#include "song.h"
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+// What a song should look like after it is loaded
+struct SavedSong {
+	std::string path;
+	bool has_info;
+	std::string name;			// Empty if it is the file name
+	const char* tags[SNAPSHOT_NUM_METADATA_FIELDS];
+	unsigned long long song_length_bytes;
+	unsigned int song_length_secs;
+	unsigned int bitrate;
+	unsigned int frequency;
+	bool is_stereo;
+	FileFormat format;
+	bool has_audio_hash;
+	unsigned long long audio_hash;
+	unsigned int start_trim;
+	unsigned long long num_samples;
+};
+
+static char temp_dir[] = "/tmp/test_snapshot_XXXXXX";
+static std::string snapshot_path;
+
+static const char* const g_artists[] = { NULL, "Miles Davis", "John Coltrane", "Björk", "Sigur Rós" };
+static const char* const g_albums[] = { NULL, "Kind of Blue", "Blue Train", "Homogenic" };
+static const char* const g_genres[] = { NULL, "Jazz", "Electronic" };
+static const char* const g_dates[] = { NULL, "1959", "1997-09-22" };
+
+
+static SavedSong RandomSavedSong(std::mt19937& random, unsigned int i)
+{
+	static std::deque<std::string> titles;		// Doesn't move the strings as it grows
+	titles.push_back("Title " + std::to_string(i));
+	SavedSong saved = {};
+	saved.path = "C:\\Music\\Artist " + std::to_string(random() % 20) + "\\" + titles.back() + ".mp3";
+	saved.has_info = random() % 8 != 0;
+	saved.has_audio_hash = random() % 2 != 0;
+	saved.audio_hash = saved.has_audio_hash ? ((unsigned long long)random() << 32 | random()) : 0;
+	if (!saved.has_info)
+		return saved;
+
+	if (random() % 4 == 0)
+		saved.name = "Artist - " + titles.back();
+	saved.tags[SNAPSHOT_TITLE] = titles.back().c_str();
+	saved.tags[SNAPSHOT_ARTIST] = g_artists[random() % 5];
+	saved.tags[SNAPSHOT_ALBUM] = g_albums[random() % 4];
+	saved.tags[SNAPSHOT_GENRE] = g_genres[random() % 3];
+	saved.tags[SNAPSHOT_TRACK_NUM] = (random() % 2) ? "3/12" : NULL;
+	saved.tags[SNAPSHOT_DISC_NUM] = (random() % 4) ? NULL : "1/2";
+	saved.tags[SNAPSHOT_DATE] = g_dates[random() % 3];
+	saved.tags[SNAPSHOT_COMMENT] = (random() % 8) ? NULL : "";
+	saved.song_length_bytes = 1000000ULL * (random() % 20000);
+	saved.song_length_secs = random() % 1000;
+	saved.bitrate = 128 + random() % 193;
+	saved.frequency = (random() % 2) ? 44100 : 48000;
+	saved.is_stereo = random() % 2 != 0;
+	saved.format = (FileFormat)(random() % 4);
+	if (random() % 2)
+	{
+		const unsigned int start_trims[] = { 0, 1105, MP3_MAX_START_TRIM };
+		saved.start_trim = start_trims[random() % 3];
+		saved.num_samples = random();
+	}
+	return saved;
+}
+
+
+static Song* CreateSong(const SavedSong& saved)
+{
+	Song* song = SongCreate();
+	CHECK(song && SongSetPath(song, saved.path.c_str()));
+	song->has_audio_hash = saved.has_audio_hash;
+	song->audio_hash = saved.audio_hash;
+	if (!saved.has_info)
+		return song;
+
+	SongDetails details = {};
+	char** fields[SNAPSHOT_NUM_METADATA_FIELDS] = {
+		&details.metadata.title, &details.metadata.artist, &details.metadata.album, &details.metadata.genre,
+		&details.metadata.track_num, &details.metadata.disc_num, &details.metadata.date, &details.metadata.comment_description
+	};
+	for (int field = 0; field < SNAPSHOT_NUM_METADATA_FIELDS; field++)
+		*fields[field] = (char*)saved.tags[field];
+	details.song_length_bytes = saved.song_length_bytes;
+	details.bitrate = saved.bitrate;
+	details.frequency = saved.frequency;
+	details.is_stereo = saved.is_stereo;
+	details.gapless.start_trim = saved.start_trim;
+	details.gapless.num_samples = saved.num_samples;
+	CHECK(SongSetDetails(song, &details, saved.name.empty() ? NULL : saved.name.c_str(), false));
+	song->song_length_secs = saved.song_length_secs;
+	song->format = saved.format;
+	song->has_info = true;
+	song->is_valid = true;
+	return song;
+}
+
+
+static bool StringEquals(const char* str, const char* expected)
+{
+	return (str == NULL || expected == NULL) ? str == expected : strcmp(str, expected) == 0;
+}
+
+
+static bool IsAscii(const char* str)
+{
+	for (; str && *str; str++)
+	{
+		if ((unsigned char)*str >= 0x80)
+			return false;
+	}
+	return true;
+}
+
+
+static bool IsAsciiSong(const SavedSong& saved)
+{
+	bool is_ascii = IsAscii(saved.path.c_str()) && IsAscii(saved.name.c_str());
+	for (int field = 0; field < SNAPSHOT_NUM_METADATA_FIELDS; field++)
+		is_ascii = is_ascii && IsAscii(saved.tags[field]);
+	return is_ascii;
+}
+
+
+// has_gapless is false for versions 1 and 2, which didn't save it
+static void CheckSong(const Song* song, const SavedSong& saved, bool has_gapless)
+{
+	char path[UTF8_MAX_PATH];
+	CHECK(SongGetPath(song, path, sizeof(path)));
+	CHECK(saved.path == path);
+	CHECK(song->has_audio_hash == saved.has_audio_hash && song->audio_hash == saved.audio_hash);
+	CHECK(song->has_info == saved.has_info);
+	if (!saved.has_info)
+	{
+		CHECK(song->details == NULL);
+		return;
+	}
+
+	const SongDetails* details = SongGetDetails(song);
+	const char* const tags[SNAPSHOT_NUM_METADATA_FIELDS] = {
+		details->metadata.title, details->metadata.artist, details->metadata.album, details->metadata.genre,
+		details->metadata.track_num, details->metadata.disc_num, details->metadata.date, details->metadata.comment_description
+	};
+	for (int field = 0; field < SNAPSHOT_NUM_METADATA_FIELDS; field++)
+		CHECK(StringEquals(tags[field], saved.tags[field]));
+	if (saved.name.empty())
+		CHECK(song->playlist_song_name == song->file_name);
+	else
+		CHECK(saved.name == song->playlist_song_name);
+	CHECK(details->song_length_bytes == saved.song_length_bytes);
+	CHECK(song->song_length_secs == saved.song_length_secs);
+	CHECK(details->bitrate == saved.bitrate && details->frequency == saved.frequency);
+	CHECK(details->is_stereo == saved.is_stereo);
+	CHECK(song->format == saved.format && song->is_valid);
+	CHECK(song->is_art_pending == (saved.format == MP3));
+	CHECK(details->gapless.start_trim == (has_gapless ? saved.start_trim : 0));
+	CHECK(details->gapless.num_samples == (has_gapless ? saved.num_samples : 0));
+}
+
+
+// Saves the songs in view order, played in play_order (view indexes), and returns the file
+static Bytes WriteSnapshot(const std::vector<SavedSong>& saved, const std::vector<unsigned int>& play_order)
+{
+	Playlist playlist_view = {};
+	Playlist playlist = {};
+	std::vector<PlaylistNode*> view_nodes;
+	for (const SavedSong& saved_song : saved)
+		view_nodes.push_back(PlaylistPushBack(&playlist_view, CreateSong(saved_song)));
+	for (unsigned int idx : play_order)
+	{
+		PlaylistNode* node = PlaylistPushBack(&playlist, view_nodes[idx]->song);
+		node->link = view_nodes[idx];
+		view_nodes[idx]->link = node;
+	}
+	CHECK(WritePlaylistSnapshot(snapshot_path.c_str(), &playlist_view, &playlist));
+	CHECK(access((snapshot_path + ".tmp").c_str(), F_OK) != 0);
+
+	for (PlaylistNode* node : view_nodes)
+		FreeSong(node->song);
+	PlaylistClear(&playlist_view);
+	PlaylistClear(&playlist);
+
+	Bytes bytes;
+	FILE* file = fopen(snapshot_path.c_str(), "rb");
+	CHECK(file);
+	int c;
+	while ((c = fgetc(file)) != EOF)
+		bytes.push_back((unsigned char)c);
+	fclose(file);
+	return bytes;
+}
+
+
+static void SaveFile(const Bytes& bytes)
+{
+	FILE* file = fopen(snapshot_path.c_str(), "wb");
+	CHECK(file && (bytes.empty() || fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size()));
+	fclose(file);
+}
+
+
+static void FreeSongs(std::vector<Song*>& songs)
+{
+	for (Song* song : songs)
+		FreeSong(song);
+	songs.clear();
+}
+
+
+// Reads the snapshot, which must be rejected without adding any songs
+static void CheckRejected(const Bytes& bytes)
+{
+	SaveFile(bytes);
+	std::vector<Song*> songs;
+	std::vector<unsigned int> play_order;
+	const bool is_read = ReadPlaylistSnapshot(snapshot_path.c_str(), songs, play_order);
+	CHECK(!is_read && songs.empty() && play_order.empty());
+}
+
+
+static SnapshotHeader GetHeader(const Bytes& bytes)
+{
+	SnapshotHeader header;
+	memcpy(&header, bytes.data(), sizeof(header));
+	return header;
+}
+
+
+static void SetHeader(Bytes& bytes, const SnapshotHeader& header)
+{
+	memcpy(bytes.data(), &header, sizeof(header));
+}
+
+
+static SnapshotRecord* GetRecord(Bytes& bytes, unsigned int i)
+{
+	return (SnapshotRecord*)(bytes.data() + sizeof(SnapshotHeader) + (size_t)i * sizeof(SnapshotRecord));
+}
+
+
+// Rewrites a version 3 snapshot the way versions 1 and 2 wrote it, with shorter records
+static Bytes ToVersion2(const Bytes& bytes, unsigned int version)
+{
+	SnapshotHeader header = GetHeader(bytes);
+	Bytes old_bytes(bytes.begin(), bytes.begin() + sizeof(header));
+	for (unsigned int i = 0; i < header.num_songs; i++)
+	{
+		const unsigned char* record = bytes.data() + sizeof(header) + (size_t)i * sizeof(SnapshotRecord);
+		old_bytes.insert(old_bytes.end(), record, record + offsetof(SnapshotRecord, gapless_start));
+		old_bytes.insert(old_bytes.end(), SNAPSHOT_RECORD_SIZE_V2 - offsetof(SnapshotRecord, gapless_start), 0);
+	}
+	const unsigned long long records_end = sizeof(header) + (unsigned long long)header.num_songs * sizeof(SnapshotRecord);
+	old_bytes.insert(old_bytes.end(), bytes.begin() + records_end, bytes.end());
+
+	const unsigned long long shrink = (unsigned long long)header.num_songs * (sizeof(SnapshotRecord) - SNAPSHOT_RECORD_SIZE_V2);
+	header.version = version;
+	header.record_size = SNAPSHOT_RECORD_SIZE_V2;
+	header.strings_offset -= shrink;
+	if (header.play_order_offset)
+		header.play_order_offset -= shrink;
+	SetHeader(old_bytes, header);
+	return old_bytes;
+}
+
+
+static std::vector<unsigned int> Identity(unsigned int count)
+{
+	std::vector<unsigned int> order(count);
+	for (unsigned int i = 0; i < count; i++)
+		order[i] = i;
+	return order;
+}
+
+
+// Every field comes back, and the play order is only saved when it differs from the view
+static void TestRoundTrip(void)
+{
+	std::mt19937 random(1);
+	std::vector<SavedSong> saved;
+	for (unsigned int i = 0; i < 500; i++)
+		saved.push_back(RandomSavedSong(random, i));
+	std::vector<unsigned int> shuffled = Identity(500);
+	std::shuffle(shuffled.begin(), shuffled.end(), random);
+	std::vector<unsigned int> half_shuffled = Identity(500);
+	std::shuffle(half_shuffled.begin() + 250, half_shuffled.end(), random);
+	const std::vector<unsigned int> play_orders[] = { Identity(500), shuffled, half_shuffled };
+
+	for (const std::vector<unsigned int>& play_order : play_orders)
+	{
+		const bool is_shuffled = play_order != Identity(500);
+		const Bytes bytes = WriteSnapshot(saved, play_order);
+		const SnapshotHeader header = GetHeader(bytes);
+		CHECK(header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION && header.num_songs == 500);
+		CHECK((header.play_order_offset != 0) == is_shuffled);
+		CHECK(header.strings_offset + header.strings_size == bytes.size());
+
+		std::vector<Song*> songs;
+		std::vector<unsigned int> read_play_order;
+		CHECK(ReadPlaylistSnapshot(snapshot_path.c_str(), songs, read_play_order));
+		CHECK(songs.size() == 500);
+		for (unsigned int i = 0; i < 500; i++)
+			CheckSong(songs[i], saved[i], true);
+		CHECK(read_play_order == (is_shuffled ? play_order : std::vector<unsigned int>()));
+		FreeSongs(songs);
+	}
+
+	// Tags shared by many songs are stored once
+	const Bytes bytes = WriteSnapshot(saved, Identity(500));
+	const SnapshotHeader header = GetHeader(bytes);
+	const char* strings = (const char*)bytes.data() + header.strings_offset;
+	unsigned int num_jazz = 0;
+	for (unsigned long long offset = 0; offset < header.strings_size; offset += strlen(strings + offset) + 1)
+		num_jazz += strcmp(strings + offset, "Jazz") == 0;
+	CHECK(num_jazz == 1);
+
+	// A start trim too big to be real isn't saved
+	SavedSong big_trim = saved[1];
+	big_trim.has_info = true;
+	big_trim.start_trim = MP3_MAX_START_TRIM + 1;
+	big_trim.num_samples = 1234;
+	WriteSnapshot({ big_trim }, { 0 });
+	std::vector<Song*> songs;
+	std::vector<unsigned int> play_order;
+	CHECK(ReadPlaylistSnapshot(snapshot_path.c_str(), songs, play_order) && songs.size() == 1);
+	big_trim.start_trim = 0;
+	big_trim.num_samples = 0;
+	CheckSong(songs[0], big_trim, true);
+	FreeSongs(songs);
+
+	// Songs are added after the ones already in the vector
+	songs.push_back(SongCreate());
+	CHECK(ReadPlaylistSnapshot(snapshot_path.c_str(), songs, play_order) && songs.size() == 2);
+	FreeSongs(songs);
+}
+
+
+static void TestEmpty(void)
+{
+	const Bytes bytes = WriteSnapshot({}, {});
+	CHECK(bytes.size() == sizeof(SnapshotHeader));
+	std::vector<Song*> songs;
+	std::vector<unsigned int> play_order;
+	CHECK(ReadPlaylistSnapshot(snapshot_path.c_str(), songs, play_order));
+	CHECK(songs.empty() && play_order.empty());
+
+	// No file, or a file too short for the header
+	unlink(snapshot_path.c_str());
+	CHECK(!ReadPlaylistSnapshot(snapshot_path.c_str(), songs, play_order));
+	CheckRejected(Bytes());
+	CheckRejected(Bytes(bytes.begin(), bytes.end() - 1));
+}
+
+
+// Every header field and offset that could point outside of the file is checked
+static void TestCorruptHeader(void)
+{
+	std::mt19937 random(2);
+	std::vector<SavedSong> saved;
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		saved.push_back(RandomSavedSong(random, i));
+		saved.back().has_info = true;
+		saved.back().tags[SNAPSHOT_ARTIST] = "Miles Davis";
+	}
+	const Bytes bytes = WriteSnapshot(saved, { 5, 3, 1, 0, 2, 4 });
+	const SnapshotHeader header = GetHeader(bytes);
+	CHECK(header.play_order_offset != 0);
+
+	// Every truncation cuts off some of the string table
+	for (size_t len = 0; len < bytes.size(); len++)
+		CheckRejected(Bytes(bytes.begin(), bytes.begin() + len));
+
+	Bytes bad = bytes;
+	SnapshotHeader bad_header = header;
+	auto check_header = [&](void (*corrupt)(SnapshotHeader*)) {
+		bad_header = header;
+		corrupt(&bad_header);
+		bad = bytes;
+		SetHeader(bad, bad_header);
+		CheckRejected(bad);
+	};
+	check_header([](SnapshotHeader* h) { h->magic ^= 1; });
+	check_header([](SnapshotHeader* h) { h->version = 0; });
+	check_header([](SnapshotHeader* h) { h->version = SNAPSHOT_VERSION + 1; });
+	check_header([](SnapshotHeader* h) { h->record_size = SNAPSHOT_RECORD_SIZE_V2; });
+	check_header([](SnapshotHeader* h) { h->record_size = 0; });
+	check_header([](SnapshotHeader* h) { h->num_songs = 0xFFFFFFFF; });
+	check_header([](SnapshotHeader* h) { h->num_songs = 7; });
+	check_header([](SnapshotHeader* h) { h->play_order_offset = sizeof(SnapshotHeader); });
+	check_header([](SnapshotHeader* h) { h->play_order_offset += 2; });
+	check_header([](SnapshotHeader* h) { h->play_order_offset = ~0ULL - 3; });
+	check_header([](SnapshotHeader* h) { h->play_order_offset = h->strings_offset + h->strings_size - 20; });
+	check_header([](SnapshotHeader* h) { h->strings_offset = h->strings_offset + h->strings_size + 1; });
+	check_header([](SnapshotHeader* h) { h->strings_offset = ~0ULL; });
+	check_header([](SnapshotHeader* h) { h->strings_size++; });
+	check_header([](SnapshotHeader* h) { h->strings_size = ~0ULL; });
+	check_header([](SnapshotHeader* h) { h->strings_size = 0; });
+
+	// Version 2 records in a version 3 snapshot, and the other way around
+	bad = ToVersion2(bytes, SNAPSHOT_VERSION_UTF8);
+	bad_header = GetHeader(bad);
+	bad_header.version = SNAPSHOT_VERSION;
+	SetHeader(bad, bad_header);
+	CheckRejected(bad);
+	bad_header = header;
+	bad_header.version = SNAPSHOT_VERSION_UTF8;
+	bad = bytes;
+	SetHeader(bad, bad_header);
+	CheckRejected(bad);
+
+	// The last string isn't terminated
+	bad = bytes;
+	bad.back() = 'x';
+	CheckRejected(bad);
+
+	// Bad string offsets and formats in a record.  Only the path can't be missing.
+	const unsigned int strings_size = (unsigned int)header.strings_size;
+	for (unsigned int i = 0; i < header.num_songs; i++)
+	{
+		bad = bytes;
+		GetRecord(bad, i)->path = SNAPSHOT_NO_STRING;
+		CheckRejected(bad);
+		bad = bytes;
+		GetRecord(bad, i)->path = strings_size;
+		CheckRejected(bad);
+		bad = bytes;
+		GetRecord(bad, i)->playlist_song_name = strings_size + 100;
+		CheckRejected(bad);
+		bad = bytes;
+		GetRecord(bad, i)->metadata[i % SNAPSHOT_NUM_METADATA_FIELDS] = SNAPSHOT_NO_STRING - 1;
+		CheckRejected(bad);
+		bad = bytes;
+		GetRecord(bad, i)->format = FLAC + 1;
+		CheckRejected(bad);
+	}
+
+	// An offset into the middle of a string is just a shorter string
+	bad = bytes;
+	GetRecord(bad, 0)->metadata[SNAPSHOT_ARTIST] = GetRecord(bad, 0)->metadata[SNAPSHOT_ARTIST] + 6;
+	SaveFile(bad);
+	std::vector<Song*> songs;
+	std::vector<unsigned int> play_order;
+	CHECK(ReadPlaylistSnapshot(snapshot_path.c_str(), songs, play_order) && songs.size() == 6);
+	CHECK(strcmp(SongGetDetails(songs[0])->metadata.artist, "Davis") == 0);
+	FreeSongs(songs);
+}
+
+
+// The play order must have every song exactly once
+static void TestBadPlayOrder(void)
+{
+	std::mt19937 random(3);
+	std::vector<SavedSong> saved;
+	for (unsigned int i = 0; i < 100; i++)
+		saved.push_back(RandomSavedSong(random, i));
+	std::vector<unsigned int> play_order = Identity(100);
+	std::shuffle(play_order.begin(), play_order.end(), random);
+	const Bytes bytes = WriteSnapshot(saved, play_order);
+	const SnapshotHeader header = GetHeader(bytes);
+	unsigned int* saved_play_order;
+
+	for (int i = 0; i < 100; i++)
+	{
+		Bytes bad = bytes;
+		saved_play_order = (unsigned int*)(bad.data() + header.play_order_offset);
+		const unsigned int a = random() % 100;
+		unsigned int b = random() % 99;
+		b += (b >= a);
+		saved_play_order[a] = saved_play_order[b];
+		CheckRejected(bad);
+
+		bad = bytes;
+		saved_play_order = (unsigned int*)(bad.data() + header.play_order_offset);
+		saved_play_order[a] = 100 + random() % 1000;
+		CheckRejected(bad);
+	}
+
+	// Swapping two entries still has every song once
+	Bytes swapped = bytes;
+	saved_play_order = (unsigned int*)(swapped.data() + header.play_order_offset);
+	std::swap(saved_play_order[10], saved_play_order[20]);
+	std::swap(play_order[10], play_order[20]);
+	SaveFile(swapped);
+	std::vector<Song*> songs;
+	std::vector<unsigned int> read_play_order;
+	CHECK(ReadPlaylistSnapshot(snapshot_path.c_str(), songs, read_play_order));
+	CHECK(read_play_order == play_order);
+	FreeSongs(songs);
+}
+
+
+// Versions 1 and 2 have shorter records without the gapless info.  Version 1 strings are in
+// the ANSI code page, so records with text that isn't ASCII only keep the path, converted to UTF-8.
+static void TestOldVersions(void)
+{
+	std::mt19937 random(4);
+	std::vector<SavedSong> saved;
+	for (unsigned int i = 0; i < 200; i++)
+		saved.push_back(RandomSavedSong(random, i));
+	saved[7].has_info = true;
+	saved[7].path = "C:\\Music\\Caf\xe9.mp3";		// Latin-1
+	saved[7].tags[SNAPSHOT_ARTIST] = "Miles Davis";
+	std::vector<unsigned int> play_order = Identity(200);
+	std::shuffle(play_order.begin(), play_order.end(), random);
+	const Bytes bytes = WriteSnapshot(saved, play_order);
+
+	// Version 2 is UTF-8, so the Latin-1 path is read as it was written
+	SaveFile(ToVersion2(bytes, SNAPSHOT_VERSION_UTF8));
+	std::vector<Song*> songs;
+	std::vector<unsigned int> read_play_order;
+	CHECK(ReadPlaylistSnapshot(snapshot_path.c_str(), songs, read_play_order));
+	CHECK(songs.size() == 200 && read_play_order == play_order);
+	for (unsigned int i = 0; i < 200; i++)
+		CheckSong(songs[i], saved[i], false);
+	FreeSongs(songs);
+
+	SaveFile(ToVersion2(bytes, SNAPSHOT_VERSION_ANSI));
+	CHECK(ReadPlaylistSnapshot(snapshot_path.c_str(), songs, read_play_order));
+	CHECK(songs.size() == 200);
+	for (unsigned int i = 0; i < 200; i++)
+	{
+		SavedSong expected = saved[i];
+		if (!IsAsciiSong(expected))
+		{
+			expected = {};
+			expected.path = (i == 7) ? "C:\\Music\\Caf\xc3\xa9.mp3" : saved[i].path;
+			expected.has_audio_hash = saved[i].has_audio_hash;
+			expected.audio_hash = saved[i].audio_hash;
+		}
+		CheckSong(songs[i], expected, false);
+	}
+	FreeSongs(songs);
+}
+
+
+// Random bytes of a valid snapshot are overwritten.  The snapshot is either rejected or loaded with
+// every song, and nothing is read outside of the file (which the sanitizers would catch).
+static void TestRandomCorruption(void)
+{
+	std::mt19937 random(5);
+	std::vector<SavedSong> saved;
+	for (unsigned int i = 0; i < 20; i++)
+		saved.push_back(RandomSavedSong(random, i));
+	std::vector<unsigned int> play_order = Identity(20);
+	std::shuffle(play_order.begin(), play_order.end(), random);
+	const Bytes bytes = WriteSnapshot(saved, play_order);
+
+	unsigned int num_loaded = 0;
+	for (int i = 0; i < 2000; i++)
+	{
+		Bytes bad = bytes;
+		const int num_changes = 1 + random() % 4;
+		for (int j = 0; j < num_changes; j++)
+		{
+			// Mostly the header and records, where the offsets are
+			const size_t pos = (random() % 2) ? random() % (sizeof(SnapshotHeader) + 20 * sizeof(SnapshotRecord)) : random() % bad.size();
+			bad[pos] = (random() % 2) ? (unsigned char)random() : bad[pos] ^ (1 << (random() % 8));
+		}
+		SaveFile(bad);
+		std::vector<Song*> songs;
+		std::vector<unsigned int> read_play_order;
+		if (ReadPlaylistSnapshot(snapshot_path.c_str(), songs, read_play_order))
+		{
+			num_loaded++;
+			CHECK(songs.size() == 20);
+			CHECK(read_play_order.empty() || read_play_order.size() == 20);
+		}
+		else
+		{
+			CHECK(songs.empty() && read_play_order.empty());
+		}
+		FreeSongs(songs);
+	}
+	CHECK(num_loaded > 0 && num_loaded < 2000);
+}
+
+
+int main()
+{
+	CHECK(mkdtemp(temp_dir));
+	snapshot_path = std::string(temp_dir) + "/playlist.wpl";
+	TestRoundTrip();
+	TestEmpty();
+	TestCorruptHeader();
+	TestBadPlayOrder();
+	TestOldVersions();
+	TestRandomCorruption();
+	unlink(snapshot_path.c_str());
+	rmdir(temp_dir);
+	return 0;
+}
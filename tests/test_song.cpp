@@ -0,0 +1,199 @@
+/******************************************************************************
+test_song.cpp - Tests for the song records and the tags read into them
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "song.h"
+#include "check.h"
+#include <string.h>
+#include <string>
+#include <vector>
+
+static std::string FormatLength(const Song* song, size_t buffer_size = 32)
+{
+	char buffer[32];
+	memset(buffer, 'x', sizeof(buffer));
+	SongFormatLength(song, buffer, buffer_size);
+	return buffer;
+}
+
+
+// The length is minutes and two digits of seconds, and empty until the song info is read or when it
+// doesn't fit
+static void TestFormatLength(void)
+{
+	Song song = {};
+	song.song_length_secs = 253;
+	CHECK(FormatLength(&song) == "");
+	song.has_info = true;
+	CHECK(FormatLength(&song) == "4:13");
+
+	const struct {
+		unsigned int secs;
+		const char* text;
+	} cases[] = {
+		{ 0, "0:00" }, { 9, "0:09" }, { 60, "1:00" }, { 599, "9:59" }, { 600, "10:00" }, { 4500, "75:00" },
+		{ 0xFFFFFFFF, "71582788:15" },
+	};
+	for (const auto& c : cases)
+	{
+		song.song_length_secs = c.secs;
+		CHECK(FormatLength(&song) == c.text);
+	}
+
+	song.song_length_secs = 600;
+	CHECK(FormatLength(&song, 6) == "10:00");
+	CHECK(FormatLength(&song, 5) == "");
+	char buffer[1] = { 'x' };
+	SongFormatLength(&song, buffer, 0);
+	CHECK(buffer[0] == 'x');
+}
+
+
+// Memory from the arena stays put until it is reset, blocks are used again after a reset, and text
+// bigger than a block gets a block of its own
+static void TestMetadataArena(void)
+{
+	MetadataArena arena = {};
+	std::vector<char*> texts;
+	for (unsigned int i = 0; i < 1000; i++)
+	{
+		char* text = MetadataArenaAlloc(&arena, 1 + i % 100);
+		CHECK(text != NULL);
+		memset(text, 'a' + i % 26, 1 + i % 100);
+		texts.push_back(text);
+	}
+	for (unsigned int i = 0; i < texts.size(); i++)
+	{
+		for (unsigned int j = 0; j < 1 + i % 100; j++)
+			CHECK(texts[i][j] == 'a' + i % 26);
+	}
+
+	MetadataArenaReset(&arena);
+	CHECK(MetadataArenaAlloc(&arena, 10) == texts[0]);
+	char* big = MetadataArenaAlloc(&arena, METADATA_ARENA_BLOCK_SIZE * 3);
+	CHECK(big != NULL);
+	memset(big, 'z', METADATA_ARENA_BLOCK_SIZE * 3);
+	MetadataArenaFree(&arena);
+	CHECK(arena.first == NULL && arena.current == NULL);
+}
+
+
+// "Artist - Title", with the artist cut after 30 characters, and none without both tags
+static void TestMakePlaylistName(void)
+{
+	MetadataArena arena = {};
+	AudioFileMetadata metadata = {};
+	CHECK(SongMakePlaylistName(&metadata, &arena) == NULL);
+	metadata.title = (char*)"Cry On My Guitar";
+	CHECK(SongMakePlaylistName(&metadata, &arena) == NULL);
+	metadata.artist = (char*)"Miles Kane";
+	CHECK(std::string(SongMakePlaylistName(&metadata, &arena)) == "Miles Kane - Cry On My Guitar");
+	metadata.artist = (char*)"Miles Kane, Zach Dawes, Loren Shane Humphrey, Tyler Parkford";
+	CHECK(std::string(SongMakePlaylistName(&metadata, &arena)) == "Miles Kane, Zach Dawes, Loren ... - Cry On My Guitar");
+	metadata.artist = (char*)"012345678901234567890123456789";
+	CHECK(std::string(SongMakePlaylistName(&metadata, &arena)) == "012345678901234567890123456789 - Cry On My Guitar");
+
+	// 31 characters of 2 bytes each
+	std::string wide_artist;
+	for (int i = 0; i < 31; i++)
+		wide_artist += "\xC3\xA9";
+	metadata.artist = (char*)wide_artist.c_str();
+	CHECK(std::string(SongMakePlaylistName(&metadata, &arena)) == wide_artist.substr(0, 60) + "... - Cry On My Guitar");
+	MetadataArenaFree(&arena);
+}
+
+
+static void AppendFrame(std::string& frames, const char* id, const std::string& data)
+{
+	const size_t size = data.size();
+	frames.append(id, 4);
+	for (int shift = 24; shift >= 0; shift -= 8)
+		frames += (char)(size >> shift);
+	frames.append(2, '\0');
+	frames += data;
+}
+
+
+// The text of each ID3v2 encoding is read into the arena as UTF-8
+static void TestParseID3v2(void)
+{
+	std::string frames;
+	AppendFrame(frames, ID3V2_TITLE_FRAME_ID, std::string("\0Caf\xE9", 5));
+	AppendFrame(frames, ID3V2_ARTIST_FRAME_ID, std::string("\1\xFF\xFEM\0e\0", 7));
+	AppendFrame(frames, ID3V2_ALBUM_FRAME_ID, std::string("\2\0B\0e", 5));
+	AppendFrame(frames, ID3V2_GENRE_FRAME_ID, std::string("\3Jazz \xE2\x99\xAA", 9));
+	AppendFrame(frames, ID3V2_TRACK_NUM_FRAME_ID, std::string("\3Caf\xE9", 5));
+	AppendFrame(frames, ID3V2_YEAR_FRAME_ID, std::string("\0", 1));
+	const size_t size = frames.size() + ID3V2_HEADER_LEN;
+	std::string tag("ID3\3\0\0\0\0", 8);
+	tag += (char)((size >> 7) & 0x7F);
+	tag += (char)(size & 0x7F);
+	tag += frames + std::string(ID3V2_HEADER_LEN, '\0');
+
+	MetadataArena arena = {};
+	AudioFileMetadata metadata = {};
+	ParseID3v2(tag.data(), &metadata, &arena);
+	CHECK(std::string(metadata.title) == "Caf\xC3\xA9");
+	CHECK(std::string(metadata.artist) == "Me");
+	CHECK(std::string(metadata.album) == "Be");
+	CHECK(std::string(metadata.genre) == "Jazz \xE2\x99\xAA");
+	CHECK(std::string(metadata.track_num) == "Caf\xC3\xA9");		// Not valid UTF-8, so read as ISO-8859-1
+	CHECK(metadata.date == NULL);
+	CHECK(metadata.album_art == NULL);
+	MetadataArenaFree(&arena);
+}
+
+
+// Field names are matched without case, unknown fields are dropped, and a repeated field keeps the last value
+static void TestParseOggComments(void)
+{
+	const char comments[] = "title=First\0ARTIST=Someone\0Album=\0UNKNOWN_FIELD_WITH_A_LONG_NAME=x\0"
+		"TITLE=Second\0tracknumber=3/12\0";
+	MetadataArena arena = {};
+	AudioFileMetadata metadata = {};
+	ParseOggComments(comments, &metadata, &arena);
+	CHECK(std::string(metadata.title) == "Second");
+	CHECK(std::string(metadata.artist) == "Someone");
+	CHECK(std::string(metadata.album) == "");
+	CHECK(std::string(metadata.track_num) == "3/12");
+	CHECK(metadata.genre == NULL && metadata.date == NULL && metadata.comment_description == NULL);
+	MetadataArenaFree(&arena);
+}
+
+
+int main()
+{
+	TestFormatLength();
+	TestMetadataArena();
+	TestMakePlaylistName();
+	TestParseID3v2();
+	TestParseOggComments();
+	printf("test_song passed\n");
+	return 0;
+}
@@ -0,0 +1,286 @@
+/******************************************************************************
+test_utf8.cpp - Tests of the UTF-8 conversions, and of the SSE2 loops against the plain ones
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Built with -fshort-wchar, so wchar_t is UTF-16 as it is on Windows and the SSE2 loops are used
+
+#include "utf8.h"
+#include "check.h"
+#include <algorithm>
+#include <random>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// The same conversions without SSE2, in their own namespace so both can be called
+namespace scalar {
+#define UTF8_NO_SSE2
+#include "utf8.cpp"
+#undef UTF8_NO_SSE2
+}
+
+static_assert(sizeof(wchar_t) == 2, "Build with -fshort-wchar");
+
+static std::vector<wchar_t> ToUtf16(const std::string& text)
+{
+	std::vector<wchar_t> result(Utf8ToUtf16(text.data(), text.size(), NULL, 0) + 1);
+	CHECK(Utf8ToUtf16(text.data(), text.size(), result.data(), result.size()) == result.size() - 1);
+	CHECK(result.back() == L'\0');
+	result.pop_back();
+	return result;
+}
+
+
+static std::string ToUtf8(const std::vector<wchar_t>& text)
+{
+	std::string result(Utf16ToUtf8(text.data(), text.size(), NULL, 0) + 1, 'x');
+	CHECK(Utf16ToUtf8(text.data(), text.size(), &result[0], result.size()) == result.size() - 1);
+	CHECK(result.back() == '\0');
+	result.pop_back();
+	return result;
+}
+
+
+// Invalid bytes become one U+FFFD each, and decoding picks up again at the next byte
+static void TestInvalidUtf8(void)
+{
+	static const struct {
+		const char* text;
+		bool is_valid;
+		std::vector<wchar_t> utf16;
+	} cases[] = {
+		{ "\x7F\xC2\x80\xDF\xBF", true, { 0x7F, 0x80, 0x7FF } },
+		{ "\xE0\xA0\x80\xED\x9F\xBF\xEE\x80\x80\xEF\xBF\xBF", true, { 0x800, 0xD7FF, 0xE000, 0xFFFF } },
+		{ "\xF0\x90\x80\x80\xF4\x8F\xBF\xBF", true, { 0xD800, 0xDC00, 0xDBFF, 0xDFFF } },
+		// Overlong
+		{ "\xC0\xAF", false, { 0xFFFD, 0xFFFD } },
+		{ "\xC1\xBF", false, { 0xFFFD, 0xFFFD } },
+		{ "\xE0\x80\xAF", false, { 0xFFFD, 0xFFFD, 0xFFFD } },
+		{ "\xE0\x9F\xBF", false, { 0xFFFD, 0xFFFD, 0xFFFD } },
+		{ "\xF0\x80\x80\xAF", false, { 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD } },
+		{ "\xF0\x8F\xBF\xBF", false, { 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD } },
+		// Surrogates, which are only valid in UTF-16
+		{ "\xED\xA0\x80", false, { 0xFFFD, 0xFFFD, 0xFFFD } },
+		{ "\xED\xBF\xBFz", false, { 0xFFFD, 0xFFFD, 0xFFFD, 'z' } },
+		{ "\xED\xA0\xBD\xED\xB8\x80", false, { 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD } },
+		// Past U+10FFFF, and bytes that are never in UTF-8
+		{ "\xF4\x90\x80\x80", false, { 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD } },
+		{ "\xF5\xF8\xFE\xFF", false, { 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD } },
+		// Truncated and stray continuation bytes
+		{ "a\xC3", false, { 'a', 0xFFFD } },
+		{ "\xE2\x82", false, { 0xFFFD, 0xFFFD } },
+		{ "\xF0\x9F\x98", false, { 0xFFFD, 0xFFFD, 0xFFFD } },
+		{ "\xE2\x82z\xE2\x82\xAC", false, { 0xFFFD, 0xFFFD, 'z', 0x20AC } },
+		{ "\x80\xBF\xC3\xA9", false, { 0xFFFD, 0xFFFD, 0xE9 } },
+	};
+
+	for (const auto& test : cases)
+	{
+		const std::string text = test.text;
+		CHECK(IsValidUtf8(text.data(), text.size()) == test.is_valid);
+		CHECK(ToUtf16(text) == test.utf16);
+		if (test.is_valid)
+			CHECK(ToUtf8(test.utf16) == text);
+
+		// Cutting the input anywhere never reads past it or makes more characters than there are bytes
+		for (size_t len = 0; len < text.size(); len++)
+		{
+			std::vector<wchar_t> out(len + 1);
+			CHECK(Utf8ToUtf16(text.data(), len, out.data(), out.size()) <= len);
+		}
+	}
+
+	// Null characters are text like any other
+	CHECK(ToUtf16(std::string("a\0b", 3)) == std::vector<wchar_t>({ 'a', 0, 'b' }));
+}
+
+
+// Unpaired surrogates become U+FFFD, from wchar_t and from little and big endian bytes
+static void TestLoneSurrogates(void)
+{
+	static const struct {
+		std::vector<wchar_t> utf16;
+		const char* utf8;
+	} cases[] = {
+		{ { 0xD83D, 0xDE00 }, "\xF0\x9F\x98\x80" },
+		{ { 0xD800 }, "\xEF\xBF\xBD" },
+		{ { 0xDC00, 'x' }, "\xEF\xBF\xBDx" },
+		{ { 'x', 0xD800, 'y' }, "x\xEF\xBF\xBDy" },
+		{ { 0xD800, 0xD800, 0xDC00 }, "\xEF\xBF\xBD\xF0\x90\x80\x80" },
+		{ { 0xDBFF, 0xDFFF, 0xDFFF }, "\xF4\x8F\xBF\xBF\xEF\xBF\xBD" },
+	};
+
+	for (const auto& test : cases)
+	{
+		CHECK(ToUtf8(test.utf16) == test.utf8);
+
+		std::vector<unsigned char> little, big;
+		for (wchar_t unit : test.utf16)
+		{
+			little.push_back(unit & 0xFF);
+			little.push_back(unit >> 8);
+			big.push_back(unit >> 8);
+			big.push_back(unit & 0xFF);
+		}
+		// An odd byte at the end is left out
+		little.push_back('z');
+		big.push_back('z');
+		char out[64];
+		CHECK(Utf16BytesToUtf8(little.data(), little.size(), false, out, sizeof(out)) == strlen(test.utf8));
+		CHECK(strcmp(out, test.utf8) == 0);
+		CHECK(Utf16BytesToUtf8(big.data(), big.size(), true, out, sizeof(out)) == strlen(test.utf8));
+		CHECK(strcmp(out, test.utf8) == 0);
+	}
+}
+
+
+// Output that doesn't fit is cut before a whole character, never in the middle of one
+static void TestTruncatedOutput(void)
+{
+	const std::string text = "ab\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80z";
+	const std::vector<wchar_t> utf16 = ToUtf16(text);
+	CHECK(utf16.size() == 7);
+
+	for (size_t out_size = 0; out_size <= utf16.size() + 1; out_size++)
+	{
+		std::vector<wchar_t> out(out_size + 1, L'#');
+		const size_t len = Utf8ToUtf16(text.data(), text.size(), out.data(), out_size);
+		size_t expected_len = (out_size == 0) ? 0 : std::min(out_size - 1, utf16.size());
+		if (expected_len > 0 && expected_len < utf16.size() && utf16[expected_len - 1] >= 0xD800 && utf16[expected_len - 1] <= 0xDBFF)
+			expected_len--;
+		CHECK(len == expected_len);
+		CHECK(out[out_size] == L'#');
+		if (out_size > 0)
+			CHECK(out[len] == L'\0');
+		CHECK(memcmp(out.data(), utf16.data(), len * sizeof(wchar_t)) == 0);
+	}
+
+	for (size_t out_size = 0; out_size <= text.size() + 1; out_size++)
+	{
+		std::string out(out_size + 1, '#');
+		const size_t len = Utf16ToUtf8(utf16.data(), utf16.size(), &out[0], out_size);
+		size_t expected_len = (out_size == 0) ? 0 : std::min(out_size - 1, text.size());
+		while (expected_len < text.size() && ((unsigned char)text[expected_len] & 0xC0) == 0x80)
+			expected_len--;
+		CHECK(len == expected_len);
+		CHECK(out[out_size] == '#');
+		if (out_size > 0)
+			CHECK(out[len] == '\0');
+		CHECK(text.compare(0, len, out, 0, len) == 0);
+	}
+
+	CHECK(Latin1ToUtf8((const unsigned char*)"Caf\xE9", 4, NULL, 0) == 5);
+	char out[5];
+	CHECK(Latin1ToUtf8((const unsigned char*)"Caf\xE9", 4, out, sizeof(out)) == 3);
+	CHECK(strcmp(out, "Caf") == 0);
+	CHECK(Utf8PrefixLength("\xC3\xA9\xC3\xA9z", 2) == 4);
+	CHECK(Utf8PrefixLength("ab", 5) == 2);
+}
+
+
+// Text that is mostly ASCII, with runs of every length around the 16 byte blocks, and some 
+// multibyte characters, invalid bytes, and surrogates
+static std::string RandomText(std::mt19937& random)
+{
+	static const char* const pieces[] = { "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\x80", "\xC3",
+		"\xED\xA0\x80", "\xFF" };
+	std::string text;
+	const int num_runs = random() % 6;
+	for (int run = 0; run < num_runs; run++)
+	{
+		const int len = random() % 40;
+		for (int i = 0; i < len; i++)
+			text += (char)(1 + random() % 0x7F);
+		if (random() % 4 != 0)
+			text += pieces[random() % (sizeof(pieces) / sizeof(pieces[0]))];
+	}
+	return text;
+}
+
+
+static std::vector<wchar_t> RandomUtf16(std::mt19937& random)
+{
+	std::vector<wchar_t> text;
+	const int num_runs = random() % 6;
+	for (int run = 0; run < num_runs; run++)
+	{
+		const int len = random() % 40;
+		for (int i = 0; i < len; i++)
+			text.push_back((wchar_t)(1 + random() % 0x7F));
+		static const wchar_t others[] = { 0x80, 0xE9, 0x7FF, 0x800, 0x20AC, 0xD83D, 0xDE00, 0xFFFF, 0xFF80 };
+		if (random() % 4 != 0)
+			text.push_back(others[random() % (sizeof(others) / sizeof(others[0]))]);
+	}
+	return text;
+}
+
+
+// The SSE2 loops give the same results as the plain ones at every length, alignment, and output size
+static void TestSse2(void)
+{
+	std::mt19937 random(1234);
+	char buffer[512];
+	for (int iteration = 0; iteration < 20000; iteration++)
+	{
+		// Start at any alignment
+		const size_t offset = random() % 16;
+		const std::string text = RandomText(random);
+		memcpy(buffer + offset, text.data(), text.size());
+		const char* str = buffer + offset;
+		const size_t len = text.size();
+
+		CHECK(IsAsciiText(str, len) == scalar::IsAsciiText(str, len));
+		CHECK(IsValidUtf8(str, len) == scalar::IsValidUtf8(str, len));
+		const size_t utf16_len = Utf8ToUtf16(str, len, NULL, 0);
+		CHECK(utf16_len == scalar::Utf8ToUtf16(str, len, NULL, 0));
+		const size_t out_size = (random() % 2) ? utf16_len + 1 : random() % (utf16_len + 2);
+		std::vector<wchar_t> out(out_size + 1, L'#'), scalar_out(out_size + 1, L'#');
+		CHECK(Utf8ToUtf16(str, len, out.data(), out_size) == scalar::Utf8ToUtf16(str, len, scalar_out.data(), out_size));
+		CHECK(out == scalar_out);
+
+		const std::vector<wchar_t> utf16 = RandomUtf16(random);
+		const size_t utf8_len = Utf16ToUtf8(utf16.data(), utf16.size(), NULL, 0);
+		CHECK(utf8_len == scalar::Utf16ToUtf8(utf16.data(), utf16.size(), NULL, 0));
+		const size_t utf8_size = (random() % 2) ? utf8_len + 1 : random() % (utf8_len + 2);
+		std::string utf8(utf8_size + 1, '#'), scalar_utf8(utf8_size + 1, '#');
+		CHECK(Utf16ToUtf8(utf16.data(), utf16.size(), &utf8[0], utf8_size)
+			== scalar::Utf16ToUtf8(utf16.data(), utf16.size(), &scalar_utf8[0], utf8_size));
+		CHECK(utf8 == scalar_utf8);
+	}
+}
+
+
+int main()
+{
+	TestInvalidUtf8();
+	TestLoneSurrogates();
+	TestTruncatedOutput();
+	TestSse2();
+	return 0;
+}
@@ -0,0 +1 @@
+// Empty.  image.h includes it, but the tested modules don't use the shell functions.
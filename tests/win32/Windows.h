@@ -0,0 +1,243 @@
+/******************************************************************************
+Windows.h - The few Win32 functions the tested modules call, for building the tests on Linux
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+// Only what the modules under test use is here.  Each function does the closest POSIX thing.
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+typedef int BOOL;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef unsigned int UINT;
+typedef uintptr_t UINT_PTR;
+typedef uintptr_t ULONG_PTR;
+typedef uintptr_t WPARAM;
+typedef intptr_t LPARAM;
+typedef long HRESULT;
+typedef void* LPVOID;
+typedef uint32_t COLORREF;
+typedef char TCHAR;
+
+// Files, mappings, and threads are the handles in fake_win32.cpp.  The others only appear in the
+// declarations of functions that aren't tested.
+typedef void* HANDLE;
+typedef void* HWND;
+typedef void* HMENU;
+typedef void* HFONT;
+typedef void* HBITMAP;
+typedef void* HDC;
+
+typedef struct {
+	long left, top, right, bottom;
+} RECT;
+
+#define TRUE	1
+#define FALSE	0
+#define MAX_PATH	260
+#define INFINITE	0xFFFFFFFF
+#define INVALID_HANDLE_VALUE	((HANDLE)(intptr_t)-1)
+#define S_OK		((HRESULT)0)
+#define FAILED(hr)	((HRESULT)(hr) < 0)
+#define WINAPI
+#define WINAPIV
+#define CALLBACK
+
+#ifndef NOMINMAX
+#define min(a, b)	(((a) < (b)) ? (a) : (b))
+#define max(a, b)	(((a) > (b)) ? (a) : (b))
+#endif
+
+typedef union {
+	struct {
+		DWORD LowPart;
+		long HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct {
+	ULONG_PTR Internal;
+	ULONG_PTR InternalHigh;
+	DWORD Offset;
+	DWORD OffsetHigh;
+	HANDLE hEvent;
+} OVERLAPPED;
+
+static inline void ZeroMemory(void* dest, size_t len)
+{
+	memset(dest, 0, len);
+}
+
+
+// Time
+
+static inline BOOL QueryPerformanceCounter(LARGE_INTEGER* count)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	count->QuadPart = (LONGLONG)now.tv_sec * 1000000000 + now.tv_nsec;
+	return TRUE;
+}
+
+static inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+	frequency->QuadPart = 1000000000;
+	return TRUE;
+}
+
+static inline DWORD GetTickCount(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (DWORD)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+
+// Strings
+
+static inline int lstrlen(const char* str)
+{
+	return (int)strlen(str);
+}
+
+static inline int lstrcmp(const char* str1, const char* str2)
+{
+	return strcmp(str1, str2);
+}
+
+static inline int lstrcmpi(const char* str1, const char* str2)
+{
+	return strcasecmp(str1, str2);
+}
+
+
+// Critical sections, which can be entered again by the thread that holds them
+
+typedef pthread_mutex_t CRITICAL_SECTION;
+
+static inline void InitializeCriticalSection(CRITICAL_SECTION* section)
+{
+	pthread_mutexattr_t attributes;
+	pthread_mutexattr_init(&attributes);
+	pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(section, &attributes);
+	pthread_mutexattr_destroy(&attributes);
+}
+
+static inline void DeleteCriticalSection(CRITICAL_SECTION* section)
+{
+	pthread_mutex_destroy(section);
+}
+
+static inline void EnterCriticalSection(CRITICAL_SECTION* section)
+{
+	pthread_mutex_lock(section);
+}
+
+static inline void LeaveCriticalSection(CRITICAL_SECTION* section)
+{
+	pthread_mutex_unlock(section);
+}
+
+
+// Files.  Paths are taken as they are, so tests use POSIX paths.
+
+#define GENERIC_READ				0x80000000
+#define GENERIC_WRITE				0x40000000
+#define FILE_SHARE_READ				0x00000001
+#define CREATE_ALWAYS				2
+#define OPEN_EXISTING				3
+#define FILE_ATTRIBUTE_NORMAL		0x00000080
+#define FILE_FLAG_SEQUENTIAL_SCAN	0x08000000
+#define FILE_FLAG_OVERLAPPED		0x40000000
+#define FILE_BEGIN					0
+#define MOVEFILE_REPLACE_EXISTING	0x00000001
+#define MOVEFILE_WRITE_THROUGH		0x00000008
+
+HANDLE CreateFile(const char* path, DWORD access, DWORD share_mode, void* security, DWORD creation, DWORD flags, 
+	HANDLE template_file);
+BOOL ReadFile(HANDLE file, void* buffer, DWORD len, DWORD* bytes_read, OVERLAPPED* overlapped);
+BOOL WriteFile(HANDLE file, const void* buffer, DWORD len, DWORD* bytes_written, OVERLAPPED* overlapped);
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, LARGE_INTEGER* new_pos, DWORD method);
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size);
+BOOL FlushFileBuffers(HANDLE file);
+BOOL MoveFileEx(const char* existing_path, const char* new_path, DWORD flags);
+BOOL DeleteFile(const char* path);
+BOOL CloseHandle(HANDLE handle);
+
+
+// File mappings.  Only whole files can be mapped, and only for reading.
+
+#define PAGE_READONLY		0x02
+#define PAGE_READWRITE		0x04
+#define FILE_MAP_READ		0x0004
+
+HANDLE CreateFileMapping(HANDLE file, void* security, DWORD protect, DWORD max_size_high, DWORD max_size_low, 
+	const char* name);
+void* MapViewOfFile(HANDLE mapping, DWORD access, DWORD offset_high, DWORD offset_low, size_t len);
+BOOL UnmapViewOfFile(const void* view);
+
+
+// Virtual memory.  Regions are aligned to 64 KB, as on Windows.
+
+#define MEM_COMMIT		0x00001000
+#define MEM_RESERVE		0x00002000
+#define MEM_RELEASE		0x00008000
+
+void* VirtualAlloc(void* address, size_t size, DWORD type, DWORD protect);
+BOOL VirtualFree(void* address, size_t size, DWORD type);
+
+
+// Threads.  Messages posted to windows go nowhere.
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID param);
+
+HANDLE CreateThread(void* security, size_t stack_size, LPTHREAD_START_ROUTINE start, LPVOID param, DWORD flags, 
+	DWORD* thread_id);
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds);
+
+static inline LONG InterlockedExchange(volatile LONG* target, LONG value)
+{
+	return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline BOOL PostMessage(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
+{
+	return TRUE;
+}
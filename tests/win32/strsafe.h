@@ -0,0 +1,68 @@
+/******************************************************************************
+strsafe.h - The safe string functions the tested modules call, built on snprintf()
+*******************************************************************************
+Winphonic
+By Kevin Perry
+https://k-perry.github.io
+-------------------------------------------------------------------------------
+MIT License
+
+Copyright (c) 2018, Kevin Perry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#pragma once
+
+#include <Windows.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+// Like the real ones, these truncate text that doesn't fit and say so
+#define STRSAFE_E_INSUFFICIENT_BUFFER	((HRESULT)0x8007007AL)
+
+static inline HRESULT StringCbVPrintfA(char* dest, size_t dest_size, const char* format, va_list args)
+{
+	if (dest_size == 0)
+		return STRSAFE_E_INSUFFICIENT_BUFFER;
+	const int len = vsnprintf(dest, dest_size, format, args);
+	return (len < 0 || (size_t)len >= dest_size) ? STRSAFE_E_INSUFFICIENT_BUFFER : S_OK;
+}
+
+static inline HRESULT StringCbPrintfA(char* dest, size_t dest_size, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	const HRESULT result = StringCbVPrintfA(dest, dest_size, format, args);
+	va_end(args);
+	return result;
+}
+
+static inline HRESULT StringCbCopyA(char* dest, size_t dest_size, const char* src)
+{
+	return StringCbPrintfA(dest, dest_size, "%s", src);
+}
+
+static inline HRESULT StringCbCatA(char* dest, size_t dest_size, const char* src)
+{
+	const size_t len = strnlen(dest, dest_size);
+	if (len == dest_size)
+		return STRSAFE_E_INSUFFICIENT_BUFFER;
+	return StringCbCopyA(dest + len, dest_size - len, src);
+}